@@ -0,0 +1,37 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "crypto/common.h"
+#include "primitives/block.h"
+
+#include "zlib.h"
+
+bool CompressBlockData(const char* pBegin, const char* pEnd, std::vector<char>& vchFrame, int nLevel)
+{
+    unsigned int nSize = pEnd - pBegin;
+    uLongf nFrameSize = compressBound(nSize);
+    vchFrame.resize(sizeof(nSize) + nFrameSize);
+    WriteLE32((unsigned char*)&vchFrame[0], nSize);
+    if (compress2((Bytef*)&vchFrame[sizeof(nSize)], &nFrameSize, (const Bytef*)pBegin, nSize, nLevel) != Z_OK)
+        return false;
+    vchFrame.resize(sizeof(nSize) + nFrameSize);
+    return vchFrame.size() < nSize;
+}
+
+bool DecompressBlockData(const char* pBegin, const char* pEnd, CDataStream& ssBlock)
+{
+    unsigned int nSize;
+    if ((size_t)(pEnd - pBegin) < sizeof(nSize))
+        return false;
+    nSize = ReadLE32((const unsigned char*)pBegin);
+    if (nSize == 0 || nSize > MAX_BLOCK_SIZE_CURRENT)
+        return false;
+    ssBlock.resize(nSize);
+    uLongf nInflated = nSize;
+    if (uncompress((Bytef*)&ssBlock[0], &nInflated, (const Bytef*)pBegin + sizeof(nSize), pEnd - pBegin - sizeof(nSize)) != Z_OK)
+        return false;
+    return nInflated == nSize;
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCOMPRESS_H
+#define BITCOIN_BLOCKCOMPRESS_H
+
+#include "streams.h"
+
+#include <vector>
+
+/**
+ * Blocks may be stored in their block file as compressed frames. Such a
+ * block has BLOCK_COMPRESSED_FLAG set in the size written in front of it,
+ * which never exceeds MAX_BLOCK_SIZE_CURRENT otherwise. The frame holds the
+ * size of the serialized block followed by its zlib stream, whose checksum
+ * covers the inflated data.
+ */
+static const unsigned int BLOCK_COMPRESSED_FLAG = 0x80000000;
+
+/** Formats of the blocks in a block file, recorded in its CBlockFileInfo */
+enum BlockFileFormat {
+    BLOCKFILE_FORMAT_RAW = 0,
+    //! Some blocks are stored as compressed frames
+    BLOCKFILE_FORMAT_COMPRESSED = 1,
+};
+
+/** The newest block file format this version can read */
+static const int BLOCKFILE_FORMAT_CURRENT = BLOCKFILE_FORMAT_COMPRESSED;
+
+/** zlib level blocks are compressed with; block data is mostly hashes and keys, so higher levels gain little */
+static const int DEFAULT_BLOCK_COMPRESSION_LEVEL = 1;
+
+/** Compress a serialized block into a frame; false if that does not make it smaller */
+bool CompressBlockData(const char* pBegin, const char* pEnd, std::vector<char>& vchFrame, int nLevel = DEFAULT_BLOCK_COMPRESSION_LEVEL);
+
+/** Inflate the frame written by CompressBlockData into ssBlock; false if it is corrupt */
+bool DecompressBlockData(const char* pBegin, const char* pEnd, CDataStream& ssBlock);
+
+#endif // BITCOIN_BLOCKCOMPRESS_H
@@ -0,0 +1,87 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "util.h"
+
+#include <errno.h>
+#include <limits>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile(const boost::filesystem::path& path) : pData(NULL), nSize(0)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= (uint64_t)std::numeric_limits<size_t>::max()) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pData = (const char*)p;
+            nSize = st.st_size;
+        } else {
+            LogPrintf("%s : mmap %s failed: %s\n", __func__, path.string(), strerror(errno));
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pData)
+        munmap((void*)pData, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMapCache::Get(int nFile, const boost::filesystem::path& path, uint64_t nEnd)
+{
+    boost::mutex::scoped_lock lock(cs);
+    for (std::list<std::pair<int, std::shared_ptr<const CMappedFile> > >::iterator it = lruFiles.begin(); it != lruFiles.end(); ++it) {
+        if (it->first != nFile)
+            continue;
+        std::shared_ptr<const CMappedFile> file = it->second;
+        lruFiles.erase(it);
+        // Written to since it was mapped
+        if (nEnd > file->size())
+            break;
+        lruFiles.push_front(std::make_pair(nFile, file));
+        return file;
+    }
+
+    std::shared_ptr<const CMappedFile> file(new CMappedFile(path));
+    if (file->IsNull() || nEnd > file->size())
+        return std::shared_ptr<const CMappedFile>();
+    lruFiles.push_front(std::make_pair(nFile, file));
+    if (lruFiles.size() > nMaxFiles)
+        lruFiles.pop_back();
+    return file;
+}
+
+void CBlockFileMapCache::Evict(int nFile)
+{
+    boost::mutex::scoped_lock lock(cs);
+    for (std::list<std::pair<int, std::shared_ptr<const CMappedFile> > >::iterator it = lruFiles.begin(); it != lruFiles.end(); ++it) {
+        if (it->first == nFile) {
+            lruFiles.erase(it);
+            return;
+        }
+    }
+}
+
+void CBlockFileMapCache::Clear()
+{
+    boost::mutex::scoped_lock lock(cs);
+    lruFiles.clear();
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "serialize.h"
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Read-only memory mapping of a whole block file. Block files are only
+ * appended to, so a mapping stays valid for the data it covers; data written
+ * later needs a new mapping of the grown file.
+ */
+class CMappedFile
+{
+private:
+    const char* pData;
+    size_t nSize;
+
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    //! Null if the file cannot be mapped, which is always the case on Windows
+    explicit CMappedFile(const boost::filesystem::path& path);
+    ~CMappedFile();
+
+    bool IsNull() const { return pData == NULL; }
+    const char* data() const { return pData; }
+    size_t size() const { return nSize; }
+};
+
+/** Deserializes from a range of memory without copying it first, such as a block in a mapped file */
+class CSpanReader
+{
+private:
+    int nType;
+    int nVersion;
+    const char* pCur;
+    const char* pEnd;
+
+public:
+    CSpanReader(const char* pBegin, const char* pEndIn, int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn), pCur(pBegin), pEnd(pEndIn) {}
+
+    //
+    // Stream subset
+    //
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pEnd - pCur))
+            throw std::ios_base::failure("CSpanReader::read : end of data");
+        memcpy(pch, pCur, nSize);
+        pCur += nSize;
+        return (*this);
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > (size_t)(pEnd - pCur))
+            throw std::ios_base::failure("CSpanReader::ignore : end of data");
+        pCur += nSize;
+    }
+
+    template <typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+/**
+ * The most recently used block files, kept mapped. Mappings are handed out
+ * as shared pointers, so a reader keeps its mapping valid while the file is
+ * evicted, remapped or pruned.
+ */
+class CBlockFileMapCache
+{
+private:
+    boost::mutex cs;
+    size_t nMaxFiles;
+    //! Most recently used first
+    std::list<std::pair<int, std::shared_ptr<const CMappedFile> > > lruFiles;
+
+public:
+    explicit CBlockFileMapCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** A mapping of block file nFile at path covering at least its first nEnd bytes, or null if there is none */
+    std::shared_ptr<const CMappedFile> Get(int nFile, const boost::filesystem::path& path, uint64_t nEnd);
+
+    /** Drop the mapping of nFile, before the file is truncated or removed */
+    void Evict(int nFile);
+
+    void Clear();
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
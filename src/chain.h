@@ -121,9 +121,6 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
-    //ppcoin: trust score of block chain
-    uint256 bnChainTrust;
-
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -158,12 +155,10 @@ public:
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
     };
 
-    // proof-of-stake specific fields
+    // proof-of-stake specific fields; the stake input is only needed when the
+    // entry is written, so it is kept out of here, see GetBlockStakePrevout
     uint256 GetBlockTrust() const;
     uint64_t nStakeModifier;             // hash modifier for proof-of-stake
-    COutPoint prevoutStake;
-    unsigned int nStakeTime;
-    uint256 hashProofOfStake;
     int64_t nMint;
     int64_t nMoneySupply;
     uint256 nStakeModifierV2;
@@ -199,8 +194,6 @@ public:
         nFlags = 0;
         nStakeModifier = 0;
         nStakeModifierV2 = uint256();
-        prevoutStake.SetNull();
-        nStakeTime = 0;
         nDynamicMultiplier = DYNAMIC_MULTIPLIER_DEFAULT * DYNAMIC_MULTIPLIER_DIVIDER;
 
         nVersion = 0;
@@ -225,11 +218,8 @@ public:
         nBits = block.nBits;
         nNonce = block.nNonce;
 
-        if (block.IsProofOfStake()) {
+        if (block.IsProofOfStake())
             SetProofOfStake();
-            prevoutStake = block.vtx[1].vin[0].prevout;
-            nStakeTime = block.nTime;
-        }
     }
 
     CDiskBlockPos GetBlockPos() const
@@ -380,16 +370,21 @@ class CDiskBlockIndex : public CBlockIndex
 public:
     uint256 hashPrev;
     uint256 hashNext;
+    //! Stake input of a proof-of-stake block; only filled in when the entry is first written, see CBlockTreeDB::ReadStakePrevout
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
 
     CDiskBlockIndex()
     {
         hashPrev = uint256();
         hashNext = uint256();
+        nStakeTime = 0;
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256(0));
+        nStakeTime = IsProofOfStake() ? nTime : 0;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -428,7 +423,6 @@ public:
         } else {
             const_cast<CDiskBlockIndex*>(this)->prevoutStake.SetNull();
             const_cast<CDiskBlockIndex*>(this)->nStakeTime = 0;
-            const_cast<CDiskBlockIndex*>(this)->hashProofOfStake = uint256();
         }
 
         if (Params().IsDynamicRewardSave(nHeight))
@@ -154,6 +154,9 @@ public:
         assert(hashGenesisBlock == uint256("0x000000077c8f4eabb532fdacc3eb56825d3bcf1401e4958b9a2317cc7d8b0496"));
         assert(genesis.hashMerkleRoot == uint256("0xc8146c6cbb18785c3f29f717a0ef7ff072fdaac51fbe179f062ef63466993e6e"));
 
+        // Updated each release, to a block buried as deep as the last checkpoint
+        hashDefaultAssumeValid = uint256("0xf39e4e0ed005b94ea19383e03219f8013cd1ba1973bbc52eb5b12f5a44f87428"); // 1258933
+
         vSeeds.push_back(CDNSSeedData("seed1", "seed1.netbox.global"));
         vSeeds.push_back(CDNSSeedData("seed2", "seed2.netbox.global"));
         vSeeds.push_back(CDNSSeedData("seed1r", "seed1.netboxglobal.com"));
@@ -229,6 +232,8 @@ public:
         hashGenesisBlock = genesis.GetHash();
         assert(hashGenesisBlock == uint256("0x000000279920da0376356ee345b9319d1b20df30506f427416fc18831a539d0d"));
 
+        hashDefaultAssumeValid = uint256("0x39e8ec06dd079f3e44b9bebb3a3fade92c2213e8fce6fecc8cfd7e34250cfb04"); // 326000
+
         vFixedSeeds.clear();
         vSeeds.clear();
         vSeeds.push_back(CDNSSeedData("seed1Testnet", "seed1.testnet.netbox.global"));
@@ -304,6 +309,8 @@ public:
         nDefaultPort = 28774;
         assert(hashGenesisBlock == uint256("0xdfbb61c239ee0a99bb47a8c253d98553d70d63e4cad30c584a7b810d388f8cfe"));
 
+        hashDefaultAssumeValid = 0;
+
         vFixedSeeds.clear(); //! Testnet mode doesn't have any fixed seeds.
         vSeeds.clear();      //! Testnet mode doesn't have any DNS seeds.
 
@@ -332,6 +339,7 @@ public:
     {
         networkID = CBaseChainParams::UNITTEST;
         strNetworkID = "unittest";
+        hashDefaultAssumeValid = 0;
         nDefaultPort = 51478;
         vFixedSeeds.clear(); //! Unit test mode doesn't have any fixed seeds.
         vSeeds.clear();      //! Unit test mode doesn't have any DNS seeds.
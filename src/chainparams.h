@@ -93,6 +93,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** Default for -assumevalid: scripts in this block and its ancestors are not verified */
+    const uint256& DefaultAssumeValid() const { return hashDefaultAssumeValid; }
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
 
     /** Spork key and Masternode Handling **/
@@ -117,6 +119,7 @@ protected:
     CChainParams() {}
 
     uint256 hashGenesisBlock;
+    uint256 hashDefaultAssumeValid;
     MessageStartChars pchMessageStart;
     //! Raw pub key bytes for the broadcast alert signing key.
     std::vector<unsigned char> vAlertPubKey;
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstatus.h"
+
+#include "chain.h"
+#include "checkpoints.h"
+#include "main.h"
+#include "rpc/server.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace
+{
+//! Only accessed through std::atomic_load and std::atomic_store
+std::shared_ptr<const CChainStatus> pChainStatus;
+//! Serializes publishers, which copy the current snapshot and modify it
+std::mutex csPublish;
+std::atomic<int> nStakeHashedHeight(-1);
+
+void Publish(const std::shared_ptr<const CChainStatus>& pStatus)
+{
+    std::atomic_store(&pChainStatus, pStatus);
+}
+}
+
+std::shared_ptr<const CChainStatus> GetChainStatus()
+{
+    std::shared_ptr<const CChainStatus> pStatus = std::atomic_load(&pChainStatus);
+    if (!pStatus) {
+        static const std::shared_ptr<const CChainStatus> pEmpty = std::make_shared<const CChainStatus>();
+        return pEmpty;
+    }
+    return pStatus;
+}
+
+void PublishChainTip(CBlockIndex* pindexTip, const CBlockIndex* pindexBestHeader)
+{
+    std::lock_guard<std::mutex> lock(csPublish);
+
+    std::shared_ptr<CChainStatus> pStatus = std::make_shared<CChainStatus>();
+    pStatus->mnCounts = GetChainStatus()->mnCounts;
+    if (pindexTip) {
+        pStatus->nHeight = pindexTip->nHeight;
+        pStatus->hashBlock = pindexTip->GetBlockHash();
+        pStatus->nTime = pindexTip->GetBlockTime();
+        pStatus->nMedianTimePast = pindexTip->GetMedianTimePast();
+        pStatus->dDifficulty = GetDifficulty(pindexTip);
+        pStatus->nMoneySupply = pindexTip->nMoneySupply;
+        pStatus->nChainWork = pindexTip->nChainWork;
+        pStatus->dVerificationProgress = Checkpoints::GuessVerificationProgress(pindexTip);
+    }
+    pStatus->nHeadersHeight = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+    Publish(pStatus);
+}
+
+void PublishMasternodeCounts(const CMasternodeCounts& counts)
+{
+    std::lock_guard<std::mutex> lock(csPublish);
+
+    std::shared_ptr<CChainStatus> pStatus = std::make_shared<CChainStatus>(*GetChainStatus());
+    pStatus->mnCounts = counts;
+    pStatus->mnCounts.fValid = true;
+    Publish(pStatus);
+}
+
+void SetStakeHashedHeight(int nHeight)
+{
+    nStakeHashedHeight = nHeight;
+}
+
+bool IsStakingActive(const CChainStatus& status)
+{
+    int nHashedHeight = nStakeHashedHeight;
+    if (status.nHeight < 0 || nHashedHeight < 0)
+        return false;
+    return nHashedHeight == status.nHeight || (nHashedHeight == status.nHeight - 1 && nLastCoinStakeSearchInterval);
+}
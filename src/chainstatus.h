@@ -0,0 +1,70 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINSTATUS_H
+#define BITCOIN_CHAINSTATUS_H
+
+#include "amount.h"
+#include "uint256.h"
+
+#include <memory>
+#include <stdint.h>
+
+class CBlockIndex;
+
+/** Summary of the masternode list, refreshed periodically by the obfuscation thread */
+struct CMasternodeCounts {
+    //! False until the first refresh
+    bool fValid;
+    int nTotal;
+    int nStable;
+    int nObfCompat;
+    int nEnabled;
+    int nInQueue;
+    int nIPv4;
+    int nIPv6;
+    int nOnion;
+
+    CMasternodeCounts() : fValid(false), nTotal(0), nStable(0), nObfCompat(0), nEnabled(0), nInQueue(0), nIPv4(0), nIPv6(0), nOnion(0) {}
+};
+
+/**
+ * Immutable summary of the active chain tip. A new instance is published
+ * whenever the tip, the best header or the masternode counts change, and
+ * readers take a reference to the current one, so status RPCs never wait for
+ * cs_main while a block is being connected.
+ */
+struct CChainStatus {
+    //! -1 while no block index is loaded
+    int nHeight;
+    uint256 hashBlock;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+    double dDifficulty;
+    CAmount nMoneySupply;
+    uint256 nChainWork;
+    //! Estimated at the time the tip was connected
+    double dVerificationProgress;
+    int nHeadersHeight;
+    CMasternodeCounts mnCounts;
+
+    CChainStatus() : nHeight(-1), nTime(0), nMedianTimePast(0), dDifficulty(0), nMoneySupply(0), dVerificationProgress(0), nHeadersHeight(-1) {}
+};
+
+/** The current snapshot; never null */
+std::shared_ptr<const CChainStatus> GetChainStatus();
+
+/** Publish a snapshot of the given tip and best header, called whenever either changes */
+void PublishChainTip(CBlockIndex* pindexTip, const CBlockIndex* pindexBestHeader);
+
+/** Publish new masternode counts along with the current tip */
+void PublishMasternodeCounts(const CMasternodeCounts& counts);
+
+/** Record the height of the block stake hashing was last attempted on */
+void SetStakeHashedHeight(int nHeight);
+
+/** Whether the wallet is hashing stakes on top of the given tip */
+bool IsStakingActive(const CChainStatus& status);
+
+#endif // BITCOIN_CHAINSTATUS_H
@@ -0,0 +1,159 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* viewIn, int nThreads) : CCoinsViewBacked(viewIn), nWaiting(0), nGeneration(0), fStop(false)
+{
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CCoinsViewPrefetch::ThreadPrefetch, this));
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+    }
+    condQueued.notify_all();
+    threads.join_all();
+}
+
+void CCoinsViewPrefetch::ThreadPrefetch()
+{
+    RenameThread("prefetch");
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (!fStop && queue.empty())
+            condQueued.wait(lock);
+        if (fStop)
+            return;
+        uint256 txid = queue.front();
+        queue.pop_front();
+        boost::unordered_map<uint256, PendingState, CCoinsKeyHasher>::iterator it = mapPending.find(txid);
+        // Already read by a lookup
+        if (it == mapPending.end())
+            continue;
+        it->second = PENDING_READING;
+        uint64_t nGenerationRead = nGeneration;
+
+        lock.unlock();
+        CStagedCoins staged;
+        bool fRead = true;
+        try {
+            staged.fFound = base->GetCoins(txid, staged.coins);
+        } catch (const std::exception& e) {
+            // The lookup reads it again and handles the error
+            LogPrintf("%s : %s\n", __func__, e.what());
+            fRead = false;
+        }
+        lock.lock();
+
+        mapPending.erase(txid);
+        if (fRead && nGenerationRead == nGeneration) {
+            CStagedCoins& entry = mapStaged[txid];
+            entry.fFound = staged.fFound;
+            entry.coins.swap(staged.coins);
+        } else {
+            stats.nDiscarded++;
+        }
+        if (nWaiting)
+            condRead.notify_all();
+    }
+}
+
+void CCoinsViewPrefetch::Prefetch(const std::vector<uint256>& vTxids)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (mapStaged.size() + mapPending.size() + vTxids.size() > MAX_PREFETCH_STAGED) {
+            stats.nDiscarded += mapStaged.size();
+            mapStaged.clear();
+        }
+        for (const uint256& txid : vTxids) {
+            if (mapStaged.count(txid) || mapPending.count(txid))
+                continue;
+            mapPending[txid] = PENDING_QUEUED;
+            queue.push_back(txid);
+            stats.nQueued++;
+        }
+    }
+    condQueued.notify_all();
+}
+
+bool CCoinsViewPrefetch::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        boost::unordered_map<uint256, PendingState, CCoinsKeyHasher>::iterator itPending = mapPending.find(txid);
+        bool fWaited = false;
+        if (itPending != mapPending.end()) {
+            if (itPending->second == PENDING_QUEUED) {
+                // Not started; reading it here is quicker than waiting for a worker
+                mapPending.erase(itPending);
+            } else {
+                nWaiting++;
+                while (mapPending.count(txid))
+                    condRead.wait(lock);
+                nWaiting--;
+                fWaited = true;
+            }
+        }
+        boost::unordered_map<uint256, CStagedCoins, CCoinsKeyHasher>::iterator it = mapStaged.find(txid);
+        if (it != mapStaged.end()) {
+            if (fWaited)
+                stats.nWaits++;
+            else
+                stats.nHits++;
+            bool fFound = it->second.fFound;
+            if (fFound)
+                coins.swap(it->second.coins);
+            mapStaged.erase(it);
+            return fFound;
+        }
+        stats.nMisses++;
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewPrefetch::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        boost::unordered_map<uint256, CStagedCoins, CCoinsKeyHasher>::const_iterator it = mapStaged.find(txid);
+        if (it != mapStaged.end())
+            return it->second.fFound;
+    }
+    return base->HaveCoins(txid);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    // The backing view may consume mapCoins
+    std::vector<uint256> vWritten;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            vWritten.push_back(it->first);
+    }
+    bool fResult = base->BatchWrite(mapCoins, hashBlock);
+
+    // Staged coins read before the write are stale, and so may be those read during it
+    boost::unique_lock<boost::mutex> lock(cs);
+    for (const uint256& txid : vWritten)
+        stats.nDiscarded += mapStaged.erase(txid);
+    nGeneration++;
+    return fResult;
+}
+
+CCoinsPrefetchStats CCoinsViewPrefetch::GetPrefetchStats() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    CCoinsPrefetchStats ret = stats;
+    ret.nStaged = mapStaged.size();
+    return ret;
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+/** Default for -prefetchthreads, the threads reading the inputs of new blocks ahead of their validation */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+static const int MAX_PREFETCH_THREADS = 16;
+/** Most coins staged at once; the unused ones are dropped when more are needed */
+static const size_t MAX_PREFETCH_STAGED = 100000;
+
+struct CCoinsPrefetchStats {
+    //! Reads issued ahead of the lookups
+    uint64_t nQueued;
+    //! Lookups answered by a finished read
+    uint64_t nHits;
+    //! Lookups that waited for a read in flight
+    uint64_t nWaits;
+    //! Lookups read from the database
+    uint64_t nMisses;
+    //! Reads dropped unused, because they were superseded by a write or evicted
+    uint64_t nDiscarded;
+    size_t nStaged;
+
+    CCoinsPrefetchStats() : nQueued(0), nHits(0), nWaits(0), nMisses(0), nDiscarded(0), nStaged(0) {}
+
+    //! Fraction of the lookups the reads ahead answered
+    double HitRate() const
+    {
+        uint64_t nLookups = nHits + nWaits + nMisses;
+        return nLookups ? (double)(nHits + nWaits) / nLookups : 0.0;
+    }
+};
+
+/**
+ * CCoinsView between the coins cache and the database that reads coins ahead
+ * of their use. Prefetch queues the txids for worker threads, which read them
+ * from the backing view into a staging area. A lookup takes its coins from
+ * there, waits for a read in flight, or reads the backing view itself if the
+ * read was not started yet. Writes drop the staged coins they change and any
+ * read in flight, which may have seen the state before them.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    enum PendingState {
+        PENDING_QUEUED,
+        PENDING_READING,
+    };
+
+    struct CStagedCoins {
+        bool fFound;
+        CCoins coins;
+    };
+
+    mutable boost::mutex cs;
+    //! Signalled when reads are queued or the workers should stop
+    boost::condition_variable condQueued;
+    //! Signalled when a read finishes that a lookup waits for
+    mutable boost::condition_variable condRead;
+    mutable int nWaiting;
+    std::deque<uint256> queue;
+    mutable boost::unordered_map<uint256, PendingState, CCoinsKeyHasher> mapPending;
+    mutable boost::unordered_map<uint256, CStagedCoins, CCoinsKeyHasher> mapStaged;
+    //! Incremented by every write, so reads in flight during it are dropped
+    uint64_t nGeneration;
+    bool fStop;
+    mutable CCoinsPrefetchStats stats;
+    boost::thread_group threads;
+
+    void ThreadPrefetch();
+
+public:
+    CCoinsViewPrefetch(CCoinsView* viewIn, int nThreads);
+    ~CCoinsViewPrefetch();
+
+    //! Start reading the coins of these txids, unless already staged or queued
+    void Prefetch(const std::vector<uint256>& vTxids);
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+
+    CCoinsPrefetchStats GetPrefetchStats() const;
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
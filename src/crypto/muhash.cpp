@@ -0,0 +1,285 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace
+{
+/** 2^3072 - MAX_PRIME_DIFF is the modulus */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+const int LIMBS = Num3072::LIMBS;
+
+/** The modulus itself, as limbs */
+struct Modulus {
+    uint32_t limbs[LIMBS];
+    Modulus()
+    {
+        limbs[0] = 0 - MAX_PRIME_DIFF;
+        for (int i = 1; i < LIMBS; ++i)
+            limbs[i] = 0xFFFFFFFF;
+    }
+};
+const Modulus modulus;
+
+/** a += b, returning the carry out of the top limb */
+uint32_t Add(uint32_t* a, const uint32_t* b)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (uint64_t)a[i] + b[i];
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return (uint32_t)carry;
+}
+
+/** a += n, returning the carry out of the top limb */
+uint32_t AddSmall(uint32_t* a, uint64_t n)
+{
+    for (int i = 0; i < LIMBS && n; ++i) {
+        n += a[i];
+        a[i] = (uint32_t)n;
+        n >>= 32;
+    }
+    return (uint32_t)n;
+}
+
+/** a -= b, returning whether it borrowed */
+bool Sub(uint32_t* a, const uint32_t* b)
+{
+    int64_t borrow = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        borrow += (int64_t)a[i] - b[i];
+        a[i] = (uint32_t)borrow;
+        borrow >>= 32;
+    }
+    return borrow != 0;
+}
+
+bool GreaterOrEqual(const uint32_t* a, const uint32_t* b)
+{
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        if (a[i] != b[i])
+            return a[i] > b[i];
+    }
+    return true;
+}
+
+bool IsOne(const uint32_t* a)
+{
+    if (a[0] != 1)
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (a[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+/** a = (a + top * 2^3072) / 2 */
+void ShiftRight(uint32_t* a, uint32_t top)
+{
+    for (int i = 0; i < LIMBS - 1; ++i)
+        a[i] = (a[i] >> 1) | (a[i + 1] << 31);
+    a[LIMBS - 1] = (a[LIMBS - 1] >> 1) | (top << 31);
+}
+
+/** a = a / 2 modulo the prime, for a below the prime */
+void HalveMod(uint32_t* a)
+{
+    if (a[0] & 1)
+        ShiftRight(a, Add(a, modulus.limbs));
+    else
+        ShiftRight(a, 0);
+}
+
+/** a = a - b modulo the prime, for a and b below the prime */
+void SubMod(uint32_t* a, const uint32_t* b)
+{
+    if (Sub(a, b))
+        Add(a, modulus.limbs);
+}
+} // namespace
+
+Num3072::Num3072(const unsigned char data[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i)
+        limbs[i] = ReadLE32(data + 4 * i);
+    if (IsOverflow())
+        FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOne() const
+{
+    return ::IsOne(limbs);
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < modulus.limbs[0])
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != 0xFFFFFFFF)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is adding MAX_PRIME_DIFF and dropping 2^3072
+    AddSmall(limbs, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint32_t tmp[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            uint64_t cur = (uint64_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        tmp[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime, so fold the upper half
+    // into the lower one until nothing is carried out of it.
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t cur = (uint64_t)tmp[LIMBS + i] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+    while (carry)
+        carry = AddSmall(limbs, carry * MAX_PRIME_DIFF);
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclid, keeping x1 * this = u and x2 * this = v
+    // modulo the prime until u or v reaches one.
+    uint32_t u[LIMBS], v[LIMBS];
+    memcpy(u, limbs, sizeof(u));
+    memcpy(v, modulus.limbs, sizeof(v));
+    Num3072 x1, x2;
+    memset(x2.limbs, 0, sizeof(x2.limbs));
+
+    bool fZero = true;
+    for (int i = 0; i < LIMBS && fZero; ++i)
+        fZero = u[i] == 0;
+    assert(!fZero);
+
+    while (!::IsOne(u) && !::IsOne(v)) {
+        while (!(u[0] & 1)) {
+            ShiftRight(u, 0);
+            HalveMod(x1.limbs);
+        }
+        while (!(v[0] & 1)) {
+            ShiftRight(v, 0);
+            HalveMod(x2.limbs);
+        }
+        if (GreaterOrEqual(u, v)) {
+            Sub(u, v);
+            SubMod(x1.limbs, x2.limbs);
+        } else {
+            Sub(v, u);
+            SubMod(x2.limbs, x1.limbs);
+        }
+    }
+    return ::IsOne(u) ? x1 : x2;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    if (!a.IsOne())
+        Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char out[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i)
+        WriteLE32(out + 4 * i, limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    for (unsigned int i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; ++i) {
+        unsigned char counter = i;
+        CSHA256().Write(hash, sizeof(hash)).Write(&counter, 1).Finalize(expanded + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(expanded);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len) : numerator(ToNum3072(data, len))
+{
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
+
+void MuHash3072::ToBytes(unsigned char out[STATE_SIZE]) const
+{
+    numerator.ToBytes(out);
+    denominator.ToBytes(out + Num3072::BYTE_SIZE);
+}
+
+void MuHash3072::FromBytes(const unsigned char in[STATE_SIZE])
+{
+    numerator = Num3072(in);
+    denominator = Num3072(in + Num3072::BYTE_SIZE);
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo 2^3072 - 1103717, the largest 3072-bit safe prime. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+
+    Num3072() { SetToOne(); }
+    //! Construct from BYTE_SIZE little-endian bytes, reduced modulo the prime
+    explicit Num3072(const unsigned char data[BYTE_SIZE]);
+
+    void SetToOne();
+    bool IsOne() const;
+    void Multiply(const Num3072& a);
+    //! Multiply by the inverse of a, which must not be zero
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char out[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+
+    uint32_t limbs[LIMBS];
+};
+
+/**
+ * A hash of a set of byte strings that can be updated incrementally and does
+ * not depend on the order in which elements were added or removed.
+ *
+ * Each element is hashed to a number modulo a 3072-bit prime and the set is
+ * represented by the product of its elements. Removing an element multiplies
+ * by its inverse; as inversion is expensive, removed elements are collected
+ * in a separate denominator that is only divided out by Finalize(). The
+ * 3072-bit element is derived from SHA256(data) by counter mode SHA256.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    //! Size of the state written by ToBytes
+    static const size_t STATE_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+    //! The hash of a set containing one element
+    MuHash3072(const unsigned char* data, size_t len);
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    //! The hash of the union of two disjoint sets
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! The hash of the difference of a set and one of its subsets
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! Divide out the denominator and return the SHA256 of the result
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+
+    void ToBytes(unsigned char out[STATE_SIZE]) const;
+    void FromBytes(const unsigned char in[STATE_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -12,6 +12,14 @@
 #include "script/script.h"
 #include "serialize.h"
 
+/** dApp Store changes reported through NotifyDAppUpdate */
+enum DAppEvent {
+    DAPP_EVENT_ADD = 0,
+    DAPP_EVENT_UPDATE = 1,
+    DAPP_EVENT_DELETE = 2,
+    DAPP_EVENT_UNDO = 3, // message transaction disconnected
+};
+
 class DApp {
 public:
     DApp() {}
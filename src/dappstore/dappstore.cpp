@@ -15,6 +15,7 @@
 #include "guiinterface.h"
 #include "init.h"
 #include "main.h"
+#include "validationinterface.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -291,6 +292,7 @@ int DAppStore::ParseVtx(std::vector<CTransaction> &vtx, int64_t blockTime) {
                                     newDApp.time = blockTime;
                                     if (Add(tx.GetHash(), newDApp, prevScript)) {
                                         LogPrintf("Found new application %s\n", tx.GetHash().GetHex().c_str());
+                                        GetMainSignals().NotifyDAppUpdate(tx.GetHash(), tx.GetHash(), DAPP_EVENT_ADD);
                                         ret++;
                                     }
                                 }
@@ -314,7 +316,8 @@ int DAppStore::ParseVtx(std::vector<CTransaction> &vtx, int64_t blockTime) {
                                     if (msg.findKey("img", index) && msg[index].isStr() && DApp::CheckImage(msg[index].get_str()))
                                         updatedDApp.image = msg[index].get_str();
                                     updatedDApp.time = blockTime;
-                                    Update(txid, tx.GetHash(), prevScript, updatedDApp);
+                                    if (Update(txid, tx.GetHash(), prevScript, updatedDApp))
+                                        GetMainSignals().NotifyDAppUpdate(txid, tx.GetHash(), DAPP_EVENT_UPDATE);
                                 }
                             } else if (msgMethod == "del") { // delete
                                 std::map <std::string, UniValue::VType> dAppKeys = {
@@ -323,7 +326,8 @@ int DAppStore::ParseVtx(std::vector<CTransaction> &vtx, int64_t blockTime) {
                                 if (msg.checkObject(dAppKeys)) {
                                     uint256 txid;
                                     txid.SetHex(msg["txid"].get_str());
-                                    Remove(txid, tx.GetHash(), prevScript, blockTime);
+                                    if (Remove(txid, tx.GetHash(), prevScript, blockTime))
+                                        GetMainSignals().NotifyDAppUpdate(txid, tx.GetHash(), DAPP_EVENT_DELETE);
                                 }
                             } else if (msgMethod == "prc" && msgSigned) { // price
                                 int64_t val = -1;
@@ -362,6 +366,7 @@ int DAppStore::CancelVtx(std::vector <CTransaction> &vtx) {
                 auto indexMyTx = std::find(dAppMyTxs.begin(), dAppMyTxs.end(), txid);
                 if (indexMyTx != dAppMyTxs.end())
                     dAppMyTxs.erase(indexMyTx);
+                GetMainSignals().NotifyDAppUpdate(txid, txid, DAPP_EVENT_UNDO);
                 ret++;
             }
         } else if (dAppHistoryTxs.count(txid)) {
@@ -372,6 +377,7 @@ int DAppStore::CancelVtx(std::vector <CTransaction> &vtx) {
                 dApps[dAppId].updateTxs.erase(indexTx);
                 RecalculateDApp(dAppId);
                 DAppStoreDB(dbFile).Add(dAppId, dApps[dAppId]);
+                GetMainSignals().NotifyDAppUpdate(dAppId, txid, DAPP_EVENT_UNDO);
             }
             dAppHistoryTxs.erase(txid);
             DAppStoreDB(dbFile).DeleteHistory(txid);
@@ -8,8 +8,10 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
+#include "rpc/stats.h"
 #include "random.h"
 #include "sync.h"
 #include "util.h"
@@ -17,6 +19,7 @@
 #include "guiinterface.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind.hpp>
 
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wellet.
@@ -54,11 +57,27 @@ private:
     struct event_base* base;
 };
 
+/** Executes batch request elements on the HTTP worker threads.
+ */
+class HTTPRPCWorkerInterface : public RPCWorkerInterface
+{
+public:
+    int Threads()
+    {
+        return HTTPWorkerThreads();
+    }
+    bool Dispatch(const boost::function<void(void)>& func)
+    {
+        return EnqueueHTTPWork(func);
+    }
+};
 
 /* Pre-base64-encoded authentication token */
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Stored RPC worker interface (for unregistration) */
+static HTTPRPCWorkerInterface* httpRPCWorkerInterface = 0;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -77,6 +96,27 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/** Send part of a JSON reply that is still being written */
+static void JSONReplyChunk(HTTPRequest* req, const std::string& strChunk)
+{
+    if (!req->IsReplyChunked())
+        req->WriteHeader("Content-Type", "application/json");
+    req->WriteReplyChunk(strChunk);
+}
+
+/** Account the reply to getrpcstats. Batches are timed as a whole under
+ * "batch"; their elements are timed by the dispatcher under their methods. */
+static void RecordRPCReply(HTTPRequest* req, const JSONRequest& jreq, bool fBatch, int64_t nStart)
+{
+    bool fError = req->GetReplyStatus() != HTTP_OK;
+    if (fBatch) {
+        RecordRequest(STATS_RPC, "batch", GetTimeMicros() - nStart, 0, fError);
+        RecordReplyBytes(STATS_RPC, "batch", req->GetReplyBytes());
+    } else if (tableRPC[jreq.strMethod]) {
+        RecordReplyBytes(STATS_RPC, jreq.strMethod, req->GetReplyBytes());
+    }
+}
+
 static bool RPCAuthorized(const std::string& strAuth)
 {
     if (strRPCUserColonPass.empty()) // Belt-and-suspenders measure if InitRPCAuthentication was not called
@@ -116,6 +156,8 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     }
 
     JSONRequest jreq;
+    bool fBatch = false;
+    int64_t nStart = GetTimeMicros();
     try {
         // Parse request
         UniValue valRequest;
@@ -127,26 +169,42 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
+            // Large results are sent while they are being written
+            CJSONStreamWriter out(boost::bind(&JSONReplyChunk, req, _1));
+            out.BeginObject();
+            out.Key("result");
+            if (tableRPC.executeStream(jreq.strMethod, jreq.params, out)) {
+                out.Write("error", NullUniValue);
+                out.Write("id", jreq.id);
+                out.EndObject();
+                strReply = out.Finish() + "\n";
+            } else {
+                UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+                // Send reply
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            }
 
         // array of requests
-        } else if (valRequest.isArray())
+        } else if (valRequest.isArray()) {
+            fBatch = true;
             strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
+        } else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
-        req->WriteHeader("Content-Type", "application/json");
+        if (!req->IsReplyChunked())
+            req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
+        RecordRPCReply(req, jreq, fBatch, nStart);
         return false;
     } catch (const std::exception& e) {
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        RecordRPCReply(req, jreq, fBatch, nStart);
         return false;
     }
+    RecordRPCReply(req, jreq, fBatch, nStart);
     return true;
 }
 
@@ -178,6 +236,8 @@ bool StartHTTPRPC()
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
     RPCSetTimerInterface(httpRPCTimerInterface);
+    httpRPCWorkerInterface = new HTTPRPCWorkerInterface();
+    RPCSetWorkerInterface(httpRPCWorkerInterface);
     return true;
 }
 
@@ -195,4 +255,9 @@ void StopHTTPRPC()
         delete httpRPCTimerInterface;
         httpRPCTimerInterface = 0;
     }
+    if (httpRPCWorkerInterface) {
+        RPCUnsetWorkerInterface(httpRPCWorkerInterface);
+        delete httpRPCWorkerInterface;
+        httpRPCWorkerInterface = 0;
+    }
 }
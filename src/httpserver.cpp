@@ -23,10 +23,14 @@
 #include <sys/stat.h>
 #include <signal.h>
 
+#include <condition_variable>
+#include <mutex>
+
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/thread.h>
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
@@ -50,7 +54,13 @@ public:
     }
     void operator()()
     {
-        func(req.get(), path);
+        try {
+            func(req.get(), path);
+        } catch (const HTTPReplyAborted& e) {
+            // The request may be gone, only the reply stream is left to close
+            LogPrint("http", "Aborted reply to %s: %s\n", path, e.what());
+            req->WriteReply(HTTP_INTERNAL);
+        }
     }
 
     std::unique_ptr<HTTPRequest> req;
@@ -60,6 +70,22 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Work item running an arbitrary function, e.g. part of an RPC batch */
+class HTTPFunctionItem : public HTTPClosure
+{
+public:
+    HTTPFunctionItem(const std::function<void(void)>& func): func(func)
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    std::function<void(void)> func;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -75,6 +101,10 @@ private:
     bool running;
     size_t maxDepth;
     int numThreads;
+    /** Statistics for getrpcstats */
+    size_t peakDepth;
+    int busyThreads;
+    uint64_t rejected;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -97,7 +127,10 @@ private:
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 peakDepth(0),
+                                 busyThreads(0),
+                                 rejected(0)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -110,14 +143,16 @@ public:
             queue.pop_front();
         }
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item, keeping nReserve slots free for other items */
+    bool Enqueue(WorkItem* item, size_t nReserve = 0)
     {
         std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        if (queue.size() + nReserve >= maxDepth) {
+            rejected++;
             return false;
         }
         queue.push_back(item);
+        peakDepth = std::max(peakDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -135,9 +170,14 @@ public:
                     break;
                 i = queue.front();
                 queue.pop_front();
+                busyThreads++;
             }
             (*i)();
             delete i;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                busyThreads--;
+            }
         }
     }
     /** Interrupt and exit loops */
@@ -161,6 +201,18 @@ public:
         std::unique_lock<std::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Fill in the counters of the queue */
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        stats.nDepth = queue.size();
+        stats.nPeakDepth = peakDepth;
+        stats.nCapacity = maxDepth;
+        stats.nThreads = numThreads;
+        stats.nBusy = busyThreads;
+        stats.nRejected = rejected;
+    }
 };
 
 struct HTTPPathHandler
@@ -185,6 +237,10 @@ struct evhttp* eventHTTP = 0;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Depth of workQueue
+static int workQueueDepth = 0;
+//! Number of threads running workQueue
+static int workQueueThreads = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 std::vector<evhttp_bound_socket *> boundSockets;
@@ -424,7 +480,7 @@ bool InitHTTPServer()
     }
 
     LogPrint("http", "Initialized HTTP server\n");
-    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+    workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
@@ -441,6 +497,7 @@ bool StartHTTPServer()
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
     LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     threadHTTP = std::thread(ThreadHTTP, eventBase, eventHTTP);
+    workQueueThreads = rpcThreads;
 
     for (int i = 0; i < rpcThreads; i++) {
         std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
@@ -489,6 +546,31 @@ void StopHTTPServer()
     LogPrint("http", "Stopped HTTP server\n");
 }
 
+bool EnqueueHTTPWork(const std::function<void(void)>& func)
+{
+    if (!workQueue)
+        return false;
+    // Keep half of the queue for incoming requests
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(func));
+    if (!workQueue->Enqueue(item.get(), workQueueDepth / 2))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
+int HTTPWorkerThreads()
+{
+    return workQueueThreads;
+}
+
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats)
+{
+    if (!workQueue)
+        return false;
+    workQueue->GetStats(stats);
+    return true;
+}
+
 struct event_base* EventBase()
 {
     return eventBase;
@@ -520,8 +602,99 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** Reply bytes allowed to wait in the connection's output buffer before a chunked reply waits for the client */
+static const size_t MAX_HTTP_REPLY_BUFFERED = 4 * 1024 * 1024;
+
+/** A chunked reply, shared by the worker writing it and the events that send it
+ * from the main http thread. Once the client disconnects, libevent may free the
+ * request, so the events stop using it and the worker stops writing. */
+struct HTTPReplyStream
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    struct evhttp_request* req;
+    bool fClosed;     //! Connection closed, req may have been freed
+    bool fDetached;   //! Closed during the reply, libevent left req to be freed by us
+    bool fMeasuring;  //! A check of the output buffer is pending
+    size_t nQueued;   //! Bytes in chunks not sent to the connection yet
+    size_t nBuffered; //! Bytes in the connection's output buffer at the last check
+
+    explicit HTTPReplyStream(struct evhttp_request* reqIn) : req(reqIn), fClosed(false), fDetached(false), fMeasuring(false), nQueued(0), nBuffered(0) {}
+
+    /** Main http thread: bytes the client still has to read */
+    size_t GetOutputLength()
+    {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+        if (evcon)
+            return evbuffer_get_length(bufferevent_get_output(evhttp_connection_get_bufferevent(evcon)));
+#endif
+        return 0;
+    }
+};
+
+static void http_reply_stream_closed(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPReplyStream* stream = (HTTPReplyStream*)arg;
+    std::unique_lock<std::mutex> lock(stream->cs);
+    // Still valid here: libevent calls this before it frees the requests of the connection
+    stream->fDetached = evhttp_request_get_connection(stream->req) == NULL;
+    stream->fClosed = true;
+    stream->cond.notify_all();
+}
+
+static void http_reply_stream_start(std::shared_ptr<HTTPReplyStream> stream)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(stream->req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, http_reply_stream_closed, stream.get());
+    evhttp_send_reply_start(stream->req, HTTP_OK, NULL);
+}
+
+/** Send a chunk. The chunk's data is moved to the connection's output buffer,
+ * so the buffer can be freed right away. */
+static void http_reply_stream_chunk(std::shared_ptr<HTTPReplyStream> stream, struct evbuffer* evb)
+{
+    size_t nSize = evbuffer_get_length(evb);
+    std::unique_lock<std::mutex> lock(stream->cs);
+    if (!stream->fClosed) {
+        evhttp_send_reply_chunk(stream->req, evb);
+        stream->nBuffered = stream->GetOutputLength();
+    }
+    evbuffer_free(evb);
+    stream->nQueued -= nSize;
+    stream->cond.notify_all();
+}
+
+static void http_reply_stream_measure(std::shared_ptr<HTTPReplyStream> stream)
+{
+    std::unique_lock<std::mutex> lock(stream->cs);
+    if (!stream->fClosed)
+        stream->nBuffered = stream->GetOutputLength();
+    stream->fMeasuring = false;
+    stream->cond.notify_all();
+}
+
+static void http_reply_stream_end(std::shared_ptr<HTTPReplyStream> stream)
+{
+    std::unique_lock<std::mutex> lock(stream->cs);
+    if (!stream->fClosed) {
+        // The connection may serve further requests, which must not find this stream
+        struct evhttp_connection* evcon = evhttp_request_get_connection(stream->req);
+        if (evcon)
+            evhttp_connection_set_closecb(evcon, NULL, NULL);
+        evhttp_send_reply_end(stream->req);
+    } else if (stream->fDetached) {
+        // Without a connection, this only frees the request
+        evhttp_send_reply_end(stream->req);
+    }
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyChunked(false),
+                                                       replyStatus(0),
+                                                       replyBytes(0)
 {
 }
 HTTPRequest::~HTTPRequest()
@@ -567,6 +740,9 @@ std::string HTTPRequest::ReadBody()
 
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
+    // Too late once a chunked reply started, and the request may be gone
+    if (replyChunked)
+        return;
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
     assert(headers);
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
@@ -580,6 +756,18 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
+    if (replyChunked) {
+        if (nStatus != HTTP_OK)
+            LogPrintf("%s: status %d after start of chunked reply, ending reply\n", __func__, nStatus);
+        else if (!strReply.empty())
+            WriteReplyChunk(strReply);
+        replyStatus = nStatus;
+        HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_reply_stream_end, replyStream));
+        ev->trigger(0);
+        replySent = true;
+        req = 0; // transferred back to main thread
+        return;
+    }
     if (ShutdownRequested()) {
         WriteHeader("Connection", "close");
     }
@@ -587,6 +775,8 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
+    replyStatus = nStatus;
+    replyBytes += strReply.size();
     HTTPEvent* ev = new HTTPEvent(eventBase, true,
         std::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
@@ -594,6 +784,45 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && req);
+    if (!replyChunked) {
+        if (ShutdownRequested()) {
+            WriteHeader("Connection", "close");
+        }
+        replyStream = std::make_shared<HTTPReplyStream>(req);
+        HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_reply_stream_start, replyStream));
+        ev->trigger(0);
+        replyChunked = true;
+    }
+    {
+        // Wait for the client to catch up instead of queueing the whole reply
+        std::unique_lock<std::mutex> lock(replyStream->cs);
+        while (!replyStream->fClosed && replyStream->nQueued + replyStream->nBuffered > MAX_HTTP_REPLY_BUFFERED) {
+            if (ShutdownRequested())
+                throw HTTPReplyAborted();
+            if (!replyStream->fMeasuring) {
+                struct timeval tv = {0, 50 * 1000};
+                HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_reply_stream_measure, replyStream));
+                ev->trigger(&tv);
+                replyStream->fMeasuring = true;
+            }
+            replyStream->cond.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (replyStream->fClosed)
+            throw HTTPReplyAborted();
+        replyStream->nQueued += strChunk.size();
+    }
+    // Events are run in the order they were triggered, so chunks stay in order
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    replyBytes += strChunk.size();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, std::bind(http_reply_stream_chunk, replyStream, evb));
+    ev->trigger(0);
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
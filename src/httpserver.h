@@ -8,6 +8,8 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
+#include <stdexcept>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -17,6 +19,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -42,11 +45,39 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Run func on one of the HTTP worker threads.
+ * Returns false if the work queue is too full to take it.
+ */
+bool EnqueueHTTPWork(const std::function<void(void)>& func);
+
+/** Number of HTTP worker threads (-rpcthreads) */
+int HTTPWorkerThreads();
+
+/** Counters of the HTTP work queue */
+struct HTTPWorkQueueStats
+{
+    size_t nDepth;
+    size_t nPeakDepth;
+    size_t nCapacity;
+    int nThreads;
+    int nBusy;
+    uint64_t nRejected;
+};
+/** Fill in the counters of the work queue. Returns false if the HTTP server is not running. */
+bool GetHTTPWorkQueueStats(HTTPWorkQueueStats& stats);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
 struct event_base* EventBase();
 
+/** Thrown by HTTPRequest::WriteReplyChunk when the client went away during a chunked reply */
+class HTTPReplyAborted : public std::runtime_error
+{
+public:
+    HTTPReplyAborted() : std::runtime_error("client disconnected during chunked reply") {}
+};
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -55,6 +86,11 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyChunked;
+    int replyStatus;
+    size_t replyBytes;
+    //! Shared with the events sending a chunked reply
+    std::shared_ptr<HTTPReplyStream> replyStream;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -110,6 +146,26 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Send part of the reply body. The first call starts a chunked reply
+     * with status HTTP_OK, so write all headers before it. Finish the reply
+     * with WriteReply, whose body is sent as the last chunk. If the status
+     * passed to WriteReply is not HTTP_OK, the body is dropped and the client
+     * only sees the reply end early.
+     * Blocks while the client is behind on reading what was already sent.
+     * Throws HTTPReplyAborted once the client has disconnected.
+     */
+    void WriteReplyChunk(const std::string& strChunk);
+
+    /** Whether WriteReplyChunk started a chunked reply */
+    bool IsReplyChunked() const { return replyChunked; }
+
+    /** Status passed to WriteReply, or 0 before it was called */
+    int GetReplyStatus() const { return replyStatus; }
+
+    /** Number of body bytes written so far */
+    size_t GetReplyBytes() const { return replyBytes; }
 };
 
 /** Event handler closure.
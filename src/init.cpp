@@ -16,6 +16,7 @@
 #include "addrman.h"
 #include "amount.h"
 #include "checkpoints.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
 #include "dappstore/dappstore.h"
 #include "httpserver.h"
@@ -33,6 +34,7 @@
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
+#include "txsubmit.h"
 #include "torcontrol.h"
 #include "guiinterface.h"
 #include "util.h"
@@ -63,6 +65,7 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
 #endif
 
@@ -79,10 +82,6 @@ volatile bool fRestartRequested = false; // true: restart false: shutdown
 volatile bool fNeedResync = false;
 extern std::list<uint256> listAccCheckpointsNoDB;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
-#endif
-
 #ifdef WIN32
 // Win32 LevelDB doesn't use filedescriptors, and the ones used for
 // accessing block files, don't count towards to fd_set size limit
@@ -247,6 +246,8 @@ void PrepareShutdown()
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        delete pcoinsPrefetch;
+        pcoinsPrefetch = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
@@ -313,6 +314,7 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopDebugLogWriter();
 }
 
 #ifndef WIN32
@@ -391,9 +393,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and skip their script verification (0 to verify all, default: %s, testnet: %s)"), Params(CBaseChainParams::MAIN).DefaultAssumeValid().GetHex(), Params(CBaseChainParams::TESTNET).DefaultAssumeValid().GetHex()));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 100));
+    strUsage += HelpMessageOpt("-checkblocksinbackground", strprintf(_("Check the -checkblocks blocks after the node has started instead of before; no stakes are made until they are checked (default: %u)"), 0));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "nbx.conf"));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -401,13 +405,20 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
+    strUsage += HelpMessageOpt("-compressblocks", strprintf(_("Store new blocks compressed; blocks are read in either format (default: %u)"), DEFAULT_COMPRESS_BLOCKS));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dboption=<db>.<option>=<value>", _("Tune database <db> (chainstate, index, sporks or all); options are filterbits, blocksize, writebuffer, compression, maxopenfiles and verifychecksums") + " " + _("(can be specified multiple times)"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-mapblockfiles", strprintf(_("Read blocks through memory mapped block files (default: %u)"), DEFAULT_MAP_BLOCK_FILES));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempoolnotify=<cmd>", _("Execute command when transaction added to mempool (%s in cmd is replaced by transaction hash)"));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the inputs of new blocks ahead of their validation (0 to %d, default: %d)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "nbxd.pid"));
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables rescans beyond the pruned blocks and serving old blocks to peers. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
@@ -490,6 +501,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via SwiftX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdappupdate=<address>", _("Enable publish dApp Store additions, updates and deletions in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubmnstate=<address>", _("Enable publish masternode state changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdynreward=<address>", _("Enable publish dynamic reward multiplier changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<type>hwm=<n>", strprintf(_("Set outbound message high water mark for a publish notifier, e.g. -zmqpubrawblockhwm (default: %d)"), CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqqueuesize=<n>", strprintf(_("Maximum number of notifications waiting to be published before new ones are dropped (default: %u)"), DEFAULT_ZMQ_QUEUE_SIZE));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -521,6 +537,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-lograte=<n>", strprintf(_("Write at most <n> messages per second of each debug category, 0 for no limit (default: %u)"), DEFAULT_LOG_RATE));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), 1));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
@@ -582,6 +599,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 28735, 28755));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcconcurrency=<method>:<n>", _("Limit how many elements of a JSON-RPC batch calling <method> may execute concurrently, 0 to run them in order. This option can be specified multiple times"));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -637,6 +655,56 @@ static void MempoolNotifyCallback(const uint256& hash)
     boost::thread t(runCommand, strCmd); // thread runs free
 }
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+void CleanupBlockRevFiles()
+{
+    using namespace boost::filesystem;
+    std::map<std::string, path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    path blocksdir = GetDataDir() / "blocks";
+    for (directory_iterator it(blocksdir); it != directory_iterator(); it++) {
+        if (is_regular_file(*it) &&
+            it->path().filename().string().length() == 12 &&
+            it->path().filename().string().substr(8, 4) == ".dat") {
+            if (it->path().filename().string().substr(0, 3) == "blk")
+                mapBlockFiles[it->path().filename().string().substr(3, 5)] = it->path();
+            else if (it->path().filename().string().substr(0, 3) == "rev")
+                remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        remove(item.second);
+    }
+}
+
+/** Whether the blocks from pindexRescan up to the tip are all still on disk */
+static bool HaveBlockDataSince(const CBlockIndex* pindexRescan)
+{
+    const CBlockIndex* block = chainActive.Tip();
+    while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+        block = block->pprev;
+    return pindexRescan == block;
+}
+
 struct CImportingNow {
     CImportingNow()
     {
@@ -658,18 +726,7 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     // -reindex
     if (fReindex) {
         CImportingNow imp;
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
-            nFile++;
-        }
+        ReindexBlockFiles();
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -836,6 +893,7 @@ bool AppInit2()
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fLogTimestamps = GetBoolArg("-logtimestamps", true);
     fLogIPs = GetBoolArg("-logips", false);
+    nLogRate = GetArg("-lograte", DEFAULT_LOG_RATE);
 
     if (mapArgs.count("-bind") || mapArgs.count("-whitebind")) {
         // when specifying an explicit binding address, you want to listen on it
@@ -947,6 +1005,12 @@ bool AppInit2()
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    hashAssumeValid = uint256S(GetArg("-assumevalid", Params().DefaultAssumeValid().GetHex()));
+    if (hashAssumeValid != 0)
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures for all blocks.\n");
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -1037,6 +1101,27 @@ bool AppInit2()
 
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0) {
+        return InitError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+
+    fMapBlockFiles = GetBoolArg("-mapblockfiles", DEFAULT_MAP_BLOCK_FILES);
+    fCompressBlocks = GetBoolArg("-compressblocks", DEFAULT_COMPRESS_BLOCKS);
+
+    std::string strInvalidDbOption;
+    if (!CheckLevelDBOptions(strInvalidDbOption))
+        return InitError(strprintf(_("Invalid -dboption: '%s'"), strInvalidDbOption));
+
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
 #ifdef WIN32
@@ -1071,6 +1156,7 @@ bool AppInit2()
     CreatePidFile(GetPidFile(), getpid());
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    StartDebugLogWriter();
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Netbox.Wallet version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
@@ -1087,8 +1173,10 @@ bool AppInit2()
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadTxPreVerify);
+        }
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1413,6 +1501,7 @@ bool AppInit2()
         size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
         nTotalCache -= nCoinDBCache;
         nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+        int nPrefetchThreads = std::max(0, std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
 
         bool fLoaded = false;
         while (!fLoaded) {
@@ -1426,8 +1515,9 @@ bool AppInit2()
                 try {
                     UnloadBlockIndex();
                     delete pcoinsTip;
-                    delete pcoinsdbview;
                     delete pcoinscatcher;
+                    delete pcoinsPrefetch;
+                    delete pcoinsdbview;
                     delete pblocktree;
                     delete pSporkDB;
 
@@ -1436,11 +1526,16 @@ bool AppInit2()
 
                     pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                     pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
-                    pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                    pcoinsPrefetch = nPrefetchThreads ? new CCoinsViewPrefetch(pcoinsdbview, nPrefetchThreads) : NULL;
+                    pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsPrefetch ? (CCoinsView*)pcoinsPrefetch : pcoinsdbview);
                     pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
-                    if (fReindex)
+                    if (fReindex) {
                         pblocktree->WriteReindexing(true);
+                        //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                        if (fPruneMode)
+                            CleanupBlockRevFiles();
+                    }
 
                     // load previous sessions sporks if we have them.
                     uiInterface.InitMessage(_("Loading sporks..."));
@@ -1471,6 +1566,13 @@ bool AppInit2()
                         break;
                     }
 
+                    // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                    // in the past, but is now trying to run unpruned.
+                    if (fHavePruned && !fPruneMode) {
+                        strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                        break;
+                    }
+
                     if (!fReindex) {
                         uiInterface.InitMessage(_("Verifying blocks..."));
 
@@ -1494,12 +1596,27 @@ bool AppInit2()
                             }
                         }
 
-                        if (!CVerifyDB().VerifyDB(pcoinsdbview, 5, GetArg("-checkblocks", 100))) {
+                        if (fHavePruned && GetArg("-checkblocks", 100) > MIN_BLOCKS_TO_KEEP) {
+                            LogPrintf("Prune: pruned datadir may not have more than %d blocks; only the blocks still on disk are checked\n",
+                                MIN_BLOCKS_TO_KEEP);
+                        }
+
+                        if (GetBoolArg("-checkblocksinbackground", false)) {
+                            LogPrintf("Verifying blocks in the background once started\n");
+                            fBlockDatabaseVerified = false;
+                        } else if (!CVerifyDB().VerifyDB(pcoinsdbview, 5, GetArg("-checkblocks", 100))) {
                             strLoadError = _("Corrupted block database detected");
                             fVerifyingBlocks = false;
                             break;
                         }
                     }
+
+                    uiInterface.InitMessage(_("Loading UTXO set statistics..."));
+                    if (!LoadUtxoStats(pcoinsdbview)) {
+                        strLoadError = _("Error loading UTXO set statistics");
+                        fVerifyingBlocks = false;
+                        break;
+                    }
                 } catch (std::exception& e) {
                     if (fDebug) LogPrintf("%s\n", e.what());
                     strLoadError = _("Error opening block database");
@@ -1698,6 +1815,10 @@ bool AppInit2()
                 pindexRescan = chainActive.Genesis();
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+            // We can't rescan beyond pruned data, stop and throw an error.
+            if (fHavePruned && !HaveBlockDataSince(pindexRescan))
+                return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
             nStart = GetTimeMillis();
@@ -1751,6 +1872,9 @@ bool AppInit2()
             }
 
             if (chainActive.Tip() && chainActive.Tip() != pindexDAppRescan) {
+                if (fHavePruned && !HaveBlockDataSince(pindexDAppRescan))
+                    return InitError(_("Prune: last dApp Store synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+
                 uiInterface.InitMessage(_("Rescanning dApps Store..."));
                 LogPrintf("Rescanning last %i blocks for dApp Store (from block %i)...\n", chainActive.Height() - pindexDAppRescan->nHeight, pindexDAppRescan->nHeight);
                 nStart = GetTimeMillis();
@@ -1761,6 +1885,17 @@ bool AppInit2()
         }
     }
 
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet or dApp Store rescanning has taken place.
+    if (fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices &= ~NODE_NETWORK;
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 11: setup ObfuScation
 
     uiInterface.InitMessage(_("Loading masternode cache..."));
@@ -1883,6 +2018,9 @@ bool AppInit2()
 
     StartNode(threadGroup, scheduler);
 
+    if (!fBlockDatabaseVerified)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "verifydb", &ThreadVerifyDB));
+
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     if (pwalletMain)
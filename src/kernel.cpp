@@ -4,8 +4,11 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <limits>
+
 #include <boost/assign/list_of.hpp>
 
+#include "chainstatus.h"
 #include "db.h"
 #include "kernel.h"
 #include "masternode-sync.h"
@@ -15,9 +18,6 @@
 #include "stakeinput.h"
 #include "utilmoneystr.h"
 
-// v1 modifier interval.
-static const int64_t OLD_MODIFIER_INTERVAL = 2087;
-
 // Get the last stake modifier and its generation time from a given block
 static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModifier, int64_t& nModifierTime)
 {
@@ -40,55 +40,49 @@ static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
     return a;
 }
 
+// A block that may contribute its entropy bit to the next stake modifier
+struct CModifierCandidate {
+    int64_t nTime;
+    const CBlockIndex* pindex;
+    // Hash deciding between the candidates of a round, the same in every round
+    uint256 hashSelection;
+    bool fSelected;
+
+    bool operator<(const CModifierCandidate& other) const
+    {
+        if (nTime != other.nTime)
+            return nTime < other.nTime;
+        return pindex->GetBlockHash() < other.pindex->GetBlockHash();
+    }
+};
+
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
-// nSelectionIntervalStop.
+// already selected blocks, and with timestamp up to nSelectionIntervalStop.
 static bool SelectBlockFromCandidates(
-    std::vector<std::pair<int64_t, uint256> >& vSortedByTimestamp,
-    std::map<uint256, const CBlockIndex*>& mapSelectedBlocks,
+    std::vector<CModifierCandidate>& vSortedByTimestamp,
     int64_t nSelectionIntervalStop,
-    uint64_t nStakeModifierPrev,
+    bool fPrintStakeModifier,
     const CBlockIndex** pindexSelected)
 {
-    bool fSelected = false;
-    uint256 hashBest = 0;
+    CModifierCandidate* pcandidateBest = NULL;
     *pindexSelected = (const CBlockIndex*)0;
-    for (const PAIRTYPE(int64_t, uint256) & item : vSortedByTimestamp) {
-        if (!mapBlockIndex.count(item.second))
-            return error("%s : failed to find block index for candidate block %s", __func__, item.second.ToString().c_str());
-
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
+    for (CModifierCandidate& candidate : vSortedByTimestamp) {
+        if (pcandidateBest && candidate.nTime > nSelectionIntervalStop)
             break;
 
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (candidate.fSelected)
             continue;
 
-        // compute the selection hash by hashing an input that is unique to that block
-        uint256 hashProof = pindex->GetBlockHash();
-
-        CDataStream ss(SER_GETHASH, 0);
-        ss << hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection >>= 32;
-
-        if (fSelected && hashSelection < hashBest) {
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
-        } else if (!fSelected) {
-            fSelected = true;
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
-        }
+        if (!pcandidateBest || candidate.hashSelection < pcandidateBest->hashSelection)
+            pcandidateBest = &candidate;
     }
-    if (GetBoolArg("-printstakemodifier", false))
-        LogPrintf("%s : selection hash=%s\n", __func__, hashBest.ToString().c_str());
-    return fSelected;
+    if (!pcandidateBest)
+        return false;
+    pcandidateBest->fSelected = true;
+    *pindexSelected = pcandidateBest->pindex;
+    if (fPrintStakeModifier)
+        LogPrintf("%s : selection hash=%s\n", __func__, pcandidateBest->hashSelection.ToString().c_str());
+    return true;
 }
 
 /* NEW MODIFIER */
@@ -149,20 +143,37 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     if (!GetLastStakeModifier(pindexPrev, nStakeModifier, nModifierTime))
         return error("%s : unable to get last modifier", __func__);
 
-    if (GetBoolArg("-printstakemodifier", false))
+    const bool fPrintStakeModifier = GetBoolArg("-printstakemodifier", false);
+    if (fPrintStakeModifier)
         LogPrintf("%s : prev modifier= %s time=%s\n", __func__, std::to_string(nStakeModifier).c_str(), DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nModifierTime).c_str());
 
     if (nModifierTime / MODIFIER_INTERVAL >= pindexPrev->GetBlockTime() / MODIFIER_INTERVAL)
         return true;
 
     // Sort candidate blocks by timestamp
-    std::vector<std::pair<int64_t, uint256> > vSortedByTimestamp;
+    std::vector<CModifierCandidate> vSortedByTimestamp;
     vSortedByTimestamp.reserve(64 * MODIFIER_INTERVAL  / Params().TargetSpacing());
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / MODIFIER_INTERVAL ) * MODIFIER_INTERVAL  - OLD_MODIFIER_INTERVAL;
     const CBlockIndex* pindex = pindexPrev;
 
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart) {
-        vSortedByTimestamp.push_back(std::make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
+        CModifierCandidate candidate;
+        candidate.nTime = pindex->GetBlockTime();
+        candidate.pindex = pindex;
+        candidate.fSelected = false;
+
+        // compute the selection hash by hashing an input that is unique to that block
+        CDataStream ss(SER_GETHASH, 0);
+        ss << pindex->GetBlockHash() << nStakeModifier;
+        candidate.hashSelection = Hash(ss.begin(), ss.end());
+
+        // the selection hash is divided by 2**32 so that proof-of-stake block
+        // is always favored over proof-of-work block. this is to preserve
+        // the energy efficiency property
+        if (pindex->IsProofOfStake())
+            candidate.hashSelection >>= 32;
+
+        vSortedByTimestamp.push_back(candidate);
         pindex = pindex->pprev;
     }
 
@@ -173,27 +184,24 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    std::map<uint256, const CBlockIndex*> mapSelectedBlocks;
     for (int nRound = 0; nRound < std::min(64, (int)vSortedByTimestamp.size()); nRound++) {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
 
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, nSelectionIntervalStop, fPrintStakeModifier, &pindex))
             return error("%s : unable to select block at round %d", __func__, nRound);
 
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
 
-        // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(std::make_pair(pindex->GetBlockHash(), pindex));
-        if (GetBoolArg("-printstakemodifier", false))
+        if (fPrintStakeModifier)
             LogPrintf("%s : selected round %d stop=%s height=%d bit=%d\n", __func__,
                 nRound, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nSelectionIntervalStop).c_str(), pindex->nHeight, pindex->GetStakeEntropyBit());
     }
 
     // Print selection map for visualization of the selected blocks
-    if (GetBoolArg("-printstakemodifier", false)) {
+    if (fPrintStakeModifier) {
         std::string strSelectionMap = "";
         // '-' indicates proof-of-work blocks not selected
         strSelectionMap.insert(0, pindexPrev->nHeight - nHeightFirstCandidate + 1, '-');
@@ -204,14 +212,13 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        for (const std::pair<const uint256, const CBlockIndex*> &item : mapSelectedBlocks) {
+        for (const CModifierCandidate& candidate : vSortedByTimestamp) {
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->IsProofOfStake() ? "S" : "W");
+            if (candidate.fSelected)
+                strSelectionMap.replace(candidate.pindex->nHeight - nHeightFirstCandidate, 1, candidate.pindex->IsProofOfStake() ? "S" : "W");
         }
         LogPrintf("%s : selection height [%d, %d] map %s\n", __func__, nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap.c_str());
-    }
-    if (GetBoolArg("-printstakemodifier", false)) {
         LogPrintf("%s : new modifier=%s time=%s\n", __func__, std::to_string(nStakeModifierNew).c_str(), DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexPrev->GetBlockTime()).c_str());
     }
 
@@ -220,14 +227,115 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+namespace
+{
+//! For each height of the active chain below the v2 modifier upgrade, the
+//! block whose stake modifier a kernel from there hashes with, NULL while it is
+//! not connected yet (protected by cs_main)
+std::vector<const CBlockIndex*> vKernelModifierBlocks;
+//! Heights of vKernelModifierBlocks still waiting for their block
+std::set<int> setKernelModifiersPending;
+//! For each height of vKernelModifierBlocks, the highest block it and the
+//! heights below it hold, INT_MAX from the first one waiting
+std::vector<int> vKernelModifierMaxHeights;
+//! Tip of the chain vKernelModifierBlocks was built for
+const CBlockIndex* pindexKernelModifiers = NULL;
+
+// The first modifier generated on the active chain after pindexFrom, at least
+// a selection interval later
+const CBlockIndex* FindKernelModifierBlock(const CBlockIndex* pindexFrom)
+{
+    const CBlockIndex* pindex = pindexFrom;
+    int64_t nStakeModifierTime = pindexFrom->GetBlockTime();
+    do {
+        pindex = chainActive[pindex->nHeight + 1];
+        // The block is not connected yet
+        if (!pindex)
+            return NULL;
+        if (pindex->GeneratedStakeModifier())
+            nStakeModifierTime = pindex->GetBlockTime();
+    } while (nStakeModifierTime < pindexFrom->GetBlockTime() + OLD_MODIFIER_INTERVAL);
+    return pindex;
+}
+}
+
+void UpdateKernelModifierIndex()
+{
+    LOCK(cs_main);
+    const CBlockIndex* pindexFork = pindexKernelModifiers ? chainActive.FindFork(pindexKernelModifiers) : NULL;
+    const int nHeightFork = pindexFork ? pindexFork->nHeight : -1;
+
+    // Drop the blocks no longer in the active chain, and the kernels using their
+    // modifiers. Block times are out of order at times, so a kernel may use a
+    // later modifier than one above it: look down to the first height below
+    // which every modifier is still connected.
+    if ((int)vKernelModifierBlocks.size() > nHeightFork + 1) {
+        vKernelModifierBlocks.resize(nHeightFork + 1);
+        vKernelModifierMaxHeights.resize(nHeightFork + 1);
+    }
+    setKernelModifiersPending.erase(setKernelModifiersPending.upper_bound(nHeightFork), setKernelModifiersPending.end());
+    for (int nHeight = vKernelModifierBlocks.size() - 1; nHeight >= 0 && vKernelModifierMaxHeights[nHeight] > nHeightFork; nHeight--) {
+        const CBlockIndex*& pindexModifier = vKernelModifierBlocks[nHeight];
+        if (pindexModifier && pindexModifier->nHeight <= nHeightFork)
+            continue;
+        pindexModifier = NULL;
+        setKernelModifiersPending.insert(nHeight);
+    }
+    const int nHeightChanged = setKernelModifiersPending.empty() ? vKernelModifierBlocks.size() : *setKernelModifiersPending.begin();
+
+    // Add the blocks connected since
+    for (int nHeight = nHeightFork + 1; nHeight <= chainActive.Height(); nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (pindex->GeneratedStakeModifier()) {
+            std::set<int>::iterator it = setKernelModifiersPending.begin();
+            while (it != setKernelModifiersPending.end()) {
+                if (chainActive[*it]->GetBlockTime() + OLD_MODIFIER_INTERVAL <= pindex->GetBlockTime()) {
+                    vKernelModifierBlocks[*it] = pindex;
+                    setKernelModifiersPending.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (!Params().IsStakeModifierV2(nHeight + 1)) {
+            vKernelModifierBlocks.push_back(NULL);
+            vKernelModifierMaxHeights.push_back(std::numeric_limits<int>::max());
+            setKernelModifiersPending.insert(nHeight);
+        }
+    }
+    for (int nHeight = nHeightChanged; nHeight < (int)vKernelModifierBlocks.size(); nHeight++) {
+        const CBlockIndex* pindexModifier = vKernelModifierBlocks[nHeight];
+        int nMaxHeight = pindexModifier ? pindexModifier->nHeight : std::numeric_limits<int>::max();
+        vKernelModifierMaxHeights[nHeight] = nHeight > 0 ? std::max(vKernelModifierMaxHeights[nHeight - 1], nMaxHeight) : nMaxHeight;
+    }
+    pindexKernelModifiers = chainActive.Tip();
+}
+
+void ClearKernelModifierIndex()
+{
+    LOCK(cs_main);
+    vKernelModifierBlocks.clear();
+    vKernelModifierMaxHeights.clear();
+    setKernelModifiersPending.clear();
+    pindexKernelModifiers = NULL;
+}
+
+const CBlockIndex* GetIndexedKernelModifierBlock(int nHeight)
+{
+    LOCK(cs_main);
+    return nHeight < (int)vKernelModifierBlocks.size() ? vKernelModifierBlocks[nHeight] : NULL;
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
 {
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+    LOCK(cs_main);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
         return error("%s : block not indexed", __func__);
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+    const CBlockIndex* pindexFrom = mi->second;
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     // Fixed stake modifier only for regtest
@@ -235,23 +343,21 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
         nStakeModifier = pindexFrom->nStakeModifier;
         return true;
     }
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindex->nHeight + 1];;
 
-    // loop to find the stake modifier later by a selection interval
-    do {
-        if (!pindexNext) {
-            // Should never happen
-            return error("%s : Null pindexNext, current block %s ", __func__, pindex->phashBlock->GetHex());
-        }
-        pindex = pindexNext;
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
-        }
-        pindexNext = chainActive[pindex->nHeight + 1];
-    } while (nStakeModifierTime < pindexFrom->GetBlockTime() + OLD_MODIFIER_INTERVAL);
+    // Kernels from the active chain are looked up in the index; its entries
+    // are only used while their block is still in the active chain too
+    const CBlockIndex* pindex = NULL;
+    if (pindexFrom->nHeight < (int)vKernelModifierBlocks.size() && chainActive[pindexFrom->nHeight] == pindexFrom)
+        pindex = vKernelModifierBlocks[pindexFrom->nHeight];
+    if (!pindex || !chainActive.Contains(pindex))
+        pindex = FindKernelModifierBlock(pindexFrom);
+    if (!pindex) {
+        // Should never happen
+        return error("%s : no stake modifier yet for kernel from block %s ", __func__, pindexFrom->GetBlockHash().GetHex());
+    }
 
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
@@ -367,46 +473,222 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
 
     mapHashedBlocks.clear();
     mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    SetStakeHashedHeight(chainActive.Tip()->nHeight);
     return fSuccess;
 }
 
-bool initStakeInput(const CBlock block, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight) {
-    const CTransaction tx = block.vtx[1];
+namespace
+{
+struct CStakeOrigin {
+    CTxOut txOut;
+    CBlockIndex* pindexFrom;
+};
+
+//! Outputs staked by recently checked blocks and the blocks that created them (protected by cs_main)
+std::map<COutPoint, CStakeOrigin> mapStakeOrigins;
+static const size_t MAX_STAKE_ORIGINS = 10000;
+
+//! The inputs spent by the blocks of the active chain after a fork point
+struct CForkSpends {
+    const CBlockIndex* pindexFork = NULL;
+    //! The last block read; the ones after it are read on the next lookup
+    const CBlockIndex* pindexLast = NULL;
+    std::map<COutPoint, CTxOut> mapOutputs;
+    //! Heights of the transactions whose last output was spent
+    std::map<uint256, int> mapHeights;
+};
+
+//! The spends of the last fork a stake input was looked up for (protected by cs_main)
+CForkSpends forkSpends;
+
+// Add the inputs spent by a block of the active chain to forkSpends
+bool ReadForkSpends(const CBlockIndex* pindex)
+{
+    CBlock blockSpend;
+    CBlockUndo blockUndo;
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO) ||
+        !ReadBlockFromDisk(blockSpend, pindex) ||
+        !blockUndo.ReadFromDisk(pindex->GetUndoPos(), pindex->pprev->GetBlockHash()) ||
+        blockUndo.vtxundo.size() + 1 != blockSpend.vtx.size())
+        return false;
+    for (unsigned int i = 1; i < blockSpend.vtx.size(); i++) {
+        const CTransaction& tx = blockSpend.vtx[i];
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size())
+            return false;
+    }
+    for (unsigned int i = 1; i < blockSpend.vtx.size(); i++) {
+        const CTransaction& tx = blockSpend.vtx[i];
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const CTxInUndo& undo = txundo.vprevout[j];
+            forkSpends.mapOutputs[tx.vin[j].prevout] = undo.txout;
+            if (undo.nHeight > 0)
+                forkSpends.mapHeights[tx.vin[j].prevout.hash] = undo.nHeight;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find prevout among the inputs spent by the blocks of the active chain
+ * after its fork with pindexPrev. A block on a fork may stake an output
+ * the active chain has spent since, and whose transaction is in a pruned
+ * block file; pruning keeps the blocks and undo data of the reorg window,
+ * and the undo data holds the output. The height comes with the spend of
+ * the last output of its transaction, if that is in the window too. The
+ * blocks after a fork point are read once for all the blocks on that fork.
+ */
+bool FindSpentOutput(const COutPoint& prevout, const CBlockIndex* pindexPrev, CTxOut& txOut, bool& fHaveOut, int& nHeightFrom)
+{
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexPrev);
+    if (!pindexFork)
+        return false;
+    if (forkSpends.pindexFork != pindexFork || !chainActive.Contains(forkSpends.pindexLast)) {
+        forkSpends = CForkSpends();
+        forkSpends.pindexFork = forkSpends.pindexLast = pindexFork;
+    }
+    // Stops at a block whose data is missing, which a later lookup retries
+    for (const CBlockIndex* pindex = chainActive.Next(forkSpends.pindexLast); pindex && ReadForkSpends(pindex); pindex = chainActive.Next(pindex))
+        forkSpends.pindexLast = pindex;
+
+    if (!fHaveOut) {
+        std::map<COutPoint, CTxOut>::const_iterator it = forkSpends.mapOutputs.find(prevout);
+        if (it != forkSpends.mapOutputs.end()) {
+            txOut = it->second;
+            fHaveOut = true;
+        }
+    }
+    if (nHeightFrom < 0) {
+        std::map<uint256, int>::const_iterator it = forkSpends.mapHeights.find(prevout.hash);
+        if (it != forkSpends.mapHeights.end())
+            nHeightFrom = it->second;
+    }
+    // Spendable on both chains only if created before they forked
+    return fHaveOut && nHeightFrom >= 0 && nHeightFrom <= pindexFork->nHeight;
+}
+
+/**
+ * Find the output staked by the coinstake of a block on top of pindexPrev,
+ * and the block of that chain that created it, without reading blocks. The
+ * coins view holds the output while it is unspent, and the height of its
+ * transaction while any output of it is. Once the block itself has been
+ * connected, its undo data holds the output, and the height too if the
+ * block spent the last output of the transaction. For a block on a fork,
+ * the output may have been spent by the active chain, see FindSpentOutput.
+ */
+bool GetStakeOrigin(const CBlock& block, const CBlockIndex* pindexPrev, CTxOut& txOut, CBlockIndex*& pindexFrom)
+{
+    AssertLockHeld(cs_main);
+    const COutPoint& prevout = block.vtx[1].vin[0].prevout;
+    std::map<COutPoint, CStakeOrigin>::const_iterator it = mapStakeOrigins.find(prevout);
+    if (it != mapStakeOrigins.end() && pindexPrev->GetAncestor(it->second.pindexFrom->nHeight) == it->second.pindexFrom) {
+        txOut = it->second.txOut;
+        pindexFrom = it->second.pindexFrom;
+        return true;
+    }
+
+    bool fHaveOut = false;
+    int nHeightFrom = -1;
+    const CCoins* coins = pcoinsTip->AccessCoins(prevout.hash);
+    if (coins && !coins->IsPruned()) {
+        // Only if the transaction is also in the chain of pindexPrev
+        CBlockIndex* pindex = chainActive[coins->nHeight];
+        if (pindex && pindexPrev->GetAncestor(coins->nHeight) == pindex) {
+            nHeightFrom = coins->nHeight;
+            if (coins->IsAvailable(prevout.n)) {
+                txOut = coins->vout[prevout.n];
+                fHaveOut = true;
+            }
+        }
+    }
+    if (!fHaveOut || nHeightFrom < 0) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(block.GetHash());
+        CBlockIndex* pindex = mi == mapBlockIndex.end() ? NULL : mi->second;
+        CBlockUndo blockUndo;
+        if (pindex && (pindex->nStatus & BLOCK_HAVE_UNDO) && pindex->pprev &&
+            blockUndo.ReadFromDisk(pindex->GetUndoPos(), pindex->pprev->GetBlockHash()) &&
+            !blockUndo.vtxundo.empty() && !blockUndo.vtxundo[0].vprevout.empty()) {
+            const CTxInUndo& undo = blockUndo.vtxundo[0].vprevout[0];
+            txOut = undo.txout;
+            fHaveOut = true;
+            if (undo.nHeight > 0)
+                nHeightFrom = undo.nHeight;
+        }
+    }
+    if ((!fHaveOut || nHeightFrom < 0) && !FindSpentOutput(prevout, pindexPrev, txOut, fHaveOut, nHeightFrom))
+        return false;
+    if (nHeightFrom < 0 || nHeightFrom > pindexPrev->nHeight)
+        return false;
+    pindexFrom = const_cast<CBlockIndex*>(pindexPrev->GetAncestor(nHeightFrom));
+
+    if (mapStakeOrigins.size() >= MAX_STAKE_ORIGINS)
+        mapStakeOrigins.clear();
+    CStakeOrigin& origin = mapStakeOrigins[prevout];
+    origin.txOut = txOut;
+    origin.pindexFrom = pindexFrom;
+    return true;
+}
+}
+
+void ClearStakeOrigins()
+{
+    LOCK(cs_main);
+    mapStakeOrigins.clear();
+    forkSpends = CForkSpends();
+}
+
+bool initStakeInput(const CBlock& block, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight) {
+    const CTransaction& tx = block.vtx[1];
     if (!tx.IsCoinStake())
         return error("%s : called on non-coinstake %s", __func__, tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
+    LOCK(cs_main);
+    BlockMap::const_iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+    if (mi == mapBlockIndex.end())
+        return error("%s : unknown previous block %s", __func__, block.hashPrevBlock.GetHex());
+    const CBlockIndex* pindexPrev = mi->second;
+
     //Construct the stakeinput object
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
-                     __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+    // Resolve the staked output from the coins database or the undo data
+    // first, which also works when the block files holding it have been
+    // pruned, then look for the previous transaction in the block files
+    CNbxStake* pivInput = new CNbxStake();
+    stake = std::unique_ptr<CStakeInput>(pivInput);
+    CTxOut txOutPrev;
+    CBlockIndex* pindexFrom = NULL;
+    if (GetStakeOrigin(block, pindexPrev, txOutPrev, pindexFrom)) {
+        pivInput->SetInput(txin.prevout, txOutPrev, pindexFrom);
+    } else {
+        uint256 hashBlock;
+        CTransaction txPrev;
+        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true) || txin.prevout.n >= txPrev.vout.size())
+            return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
+                         __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+        txOutPrev = txPrev.vout[txin.prevout.n];
+        pivInput->SetInput(txPrev, txin.prevout.n);
+    }
 
     //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+    if (!VerifyScript(txin.scriptSig, txOutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
         return error("%s : VerifySignature failed on coinstake %s", __func__, tx.GetHash().ToString().c_str());
 
-    CNbxStake* pivInput = new CNbxStake();
-    pivInput->SetInput(txPrev, txin.prevout.n);
-    stake = std::unique_ptr<CStakeInput>(pivInput);
-
     return true;
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight)
+bool CheckProofOfStake(const CBlock& block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight)
 {
     // Initialize the stake object
     if(!initStakeInput(block, stake, nPreviousBlockHeight))
         return error("%s : stake input object initialization failed", __func__);
 
-    const CTransaction tx = block.vtx[1];
+    const CTransaction& tx = block.vtx[1];
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
-    CBlockIndex* pindexPrev = mapBlockIndex[block.hashPrevBlock];
+    CBlockIndex* pindexPrev = mapBlockIndex.at(block.hashPrevBlock);
     CBlockIndex* pindexfrom = stake->GetIndexFrom();
     if (!pindexfrom)
         return error("%s : Failed to find the block index for stake origin", __func__);
@@ -5,8 +5,14 @@
 #include "leveldbwrapper.h"
 
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,34 +33,163 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** Block cache that counts how many lookups it answers */
+class CCountingCache : public leveldb::Cache
 {
-    leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
-    if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
-        // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
-        // on corruption in later versions.
-        options.paranoid_checks = true;
+private:
+    leveldb::Cache* pcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    explicit CCountingCache(size_t nCapacity) : pcache(leveldb::NewLRUCache(nCapacity)), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete pcache; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value))
+    {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = pcache->Lookup(key);
+        if (handle)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+
+    void Release(Handle* handle) { pcache->Release(handle); }
+    void* Value(Handle* handle) { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice& key) { pcache->Erase(key); }
+    uint64_t NewId() { return pcache->NewId(); }
+    void Prune() { pcache->Prune(); }
+    size_t TotalCharge() const { return pcache->TotalCharge(); }
+};
+
+/** Environment that counts the background work LevelDB schedules, which is memory table flushes and compactions */
+class CCountingEnv : public leveldb::EnvWrapper
+{
+public:
+    std::atomic<uint64_t> nScheduled;
+
+    explicit CCountingEnv(leveldb::Env* penv) : leveldb::EnvWrapper(penv), nScheduled(0) {}
+
+    void Schedule(void (*function)(void* arg), void* arg)
+    {
+        nScheduled++;
+        target()->Schedule(function, arg);
+    }
+};
+
+namespace
+{
+boost::mutex csDatabases;
+//! Named databases currently open
+std::map<std::string, const CLevelDBWrapper*> mapDatabases;
+
+/** Apply one "<option>=<value>" of -dboption to options */
+bool ParseLevelDBOption(const std::string& strOption, CLevelDBOptions& options)
+{
+    size_t nEq = strOption.find('=');
+    if (nEq == std::string::npos)
+        return false;
+    std::string strKey = strOption.substr(0, nEq);
+    int64_t nValue;
+    if (!ParseInt64(strOption.substr(nEq + 1), &nValue) || nValue < 0)
+        return false;
+    if (strKey == "filterbits" && nValue <= 64)
+        options.nFilterBits = nValue;
+    else if (strKey == "blocksize" && nValue >= 1024 && nValue <= 64 * 1024 * 1024)
+        options.nBlockSize = nValue;
+    else if (strKey == "writebuffer" && nValue <= 1024 * 1024 * 1024)
+        options.nWriteBufferSize = nValue;
+    else if (strKey == "compression" && nValue <= 1)
+        options.fCompression = nValue;
+    else if (strKey == "maxopenfiles" && nValue >= 16 && nValue <= 100000)
+        options.nMaxOpenFiles = nValue;
+    else if (strKey == "verifychecksums" && nValue <= 1)
+        options.fVerifyChecksums = nValue;
+    else
+        return false;
+    return true;
+}
+}
+
+const std::vector<std::string>& GetLevelDBNames()
+{
+    static const std::vector<std::string> vNames = {"chainstate", "index", "sporks"};
+    return vNames;
+}
+
+CLevelDBOptions GetLevelDBOptions(const std::string& strName)
+{
+    CLevelDBOptions options;
+    if (strName.empty())
+        return options;
+    // Those for all databases first, so the ones for this database override them
+    for (const std::string& strPrefix : {std::string("all."), strName + "."}) {
+        for (const std::string& strArg : mapMultiArgs["-dboption"]) {
+            if (strArg.compare(0, strPrefix.size(), strPrefix) == 0)
+                ParseLevelDBOption(strArg.substr(strPrefix.size()), options);
+        }
     }
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+bool CheckLevelDBOptions(std::string& strInvalid)
+{
+    const std::vector<std::string>& vNames = GetLevelDBNames();
+    for (const std::string& strArg : mapMultiArgs["-dboption"]) {
+        size_t nDot = strArg.find('.');
+        std::string strName = strArg.substr(0, nDot);
+        CLevelDBOptions options;
+        if (nDot == std::string::npos || (strName != "all" && std::find(vNames.begin(), vNames.end(), strName) == vNames.end()) ||
+            !ParseLevelDBOption(strArg.substr(nDot + 1), options)) {
+            strInvalid = strArg;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::pair<std::string, CLevelDBStats> > GetLevelDBStats()
+{
+    std::vector<std::pair<std::string, CLevelDBStats> > vStats;
+    boost::mutex::scoped_lock lock(csDatabases);
+    for (const std::pair<const std::string, const CLevelDBWrapper*>& item : mapDatabases) {
+        vStats.push_back(std::make_pair(item.first, CLevelDBStats()));
+        item.second->GetStats(vStats.back().second);
+    }
+    return vStats;
+}
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSizeIn, bool fMemory, bool fWipe, const std::string& strNameIn)
+    : strName(strNameIn), dboptions(GetLevelDBOptions(strNameIn)), nCacheSize(nCacheSizeIn)
 {
     penv = NULL;
-    readoptions.verify_checksums = true;
+    readoptions.verify_checksums = dboptions.fVerifyChecksums;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    pcache = new CCountingCache(nCacheSize / 2);
+    options.block_cache = pcache;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = dboptions.nWriteBufferSize ? dboptions.nWriteBufferSize : nCacheSize / 4;
+    options.filter_policy = dboptions.nFilterBits ? leveldb::NewBloomFilterPolicy(dboptions.nFilterBits) : NULL;
+    options.block_size = dboptions.nBlockSize;
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
+    if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
+        // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
+        // on corruption in later versions.
+        options.paranoid_checks = true;
+    }
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
-        options.env = penv;
     } else {
         if (fWipe) {
             LogPrintf("Wiping LevelDB in %s\n", path.string());
@@ -63,23 +198,60 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
+    pcountingenv = new CCountingEnv(penv ? penv : leveldb::Env::Default());
+    options.env = pcountingenv;
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+
+    if (!strName.empty()) {
+        boost::mutex::scoped_lock lock(csDatabases);
+        mapDatabases[strName] = this;
+    }
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    if (!strName.empty()) {
+        boost::mutex::scoped_lock lock(csDatabases);
+        if (mapDatabases[strName] == this)
+            mapDatabases.erase(strName);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
-    delete options.block_cache;
+    delete pcache;
     options.block_cache = NULL;
+    delete pcountingenv;
     delete penv;
     options.env = NULL;
 }
 
+void CLevelDBWrapper::GetStats(CLevelDBStats& stats) const
+{
+    stats.options = dboptions;
+    stats.options.nWriteBufferSize = options.write_buffer_size;
+    stats.nCacheSize = nCacheSize;
+
+    // Everything from the empty key on
+    std::string strEnd(64, '\xff');
+    leveldb::Slice slBegin;
+    leveldb::Range range(slBegin, leveldb::Slice(strEnd));
+    pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+
+    std::string strValue;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+    for (int nLevel = 0; pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), &strValue); nLevel++)
+        stats.vFilesPerLevel.push_back(atoi(strValue));
+    pdb->GetProperty("leveldb.stats", &stats.strStats);
+
+    stats.nCompactions = pcountingenv->nScheduled;
+    stats.nCacheHits = pcache->nHits;
+    stats.nCacheMisses = pcache->nMisses;
+}
+
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -11,11 +11,18 @@
 #include "util.h"
 #include "version.h"
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+class CCountingCache;
+class CCountingEnv;
+
 class leveldb_error : public std::runtime_error
 {
 public:
@@ -24,6 +31,57 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+/**
+ * Tuning of one database. The defaults are what every database used before
+ * they could be set with -dboption=<database>.<option>=<value>.
+ */
+struct CLevelDBOptions {
+    //! Bits per key of the bloom filters, 0 for none
+    int nFilterBits;
+    //! Approximate size of uncompressed data blocks
+    size_t nBlockSize;
+    //! Size of the memory table, 0 for a quarter of the cache
+    size_t nWriteBufferSize;
+    //! Snappy compression of data blocks, if LevelDB was built with it
+    bool fCompression;
+    int nMaxOpenFiles;
+    //! Verify the checksums of the blocks read by point lookups
+    bool fVerifyChecksums;
+
+    CLevelDBOptions() : nFilterBits(10), nBlockSize(4096), nWriteBufferSize(0), fCompression(false), nMaxOpenFiles(64), fVerifyChecksums(true) {}
+};
+
+/** Names of the databases -dboption applies to */
+const std::vector<std::string>& GetLevelDBNames();
+
+/** The options of database strName, with the -dboption arguments for it or for "all" applied */
+CLevelDBOptions GetLevelDBOptions(const std::string& strName);
+
+/** Check the -dboption arguments; false with strInvalid set to the first invalid one */
+bool CheckLevelDBOptions(std::string& strInvalid);
+
+/** Internals of an open database, as reported by getdbstats */
+struct CLevelDBStats {
+    CLevelDBOptions options;
+    size_t nCacheSize;
+    //! Approximate size of all data on disk
+    uint64_t nApproximateSize;
+    //! Memory used by memory tables and the block cache
+    uint64_t nMemoryUsage;
+    std::vector<int> vFilesPerLevel;
+    //! Background work scheduled: memory table flushes and compactions
+    uint64_t nCompactions;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    //! LevelDB's own compaction table
+    std::string strStats;
+
+    CLevelDBStats() : nCacheSize(0), nApproximateSize(0), nMemoryUsage(0), nCompactions(0), nCacheHits(0), nCacheMisses(0) {}
+};
+
+/** Stats of the named databases currently open, by name */
+std::vector<std::pair<std::string, CLevelDBStats> > GetLevelDBStats();
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -67,6 +125,20 @@ private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
+    //! environment counting the background work, wrapping penv or the default one
+    CCountingEnv* pcountingenv;
+
+    //! block cache counting its hits
+    CCountingCache* pcache;
+
+    //! name for -dboption and getdbstats, empty for unnamed databases
+    std::string strName;
+
+    //! tuning the database was opened with
+    CLevelDBOptions dboptions;
+
+    size_t nCacheSize;
+
     //! database options used
     leveldb::Options options;
 
@@ -86,9 +158,11 @@ private:
     leveldb::DB* pdb;
 
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSizeIn, bool fMemory = false, bool fWipe = false, const std::string& strNameIn = "");
     ~CLevelDBWrapper();
 
+    void GetStats(CLevelDBStats& stats) const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -149,6 +223,21 @@ public:
         return WriteBatch(batch, fSync);
     }
 
+    //! Approximate size on disk of the keys in [key_begin, key_end); may be 0 for data not yet compacted
+    template <typename K>
+    size_t EstimateSize(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(&ssKey1[0], ssKey1.size());
+        leveldb::Slice slKey2(&ssKey2[0], ssKey2.size());
+        uint64_t size = 0;
+        leveldb::Range range(slKey1, slKey2);
+        pdb->GetApproximateSizes(&range, 1, &size);
+        return size;
+    }
+
     bool WriteBatch(CLevelDBBatch& batch, bool fSync = false);
 
     // not available for LevelDB; provide for compatibility with BDB
@@ -0,0 +1,156 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logwriter.h"
+
+#include "tinyformat.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+
+/** Milliseconds the writer thread waits for messages before it looks again */
+static const int LOG_WRITER_INTERVAL = 100;
+/** Most milliseconds Stop waits for loggers that saw the writer running to queue their message */
+static const int LOG_STOP_WAIT = 1000;
+
+CLogWriter::CLogWriter(const Sink& sinkIn, size_t nMaxQueuedBytesIn) : sink(sinkIn), nMaxQueuedBytes(nMaxQueuedBytesIn),
+    pqueue(NULL), nQueuedBytes(0), nDropped(0), pbatch(NULL), fRunning(false), nQueuing(0), pthreadWriter(NULL)
+{
+}
+
+CLogWriter::~CLogWriter()
+{
+    Stop();
+    for (CLogEntry* pentry = TakeQueue(); pentry != NULL;) {
+        CLogEntry* pnext = pentry->pnext;
+        delete pentry;
+        pentry = pnext;
+    }
+}
+
+void CLogWriter::Start()
+{
+    if (fRunning)
+        return;
+    fRunning = true;
+    pthreadWriter = new boost::thread(boost::bind(&CLogWriter::ThreadWriter, this));
+}
+
+void CLogWriter::Stop()
+{
+    if (!fRunning.exchange(false))
+        return;
+    {
+        boost::mutex::scoped_lock scoped_lock(mutexWake);
+        condQueued.notify_one();
+    }
+    pthreadWriter->join();
+    delete pthreadWriter;
+    pthreadWriter = NULL;
+
+    // Loggers that saw the writer running just before it stopped still queue
+    // their message; one that is not done in time leaves it for the next Flush
+    {
+        boost::mutex::scoped_lock scoped_lock(mutexWake);
+        boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(LOG_STOP_WAIT);
+        while (nQueuing > 0) {
+            if (!condQueuingDone.timed_wait(scoped_lock, timeout))
+                break;
+        }
+    }
+    Flush();
+}
+
+void CLogWriter::DoneQueuing()
+{
+    if (--nQueuing == 0 && !fRunning) {
+        boost::mutex::scoped_lock scoped_lock(mutexWake);
+        condQueuingDone.notify_all();
+    }
+}
+
+bool CLogWriter::Queue(const std::string& str, int64_t nTime)
+{
+    nQueuing++;
+    if (!fRunning) {
+        DoneQueuing();
+        return false;
+    }
+    // Dropped rather than queued without bound if the writer cannot keep up
+    if (nQueuedBytes + str.size() > nMaxQueuedBytes) {
+        nDropped++;
+        DoneQueuing();
+        return true;
+    }
+    nQueuedBytes += str.size();
+    CLogEntry* pentry = new CLogEntry();
+    pentry->nTime = nTime;
+    pentry->str = str;
+    pentry->pnext = pqueue.load();
+    while (!pqueue.compare_exchange_weak(pentry->pnext, pentry)) {
+    }
+    // Loggers only signal a queue they found empty, and do so without the lock, so a wakeup may be missed
+    if (pentry->pnext == NULL)
+        condQueued.notify_one();
+    DoneQueuing();
+    return true;
+}
+
+CLogEntry* CLogWriter::TakeQueue()
+{
+    CLogEntry* pentry = pqueue.exchange(NULL);
+    CLogEntry* pfirst = NULL;
+    while (pentry != NULL) {
+        CLogEntry* pnext = pentry->pnext;
+        pentry->pnext = pfirst;
+        pfirst = pentry;
+        pentry = pnext;
+    }
+    return pfirst;
+}
+
+void CLogWriter::Flush()
+{
+    boost::mutex::scoped_lock scoped_lock(mutexBatch);
+    CLogEntry* pfirst = TakeQueue();
+    size_t nBytes = 0;
+    CLogEntry** ppnext = &pfirst;
+    for (; *ppnext != NULL; ppnext = &(*ppnext)->pnext)
+        nBytes += (*ppnext)->str.size();
+    uint64_t nDroppedBatch = nDropped.exchange(0);
+    if (nDroppedBatch) {
+        *ppnext = new CLogEntry();
+        (*ppnext)->pnext = NULL;
+        (*ppnext)->nTime = GetTime();
+        (*ppnext)->str = strprintf("%u log messages dropped, the log writer fell behind\n", nDroppedBatch);
+    }
+    if (pfirst == NULL)
+        return;
+
+    pbatch = pfirst;
+    sink(pfirst);
+    pbatch = NULL;
+    nQueuedBytes -= nBytes;
+    while (pfirst != NULL) {
+        CLogEntry* pnext = pfirst->pnext;
+        delete pfirst;
+        pfirst = pnext;
+    }
+}
+
+void CLogWriter::ThreadWriter()
+{
+    RenameThread("logwriter");
+    while (true) {
+        bool fWasRunning = fRunning;
+        Flush();
+        if (!fWasRunning)
+            return;
+
+        boost::mutex::scoped_lock scoped_lock(mutexWake);
+        if (pqueue.load() == NULL && fRunning)
+            condQueued.timed_wait(scoped_lock, boost::posix_time::milliseconds(LOG_WRITER_INTERVAL));
+    }
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LOGWRITER_H
+#define BITCOIN_LOGWRITER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** A message queued for a CLogWriter, and the time it was logged */
+struct CLogEntry {
+    CLogEntry* pnext;
+    int64_t nTime;
+    std::string str;
+};
+
+/**
+ * Writes log messages in batches from a thread of its own. Loggers queue
+ * messages on a lock-free list; the thread takes the whole list at once and
+ * hands it, oldest first, to the sink.
+ */
+class CLogWriter
+{
+public:
+    //! Writes a batch of messages, linked oldest first
+    typedef boost::function<void(const CLogEntry*)> Sink;
+
+private:
+    const Sink sink;
+    //! Most bytes of messages queued; more are dropped
+    const size_t nMaxQueuedBytes;
+
+    //! Queued messages, newest first
+    std::atomic<CLogEntry*> pqueue;
+    std::atomic<size_t> nQueuedBytes;
+    std::atomic<uint64_t> nDropped;
+    //! The batch handed to the sink
+    std::atomic<const CLogEntry*> pbatch;
+    std::atomic<bool> fRunning;
+    //! Loggers that may have seen fRunning set and not yet queued their message
+    std::atomic<int> nQueuing;
+
+    //! Only one batch is written at a time
+    boost::mutex mutexBatch;
+    boost::mutex mutexWake;
+    boost::condition_variable condQueued;
+    boost::condition_variable condQueuingDone;
+    boost::thread* pthreadWriter;
+
+    CLogWriter(const CLogWriter&);
+    CLogWriter& operator=(const CLogWriter&);
+
+    void ThreadWriter();
+    void DoneQueuing();
+
+public:
+    CLogWriter(const Sink& sinkIn, size_t nMaxQueuedBytesIn);
+    //! Stops the writer; messages still queued are freed without being written
+    ~CLogWriter();
+
+    void Start();
+    /** Write out the queued messages and stop the thread */
+    void Stop();
+    bool IsRunning() const { return fRunning; }
+
+    /**
+     * Queue a message logged at nTime, or drop it if the queue is full.
+     * Returns false if the writer is not running, in which case the caller
+     * writes the message itself.
+     */
+    bool Queue(const std::string& str, int64_t nTime);
+    /** Hand the queued messages to the sink now, followed by a notice of the dropped ones */
+    void Flush();
+
+    /**
+     * For a crash handler: the batch the sink is writing, and the messages
+     * queued after it, oldest first. Neither locks nor allocates.
+     */
+    const CLogEntry* GetBatch() const { return pbatch; }
+    CLogEntry* TakeQueue();
+};
+
+#endif // BITCOIN_LOGWRITER_H
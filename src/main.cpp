@@ -10,10 +10,13 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilemap.h"
 #include "blocksignature.h"
 #include "chainparams.h"
+#include "chainstatus.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
 #include "dappstore/dappstore.h"
 #include "init.h"
 #include "kernel.h"
@@ -32,6 +35,7 @@
 #include "guiinterface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 #include "wallet/wallet.h"
 
@@ -44,6 +48,7 @@
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <memory>
 #include <queue>
 
 #if defined(NDEBUG)
@@ -57,6 +62,7 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+//! Proof-of-stake hashes of accepted blocks, kept here rather than in CBlockIndex
 std::map<uint256, uint256> mapProofOfStake;
 std::map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
@@ -71,6 +77,13 @@ bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
+std::atomic<bool> fBlockDatabaseVerified(true);
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
+bool fMapBlockFiles = DEFAULT_MAP_BLOCK_FILES;
+bool fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+uint256 hashAssumeValid;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
 bool fPreventBestBlockSaving = false;
@@ -96,6 +109,7 @@ struct COrphanTx {
 };
 std::map<uint256, COrphanTx> mapOrphanTransactions;
 std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+CCriticalSection cs_mapRejectedBlocks;
 std::map<uint256, int64_t> mapRejectedBlocks;
 
 void EraseOrphansFor(NodeId peer);
@@ -182,6 +196,57 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/**
+ * Global flag to indicate we should check to see if there are
+ * block/undo files that should be deleted.  Set on startup
+ * or if we allocate more file space when we're in prune mode
+ */
+bool fCheckForPruning = false;
+
+/** Lowest height from which on the blocks of the active chain are on disk, updated when files are pruned */
+std::atomic<int> nPruneHeight(0);
+
+/**
+ * Block index entries are only ever freed all together, so they are carved
+ * out of large chunks instead of being allocated one by one. This saves the
+ * per-allocation overhead and keeps entries of consecutive blocks close in
+ * memory. Protected by cs_main.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_ENTRIES = 4096;
+    std::vector<CBlockIndex*> vChunks;
+    size_t nUsedInLastChunk;
+
+public:
+    CBlockIndexArena() : nUsedInLastChunk(CHUNK_ENTRIES) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    CBlockIndex* Allocate()
+    {
+        if (nUsedInLastChunk == CHUNK_ENTRIES) {
+            vChunks.push_back(new CBlockIndex[CHUNK_ENTRIES]);
+            nUsedInLastChunk = 0;
+        }
+        return &vChunks.back()[nUsedInLastChunk++];
+    }
+
+    void Clear()
+    {
+        for (CBlockIndex* pchunk : vChunks)
+            delete[] pchunk;
+        vChunks.clear();
+        nUsedInLastChunk = CHUNK_ENTRIES;
+    }
+
+    size_t DynamicMemoryUsage() const { return vChunks.size() * CHUNK_ENTRIES * sizeof(CBlockIndex); }
+};
+CBlockIndexArena blockIndexArena;
+
+/** Stake inputs of proof-of-stake entries not yet written to the block tree database. Protected by cs_main. */
+std::map<const CBlockIndex*, COutPoint> mapUnwrittenStakePrevouts;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -531,7 +596,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
@@ -607,9 +672,13 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewPrefetch* pcoinsPrefetch = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
 
+/** Statistics of the UTXO set in pcoinsTip, when their hashBlock matches its best block (protected by cs_main) */
+static CUtxoStats utxoStats;
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1456,13 +1525,163 @@ bool GetOutput(const uint256& hash, unsigned int index, CTxOut& out)
     return true;
 }
 
+bool GetUnspentOutput(const COutPoint& outpoint, CTxOut& out, CBlockIndex** ppindexFrom)
+{
+    LOCK(cs_main);
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    if (!coins || !coins->IsAvailable(outpoint.n))
+        return false;
+    out = coins->vout[outpoint.n];
+    if (ppindexFrom)
+        *ppindexFrom = chainActive[coins->nHeight];
+    return true;
+}
+
+namespace
+{
+CBlockFileMapCache blockFileMaps(MAX_MAPPED_BLOCK_FILES);
+
+/**
+ * Map the block file holding the block at pos and delimit the data stored
+ * for it by the size written in front of it. Null if mapping is disabled or
+ * fails, in which case the block is read from the file instead.
+ */
+std::shared_ptr<const CMappedFile> MapBlock(const CDiskBlockPos& pos, const char*& pBegin, const char*& pEnd, bool& fCompressed)
+{
+    std::shared_ptr<const CMappedFile> file;
+    unsigned int nSize;
+    if (!fMapBlockFiles || pos.IsNull() || pos.nPos < sizeof(nSize))
+        return file;
+    file = blockFileMaps.Get(pos.nFile, GetBlockPosFilename(pos, "blk"), pos.nPos);
+    if (!file)
+        return file;
+    CSpanReader(file->data() + pos.nPos - sizeof(nSize), file->data() + pos.nPos, SER_DISK, CLIENT_VERSION) >> nSize;
+    fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+    nSize &= ~BLOCK_COMPRESSED_FLAG;
+    if ((uint64_t)pos.nPos + nSize > file->size()) {
+        file = blockFileMaps.Get(pos.nFile, GetBlockPosFilename(pos, "blk"), (uint64_t)pos.nPos + nSize);
+        if (!file)
+            return file;
+    }
+    pBegin = file->data() + pos.nPos;
+    pEnd = pBegin + nSize;
+    return file;
+}
+
+void SkipBytes(CAutoFile& file, unsigned int nSize)
+{
+    if (fseek(file.Get(), nSize, SEEK_CUR))
+        throw std::ios_base::failure("CAutoFile::seek : fseek failed");
+}
+
+template <typename Stream>
+void SkipBytes(Stream& s, unsigned int nSize)
+{
+    s.ignore(nSize);
+}
+
+/** Deserializes a whole block */
+struct CBlockReader {
+    CBlock& block;
+
+    explicit CBlockReader(CBlock& blockIn) : block(blockIn) {}
+
+    template <typename Stream>
+    void operator()(Stream& s) { s >> block; }
+};
+
+/** Deserializes the header of a block and the transaction at nTxOffset after it */
+struct CBlockTxReader {
+    CBlockHeader& header;
+    CTransaction& tx;
+    unsigned int nTxOffset;
+
+    CBlockTxReader(CBlockHeader& headerIn, CTransaction& txIn, unsigned int nTxOffsetIn) : header(headerIn), tx(txIn), nTxOffset(nTxOffsetIn) {}
+
+    template <typename Stream>
+    void operator()(Stream& s)
+    {
+        s >> header;
+        SkipBytes(s, nTxOffset);
+        s >> tx;
+    }
+};
+
+/**
+ * Pass the serialization of the block stored at pos to reader: straight from
+ * the mapped block file if possible, otherwise from the file itself, and
+ * through an inflated copy if it is stored compressed. Deserialization
+ * errors are thrown.
+ */
+template <typename Reader>
+bool ReadStoredBlock(const CDiskBlockPos& pos, Reader& reader)
+{
+    const char* pBegin;
+    const char* pEnd;
+    bool fCompressed;
+    std::shared_ptr<const CMappedFile> mapped = MapBlock(pos, pBegin, pEnd, fCompressed);
+    if (mapped) {
+        if (fCompressed) {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            if (!DecompressBlockData(pBegin, pEnd, ssBlock))
+                return error("%s : corrupt compressed block in blk%05u.dat at %u", __func__, pos.nFile, pos.nPos);
+            reader(ssBlock);
+        } else {
+            CSpanReader s(pBegin, pEnd, SER_DISK, CLIENT_VERSION);
+            reader(s);
+        }
+        return true;
+    }
+
+    // Open history file to read, at the size in front of the block
+    unsigned int nSize = 0;
+    CDiskBlockPos posSize(pos.nFile, pos.nPos >= sizeof(nSize) ? pos.nPos - sizeof(nSize) : pos.nPos);
+    CAutoFile filein(OpenBlockFile(posSize, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+    if (posSize.nPos != pos.nPos)
+        filein >> nSize;
+    if (nSize & BLOCK_COMPRESSED_FLAG) {
+        nSize &= ~BLOCK_COMPRESSED_FLAG;
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : invalid compressed block size %u in blk%05u.dat at %u", __func__, nSize, pos.nFile, pos.nPos);
+        std::vector<char> vchFrame(nSize);
+        filein.read(&vchFrame[0], vchFrame.size());
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        if (!DecompressBlockData(vchFrame.data(), vchFrame.data() + vchFrame.size(), ssBlock))
+            return error("%s : corrupt compressed block in blk%05u.dat at %u", __func__, pos.nFile, pos.nPos);
+        reader(ssBlock);
+    } else {
+        reader(filein);
+    }
+    return true;
+}
+
+/** Read the size and format written in front of the block stored at pos */
+bool ReadStoredBlockSize(const CDiskBlockPos& pos, unsigned int& nSize, bool& fCompressed)
+{
+    if (pos.nPos < sizeof(nSize))
+        return error("%s : invalid position %u in blk%05u.dat", __func__, pos.nPos, pos.nFile);
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(nSize)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+    try {
+        filein >> nSize;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+    nSize &= ~BLOCK_COMPRESSED_FLAG;
+    return true;
+}
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
     CBlockIndex* pindexSlow = blockIndex;
 
-    LOCK(cs_main);
-
+    // cs_main is only needed for the coins and block index lookups, the disk reads go without it
     if (!blockIndex) {
         if (mempool.lookup(hash, txOut)) {
             return true;
@@ -1471,14 +1690,11 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
+                CBlockTxReader reader(header, txOut, postx.nTxOffset);
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    if (!ReadStoredBlock(postx, reader))
+                        return false;
                 } catch (std::exception& e) {
                     return error("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1493,6 +1709,7 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            LOCK(cs_main);
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -1505,9 +1722,16 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
     }
 
-    if (pindexSlow) {
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (pindexSlow && (pindexSlow->nStatus & BLOCK_HAVE_DATA))
+            pos = pindexSlow->GetBlockPos();
+    }
+
+    if (!pos.IsNull()) {
         CBlock block;
-        if (ReadBlockFromDisk(block, pindexSlow)) {
+        if (ReadBlockFromDisk(block, pos) && block.GetHash() == pindexSlow->GetBlockHash()) {
             for (const CTransaction& tx : block.vtx) {
                 if (tx.GetHash() == hash) {
                     txOut = tx;
@@ -1527,7 +1751,16 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
+void CStoredBlock::Set(const CBlock& block)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+    fCompressed = fCompressBlocks && CompressBlockData(&ssBlock[0], &ssBlock[0] + ssBlock.size(), vchData);
+    if (!fCompressed)
+        vchData.assign(ssBlock.begin(), ssBlock.end());
+}
+
+bool WriteBlockToDisk(const CStoredBlock& stored, CDiskBlockPos& pos)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1535,7 +1768,9 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
         return error("WriteBlockToDisk : OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = fileout.GetSerializeSize(block);
+    unsigned int nSize = stored.vchData.size();
+    if (stored.fCompressed)
+        nSize |= BLOCK_COMPRESSED_FLAG;
     fileout << FLATDATA(Params().MessageStart()) << nSize;
 
     // Write block
@@ -1543,7 +1778,7 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     if (fileOutPos < 0)
         return error("WriteBlockToDisk : ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write(stored.vchData.data(), stored.vchData.size());
 
     return true;
 }
@@ -1552,14 +1787,11 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
     // Read block
+    CBlockReader reader(block);
     try {
-        filein >> block;
+        if (!ReadStoredBlock(pos, reader))
+            return false;
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1795,13 +2027,13 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase()) {
         if (pvChecks)
@@ -1862,13 +2094,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Inputs checked right here share their signature hash data; the
+            // caller provides it for checks queued to run later
+            std::unique_ptr<PrecomputedTransactionData> txdataLocal;
+            if (!txdata && !pvChecks && tx.vin.size() >= SIGHASH_PRECOMPUTE_MIN_INPUTS) {
+                txdataLocal.reset(new PrecomputedTransactionData(tx));
+                txdata = txdataLocal.get();
+            }
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1881,7 +2120,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1901,7 +2140,32 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+{
+    bool fClean = true;
+    CCoinsModifier coins = view.ModifyCoins(out.hash);
+    if (undo.nHeight != 0) {
+        // undo data contains height: this is the last output of the prevout tx being spent
+        if (!coins->IsPruned())
+            fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
+        coins->Clear();
+        coins->fCoinBase = undo.fCoinBase;
+        coins->fCoinStake = undo.fCoinStake;
+        coins->nHeight = undo.nHeight;
+        coins->nVersion = undo.nVersion;
+    } else {
+        if (coins->IsPruned())
+            fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+    }
+    if (coins->IsAvailable(out.n))
+        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
+    if (coins->vout.size() < out.n + 1)
+        coins->vout.resize(out.n + 1);
+    coins->vout[out.n] = undo.txout;
+    return fClean;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CUtxoStats* pstats)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1927,6 +2191,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         const CTransaction& tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (pstats)
+            pstats->BeginTx(tx, view, pindex->nHeight, false);
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
@@ -1955,32 +2222,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock() : transaction and undo data inconsistent - txundo.vprevout.siz=%d tx.vin.siz=%d", txundo.vprevout.size(), tx.vin.size());
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
-                const COutPoint& out = tx.vin[j].prevout;
-                const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
-                }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
+                if (!ApplyTxInUndo(txundo.vprevout[j], view, tx.vin[j].prevout))
+                    fClean = false;
             }
         }
+
+        if (pstats)
+            pstats->EndTx(tx, view, false);
     }
 
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
+    if (pstats)
+        pstats->hashBlock = pindex->pprev->GetBlockHash();
 
     if (pfClean) {
         *pfClean = fClean;
@@ -1998,8 +2252,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            blockFileMaps.Evict(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2029,7 +2285,40 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+/** Whether the last block connected skipped its script checks, to log when that changes */
+static bool fSkippingScripts = false;
+
+/**
+ * Whether the scripts of pindex need not be verified because it is an ancestor
+ * of the -assumevalid block. Blocks are downloaded without their headers, so
+ * that block is usually not known yet during the initial download. Until it
+ * is, an -assumevalid block that is a checkpoint covers the blocks up to its
+ * height, as the chain is held to the checkpoints on the way.
+ */
+static bool IsAssumedValid(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid == 0)
+        return false;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it != mapBlockIndex.end()) {
+        const CBlockIndex* pindexAssumeValid = it->second;
+        if (pindexAssumeValid->GetAncestor(pindex->nHeight) != pindex)
+            return false;
+        // Not if the best header chain left it
+        return pindexBestHeader && pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) == pindexAssumeValid;
+    }
+    if (!Checkpoints::fEnabled)
+        return false;
+    const Checkpoints::MapCheckpoints& checkpoints = *Params().Checkpoints().mapCheckpoints;
+    for (Checkpoints::MapCheckpoints::const_iterator itCheckpoint = checkpoints.begin(); itCheckpoint != checkpoints.end(); ++itCheckpoint) {
+        if (itCheckpoint->second == hashAssumeValid)
+            return pindex->nHeight <= itCheckpoint->first;
+    }
+    return false;
+}
+
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, CUtxoStats* pstats)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2046,6 +2335,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().HashGenesisBlock()) {
         view.SetBestBlock(pindex->GetBlockHash());
+        if (pstats)
+            pstats->hashBlock = pindex->GetBlockHash();
         return true;
     }
 
@@ -2057,7 +2348,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    bool fScriptChecks = !IsAssumedValid(pindex);
+    if (!fJustCheck && fScriptChecks == fSkippingScripts) {
+        fSkippingScripts = !fScriptChecks;
+        if (fSkippingScripts)
+            LogPrintf("%s : skipping script verification from height %d, assuming ancestors of block %s are valid\n", __func__, pindex->nHeight, hashAssumeValid.GetHex());
+        else
+            LogPrintf("%s : verifying scripts from height %d\n", __func__, pindex->nHeight);
+    }
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2077,6 +2375,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"), REJECT_INVALID, "bad-txns-BIP30");
     }
 
+    // Shared by the script checks of each transaction with many inputs, which
+    // may still run until control is destroyed; reserved so they stay in place
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
@@ -2118,7 +2420,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             std::vector<CScriptCheck> vChecks;
             unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            const PrecomputedTransactionData* ptxdata = NULL;
+            if (fScriptChecks && tx.vin.size() >= SIGHASH_PRECOMPUTE_MIN_INPUTS) {
+                txdata.emplace_back(tx);
+                ptxdata = &txdata.back();
+            }
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL, ptxdata))
                 return false;
             control.Add(vChecks);
         }
@@ -2128,7 +2435,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
+        if (pstats)
+            pstats->BeginTx(tx, view, pindex->nHeight, true);
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        if (pstats)
+            pstats->EndTx(tx, view, true);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -2197,6 +2508,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
+    if (pstats)
+        pstats->hashBlock = pindex->GetBlockHash();
 
     int64_t nTime3 = GetTimeMicros();
     nTimeIndex += nTime3 - nTime2;
@@ -2214,6 +2527,126 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        blockFileMaps.Evict(*it);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Calculate the block/rev files that should be deleted to remain under target.
+ * Block files are pruned oldest first, and only once all of their blocks are
+ * deeper than both MIN_BLOCKS_TO_KEEP and the maximum reorganization depth,
+ * so that the undo data of any block that can still be disconnected is kept.
+ * Stake modifiers, stake inputs and masternode payments are resolved from the
+ * block index and the coins database, which are never pruned.
+ */
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0) {
+        return;
+    }
+    const int nKeep = std::max((int)MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth());
+    if (chainActive.Tip()->nHeight <= nKeep) {
+        return;
+    }
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - nKeep;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBytesToPrune;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within nKeep of the main chain's tip but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, count);
+}
+
+void static UpdatePruneHeight()
+{
+    const CBlockIndex* block = chainActive.Tip();
+    while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+        block = block->pprev;
+    nPruneHeight = block ? block->nHeight : 0;
+}
+
+int GetPruneHeight()
+{
+    return nPruneHeight;
+}
+
 enum FlushStateMode {
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
@@ -2229,8 +2662,21 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -2250,19 +2696,33 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                     vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CDiskBlockIndex> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    vBlocks.push_back(CDiskBlockIndex(*it));
+                    // An entry already on disk keeps the stake input stored with it the first time
+                    std::map<const CBlockIndex*, COutPoint>::iterator itStake = mapUnwrittenStakePrevouts.find(*it);
+                    if (itStake != mapUnwrittenStakePrevouts.end())
+                        vBlocks.back().prevoutStake = itStake->second;
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return state.Abort("Files to write to block index database");
                 }
+                // Every entry kept aside was dirty, so all of them are written now
+                mapUnwrittenStakePrevouts.clear();
+                // Finally remove any pruned files
+                if (fFlushForPrune) {
+                    UnlinkPrunedFiles(setFilesToPrune);
+                    UpdatePruneHeight();
+                }
             }
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            // Store the UTXO set statistics that belong to the flushed chainstate
+            if (utxoStats.hashBlock == pcoinsTip->GetBestBlock() && !pblocktree->WriteUtxoStatsState(utxoStats))
+                return state.Abort("Failed to write UTXO set statistics");
             // Update best block in wallet (so we can detect restored wallets).
             if (!fPreventBestBlockSaving && mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -2281,14 +2741,58 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED);
+}
+
+bool LoadUtxoStats(CCoinsViewDB* coinsview)
+{
+    LOCK(cs_main);
+    uint256 hashBest = coinsview->GetBestBlock();
+    if (utxoStats.hashBlock == hashBest)
+        return true;
+    if (pblocktree->ReadUtxoStatsState(utxoStats) && utxoStats.hashBlock == hashBest)
+        return true;
+
+    // Statistics of an older version or interrupted flush: start over from the current set
+    LogPrintf("Rebuilding UTXO set statistics, this may take a while...\n");
+    int64_t nStart = GetTimeMillis();
+    utxoStats = CUtxoStats();
+    if (!coinsview->GetUtxoStats(utxoStats))
+        return error("%s : scanning the coin database failed", __func__);
+    LogPrintf("UTXO set statistics rebuilt: %u transactions, %u outputs in %dms\n",
+        (unsigned int)utxoStats.nTransactions, (unsigned int)utxoStats.nTransactionOutputs, GetTimeMillis() - nStart);
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+    if (mi != mapBlockIndex.end() && !pblocktree->WriteUtxoStats(hashBest, utxoStats.GetStats(mi->second->nHeight)))
+        return false;
+    return pblocktree->WriteUtxoStatsState(utxoStats);
+}
+
+bool GetUtxoStats(const CBlockIndex* pindex, CCoinsStats& stats)
+{
+    AssertLockHeld(cs_main);
+    if (pblocktree->ReadUtxoStats(pindex->GetBlockHash(), stats))
+        return true;
+    if (pindex->GetBlockHash() != utxoStats.hashBlock)
+        return false;
+    stats = utxoStats.GetStats(pindex->nHeight);
+    return true;
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    UpdateKernelModifierIndex();
 
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
+    PublishChainTip(pindexNew, pindexBestHeader);
 
     LogPrintf("UpdateTip: new best=%s  height=%d version=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), chainActive.Tip()->nVersion, log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
@@ -2332,9 +2836,13 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CUtxoStats statsNew = utxoStats;
+        bool fStats = utxoStats.hashBlock == pindexDelete->GetBlockHash();
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, fStats ? &statsNew : NULL))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        if (fStats)
+            utxoStats = statsNew;
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -2357,6 +2865,8 @@ bool static DisconnectTip(CValidationState& state)
     for (const CTransaction& tx : block.vtx) {
         SyncWithWallets(tx, NULL);
     }
+    if (pindexDelete->pprev && pindexDelete->nDynamicMultiplier != pindexDelete->pprev->nDynamicMultiplier)
+        GetMainSignals().NotifyDynamicReward(pindexDelete, pindexDelete->pprev->nDynamicMultiplier, false);
     if (pdAppStore)
         pdAppStore->CancelVtx(block.vtx);
     return true;
@@ -2396,7 +2906,9 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        CUtxoStats statsNew = utxoStats;
+        bool fStats = utxoStats.hashBlock == (pindexNew->pprev ? pindexNew->pprev->GetBlockHash() : uint256(0));
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, fStats ? &statsNew : NULL);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2408,6 +2920,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        if (fStats) {
+            utxoStats = statsNew;
+            if (!pblocktree->WriteUtxoStats(pindexNew->GetBlockHash(), utxoStats.GetStats(pindexNew->nHeight)))
+                return state.Abort("Failed to write UTXO set statistics");
+        }
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -2438,6 +2955,9 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     for (const CTransaction& tx : pblock->vtx) {
         SyncWithWallets(tx, pblock);
     }
+    // Announced here rather than from ConnectBlock, which VerifyDB also runs
+    if (pindexNew->pprev && pindexNew->nDynamicMultiplier != pindexNew->pprev->nDynamicMultiplier)
+        GetMainSignals().NotifyDynamicReward(pindexNew, pindexNew->nDynamicMultiplier, true);
 
     if (pdAppStore)
         pdAppStore->ParseVtx(pblock->vtx, pblock->nTime);
@@ -2726,7 +3246,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
             uiInterface.NotifyBlockTip(hashNewTip);
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            GetMainSignals().UpdatedBlockTip(pindexNewTip, pblock && pblock->GetHash() == hashNewTip ? pblock : NULL);
 
             unsigned size = 0;
             if (pblock)
@@ -2827,8 +3347,10 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
+    if (block.IsProofOfStake())
+        mapUnwrittenStakePrevouts[pindexNew] = block.vtx[1].vin[0].prevout;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2845,20 +3367,10 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
         // ppcoin: compute stake entropy bit for stake modifier
         if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
-
         if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
             uint64_t nStakeModifier = 0;
             bool fGeneratedStakeModifier = false;
@@ -2916,8 +3428,10 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        PublishChainTip(chainActive.Tip(), pindexBestHeader);
+    }
 
     //update previous block pointer
     if (pindexNew->nHeight)
@@ -2976,7 +3490,7 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
-bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false)
+bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false, int nFormat = BLOCKFILE_FORMAT_RAW)
 {
     LOCK(cs_LastBlockFile);
 
@@ -3000,6 +3514,7 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
 
     nLastBlockFile = nFile;
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
+    vinfoBlockFile[nFile].nFormat = std::max(vinfoBlockFile[nFile].nFormat, nFormat);
     if (fKnown)
         vinfoBlockFile[nFile].nSize = std::max(pos.nPos + nAddSize, vinfoBlockFile[nFile].nSize);
     else
@@ -3009,6 +3524,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -3039,6 +3556,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -3063,7 +3582,7 @@ bool CheckBlockHeader(const CBlockHeader& block, int nHeight, CValidationState&
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, bool fCheckPayees)
 {
 
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -3149,12 +3668,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // ----------- swiftTX transaction scanning -----------
     for (const CTransaction& tx : block.vtx) {
-        if (!tx.IsCoinBase()) {
+        if (fCheckPayees && !tx.IsCoinBase()) {
             //only reject blocks when it's based on complete consensus
             for (const CTxIn& in : tx.vin) {
                 if (mapLockedInputs.count(in.prevout)) {
                     if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                        mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
+                        {
+                            LOCK(cs_mapRejectedBlocks);
+                            mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
+                        }
                         LogPrintf("%s : found conflicting transaction with transaction lock %s %s\n", __func__,
                                     mapLockedInputs[in.prevout].ToString(), tx.GetHash().GetHex());
                         return state.DoS(0, error("%s : found conflicting transaction with transaction lock", __func__),
@@ -3166,14 +3688,17 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     }
 
     // masternode payments
-    if (block.IsProofOfStake()) {
+    if (fCheckPayees && block.IsProofOfStake()) {
         // It is entierly possible that we don't have enough data and this could fail
         // (i.e. the block could indeed be valid). Store the block for later consideration
         // but issue an initial reject message.
         // The case also exists that the sending peer could not have enough data to see
         // that this block is invalid, so don't issue an outright ban.
         if (!IsBlockPayeeValid(block, nHeight, prevMoneySupply)) {
-            mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
+            {
+                LOCK(cs_mapRejectedBlocks);
+                mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
+            }
             return state.DoS(0, error("%s : Couldn't find some payments", __func__),
                     REJECT_INVALID, "bad-cb-payee");
         }
@@ -3201,7 +3726,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock& block, CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().GetHex());
@@ -3522,14 +4047,25 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
-        if (dbp != NULL)
+        CStoredBlock stored;
+        unsigned int nDiskSize;
+        bool fCompressed;
+        if (dbp != NULL) {
+            // Already stored, in whichever format it was written
             blockPos = *dbp;
-        if (!FindBlockPos(state, blockPos, nBlockSize + 8, nHeight, block.GetBlockTime(), dbp != NULL))
+            if (!ReadStoredBlockSize(blockPos, nDiskSize, fCompressed))
+                return error("AcceptBlock() : ReadStoredBlockSize failed");
+            nDiskSize += 8;
+        } else {
+            stored.Set(block);
+            nDiskSize = stored.GetDiskSize();
+            fCompressed = stored.fCompressed;
+        }
+        if (!FindBlockPos(state, blockPos, nDiskSize, nHeight, block.GetBlockTime(), dbp != NULL, fCompressed ? BLOCKFILE_FORMAT_COMPRESSED : BLOCKFILE_FORMAT_RAW))
             return error("AcceptBlock() : FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos))
+            if (!WriteBlockToDisk(stored, blockPos))
                 return state.Abort("Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock() : ReceivedBlockTransactions failed");
@@ -3589,6 +4125,27 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+/** Start reading the coins spent by a block that extends the tip, so they are at hand when it is connected */
+void static PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!pcoinsPrefetch || chainActive.Tip() == NULL || block.hashPrevBlock != chainActive.Tip()->GetBlockHash())
+        return;
+    std::set<uint256> setCreated;
+    std::vector<uint256> vTxids;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                const uint256& txid = txin.prevout.hash;
+                if (!setCreated.count(txid) && !pcoinsTip->HaveCoinsInCache(txid))
+                    vTxids.push_back(txid);
+            }
+        }
+        setCreated.insert(tx.GetHash());
+    }
+    pcoinsPrefetch->Prefetch(vTxids);
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -3616,6 +4173,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         if (!checked) {
             return error ("%s : CheckBlock FAILED for block %s", __func__, pblock->GetHash().GetHex());
         }
+        PrefetchBlockInputs(*pblock);
 
         // Store to disk
         CBlockIndex* pindex = nullptr;
@@ -3771,9 +4329,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -3781,10 +4337,27 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+bool GetBlockStakePrevout(const CBlockIndex* pindex, COutPoint& prevout)
+{
+    std::map<const CBlockIndex*, COutPoint>::const_iterator it = mapUnwrittenStakePrevouts.find(pindex);
+    if (it != mapUnwrittenStakePrevouts.end()) {
+        prevout = it->second;
+        return true;
+    }
+    return pblocktree->ReadStakePrevout(pindex->GetBlockHash(), prevout);
+}
+
+size_t GetBlockIndexMemoryUsage()
+{
+    return blockIndexArena.DynamicMemoryUsage();
+}
+
 bool static LoadBlockIndexDB(std::string& strError)
 {
+    int64_t nStart = GetTimeMillis();
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
+    int64_t nTimeGuts = GetTimeMillis();
 
     boost::this_thread::interruption_point();
 
@@ -3799,7 +4372,9 @@ bool static LoadBlockIndexDB(std::string& strError)
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3820,6 +4395,7 @@ bool static LoadBlockIndexDB(std::string& strError)
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nTimeChainWork = GetTimeMillis();
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3837,6 +4413,15 @@ bool static LoadBlockIndexDB(std::string& strError)
             break;
         }
     }
+    for (const CBlockFileInfo& info : vinfoBlockFile) {
+        if (info.nFormat > BLOCKFILE_FORMAT_CURRENT)
+            return error("%s: block files were written in a newer format (%d)", __func__, info.nFormat);
+    }
+
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
@@ -3853,6 +4438,8 @@ bool static LoadBlockIndexDB(std::string& strError)
             return false;
         }
     }
+    LogPrintf("%s: %u entries (%u bytes each, %.1f MiB), load %dms, chain work %dms, block files %dms\n", __func__, mapBlockIndex.size(),
+        sizeof(CBlockIndex), GetBlockIndexMemoryUsage() / 1048576.0, nTimeGuts - nStart, nTimeChainWork - nTimeGuts, GetTimeMillis() - nTimeChainWork);
 
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
@@ -3876,6 +4463,10 @@ bool static LoadBlockIndexDB(std::string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    UpdateKernelModifierIndex();
+    PublishChainTip(chainActive.Tip(), pindexBestHeader);
+    if (fHavePruned)
+        UpdatePruneHeight();
 
     PruneBlockIndexCandidates();
 
@@ -3887,6 +4478,70 @@ bool static LoadBlockIndexDB(std::string& strError)
     return true;
 }
 
+namespace
+{
+/** Blocks read and checked per round of VerifyDB workers */
+const size_t VERIFYDB_BLOCKS_PER_THREAD = 16;
+
+/** A block VerifyDB checks, with its positions on disk so it can be read without holding cs_main */
+struct CVerifyDBBlock {
+    CBlockIndex* pindex;
+    CDiskBlockPos blockPos;
+    CDiskBlockPos undoPos;
+};
+
+/** A block being checked on one of the VerifyDB worker threads */
+struct CVerifyDBSlot {
+    CVerifyDBBlock entry;
+    CBlock block;
+    //! Set by the worker; empty if the block passed
+    std::string strError;
+};
+
+void ReadVerifyDBSlots(std::vector<CVerifyDBSlot>& vSlots, size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < vSlots.size(); i += nStride) {
+        CVerifyDBSlot& slot = vSlots[i];
+        if (!ReadBlockFromDisk(slot.block, slot.entry.blockPos) || slot.block.GetHash() != slot.entry.pindex->GetBlockHash()) {
+            slot.strError = "ReadBlockFromDisk failed";
+            continue;
+        }
+        CBlockUndo undo;
+        if (!slot.entry.undoPos.IsNull() && !undo.ReadFromDisk(slot.entry.undoPos, slot.entry.pindex->pprev->GetBlockHash()))
+            slot.strError = "found bad undo data";
+    }
+}
+
+/**
+ * Only the checks of the block itself run on the workers; the caller holds
+ * cs_main, so the chain they read the height from cannot change underneath.
+ * The swiftTX lock and masternode payee checks depend on what the node has
+ * heard from the network since it started, not on the history being
+ * verified, and they read state that is not safe to share between threads.
+ */
+void CheckVerifyDBSlots(std::vector<CVerifyDBSlot>& vSlots, size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < vSlots.size(); i += nStride) {
+        CVerifyDBSlot& slot = vSlots[i];
+        CValidationState state;
+        if (slot.strError.empty() && !CheckBlock(slot.block, state, true, true, true, false))
+            slot.strError = "found bad block";
+    }
+}
+
+void RunVerifyDBWorkers(void (*func)(std::vector<CVerifyDBSlot>&, size_t, size_t), std::vector<CVerifyDBSlot>& vSlots, int nThreads)
+{
+    if (nThreads > 1) {
+        boost::thread_group threads;
+        for (int t = 0; t < nThreads; t++)
+            threads.create_thread(boost::bind(func, boost::ref(vSlots), t, nThreads));
+        threads.join_all();
+    } else {
+        func(vSlots, 0, 1);
+    }
+}
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -3899,86 +4554,155 @@ CVerifyDB::~CVerifyDB()
 
 bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth)
 {
-    LOCK(cs_main);
-    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
-        return true;
+    // Blocks in the best chain to check
+    std::vector<CVerifyDBBlock> vBlocks;
+    CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        if (pindexTip == NULL || pindexTip->pprev == NULL)
+            return true;
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0)
-        nCheckDepth = 1000000000; // suffices until the year 19000
-    if (nCheckDepth > chainActive.Height())
-        nCheckDepth = chainActive.Height();
-    nCheckLevel = std::max(0, std::min(5, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+        if (nCheckDepth <= 0)
+            nCheckDepth = 1000000000; // suffices until the year 19000
+        if (nCheckDepth > chainActive.Height())
+            nCheckDepth = chainActive.Height();
+        nCheckLevel = std::max(0, std::min(5, nCheckLevel));
+        LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+        vBlocks.reserve(nCheckDepth + 1);
+        for (CBlockIndex* pindex = pindexTip; pindex && pindex->pprev && pindex->nHeight >= chainActive.Height() - nCheckDepth; pindex = pindex->pprev) {
+            // If pruning, only go back as far as we have data.
+            if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+                nCheckDepth = chainActive.Height() - pindex->nHeight - 1;
+                break;
+            }
+            CVerifyDBBlock entry;
+            entry.pindex = pindex;
+            entry.blockPos = pindex->GetBlockPos();
+            entry.undoPos = pindex->GetUndoPos();
+            vBlocks.push_back(entry);
+        }
+    }
+
+    // Read the blocks and their undo data, then check them, each spread over
+    // the worker threads; only the checks hold cs_main. At most a round of
+    // blocks is in memory at a time.
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS));
+    size_t nRound = nThreads * VERIFYDB_BLOCKS_PER_THREAD;
+    std::vector<CVerifyDBSlot> vRound;
+    int64_t nStart = GetTimeMillis();
+    for (size_t nFirst = 0; nFirst < vBlocks.size(); nFirst += nRound) {
+        boost::this_thread::interruption_point();
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(nFirst * (nCheckLevel >= 5 ? 50 : 100) / vBlocks.size()))));
+        vRound.resize(std::min(nRound, vBlocks.size() - nFirst));
+        for (size_t i = 0; i < vRound.size(); i++) {
+            vRound[i].entry = vBlocks[nFirst + i];
+            vRound[i].strError.clear();
+        }
+        int nRoundThreads = std::min((size_t)nThreads, vRound.size());
+        RunVerifyDBWorkers(&ReadVerifyDBSlots, vRound, nRoundThreads);
+        {
+            LOCK(cs_main);
+            RunVerifyDBWorkers(&CheckVerifyDBSlots, vRound, nRoundThreads);
+        }
+        for (const CVerifyDBSlot& slot : vRound) {
+            if (!slot.strError.empty())
+                return error("VerifyDB() : *** %s at %d, hash=%s", slot.strError, slot.entry.pindex->nHeight, slot.entry.pindex->GetBlockHash().ToString());
+        }
+        if (ShutdownRequested())
+            return true;
+    }
+    LogPrintf("Checked %u blocks on %d threads in %dms\n", vBlocks.size(), nThreads, GetTimeMillis() - nStart);
+    std::vector<CVerifyDBSlot>().swap(vRound);
+
+    // cs_main is taken for each block, so blocks can still be connected while
+    // this runs in the background. The view below is only valid for the tip
+    // it started from; if that moves on, the check of the coins stops there.
     CCoinsViewCache coins(coinsview);
-    CBlockIndex* pindexState = chainActive.Tip();
+    CBlockIndex* pindexState = pindexTip;
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+    // check for inconsistencies during memory-only disconnect of tip blocks
+    for (CBlockIndex* pindex = pindexTip; pindex && pindex->pprev; pindex = pindex->pprev) {
         boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 5 ? 50 : 100)))));
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexTip) {
+            LogPrintf("VerifyDB(): the chain tip moved on, the coin database check stops at height %d\n", pindex->nHeight);
+            return true;
+        }
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if ((coins.GetCacheSize() + pcoinsTip->GetCacheSize()) > nCoinCacheSize)
+            break;
         CBlock block;
-        // read from disk
         if (!ReadBlockFromDisk(block, pindex))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // verify block validity
-        if (!CheckBlock(block, state))
-            return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // verify undo validity
-        if (pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!undo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
-        // check for inconsistencies during memory-only disconnect of tip blocks
-        if (pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size();
-        }
+        bool fClean = true;
+        if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        pindexState = pindex->pprev;
+        if (!fClean) {
+            nGoodTransactions = 0;
+            pindexFailure = pindex;
+        } else
+            nGoodTransactions += block.vtx.size();
         if (ShutdownRequested())
             return true;
     }
     if (pindexFailure)
-        return error("VerifyDB() : *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+        return error("VerifyDB() : *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", pindexTip->nHeight - pindexFailure->nHeight + 1, nGoodTransactions);
 
     // try reconnecting blocks
     CBlockIndex* pindex = pindexState;
-    while (pindex != chainActive.Tip()) {
+    while (pindex != pindexTip) {
         boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(pindexTip->nHeight - pindex->nHeight)) / (double)nCheckDepth * 50))));
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexTip) {
+            LogPrintf("VerifyDB(): the chain tip moved on, the coin database check stops at height %d\n", pindex->nHeight);
+            return true;
+        }
         pindex = chainActive.Next(pindex);
         CBlock block;
         if (!ReadBlockFromDisk(block, pindex))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        if (!ConnectBlock(block, state, pindex, coins, false))
+        // Checked above already, without the payee checks
+        if (!ConnectBlock(block, state, pindex, coins, false, true))
             return error("VerifyDB() : *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
     }
 
-    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
+    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", pindexTip->nHeight - pindexState->nHeight, nGoodTransactions);
 
     return true;
 }
 
+void ThreadVerifyDB()
+{
+    // The tip may have moved on since startup, so verify against the coins
+    // cache rather than the database
+    if (!CVerifyDB().VerifyDB(pcoinsTip, 5, GetArg("-checkblocks", 100))) {
+        AbortNode("Corrupted block database detected", _("Corrupted block database detected") + ". " + _("Please restart with -reindex."));
+        return;
+    }
+    if (!ShutdownRequested()) {
+        fBlockDatabaseVerified = true;
+        LogPrintf("Background verification of the block database finished\n");
+    }
+}
+
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    blockFileMaps.Clear();
+    ClearStakeOrigins();
+    ClearKernelModifierIndex();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    PublishChainTip(NULL, NULL);
     mempool.clear();
     mapOrphanTransactions.clear();
     mapOrphanTransactionsByPrev.clear();
@@ -3994,11 +4718,12 @@ void UnloadBlockIndex()
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
+    mapUnwrittenStakePrevouts.clear();
+    fHavePruned = false;
+    nPruneHeight = 0;
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -4025,12 +4750,13 @@ bool InitBlockIndex()
         try {
             CBlock& block = const_cast<CBlock&>(Params().GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            CStoredBlock stored;
+            stored.Set(block);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize + 8, 0, block.GetBlockTime()))
+            if (!FindBlockPos(state, blockPos, stored.GetDiskSize(), 0, block.GetBlockTime(), false, stored.fCompressed ? BLOCKFILE_FORMAT_COMPRESSED : BLOCKFILE_FORMAT_RAW))
                 return error("LoadBlockIndex() : FindBlockPos failed");
-            if (!WriteBlockToDisk(block, blockPos))
+            if (!WriteBlockToDisk(stored, blockPos))
                 return error("LoadBlockIndex() : writing genesis block to disk failed");
             CBlockIndex* pindex = AddToBlockIndex(block);
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
@@ -4048,20 +4774,103 @@ bool InitBlockIndex()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
+namespace
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/** Bytes of blocks a block file reader may have read ahead of validation */
+const size_t MAX_IMPORT_QUEUE_BYTES = 32 * 1024 * 1024;
+/** Block files read at the same time during -reindex */
+const int MAX_IMPORT_READERS = 4;
 
-    int nLoaded = 0;
+/** Progress of the running import, see GetImportProgress */
+std::atomic<int64_t> nImportStartMillis(0);
+std::atomic<int> nImportFile(-1);
+std::atomic<int> nImportedBlocks(0);
+
+/** Map of disk positions for blocks with unknown parent (only used for reindex) */
+std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/** A block deserialized by a block file reader */
+struct CImportedBlock {
+    CBlock block;
+    uint256 hash;
+    CDiskBlockPos pos;
+    unsigned int nSize;
+};
+
+/** Blocks of one file, handed from its reader thread to validation in file order */
+class CBlockImportQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::unique_ptr<CImportedBlock> > queue;
+    size_t nQueuedBytes;
+    //! Set by the reader at the end of the file
+    bool fDone;
+    //! Set when validation stops early, so the reader does too
+    bool fAborted;
+
+public:
+    CBlockImportQueue() : nQueuedBytes(0), fDone(false), fAborted(false) {}
+
+    /** Wait for room and queue pblock; false once aborted */
+    bool Push(std::unique_ptr<CImportedBlock>& pblock)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fAborted && nQueuedBytes >= MAX_IMPORT_QUEUE_BYTES)
+            cond.wait(lock);
+        if (fAborted)
+            return false;
+        nQueuedBytes += pblock->nSize;
+        queue.push_back(std::move(pblock));
+        cond.notify_all();
+        return true;
+    }
+
+    /** Wait for the next block; null at the end of the file */
+    std::unique_ptr<CImportedBlock> Pop()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty() && !fDone)
+            cond.wait(lock);
+        std::unique_ptr<CImportedBlock> pblock;
+        if (!queue.empty()) {
+            pblock = std::move(queue.front());
+            queue.pop_front();
+            nQueuedBytes -= pblock->nSize;
+            cond.notify_all();
+        }
+        return pblock;
+    }
+
+    void SetDone()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fDone = true;
+        cond.notify_all();
+    }
+
+    void Abort()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fAborted = true;
+        cond.notify_all();
+    }
+};
+
+/**
+ * Locate, deserialize and hash the blocks of fileIn, which is closed
+ * afterwards. nFile is the number of the block file, or -1 for files from
+ * outside the block directory.
+ */
+void ReadImportFile(FILE* fileIn, int nFile, CBlockImportQueue* pqueue)
+{
+    RenameThread("nbx-loadblkread");
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
         while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
             blkdat.SetPos(nRewind);
             nRewind++;         // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
@@ -4076,7 +4885,7 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                if ((nSize & ~BLOCK_COMPRESSED_FLAG) < 80 || (nSize & ~BLOCK_COMPRESSED_FLAG) > MAX_BLOCK_SIZE_CURRENT)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -4084,70 +4893,203 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
             }
             try {
                 // read block
+                bool fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+                nSize &= ~BLOCK_COMPRESSED_FLAG;
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
+                std::unique_ptr<CImportedBlock> pimport(new CImportedBlock());
+                if (fCompressed) {
+                    std::vector<char> vchFrame(nSize);
+                    blkdat.read(&vchFrame[0], nSize);
+                    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+                    if (!DecompressBlockData(vchFrame.data(), vchFrame.data() + nSize, ssBlock))
+                        throw std::ios_base::failure("corrupt compressed block");
+                    ssBlock >> pimport->block;
+                } else {
+                    blkdat >> pimport->block;
+                }
                 nRewind = blkdat.GetPos();
+                pimport->hash = pimport->block.GetHash();
+                pimport->pos = CDiskBlockPos(nFile, nBlockPos);
+                pimport->nSize = nSize;
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                // Check the header here rather than on the validation thread
+                if (pimport->block.IsProofOfWork() && !CheckProofOfWork(pimport->hash, pimport->block.nBits)) {
+                    LogPrint("reindex", "%s: Skipping block %s with invalid proof of work\n", __func__, pimport->hash.ToString());
                     continue;
                 }
+                if (!pqueue->Push(pimport))
+                    break;
+            } catch (std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    pqueue->SetDone();
+}
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+/** The reader thread of one file; stops and joins it when going out of scope */
+class CImportReader
+{
+private:
+    CBlockImportQueue queue;
+    boost::thread thread;
+
+public:
+    CImportReader(FILE* fileIn, int nFile) : thread(boost::bind(&ReadImportFile, fileIn, nFile, &queue)) {}
+
+    ~CImportReader()
+    {
+        boost::this_thread::disable_interruption noInterrupt;
+        queue.Abort();
+        thread.join();
+    }
+
+    CBlockImportQueue& Queue() { return queue; }
+};
+
+/** Validate the blocks of queue in file order; fBlockDir if they come from a block file, to be indexed where they are */
+void ProcessImportQueue(CBlockImportQueue& queue, bool fBlockDir, int& nLoaded)
+{
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::unique_ptr<CImportedBlock> pimport = queue.Pop();
+        if (!pimport)
+            break;
+        try {
+            CBlock& block = pimport->block;
+            const uint256& hash = pimport->hash;
+            CDiskBlockPos* dbp = fBlockDir ? &pimport->pos : NULL;
+
+            // detect out of order blocks, and store them for later
+            if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+                if (dbp)
+                    mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                continue;
+            }
+
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                CValidationState state;
+                if (ProcessNewBlock(state, NULL, &block, dbp)) {
+                    nLoaded++;
+                    nImportedBlocks++;
                 }
+                if (state.IsError())
+                    break;
+            } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queueChildren;
+            queueChildren.push_back(hash);
+            while (!queueChildren.empty()) {
+                uint256 head = queueChildren.front();
+                queueChildren.pop_front();
+                std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                    CBlock blockChild;
+                    if (ReadBlockFromDisk(blockChild, it->second)) {
+                        LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                            head.ToString());
+                        CValidationState dummy;
+                        if (ProcessNewBlock(dummy, NULL, &blockChild, &it->second)) {
+                            nLoaded++;
+                            nImportedBlocks++;
+                            queueChildren.push_back(blockChild.GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
             }
+        } catch (std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
         }
-    } catch (std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+    }
+}
+
+void StartImportProgress()
+{
+    nImportStartMillis = GetTimeMillis();
+    nImportFile = -1;
+    nImportedBlocks = 0;
+}
+}
+
+bool LoadExternalBlockFile(FILE* fileIn)
+{
+    int64_t nStart = GetTimeMillis();
+    StartImportProgress();
+
+    // Blocks are read on their own thread while earlier ones are validated here
+    int nLoaded = 0;
+    {
+        CImportReader reader(fileIn, -1);
+        ProcessImportQueue(reader.Queue(), false, nLoaded);
     }
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
 
+bool ReindexBlockFiles()
+{
+    int64_t nStart = GetTimeMillis();
+    StartImportProgress();
+
+    // Each block file gets its own reader thread, so the files after the one
+    // being validated are already read and deserialized when it is their turn
+    int nReaders = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_IMPORT_READERS));
+    std::deque<std::unique_ptr<CImportReader> > readers;
+    int nNextFile = 0;
+    bool fMoreFiles = true;
+    int nLoaded = 0;
+    while (true) {
+        while (fMoreFiles && (int)readers.size() < nReaders) {
+            CDiskBlockPos pos(nNextFile, 0);
+            if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk"))) {
+                fMoreFiles = false; // No block files left to reindex
+                break;
+            }
+            FILE* file = OpenBlockFile(pos, true);
+            if (!file) {
+                fMoreFiles = false; // This error is logged in OpenBlockFile
+                break;
+            }
+            readers.push_back(std::unique_ptr<CImportReader>(new CImportReader(file, nNextFile)));
+            nNextFile++;
+        }
+        if (readers.empty())
+            break;
+
+        int nFile = nNextFile - readers.size();
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        nImportFile = nFile;
+        ProcessImportQueue(readers.front()->Queue(), true, nLoaded);
+        readers.pop_front();
+    }
+    LogPrintf("Reindexed %i blocks from %i files in %dms using %d readers\n", nLoaded, nNextFile, GetTimeMillis() - nStart, nReaders);
+    return nLoaded > 0;
+}
+
+CImportProgress GetImportProgress()
+{
+    CImportProgress progress;
+    progress.nFile = nImportFile;
+    progress.nBlocks = nImportedBlocks;
+    int64_t nElapsed = GetTimeMillis() - nImportStartMillis;
+    progress.dBlocksPerSecond = nElapsed > 0 ? progress.nBlocks * 1000.0 / nElapsed : 0;
+    return progress;
+}
+
 void static CheckBlockIndex()
 {
     if (!fCheckBlockIndex) {
@@ -4184,6 +5126,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4191,6 +5134,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4201,12 +5145,20 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4218,11 +5170,20 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates.  chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
-        } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
+        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
         }
         // Check whether this block is in mapBlocksUnlinked.
@@ -4236,12 +5197,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4261,6 +5238,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4868,6 +5846,13 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // If pruning, don't inv blocks unless we have on disk and are likely to still have
+            // for some reasonable time window (1 hour) that block relay might require.
+            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / Params().TargetSpacing();
+            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave)) {
+                LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0) {
                 // When this block is requested, we'll send an inv that'll make them
@@ -5576,8 +6561,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         state.rejects.clear();
 
         // Start block sync
-        if (pindexBestHeader == NULL)
+        if (pindexBestHeader == NULL) {
             pindexBestHeader = chainActive.Tip();
+            PublishChainTip(chainActive.Tip(), pindexBestHeader);
+        }
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && fFetch /*&& !fImporting*/ && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to end of initial download.
@@ -5760,7 +6747,7 @@ bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock
 
 std::string CBlockFileInfo::ToString() const
 {
-    return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s)", nBlocks, nSize, nHeightFirst, nHeightLast, DateTimeStrFormat("%Y-%m-%d", nTimeFirst), DateTimeStrFormat("%Y-%m-%d", nTimeLast));
+    return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s, format=%d)", nBlocks, nSize, nHeightFirst, nHeightLast, DateTimeStrFormat("%Y-%m-%d", nTimeFirst), DateTimeStrFormat("%Y-%m-%d", nTimeLast), nFormat);
 }
 
 
@@ -5770,10 +6757,7 @@ public:
     CMainCleanup() {}
     ~CMainCleanup()
     {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+        // block headers; the entries are freed with blockIndexArena
         mapBlockIndex.clear();
 
         // orphan transactions
@@ -14,6 +14,7 @@
 #endif
 
 #include "amount.h"
+#include "blockcompress.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
@@ -31,6 +32,7 @@
 #include "undo.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
 #include <set>
@@ -43,10 +45,13 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CCoinsViewPrefetch;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CUtxoStats;
 class CValidationInterface;
 class CValidationState;
 
@@ -103,6 +108,26 @@ static const bool DEFAULT_PEERBLOOMFILTERS = true;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+
+/** Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
+ * At 1MB per block, 288 blocks = 288MB.
+ * Add 15% for Undo data = 331MB
+ * Add 20% for Orphan block rate = 397MB
+ * We want the low water mark after pruning to be at least 397 MB and since we prune in
+ * full block file chunks, we need the high water mark which triggers the prune to be
+ * one 128MB block file + added 15% undo data = 147MB greater for a total of 545MB
+ * Setting the target to > than 550MB will make it likely we can respect the target. */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
+
+/** Default for -mapblockfiles; mapping whole block files needs a 64-bit address space */
+static const bool DEFAULT_MAP_BLOCK_FILES = sizeof(void*) >= 8;
+/** Number of block files kept memory mapped for reading */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 8;
+/** Default for -compressblocks, store new blocks as compressed frames */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
+
 /** Default for -blockspamfilter, use header spam filter */
 static const bool DEFAULT_BLOCK_SPAM_FILTER = true;
 /** Default for -blockspamfiltermaxsize, maximum size of the list of indexes in the block spam filter */
@@ -147,6 +172,20 @@ extern bool fAlerts;
 extern bool fPreventBestBlockSaving;
 extern int64_t nMaxTipAge;
 extern bool fVerifyingBlocks;
+/** False while the block database is being verified in the background; no stakes are made until then */
+extern std::atomic<bool> fBlockDatabaseVerified;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of bytes of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** True if blocks are read through memory mapped block files */
+extern bool fMapBlockFiles;
+/** True if new blocks are stored compressed */
+extern bool fCompressBlocks;
+/** Block whose ancestors' scripts are not verified (-assumevalid), 0 to verify all */
+extern uint256 hashAssumeValid;
 
 extern bool fLargeWorkForkFound;
 extern bool fLargeWorkInvalidChainFound;
@@ -155,6 +194,8 @@ extern int64_t nLastCoinStakeSearchInterval;
 extern int64_t nLastCoinStakeSearchTime;
 extern int64_t nReserveBalance;
 
+//! Blocks CheckBlock rejected for reasons that may pass later; guarded by cs_mapRejectedBlocks, as CheckBlock runs outside cs_main and on several threads
+extern CCriticalSection cs_mapRejectedBlocks;
 extern std::map<uint256, int64_t> mapRejectedBlocks;
 extern std::map<unsigned int, unsigned int> mapHashedBlocks;
 
@@ -190,11 +231,25 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 std::string GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+bool LoadExternalBlockFile(FILE* fileIn);
+/** Rebuild the block index from the block files, reading several files ahead of validation */
+bool ReindexBlockFiles();
+/** Progress of -reindex or a block file import, reported by getblockchaininfo */
+struct CImportProgress {
+    //! Block file being validated, -1 for external files
+    int nFile;
+    int nBlocks;
+    double dBlocksPerSecond;
+};
+CImportProgress GetImportProgress();
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(std::string& strError);
+/** Load the running UTXO set statistics, rebuilding them by a scan of coinsview if they do not match it */
+bool LoadUtxoStats(CCoinsViewDB* coinsview);
+/** Statistics of the UTXO set after the given block, if they were recorded when it was connected */
+bool GetUtxoStats(const CBlockIndex* pindex, CCoinsStats& stats);
 /** Unload database information */
 void UnloadBlockIndex();
 /** See whether the protocol update is enforced for connected nodes */
@@ -219,6 +274,8 @@ std::string GetWarnings(std::string strFor);
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CTxOut& out);
+/** Retrieve an unspent output and the active chain block that created it from the coins database; works without the block files */
+bool GetUnspentOutput(const COutPoint& outpoint, CTxOut& out, CBlockIndex** ppindexFrom = NULL);
 /** Find the best known block, and make it the tip of the block chain */
 
 // ***TODO***
@@ -234,6 +291,10 @@ CAmount GetBlockValue(int nHeight, CAmount prevMoneySupply);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex* InsertBlockIndex(uint256 hash);
+/** The stake input of a proof-of-stake block. Kept aside until the entry is written, then read back from the block tree database. */
+bool GetBlockStakePrevout(const CBlockIndex* pindex, COutPoint& prevout);
+/** Memory taken by the block index entries */
+size_t GetBlockIndexMemoryUsage();
 /** Abort with a message */
 bool AbortNode(const std::string& msg, const std::string& userMessage = "");
 /** Get statistics from node state */
@@ -242,6 +303,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/** Mark one block file as pruned: its blocks lose BLOCK_HAVE_DATA and BLOCK_HAVE_UNDO and the file info is cleared */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Height of the lowest block from which on the active chain's blocks are on disk, 0 unless pruned */
+int GetPruneHeight();
 
 
 /** (try to) add transaction to memory pool **/
@@ -333,7 +404,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL, const PrecomputedTransactionData* txdata = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
@@ -393,11 +464,12 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData* txdata;
 
 public:
-    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(NULL) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = NULL) : scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+                                                                                                                                ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) {}
 
     bool operator()();
 
@@ -409,36 +481,54 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
 };
 
 
+/** A block as written to its block file: its serialization, compressed if -compressblocks is set and that makes it smaller */
+struct CStoredBlock {
+    std::vector<char> vchData;
+    bool fCompressed;
+
+    CStoredBlock() : fCompressed(false) {}
+    void Set(const CBlock& block);
+    /** Bytes taken in the block file, including the message start and size in front */
+    unsigned int GetDiskSize() const { return vchData.size() + 8; }
+};
+
 /** Functions for disk access for blocks */
-bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
+bool WriteBlockToDisk(const CStoredBlock& stored, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
 
+/** Restore the output a transaction input spent, from its undo data. Returns false if view did not match the undo data. */
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out);
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. If pstats is provided, the
+ *  changes are applied to those UTXO set statistics as well. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CUtxoStats* pstats = NULL);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins,
+ *  and on the UTXO set statistics pstats if provided */
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false, CUtxoStats* pstats = NULL);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, int nHeight, CValidationState& state, bool fCheckPOW = true);
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+/** fCheckPayees: also check the swiftTX locks and masternode payees, which depend on the state of the network rather than the block */
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true, bool fCheckPayees = true);
+bool CheckWork(const CBlock& block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -452,6 +542,14 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** pindex, C
 bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex = NULL);
 
 
+/** Whether all data of s has been read; only memory streams can tell */
+template <typename Stream>
+inline bool AtEndOfStream(Stream& s)
+{
+    return false;
+}
+inline bool AtEndOfStream(CDataStream& s) { return s.empty(); }
+
 class CBlockFileInfo
 {
 public:
@@ -462,6 +560,7 @@ public:
     unsigned int nHeightLast;  //! highest height of block in file
     uint64_t nTimeFirst;       //! earliest time of block in file
     uint64_t nTimeLast;        //! latest time of block in file
+    int nFormat;               //! newest BlockFileFormat of the blocks in file
 
     ADD_SERIALIZE_METHODS;
 
@@ -475,6 +574,11 @@ public:
         READWRITE(VARINT(nHeightLast));
         READWRITE(VARINT(nTimeFirst));
         READWRITE(VARINT(nTimeLast));
+        // Entries written before blocks could be stored compressed end here
+        if (!ser_action.ForRead() || !AtEndOfStream(s))
+            READWRITE(VARINT(nFormat));
+        else
+            nFormat = BLOCKFILE_FORMAT_RAW;
     }
 
     void SetNull()
@@ -486,6 +590,7 @@ public:
         nHeightLast = 0;
         nTimeFirst = 0;
         nTimeLast = 0;
+        nFormat = BLOCKFILE_FORMAT_RAW;
     }
 
     CBlockFileInfo()
@@ -592,6 +697,9 @@ public:
     bool VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** Verify the -checkblocks blocks while the node is already running, then set fBlockDatabaseVerified */
+void ThreadVerifyDB();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -607,6 +715,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Reads the inputs of new blocks ahead of their validation, below pcoinsTip; NULL with -prefetchthreads=0 */
+extern CCoinsViewPrefetch* pcoinsPrefetch;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
@@ -12,6 +12,7 @@
 #include "obfuscation.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 
 // keep track of the scanning errors I've seen
 std::map<uint256, int> mapSeenMasternodeScanningErrors;
@@ -183,6 +184,14 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
 }
 
 void CMasternode::Check(bool forceCheck)
+{
+    int nPrevState = activeState;
+    UpdateState(forceCheck);
+    if (activeState != nPrevState)
+        GetMainSignals().NotifyMasternodeState(vin.prevout, activeState);
+}
+
+void CMasternode::UpdateState(bool forceCheck)
 {
     if (ShutdownRequested()) return;
 
@@ -606,12 +615,10 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
 
     // verify that sig time is legit in past
     // should be at least not earlier than block when 10000 NBX tx got MASTERNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 10000 NBX tx -> 1 confirmation
+    // the collateral is unspent, so the coins database has its block even when the block files are pruned
+    CTxOut txOutCollateral;
+    CBlockIndex* pMNIndex = NULL; // block for 10000 NBX tx -> 1 confirmation
+    if (GetUnspentOutput(vin.prevout, txOutCollateral, &pMNIndex) && pMNIndex) {
         CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
         if (pConfIndex->GetBlockTime() > sigTime) {
             LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
@@ -109,6 +109,8 @@ private:
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
 
+    void UpdateState(bool forceCheck);
+
 public:
     enum state {
         MASTERNODE_PRE_ENABLED,
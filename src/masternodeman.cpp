@@ -11,6 +11,7 @@
 #include "obfuscation.h"
 #include "spork.h"
 #include "util.h"
+#include "validationinterface.h"
 #include <boost/filesystem.hpp>
 
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
@@ -209,6 +210,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        GetMainSignals().NotifyMasternodeState(mn.vin.prevout, mn.activeState);
         return true;
     }
 
@@ -278,6 +280,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            if ((*it).activeState != CMasternode::MASTERNODE_REMOVE)
+                GetMainSignals().NotifyMasternodeState((*it).vin.prevout, CMasternode::MASTERNODE_REMOVE);
             it = vMasternodes.erase(it);
         } else {
             ++it;
@@ -472,6 +476,20 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
+CMasternodeCounts CMasternodeMan::GetCounts(int nBlockHeight)
+{
+    CMasternodeCounts counts;
+    if (nBlockHeight >= 0)
+        GetNextMasternodeInQueueForPayment(nBlockHeight, true, counts.nInQueue);
+    CountNetworks(ActiveProtocol(), counts.nIPv4, counts.nIPv6, counts.nOnion);
+    counts.nTotal = size();
+    counts.nStable = stable_size();
+    counts.nObfCompat = CountEnabled(ActiveProtocol());
+    counts.nEnabled = CountEnabled();
+    counts.fValid = true;
+    return counts;
+}
+
 CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
 {
     LOCK(cs);
@@ -1002,12 +1020,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
             // verify that sig time is legit in past
             // should be at least not earlier than block when 10000 NBX tx got MASTERNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            CTransaction tx2;
-            GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 10000 NBX tx -> 1 confirmation
+            // the collateral is unspent, so the coins database has its block even when the block files are pruned
+            CTxOut txOutCollateral;
+            CBlockIndex* pMNIndex = NULL; // block for 10000 NBX tx -> 1 confirmation
+            if (GetUnspentOutput(vin.prevout, txOutCollateral, &pMNIndex) && pMNIndex) {
                 CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
                 if (pConfIndex->GetBlockTime() > sigTime) {
                     LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
@@ -1135,6 +1151,8 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            if ((*it).activeState != CMasternode::MASTERNODE_REMOVE)
+                GetMainSignals().NotifyMasternodeState((*it).vin.prevout, CMasternode::MASTERNODE_REMOVE);
             vMasternodes.erase(it);
             break;
         }
@@ -7,6 +7,7 @@
 #define MASTERNODEMAN_H
 
 #include "base58.h"
+#include "chainstatus.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
@@ -111,6 +112,9 @@ public:
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
+    /// All the counts reported by getmasternodecount, with the payment queue computed for nBlockHeight
+    CMasternodeCounts GetCounts(int nBlockHeight);
+
     void DsegUpdate(CNode* pnode);
 
     /// Find an entry
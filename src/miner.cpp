@@ -459,11 +459,10 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet)
     LogPrintf("%s\n", pblock->ToString());
 
     CAmount nDebit = 0;
-    CTransaction tx;
-    uint256 hash_block;
+    CTxOut txOutStake;
     COutPoint prevout = pblock->GetProofOfStake().first;
-    if (GetTransaction(prevout.hash, tx, hash_block, true))
-        nDebit = tx.vout[prevout.n].nValue;
+    if (GetUnspentOutput(prevout, txOutStake))
+        nDebit = txOutStake.nValue;
     CAmount nCredit = 0;
     for (const CTxOut& txout : pblock->vtx[1].vout)
         nCredit += txout.nValue;
@@ -529,7 +528,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             }
 
             while (vNodes.empty() || pwallet->IsLocked() || !fMintableCoins ||
-                   (pwallet->GetBalance() > 0 && nReserveBalance >= pwallet->GetBalance()) || !masternodeSync.IsSynced()) {
+                   (pwallet->GetBalance() > 0 && nReserveBalance >= pwallet->GetBalance()) || !masternodeSync.IsSynced() ||
+                   !fBlockDatabaseVerified) {
                 nLastCoinStakeSearchInterval = 0;
                 MilliSleep(5000);
                 // Do a separate 1 minute check here to ensure fMintableCoins is updated
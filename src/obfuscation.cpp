@@ -512,6 +512,11 @@ bool CObfuScationSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
     CScript payee2;
     payee2 = GetScriptForDestination(pubkey.GetID());
 
+    // The collateral itself is found in the coins database even when the block files are pruned
+    CTxOut txOutVin;
+    if (GetUnspentOutput(vin.prevout, txOutVin) && txOutVin.nValue == 10000 * COIN && txOutVin.scriptPubKey == payee2)
+        return true;
+
     CTransaction txVin;
     uint256 hash;
     if (GetTransaction(vin.prevout.hash, txVin, hash, true)) {
@@ -644,11 +649,16 @@ void ThreadCheckObfuScationPool()
     RenameThread("obfuscation");
 
     unsigned int c = 0;
+    unsigned int nTicks = 0;
 
     while (true) {
         MilliSleep(1000);
         //LogPrintf("ThreadCheckObfuScationPool::check timeout\n");
 
+        // keep the counts served by getmasternodecount fresh without computing them in the RPC
+        if (nTicks++ % MASTERNODE_CHECK_SECONDS == 0)
+            PublishMasternodeCounts(mnodeman.GetCounts(GetChainStatus()->nHeight));
+
         // try to sync from all available nodes, one step at a time
         masternodeSync.Process();
 
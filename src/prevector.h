@@ -0,0 +1,415 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREVECTOR_H
+#define BITCOIN_PREVECTOR_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+
+#pragma pack(push, 1)
+/**
+ * Vector with the first N elements stored inside the object, so small
+ * vectors take no heap allocation. Longer ones are moved to the heap, where
+ * they stay until shrunk to N elements or fewer.
+ *
+ * It has the interface of std::vector for the parts the code base uses, but
+ * is only meant for trivially copyable T: elements are moved with memmove
+ * and realloc. Iterators, pointers and references are invalidated by any
+ * change to the size or capacity, as with std::vector.
+ *
+ * The object is packed, so prevector<28, unsigned char> takes 32 bytes: 28
+ * bytes of elements, or a heap pointer and capacity, and a 4 byte size.
+ */
+template <unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+
+    class iterator
+    {
+        T* ptr;
+
+    public:
+        typedef Diff difference_type;
+        typedef T value_type;
+        typedef T* pointer;
+        typedef T& reference;
+        typedef std::random_access_iterator_tag iterator_category;
+        iterator() : ptr(NULL) {}
+        iterator(T* ptr_) : ptr(ptr_) {}
+        T& operator*() const { return *ptr; }
+        T* operator->() const { return ptr; }
+        T& operator[](size_type pos) const { return ptr[pos]; }
+        iterator& operator++() { ptr++; return *this; }
+        iterator& operator--() { ptr--; return *this; }
+        iterator operator++(int) { iterator copy(*this); ++(*this); return copy; }
+        iterator operator--(int) { iterator copy(*this); --(*this); return copy; }
+        difference_type friend operator-(iterator a, iterator b) { return (&(*a) - &(*b)); }
+        iterator operator+(size_type n) const { return iterator(ptr + n); }
+        iterator& operator+=(size_type n) { ptr += n; return *this; }
+        iterator operator-(size_type n) const { return iterator(ptr - n); }
+        iterator& operator-=(size_type n) { ptr -= n; return *this; }
+        bool operator==(iterator x) const { return ptr == x.ptr; }
+        bool operator!=(iterator x) const { return ptr != x.ptr; }
+        bool operator>=(iterator x) const { return ptr >= x.ptr; }
+        bool operator<=(iterator x) const { return ptr <= x.ptr; }
+        bool operator>(iterator x) const { return ptr > x.ptr; }
+        bool operator<(iterator x) const { return ptr < x.ptr; }
+    };
+
+    class const_iterator
+    {
+        const T* ptr;
+
+    public:
+        typedef Diff difference_type;
+        typedef const T value_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+        typedef std::random_access_iterator_tag iterator_category;
+        const_iterator() : ptr(NULL) {}
+        const_iterator(const T* ptr_) : ptr(ptr_) {}
+        const_iterator(iterator x) : ptr(&(*x)) {}
+        const T& operator*() const { return *ptr; }
+        const T* operator->() const { return ptr; }
+        const T& operator[](size_type pos) const { return ptr[pos]; }
+        const_iterator& operator++() { ptr++; return *this; }
+        const_iterator& operator--() { ptr--; return *this; }
+        const_iterator operator++(int) { const_iterator copy(*this); ++(*this); return copy; }
+        const_iterator operator--(int) { const_iterator copy(*this); --(*this); return copy; }
+        difference_type friend operator-(const_iterator a, const_iterator b) { return (&(*a) - &(*b)); }
+        const_iterator operator+(size_type n) const { return const_iterator(ptr + n); }
+        const_iterator& operator+=(size_type n) { ptr += n; return *this; }
+        const_iterator operator-(size_type n) const { return const_iterator(ptr - n); }
+        const_iterator& operator-=(size_type n) { ptr -= n; return *this; }
+        bool operator==(const_iterator x) const { return ptr == x.ptr; }
+        bool operator!=(const_iterator x) const { return ptr != x.ptr; }
+        bool operator>=(const_iterator x) const { return ptr >= x.ptr; }
+        bool operator<=(const_iterator x) const { return ptr <= x.ptr; }
+        bool operator>(const_iterator x) const { return ptr > x.ptr; }
+        bool operator<(const_iterator x) const { return ptr < x.ptr; }
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    //! The size while stored inline; the size plus N + 1 once on the heap
+    size_type _size;
+    union direct_or_indirect {
+        char direct[sizeof(T) * N];
+        struct {
+            size_type capacity;
+            char* indirect;
+        } heap;
+    } _union;
+
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.heap.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.heap.indirect) + pos; }
+    bool is_direct() const { return _size <= N; }
+
+    void change_capacity(size_type new_capacity)
+    {
+        if (new_capacity <= N) {
+            if (!is_direct()) {
+                T* indirect = indirect_ptr(0);
+                memcpy(direct_ptr(0), indirect, size() * sizeof(T));
+                free(indirect);
+                _size -= N + 1;
+            }
+        } else if (!is_direct()) {
+            // realloc and malloc do not call the new handler, so a failed allocation is fatal here
+            _union.heap.indirect = static_cast<char*>(realloc(_union.heap.indirect, ((size_t)sizeof(T)) * new_capacity));
+            assert(_union.heap.indirect);
+            _union.heap.capacity = new_capacity;
+        } else {
+            char* new_indirect = static_cast<char*>(malloc(((size_t)sizeof(T)) * new_capacity));
+            assert(new_indirect);
+            memcpy(new_indirect, direct_ptr(0), size() * sizeof(T));
+            _union.heap.indirect = new_indirect;
+            _union.heap.capacity = new_capacity;
+            _size += N + 1;
+        }
+    }
+
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    //! Grow the capacity for new_size elements, by half again if on the heap already
+    void grow(size_type new_size)
+    {
+        if (capacity() < new_size)
+            change_capacity(is_direct() ? new_size : new_size + (new_size >> 1));
+    }
+
+    void fill(T* dst, size_type count, const T& value)
+    {
+        for (size_type i = 0; i < count; i++)
+            new (static_cast<void*>(dst + i)) T(value);
+    }
+
+    template <typename InputIterator>
+    void fill(T* dst, InputIterator first, InputIterator last)
+    {
+        while (first != last) {
+            new (static_cast<void*>(dst)) T(*first);
+            ++dst;
+            ++first;
+        }
+    }
+
+public:
+    void assign(size_type n, const T& val)
+    {
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        _size += n;
+        fill(item_ptr(0), n, val);
+    }
+
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        size_type n = std::distance(first, last);
+        clear();
+        if (capacity() < n)
+            change_capacity(n);
+        _size += n;
+        fill(item_ptr(0), first, last);
+    }
+
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n) : _size(0)
+    {
+        resize(n);
+    }
+
+    explicit prevector(size_type n, const T& val) : _size(0)
+    {
+        change_capacity(n);
+        _size += n;
+        fill(item_ptr(0), n, val);
+    }
+
+    template <typename InputIterator>
+    prevector(InputIterator first, InputIterator last) : _size(0)
+    {
+        size_type n = std::distance(first, last);
+        change_capacity(n);
+        _size += n;
+        fill(item_ptr(0), first, last);
+    }
+
+    prevector(const prevector<N, T, Size, Diff>& other) : _size(0)
+    {
+        change_capacity(other.size());
+        _size += other.size();
+        fill(item_ptr(0), other.begin(), other.end());
+    }
+
+    prevector& operator=(const prevector<N, T, Size, Diff>& other)
+    {
+        if (&other == this)
+            return *this;
+        assign(other.begin(), other.end());
+        return *this;
+    }
+
+    size_type size() const
+    {
+        return is_direct() ? _size : _size - N - 1;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    iterator begin() { return iterator(item_ptr(0)); }
+    const_iterator begin() const { return const_iterator(item_ptr(0)); }
+    iterator end() { return iterator(item_ptr(size())); }
+    const_iterator end() const { return const_iterator(item_ptr(size())); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    size_t capacity() const
+    {
+        return is_direct() ? N : _union.heap.capacity;
+    }
+
+    T& operator[](size_type pos)
+    {
+        return *item_ptr(pos);
+    }
+
+    const T& operator[](size_type pos) const
+    {
+        return *item_ptr(pos);
+    }
+
+    void resize(size_type new_size)
+    {
+        size_type cur_size = size();
+        if (new_size < cur_size) {
+            erase(item_ptr(new_size), end());
+            return;
+        }
+        if (new_size > capacity())
+            change_capacity(new_size);
+        fill(item_ptr(cur_size), new_size - cur_size, T());
+        _size += new_size - cur_size;
+    }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit()
+    {
+        change_capacity(size());
+    }
+
+    void clear()
+    {
+        resize(0);
+    }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        // value may be an element of this vector, which growing moves
+        T copy(value);
+        size_type p = pos - begin();
+        grow(size() + 1);
+        T* ptr = item_ptr(p);
+        memmove(ptr + 1, ptr, (size() - p) * sizeof(T));
+        _size++;
+        new (static_cast<void*>(ptr)) T(copy);
+        return iterator(ptr);
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        T copy(value);
+        size_type p = pos - begin();
+        grow(size() + count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        _size += count;
+        fill(ptr, count, copy);
+    }
+
+    template <typename InputIterator>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        size_type p = pos - begin();
+        difference_type count = std::distance(first, last);
+        grow(size() + count);
+        T* ptr = item_ptr(p);
+        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        _size += count;
+        fill(ptr, first, last);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        iterator p = first;
+        char* endp = (char*)&(*end());
+        while (p != last) {
+            (*p).~T();
+            _size--;
+            ++p;
+        }
+        memmove(&(*first), &(*last), endp - ((char*)(&(*last))));
+        return first;
+    }
+
+    void push_back(const T& value)
+    {
+        T copy(value);
+        grow(size() + 1);
+        new (static_cast<void*>(item_ptr(size()))) T(copy);
+        _size++;
+    }
+
+    void pop_back()
+    {
+        erase(end() - 1, end());
+    }
+
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+
+    void swap(prevector<N, T, Size, Diff>& other)
+    {
+        std::swap(_union, other._union);
+        std::swap(_size, other._size);
+    }
+
+    ~prevector()
+    {
+        clear();
+        if (!is_direct()) {
+            free(_union.heap.indirect);
+            _union.heap.indirect = NULL;
+        }
+    }
+
+    bool operator==(const prevector<N, T, Size, Diff>& other) const
+    {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const prevector<N, T, Size, Diff>& other) const
+    {
+        return !(*this == other);
+    }
+
+    //! Lexicographical, as std::vector, so sets and maps keyed by scripts keep their order
+    bool operator<(const prevector<N, T, Size, Diff>& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+
+    //! Heap bytes held, not counting the allocator's own overhead
+    size_t allocated_memory() const
+    {
+        return is_direct() ? 0 : ((size_t)sizeof(T)) * _union.heap.capacity;
+    }
+
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+};
+#pragma pack(pop)
+
+#endif // BITCOIN_PREVECTOR_H
@@ -5,23 +5,38 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "dappstore/dappstore.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "rpc/stats.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/dynamic_bitset.hpp>
 
+#include <memory>
+
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+//! Outpoints posted in a binary or hex body are not limited by the URI length
+static const size_t MAX_GETUTXOS_BODY_OUTPOINTS = 10000;
+//! Most headers returned by one /rest/headersbyheight/ request
+static const int MAX_REST_HEADERS_RANGE = 100000;
+//! Most blocks returned by one /rest/blocksbyheight/ request
+static const int MAX_REST_BLOCKS_RANGE = 1000;
+//! Size above which range replies are sent in chunks while they are being built
+static const size_t REST_RANGE_CHUNK_SIZE = 1 << 20;
 
 enum RetFormat {
     RF_UNDEF,
@@ -57,11 +72,14 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStreamWriter& out);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSONStream(bool fVerbose, CJSONStreamWriter& out);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue dAppToJson(const uint256& txid, const DAppExt& dApp, bool hide);
+
+extern DAppStore* pdAppStore;
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
@@ -218,11 +236,10 @@ static bool rest_block(HTTPRequest* req,
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
         std::string binaryBlock = ssBlock.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
@@ -230,6 +247,8 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_HEX: {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
@@ -237,10 +256,10 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter out(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1));
+        blockToJSONStream(block, pblockindex, showTxDetails, out);
+        req->WriteReply(HTTP_OK, out.Finish() + "\n");
         return true;
     }
 
@@ -263,6 +282,142 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/**
+ * Parse "<start>/<count>" and look up the blocks of the active chain at
+ * those heights; the range ends early at the tip.
+ */
+static bool ParseHeightRange(HTTPRequest* req, const std::string& strPath, int nMaxCount, std::vector<const CBlockIndex*>& vIndex)
+{
+    std::vector<std::string> path;
+    boost::split(path, strPath, boost::is_any_of("/"));
+    int32_t nStart, nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use <start height>/<count>.<ext>");
+    if (nCount < 1 || nCount > nMaxCount)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Count out of range (max: %d): %s", nMaxCount, path[1]));
+
+    LOCK(cs_main);
+    if (nStart < 0 || nStart > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+    int nEnd = std::min((int64_t)chainActive.Height() + 1, (int64_t)nStart + nCount);
+    vIndex.reserve(nEnd - nStart);
+    for (int nHeight = nStart; nHeight < nEnd; nHeight++)
+        vIndex.push_back(chainActive[nHeight]);
+    return true;
+}
+
+/** Send ss in the reply, as a chunk if it grew large enough or fFinal is not set */
+static void WriteRangeData(HTTPRequest* req, enum RetFormat rf, CDataStream& ss, bool fFinal)
+{
+    if (!fFinal && ss.size() < REST_RANGE_CHUNK_SIZE)
+        return;
+    std::string strData = rf == RF_HEX ? HexStr(ss.begin(), ss.end()) : ss.str();
+    ss.clear();
+    if (fFinal)
+        req->WriteReply(HTTP_OK, rf == RF_HEX ? strData + "\n" : strData);
+    else
+        req->WriteReplyChunk(strData);
+}
+
+static bool rest_headers_range(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseHeightRange(req, params[0], MAX_REST_HEADERS_RANGE, vIndex))
+        return false;
+
+    if (rf == RF_JSON) {
+        req->WriteHeader("Content-Type", "application/json");
+        CJSONStreamWriter out(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1));
+        out.BeginArray();
+        for (const CBlockIndex* pindex : vIndex) {
+            LOCK(cs_main);
+            out.Value(blockheaderToJSON(pindex));
+        }
+        out.EndArray();
+        req->WriteReply(HTTP_OK, out.Finish() + "\n");
+        return true;
+    }
+
+    // Block index entries are never deleted, and headers in the active chain do not change
+    req->WriteHeader("Content-Type", rf == RF_HEX ? "text/plain" : "application/octet-stream");
+    CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CBlockIndex* pindex : vIndex) {
+        ssHeaders << pindex->GetBlockHeader();
+        WriteRangeData(req, rf, ssHeaders, false);
+    }
+    WriteRangeData(req, rf, ssHeaders, true);
+    return true;
+}
+
+static bool rest_blocks_range(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<const CBlockIndex*> vIndex;
+    if (!ParseHeightRange(req, params[0], MAX_REST_BLOCKS_RANGE, vIndex))
+        return false;
+
+    // Check all blocks are available before the reply starts
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex : vIndex) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+        }
+    }
+
+    CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+    std::unique_ptr<CJSONStreamWriter> out;
+    if (rf == RF_JSON) {
+        req->WriteHeader("Content-Type", "application/json");
+        out.reset(new CJSONStreamWriter(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1)));
+        out->BeginArray();
+    } else {
+        req->WriteHeader("Content-Type", rf == RF_HEX ? "text/plain" : "application/octet-stream");
+    }
+    for (const CBlockIndex* pindex : vIndex) {
+        CBlock block;
+        bool fRead;
+        {
+            LOCK(cs_main);
+            fRead = ReadBlockFromDisk(block, pindex);
+        }
+        if (!fRead) {
+            // Once the reply has started, the client only sees it end early
+            if (req->IsReplyChunked()) {
+                req->WriteReply(HTTP_INTERNAL_SERVER_ERROR);
+                return false;
+            }
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not found");
+        }
+        if (out) {
+            blockToJSONStream(block, pindex, false, *out);
+        } else {
+            ssBlocks << block;
+            WriteRangeData(req, rf, ssBlocks, false);
+        }
+    }
+    if (out) {
+        out->EndArray();
+        req->WriteReply(HTTP_OK, out->Finish() + "\n");
+    } else {
+        WriteRangeData(req, rf, ssBlocks, true);
+    }
+    return true;
+}
+
 static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -322,11 +477,10 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter out(boost::bind(&HTTPRequest::WriteReplyChunk, req, _1));
+        mempoolToJSONStream(true, out);
+        req->WriteReply(HTTP_OK, out.Finish() + "\n");
         return true;
     }
     default: {
@@ -459,8 +613,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
                 if (fInputParsed) //don't allow sending input over URI and HTTP RAW DATA
                     return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Combination of URI scheme inputs and raw post data is not allowed");
 
-                CDataStream oss(SER_NETWORK, PROTOCOL_VERSION);
-                oss << strRequestMutable;
+                CDataStream oss(strRequestMutable.data(), strRequestMutable.data() + strRequestMutable.size(), SER_NETWORK, PROTOCOL_VERSION);
                 oss >> fCheckMemPool;
                 oss >> vOutPoints;
             }
@@ -482,16 +635,22 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 
     // limit max outpoints
-    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
-        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+    size_t nMaxOutPoints = fInputParsed ? MAX_GETUTXOS_OUTPOINTS : MAX_GETUTXOS_BODY_OUTPOINTS;
+    if (vOutPoints.size() > nMaxOutPoints)
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", nMaxOutPoints, vOutPoints.size()));
 
     // check spentness and form a bitmap (as well as a JSON capable human-readble string representation)
     std::vector<unsigned char> bitmap;
     std::vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    std::vector<CCoin> vFound(vOutPoints.size());
+    int nChainHeight;
+    uint256 hashChainTip;
     {
         LOCK2(cs_main, mempool.cs);
+        nChainHeight = chainActive.Height();
+        hashChainTip = chainActive.Tip()->GetBlockHash();
 
         CCoinsView viewDummy;
         CCoinsViewCache view(&viewDummy);
@@ -502,27 +661,40 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         if (fCheckMemPool)
             view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
 
-        for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
+        // Look up each transaction once, however many of its outputs are queried
+        std::vector<size_t> vOrder(vOutPoints.size());
+        for (size_t i = 0; i < vOrder.size(); i++)
+            vOrder[i] = i;
+        std::sort(vOrder.begin(), vOrder.end(), [&vOutPoints](size_t a, size_t b) { return vOutPoints[a] < vOutPoints[b]; });
+
+        CCoins coins;
+        bool fHaveCoins = false;
+        for (size_t j = 0; j < vOrder.size(); j++) {
+            size_t i = vOrder[j];
             uint256 hash = vOutPoints[i].hash;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hits[i] = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            if (j == 0 || hash != vOutPoints[vOrder[j - 1]].hash) {
+                fHaveCoins = view.GetCoins(hash, coins);
+                if (fHaveCoins)
+                    mempool.pruneSpent(hash, coins);
+            }
+            if (fHaveCoins && coins.IsAvailable(vOutPoints[i].n)) {
+                hits[i] = true;
+                // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
+                // n is valid but points to an already spent output (IsNull).
+                vFound[i].nTxVer = coins.nVersion;
+                vFound[i].nHeight = coins.nHeight;
+                vFound[i].out = coins.vout.at(vOutPoints[i].n);
+                assert(!vFound[i].out.IsNull());
             }
-
-            bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
         }
     }
+
+    outs.reserve(hits.count());
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (hits[i])
+            outs.push_back(vFound[i]);
+        bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
+    }
     boost::to_block_range(hits, std::back_inserter(bitmap));
 
     switch (rf) {
@@ -530,7 +702,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         // serialize data
         // use exact same output as mentioned in Bip64
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         std::string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -540,7 +712,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
     case RF_HEX: {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         std::string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -553,8 +725,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.push_back(Pair("chainHeight", chainActive.Height()));
-        objGetUTXOResponse.push_back(Pair("chaintipHash", chainActive.Tip()->GetBlockHash().GetHex()));
+        objGetUTXOResponse.push_back(Pair("chainHeight", nChainHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashChainTip.GetHex()));
         objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
 
         UniValue utxos(UniValue::VARR);
@@ -587,6 +759,85 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_dapps(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    if (!pdAppStore)
+        return RESTERR(req, HTTP_NOT_FOUND, "DApp Store is disabled. Start with -dappstore to enable it");
+
+    // /rest/dapps.<ext> lists all dApps that are not deleted, /rest/dapps/<txid>.<ext> returns one
+    std::vector<std::pair<uint256, DAppExt> > vDApps;
+    bool fSingle = !params[0].empty();
+    {
+        LOCK(cs_main);
+        if (fSingle) {
+            uint256 txid;
+            if (params[0][0] != '/' || !ParseHashStr(params[0].substr(1), txid))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + params[0]);
+            std::unordered_map<uint256, DAppExt>::const_iterator it = pdAppStore->dApps.find(txid);
+            if (it == pdAppStore->dApps.end())
+                return RESTERR(req, HTTP_NOT_FOUND, txid.GetHex() + " not found");
+            vDApps.push_back(*it);
+        } else {
+            for (const uint256& txid : pdAppStore->dAppTxs) {
+                const DAppExt& dApp = pdAppStore->dApps[txid];
+                if (!dApp.deleted)
+                    vDApps.push_back(std::make_pair(txid, dApp));
+            }
+        }
+    }
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssDApps(SER_NETWORK, PROTOCOL_VERSION);
+        if (fSingle)
+            ssDApps << vDApps[0];
+        else
+            ssDApps << vDApps;
+        if (rf == RF_HEX) {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(ssDApps.begin(), ssDApps.end()) + "\n");
+        } else {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssDApps.str());
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue ret(UniValue::VARR);
+        for (const std::pair<uint256, DAppExt>& item : vDApps)
+            ret.push_back(dAppToJson(item.first, item.second, false));
+        std::string strJSON = (fSingle ? ret[0].write() : ret.write()) + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!strURIPart.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Not found");
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, GetPrometheusMetrics());
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -598,13 +849,28 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/headersbyheight/", rest_headers_range},
+      {"/rest/blocksbyheight/", rest_blocks_range},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/dapps", rest_dapps},
+      {"/rest/metrics", rest_metrics},
 };
 
+/** Runs a handler and accounts the request to its prefix for getrpcstats */
+static bool rest_timed(bool (*handler)(HTTPRequest* req, const std::string& strReq), const char* prefix, HTTPRequest* req, const std::string& strURIPart)
+{
+    int64_t nStart = GetTimeMicros();
+    int64_t nLockWaitStart = GetThreadLockWaitMicros();
+    bool fRet = handler(req, strURIPart);
+    RecordRequest(STATS_REST, prefix, GetTimeMicros() - nStart, GetThreadLockWaitMicros() - nLockWaitStart, req->GetReplyStatus() >= 400);
+    RecordReplyBytes(STATS_REST, prefix, req->GetReplyBytes());
+    return fRet;
+}
+
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, boost::bind(&rest_timed, uri_prefixes[i].handler, uri_prefixes[i].prefix, _1, _2));
     return true;
 }
 
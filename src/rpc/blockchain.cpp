@@ -7,10 +7,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainstatus.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "coinsprefetch.h"
 #include "kernel.h"
 #include "main.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "sync.h"
 #include "txdb.h"
@@ -92,46 +95,37 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** The members of blockToJSON before and after "tx". Requires cs_main. */
+static void blockToJSONMembers(const CBlock& block, const CBlockIndex* blockindex, UniValue& head, UniValue& tail)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    head.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    for (const CTransaction& tx : block.vtx) {
-        if (txDetails) {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(0), objTx);
-            txs.push_back(objTx);
-        } else
-            txs.push_back(tx.GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    head.push_back(Pair("confirmations", confirmations));
+    head.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    head.push_back(Pair("height", blockindex->nHeight));
+    head.push_back(Pair("version", block.nVersion));
+    head.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+
+    tail.push_back(Pair("time", block.GetBlockTime()));
+    tail.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    tail.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    tail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    tail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    tail.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        tail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
     CBlockIndex* pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        tail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
 
-    result.push_back(Pair("modifier", strprintf("%016x", blockindex->nStakeModifier)));
-    result.push_back(Pair("modifierV2", blockindex->nStakeModifierV2.GetHex()));
+    tail.push_back(Pair("modifier", strprintf("%016x", blockindex->nStakeModifier)));
+    tail.push_back(Pair("modifierV2", blockindex->nStakeModifierV2.GetHex()));
 
-    result.push_back(Pair("moneysupply",ValueFromAmount(blockindex->nMoneySupply)));
+    tail.push_back(Pair("moneysupply",ValueFromAmount(blockindex->nMoneySupply)));
 
     //////////
     ////////// Coin stake data ////////////////
@@ -141,8 +135,16 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         uint256 hashProofOfStakeRet;
         std::unique_ptr <CStakeInput> stake;
         // Initialize the stake object (we should look for this in some other place and not initialize it every time..)
-        if (!initStakeInput(block, stake, blockindex->nHeight - 1))
+        if (!initStakeInput(block, stake, blockindex->nHeight - 1)) {
+            // A spent stake input may only be found in a pruned block
+            if (fHavePruned) {
+                UniValue stakeData(UniValue::VOBJ);
+                stakeData.push_back(Pair("pruned", true));
+                tail.push_back(Pair("CoinStake", stakeData));
+                return;
+            }
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Cannot initialize stake input");
+        }
 
         unsigned int nTxTime = block.nTime;
         // todo: Add the debug as param..
@@ -153,12 +155,59 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         stakeData.push_back(Pair("BlockFromHash", stake.get()->GetIndexFrom()->GetBlockHash().GetHex()));
         stakeData.push_back(Pair("BlockFromHeight", stake.get()->GetIndexFrom()->nHeight));
         stakeData.push_back(Pair("hashProofOfStake", hashProofOfStakeRet.GetHex()));
-        result.push_back(Pair("CoinStake", stakeData));
+        tail.push_back(Pair("CoinStake", stakeData));
     }
+}
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue tail(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        blockToJSONMembers(block, blockindex, result, tail);
+    }
+    UniValue txs(UniValue::VARR);
+    for (const CTransaction& tx : block.vtx) {
+        if (txDetails) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(0), objTx);
+            txs.push_back(objTx);
+        } else
+            txs.push_back(tx.GetHash().GetHex());
+    }
+    result.push_back(Pair("tx", txs));
+    result.pushKVs(tail);
     return result;
 }
 
+/** Write the same document as blockToJSON, one transaction at a time */
+void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStreamWriter& out)
+{
+    UniValue head(UniValue::VOBJ);
+    UniValue tail(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        blockToJSONMembers(block, blockindex, head, tail);
+    }
+
+    out.BeginObject();
+    out.WriteMembers(head);
+    out.Key("tx");
+    out.BeginArray();
+    for (const CTransaction& tx : block.vtx) {
+        if (txDetails) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(0), objTx);
+            out.Value(objTx);
+        } else
+            out.Value(tx.GetHash().GetHex());
+    }
+    out.EndArray();
+    out.WriteMembers(tail);
+    out.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -173,8 +222,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             HelpExampleCli("getblockcount", "") +
             HelpExampleRpc("getblockcount", ""));
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainStatus()->nHeight;
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -191,8 +239,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             HelpExampleCli("getbestblockhash", "") +
             HelpExampleRpc("getbestblockhash", ""));
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainStatus()->hashBlock.GetHex();
 }
 
 void RPCNotifyBlockChange(const uint256 hashBlock)
@@ -356,36 +403,39 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 }
 
 
+/** Verbose mempoolToJSON entry. Requires mempool.cs. */
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    std::set<std::string> setDepends;
+    for (const CTxIn& txin : tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    for (const std::string& dep : setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry : mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            std::set<std::string> setDepends;
-            for (const CTxIn& txin : tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            for (const std::string& dep : setDepends) {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+        for (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry : mempool.mapTx)
+            o.push_back(Pair(entry.first.ToString(), mempoolEntryToJSON(entry.second)));
         return o;
     } else {
         std::vector<uint256> vtxid;
@@ -399,6 +449,26 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** Write the same document as mempoolToJSON, one entry at a time */
+void mempoolToJSONStream(bool fVerbose, CJSONStreamWriter& out)
+{
+    if (fVerbose) {
+        LOCK(mempool.cs);
+        out.BeginObject();
+        for (const PAIRTYPE(const uint256, CTxMemPoolEntry) & entry : mempool.mapTx)
+            out.Write(entry.first.ToString(), mempoolEntryToJSON(entry.second));
+        out.EndObject();
+    } else {
+        std::vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        out.BeginArray();
+        for (const uint256& hash : vtxid)
+            out.Value(hash.ToString());
+        out.EndArray();
+    }
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -441,6 +511,17 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+bool getrawmempool_stream(const UniValue& params, CJSONStreamWriter& out)
+{
+    if (params.size() > 1)
+        return false;
+
+    LOCK(cs_main);
+
+    mempoolToJSONStream(ParseBool(params[0]), out);
+    return true;
+}
+
 UniValue clearmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -486,6 +567,28 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+/** Look up the block for getblock and read it, holding cs_main for the lookup only */
+static CBlockIndex* ReadBlockChecked(const uint256& hash, CBlock& block)
+{
+    CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
+
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -523,6 +626,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "    \"BlockFromHash\": \"hash\",    (string) Block hash of the coin stake input\n"
             "    \"BlockFromHeight\": n,       (numeric) Block Height of the coin stake input\n"
             "    \"hashProofOfStake\": \"hash\"  (string) Proof of Stake hash\n"
+            "    \"pruned\": true              (boolean) Only present, instead of the above, if the stake input is in a pruned block\n"
             "  }\n"
             "}\n"
 
@@ -533,21 +637,13 @@ UniValue getblock(const UniValue& params, bool fHelp)
             HelpExampleCli("getblock", "\"1e5aca38a7e5f2e2aea1b88335df9afc64b71544fcb93a708a516e492bd806a5\"") +
             HelpExampleRpc("getblock", "\"1e5aca38a7e5f2e2aea1b88335df9afc64b71544fcb93a708a516e492bd806a5\""));
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
     bool fVerbose = ParseBool(params[1], true);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadBlockChecked(hash, block);
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -559,6 +655,19 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+bool getblock_stream(const UniValue& params, CJSONStreamWriter& out)
+{
+    if (params.size() < 1 || params.size() > 2 || !ParseBool(params[1], true))
+        return false;
+
+    uint256 hash(params[0].get_str());
+    CBlock block;
+    CBlockIndex* pblockindex = ReadBlockChecked(hash, block);
+
+    blockToJSONStream(block, pblockindex, false, out);
+    return true;
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -616,42 +725,80 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( hash_or_height hash_serialized )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are kept up to date as blocks are connected, so they are available immediately,\n"
+            "also for earlier blocks connected by this node. Only hash_serialized takes a scan of the set.\n"
+
+            "\nArguments:\n"
+            "1. hash_or_height   (string or numeric, optional, default=the best block) The hash or height of the block\n"
+            "                    whose resulting UTXO set to describe\n"
+            "2. hash_serialized  (boolean, optional, default=true) Also report hash_serialized, for the best block only.\n"
+            "                    The scan is redone when the best block changes\n"
 
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"height\":n,     (numeric) The block height (index)\n"
+            "  \"bestblock\": \"hex\",   (string) the block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (only for the best block)\n"
+            "  \"muhash\": \"hash\",      (string) The order-independent MuHash3072 of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") +
-            HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "1000") +
+            HelpExampleCli("gettxoutsetinfo", "null false") +
+            HelpExampleCli("gettxoutsetinfo", "'\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"'") +
+            HelpExampleRpc("gettxoutsetinfo", "1000"));
 
     LOCK(cs_main);
 
-    UniValue ret(UniValue::VOBJ);
+    const CBlockIndex* pindex = chainActive.Tip();
+    if (params.size() > 0 && !params[0].isNull()) {
+        if (params[0].isNum()) {
+            int nHeight = params[0].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[nHeight];
+        } else {
+            uint256 hash(params[0].get_str());
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi == mapBlockIndex.end())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pindex = mi->second;
+        }
+    }
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    if (!GetUtxoStats(pindex, stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "UTXO set statistics are not available for this block");
+
+    // The serialized hash depends on the order of the whole set, so it comes from a scan of the flushed coin database
+    bool fHashSerialized = pindex == chainActive.Tip() && (params.size() < 2 || params[1].get_bool());
+    if (fHashSerialized) {
+        CCoinsStats statsScan;
+        FlushStateToDisk();
+        if (!pcoinsTip->GetStats(statsScan))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the UTXO set");
+        stats.hashSerialized = statsScan.hashSerialized;
     }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+    if (fHashSerialized)
+        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+    ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     return ret;
 }
 
@@ -694,8 +841,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             "\nAs a json rpc call\n" +
             HelpExampleRpc("gettxout", "\"txid\", 1"));
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
@@ -704,26 +849,33 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     bool fMempool = ParseBool(params[2], true);
 
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    uint256 hashBestBlock;
+    int nBestHeight;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoins(hash, coins))
+                return NullUniValue;
+            mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        } else {
+            if (!pcoinsTip->GetCoins(hash, coins))
+                return NullUniValue;
+        }
+
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        hashBestBlock = it->second->GetBlockHash();
+        nBestHeight = it->second->nHeight;
     }
     if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
         return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex* pindex = it->second;
-    ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
+    ret.push_back(Pair("bestblock", hashBestBlock.GetHex()));
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", -1));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
+        ret.push_back(Pair("confirmations", nBestHeight - coins.nHeight + 1));
     ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
     UniValue o(UniValue::VOBJ);
     ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
@@ -781,6 +933,22 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored, only with pruning\n"
+            "  \"import\": {               (object) only while -reindex or a block file import is running\n"
+            "     \"file\": n,              (numeric) number of the block file being validated, -1 for external files\n"
+            "     \"blocks\": n,            (numeric) blocks imported so far\n"
+            "     \"blockspersec\": x.x,    (numeric) average import rate\n"
+            "  },\n"
+            "  \"coinsprefetch\": {        (object) reads of block inputs ahead of their validation, unless -prefetchthreads=0\n"
+            "     \"queued\": n,            (numeric) reads issued\n"
+            "     \"hits\": n,              (numeric) coins database lookups answered by a finished read\n"
+            "     \"waits\": n,             (numeric) lookups that waited for a read in flight\n"
+            "     \"misses\": n,            (numeric) lookups read from the database\n"
+            "     \"discarded\": n,         (numeric) reads dropped unused\n"
+            "     \"staged\": n,            (numeric) reads waiting to be used\n"
+            "     \"hitrate\": x.x          (numeric) fraction of the lookups answered by hits and waits\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -800,16 +968,39 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             HelpExampleCli("getblockchaininfo", "") +
             HelpExampleRpc("getblockchaininfo", ""));
 
-    LOCK(cs_main);
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain", Params().NetworkIDString()));
-    obj.push_back(Pair("blocks", (int)chainActive.Height()));
-    obj.push_back(Pair("headers", pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash", chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty", (double)GetDifficulty()));
-    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
-    obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("blocks", status->nHeight));
+    obj.push_back(Pair("headers", status->nHeadersHeight));
+    obj.push_back(Pair("bestblockhash", status->hashBlock.GetHex()));
+    obj.push_back(Pair("difficulty", status->dDifficulty));
+    obj.push_back(Pair("verificationprogress", status->dVerificationProgress));
+    obj.push_back(Pair("chainwork", status->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode)
+        obj.push_back(Pair("pruneheight", GetPruneHeight()));
+    if (fImporting || fReindex) {
+        CImportProgress progress = GetImportProgress();
+        UniValue import(UniValue::VOBJ);
+        import.push_back(Pair("file", progress.nFile));
+        import.push_back(Pair("blocks", progress.nBlocks));
+        import.push_back(Pair("blockspersec", progress.dBlocksPerSecond));
+        obj.push_back(Pair("import", import));
+    }
+    if (pcoinsPrefetch) {
+        CCoinsPrefetchStats prefetch = pcoinsPrefetch->GetPrefetchStats();
+        UniValue coinsprefetch(UniValue::VOBJ);
+        coinsprefetch.push_back(Pair("queued", prefetch.nQueued));
+        coinsprefetch.push_back(Pair("hits", prefetch.nHits));
+        coinsprefetch.push_back(Pair("waits", prefetch.nWaits));
+        coinsprefetch.push_back(Pair("misses", prefetch.nMisses));
+        coinsprefetch.push_back(Pair("discarded", prefetch.nDiscarded));
+        coinsprefetch.push_back(Pair("staged", (uint64_t)prefetch.nStaged));
+        coinsprefetch.push_back(Pair("hitrate", prefetch.HitRate()));
+        obj.push_back(Pair("coinsprefetch", coinsprefetch));
+    }
     return obj;
 }
 
@@ -1146,6 +1337,9 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
     if (!pindex)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
 
+    if (fHavePruned && heightStart < GetPruneHeight())
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Block not available (pruned data)");
+
     while (true) {
         CBlock block;
         if (!ReadBlockFromDisk(block, pindex)) {
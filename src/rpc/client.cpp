@@ -29,6 +29,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     {
         {"stop", 0},
         {"setmocktime", 0},
+        {"setlockprofiler", 0},
+        {"getlockprofile", 0},
+        {"getlockprofile", 1},
         {"getaddednodeinfo", 0},
         {"setgenerate", 0},
         {"setgenerate", 1},
@@ -51,6 +54,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getbalance", 1},
         {"getbalance", 2},
         {"getblockhash", 0},
+        {"gettxoutsetinfo", 0},
+        {"gettxoutsetinfo", 1},
         {"waitforblockheight", 0 },
         {"waitforblockheight", 1 },
         {"waitforblock", 1 },
@@ -82,6 +87,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listunspent", 2},
         {"listunspent", 3},
         {"getblock", 1},
+        {"getrpcstats", 0},
         {"getblockheader", 1},
         {"gettransaction", 1},
         {"listdapps", 0},
@@ -94,6 +100,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"signrawtransaction", 2},
         {"sendrawtransaction", 1},
         {"sendrawtransaction", 2},
+        {"sendrawtransactions", 0},
+        {"sendrawtransactions", 1},
         {"gettxout", 1},
         {"gettxout", 2},
         {"lockunspent", 0},
@@ -6,6 +6,7 @@
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "uint256.h"
 
@@ -519,6 +520,29 @@ UniValue listdapps(const UniValue &params, bool fHelp) {
     return ret;
 }
 
+bool listdapps_stream(const UniValue& params, CJSONStreamWriter& out)
+{
+    if (params.size() > 1 || !pdAppStore)
+        return false;
+
+    int fVerbose = 0;
+    if (!params[0].isNull())
+        fVerbose = params[0].isNum() ? params[0].get_int() : (params[0].get_bool() ? 1 : 0);
+
+    LOCK(cs_main);
+
+    out.BeginArray();
+    for (auto dAppTx : pdAppStore->dAppTxs)
+        if (!pdAppStore->dApps[dAppTx].deleted || fVerbose == 2) {
+            if (fVerbose)
+                out.Value(dAppToJson(dAppTx, pdAppStore->dApps[dAppTx], fVerbose == 2));
+            else
+                out.Value(dAppTx.GetHex());
+        }
+    out.EndArray();
+    return true;
+}
+
 UniValue listmydapps(const UniValue &params, bool fHelp) {
     if (fHelp || params.size() > 1)
         throw std::runtime_error(
@@ -0,0 +1,105 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn) : sink(sinkIn),
+                                                                                 nChunkSize(nChunkSizeIn),
+                                                                                 fAfterKey(false),
+                                                                                 fStarted(false)
+{
+    strBuffer.reserve(nChunkSize);
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+        return;
+    if (!vEmpty.back())
+        strBuffer += ',';
+    vEmpty.back() = false;
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.size() < nChunkSize || vEmpty.empty())
+        return;
+    fStarted = true;
+    sink(strBuffer);
+    strBuffer.clear();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    strBuffer += '}';
+    vEmpty.pop_back();
+    Flush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    strBuffer += ']';
+    vEmpty.pop_back();
+    Flush();
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    assert(!fAfterKey);
+    Separate();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    strBuffer += value.write();
+    Flush();
+}
+
+void CJSONStreamWriter::Write(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void CJSONStreamWriter::WriteMembers(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (unsigned int i = 0; i < keys.size(); i++)
+        Write(keys[i], values[i]);
+}
+
+std::string CJSONStreamWriter::Finish()
+{
+    assert(vEmpty.empty() && !fAfterKey);
+    std::string strRest;
+    strRest.swap(strBuffer);
+    return strRest;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/** Number of bytes buffered before they are passed on to the sink */
+static const size_t DEFAULT_JSON_STREAM_CHUNK = 64 * 1024;
+
+/**
+ * Writes a JSON document piece by piece, so large results do not have to be
+ * built as one UniValue tree and then as one string before the first byte
+ * can be sent. Output is buffered and handed to the sink whenever about
+ * nChunkSize bytes have accumulated; Finish() returns whatever is left.
+ *
+ * The output is identical to UniValue::write() of the equivalent tree.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef boost::function<void(const std::string&)> Sink;
+
+    CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write the key of the next member of the current object */
+    void Key(const std::string& key);
+    /** Write a complete value */
+    void Value(const UniValue& value);
+    /** Write a member of the current object */
+    void Write(const std::string& key, const UniValue& value);
+    /** Write all members of obj as members of the current object */
+    void WriteMembers(const UniValue& obj);
+
+    /** Whether part of the output has already been passed to the sink */
+    bool Started() const { return fStarted; }
+    /** Return the output not yet passed to the sink */
+    std::string Finish();
+
+private:
+    void Separate();
+    void Flush();
+
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    //! For each open object or array, whether nothing was written in it yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fStarted;
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -11,6 +11,7 @@
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "utilmoneystr.h"
 
@@ -46,6 +47,45 @@ UniValue getpoolinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+/** Fill obj with the listmasternodes entry of a ranked masternode, or return false if it is unknown or filtered out */
+static bool masternodeToJSON(int nRank, const CMasternode& mnRanked, const std::string& strFilter, UniValue& obj)
+{
+    std::string strTxHash = mnRanked.vin.prevout.hash.ToString();
+    uint32_t oIdx = mnRanked.vin.prevout.n;
+
+    CMasternode* mn = mnodeman.Find(mnRanked.vin);
+    if (mn == NULL)
+        return false;
+
+    if (strFilter != "" &&
+        strTxHash.find(strFilter) == std::string::npos &&
+        mn->GetStatus().find(strFilter) == std::string::npos &&
+        CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == std::string::npos &&
+        mn->addr.ToString().find(strFilter) == std::string::npos)
+        return false;
+
+    std::string strStatus = mn->GetStatus();
+    std::string strHost;
+    int port;
+    SplitHostPort(mn->addr.ToString(), port, strHost);
+    CNetAddr node = CNetAddr(strHost, false);
+    std::string strNetwork = GetNetworkName(node.GetNetwork());
+
+    obj.push_back(Pair("rank", (strStatus == "ENABLED" ? nRank : 0)));
+    obj.push_back(Pair("network", strNetwork));
+    obj.push_back(Pair("txhash", strTxHash));
+    obj.push_back(Pair("outidx", (uint64_t)oIdx));
+    obj.push_back(Pair("pubkey", HexStr(mn->pubKeyMasternode)));
+    obj.push_back(Pair("status", strStatus));
+    obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
+    obj.push_back(Pair("netaddr", mn->addr.ToString()));
+    obj.push_back(Pair("version", mn->protocolVersion));
+    obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
+    obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
+    obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
+    return true;
+}
+
 UniValue listmasternodes(const UniValue& params, bool fHelp)
 {
     std::string strFilter = "";
@@ -93,47 +133,39 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
     std::vector<std::pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
     for (PAIRTYPE(int, CMasternode) & s : vMasternodeRanks) {
         UniValue obj(UniValue::VOBJ);
-        std::string strVin = s.second.vin.prevout.ToStringShort();
-        std::string strTxHash = s.second.vin.prevout.hash.ToString();
-        uint32_t oIdx = s.second.vin.prevout.n;
-
-        CMasternode* mn = mnodeman.Find(s.second.vin);
-
-        if (mn != NULL) {
-            if (strFilter != "" &&
-                strTxHash.find(strFilter) == std::string::npos &&
-                mn->GetStatus().find(strFilter) == std::string::npos &&
-                CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString().find(strFilter) == std::string::npos &&
-                mn->addr.ToString().find(strFilter) == std::string::npos)
-                continue;
-
-            std::string strStatus = mn->GetStatus();
-            std::string strHost;
-            int port;
-            SplitHostPort(mn->addr.ToString(), port, strHost);
-            CNetAddr node = CNetAddr(strHost, false);
-            std::string strNetwork = GetNetworkName(node.GetNetwork());
-
-            obj.push_back(Pair("rank", (strStatus == "ENABLED" ? s.first : 0)));
-            obj.push_back(Pair("network", strNetwork));
-            obj.push_back(Pair("txhash", strTxHash));
-            obj.push_back(Pair("outidx", (uint64_t)oIdx));
-            obj.push_back(Pair("pubkey", HexStr(mn->pubKeyMasternode)));
-            obj.push_back(Pair("status", strStatus));
-            obj.push_back(Pair("addr", CBitcoinAddress(mn->pubKeyCollateralAddress.GetID()).ToString()));
-            obj.push_back(Pair("netaddr", mn->addr.ToString()));
-            obj.push_back(Pair("version", mn->protocolVersion));
-            obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
-            obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
-            obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
-
+        if (masternodeToJSON(s.first, s.second, strFilter, obj))
             ret.push_back(obj);
-        }
     }
 
     return ret;
 }
 
+bool listmasternodes_stream(const UniValue& params, CJSONStreamWriter& out)
+{
+    if (params.size() > 1)
+        return false;
+
+    std::string strFilter = "";
+    if (params.size() == 1) strFilter = params[0].get_str();
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindex = chainActive.Tip();
+        if(!pindex) return false;
+        nHeight = pindex->nHeight;
+    }
+    std::vector<std::pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
+    out.BeginArray();
+    for (PAIRTYPE(int, CMasternode) & s : vMasternodeRanks) {
+        UniValue obj(UniValue::VOBJ);
+        if (masternodeToJSON(s.first, s.second, strFilter, obj))
+            out.Value(obj);
+    }
+    out.EndArray();
+    return true;
+}
+
 UniValue masternodeconnect(const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() != 1))
@@ -181,23 +213,20 @@ UniValue getmasternodecount (const UniValue& params, bool fHelp)
             HelpExampleCli("getmasternodecount", "") +
             HelpExampleRpc("getmasternodecount", ""));
 
+    // Refreshed every few seconds by the obfuscation thread, which does not run in lite mode
+    CMasternodeCounts counts = GetChainStatus()->mnCounts;
+    if (!counts.fValid)
+        counts = mnodeman.GetCounts(GetChainStatus()->nHeight);
+
     UniValue obj(UniValue::VOBJ);
-    int nCount = 0;
-    int ipv4 = 0, ipv6 = 0, onion = 0;
-
-    if (chainActive.Tip())
-        mnodeman.GetNextMasternodeInQueueForPayment(chainActive.Tip()->nHeight, true, nCount);
-
-    mnodeman.CountNetworks(ActiveProtocol(), ipv4, ipv6, onion);
-
-    obj.push_back(Pair("total", mnodeman.size()));
-    obj.push_back(Pair("stable", mnodeman.stable_size()));
-    obj.push_back(Pair("obfcompat", mnodeman.CountEnabled(ActiveProtocol())));
-    obj.push_back(Pair("enabled", mnodeman.CountEnabled()));
-    obj.push_back(Pair("inqueue", nCount));
-    obj.push_back(Pair("ipv4", ipv4));
-    obj.push_back(Pair("ipv6", ipv6));
-    obj.push_back(Pair("onion", onion));
+    obj.push_back(Pair("total", counts.nTotal));
+    obj.push_back(Pair("stable", counts.nStable));
+    obj.push_back(Pair("obfcompat", counts.nObfCompat));
+    obj.push_back(Pair("enabled", counts.nEnabled));
+    obj.push_back(Pair("inqueue", counts.nInQueue));
+    obj.push_back(Pair("ipv4", counts.nIPv4));
+    obj.push_back(Pair("ipv6", counts.nIPv6));
+    obj.push_back(Pair("onion", counts.nOnion));
 
     return obj;
 }
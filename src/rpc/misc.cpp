@@ -7,6 +7,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainstatus.h"
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
@@ -21,6 +22,9 @@
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
+#if ENABLE_ZMQ
+#include "zmq/zmqnotificationinterface.h"
+#endif
 
 #include <stdint.h>
 
@@ -74,11 +78,9 @@ UniValue getinfo(const UniValue& params, bool fHelp)
             HelpExampleCli("getinfo", "") +
             HelpExampleRpc("getinfo", ""));
 
-#ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
-#else
-    LOCK(cs_main);
-#endif
+    // The chain fields come from the tip snapshot, so a block being connected
+    // does not hold up the reply; the wallet takes its own locks
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
 
     std::string services;
     for (int i = 0; i < 8; i++) {
@@ -111,24 +113,25 @@ UniValue getinfo(const UniValue& params, bool fHelp)
         obj.push_back(Pair("balance", ValueFromAmount(pwalletMain->GetBalance())));
     }
 #endif
-    obj.push_back(Pair("blocks", (int)chainActive.Height()));
+    obj.push_back(Pair("blocks", status->nHeight));
     obj.push_back(Pair("timeoffset", GetTimeOffset()));
     obj.push_back(Pair("connections", (int)vNodes.size()));
     obj.push_back(Pair("proxy", (proxy.IsValid() ? proxy.proxy.ToStringIPPort() : std::string())));
-    obj.push_back(Pair("difficulty", (double)GetDifficulty()));
+    obj.push_back(Pair("difficulty", status->dDifficulty));
     obj.push_back(Pair("testnet", Params().TestnetToBeDeprecatedFieldRPC()));
 
     // During inital block verification chainActive.Tip() might be not yet initialized
-    if (chainActive.Tip() == NULL) {
+    if (status->nHeight < 0) {
         obj.push_back(Pair("status", "Blockchain information not yet available"));
         return obj;
     }
 
-    obj.push_back(Pair("moneysupply",ValueFromAmount(chainActive.Tip()->nMoneySupply)));
+    obj.push_back(Pair("moneysupply",ValueFromAmount(status->nMoneySupply)));
 
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
         obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
+        LOCK(pwalletMain->cs_wallet);
         obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
     }
     if (pwalletMain && pwalletMain->IsCrypted())
@@ -136,12 +139,7 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("paytxfee", ValueFromAmount(payTxFee.GetFeePerK())));
 #endif
     obj.push_back(Pair("relayfee", ValueFromAmount(::minRelayTxFee.GetFeePerK())));
-    bool nStaking = false;
-    if (mapHashedBlocks.count(chainActive.Tip()->nHeight))
-        nStaking = true;
-    else if (mapHashedBlocks.count(chainActive.Tip()->nHeight - 1) && nLastCoinStakeSearchInterval)
-        nStaking = true;
-    obj.push_back(Pair("staking status", (nStaking ? "Staking Active" : "Staking Not Active")));
+    obj.push_back(Pair("staking status", (IsStakingActive(*status) ? "Staking Active" : "Staking Not Active")));
     obj.push_back(Pair("errors", GetWarnings("statusbar")));
     return obj;
 }
@@ -501,8 +499,6 @@ UniValue verifymessage(const UniValue& params, bool fHelp)
             "\nAs json rpc\n" +
             HelpExampleRpc("verifymessage", "\"NYkDC3hHouRaCSAMNsSxFj5Xv1h5etPzGT\", \"signature\", \"my message\""));
 
-    LOCK(cs_main);
-
     std::string strAddress = params[0].get_str();
     std::string strSign = params[1].get_str();
     std::string strMessage = params[2].get_str();
@@ -554,6 +550,165 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue setlockprofiler(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "setlockprofiler rate\n"
+            "\nEnable or disable the lock contention profiler. While enabled, one in every rate\n"
+            "acquisitions of a lock by each thread is timed, and its wait and hold times are\n"
+            "accounted to the source line that took the lock. See getlockprofile.\n"
+
+            "\nArguments:\n"
+            "1. rate    (numeric, required) Sample one in rate acquisitions, 1 for all of them, 0 to disable\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("setlockprofiler", "100") +
+            HelpExampleRpc("setlockprofiler", "0"));
+
+    int nRate = params[0].get_int();
+    if (nRate < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid rate");
+    nLockProfilerRate = nRate;
+
+    return NullUniValue;
+}
+
+static bool CompareLockSiteWait(const CLockSiteStats& a, const CLockSiteStats& b)
+{
+    if (a.nWaitMicros != b.nWaitMicros)
+        return a.nWaitMicros > b.nWaitMicros;
+    return a.nHoldMicros > b.nHoldMicros;
+}
+
+UniValue getlockprofile(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw std::runtime_error(
+            "getlockprofile ( count reset )\n"
+            "\nReturns the lock sites sampled by the lock contention profiler, the ones that\n"
+            "waited longest first. Times are totals over the samples; multiply by the rate for\n"
+            "an estimate of the totals over all acquisitions.\n"
+
+            "\nArguments:\n"
+            "1. count    (numeric, optional, default=20) Number of sites to return, 0 for all\n"
+            "2. reset    (boolean, optional, default=false) Clear the samples after returning them\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"rate\": n,               (numeric) Current sampling rate, 0 if disabled\n"
+            "  \"sites\": [\n"
+            "    {\n"
+            "      \"lock\": \"name\",       (string) The lock, as written at the site\n"
+            "      \"site\": \"file:line\",  (string) Where the lock was taken\n"
+            "      \"samples\": n,          (numeric) Sampled acquisitions\n"
+            "      \"contended\": n,        (numeric) Samples that had to wait for the lock\n"
+            "      \"wait_ms\": n,          (numeric) Total time spent waiting\n"
+            "      \"max_wait_ms\": n,      (numeric) Longest wait\n"
+            "      \"hold_ms\": n,          (numeric) Total time the lock was held\n"
+            "      \"max_hold_ms\": n       (numeric) Longest hold\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getlockprofile", "") +
+            HelpExampleCli("getlockprofile", "10 true") +
+            HelpExampleRpc("getlockprofile", "10, true"));
+
+    int nCount = 20;
+    if (params.size() > 0)
+        nCount = params[0].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count");
+
+    std::vector<CLockSiteStats> vSites = GetLockProfile();
+    std::sort(vSites.begin(), vSites.end(), CompareLockSiteWait);
+    if (nCount > 0 && vSites.size() > (size_t)nCount)
+        vSites.resize(nCount);
+
+    UniValue sites(UniValue::VARR);
+    for (const CLockSiteStats& site : vSites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", site.strName));
+        obj.push_back(Pair("site", strprintf("%s:%d", site.strFile, site.nLine)));
+        obj.push_back(Pair("samples", (uint64_t)site.nSamples));
+        obj.push_back(Pair("contended", (uint64_t)site.nContended));
+        obj.push_back(Pair("wait_ms", site.nWaitMicros * 0.001));
+        obj.push_back(Pair("max_wait_ms", site.nMaxWaitMicros * 0.001));
+        obj.push_back(Pair("hold_ms", site.nHoldMicros * 0.001));
+        obj.push_back(Pair("max_hold_ms", site.nMaxHoldMicros * 0.001));
+        sites.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("rate", nLockProfilerRate.load()));
+    ret.push_back(Pair("sites", sites));
+
+    if (params.size() > 1 && params[1].get_bool())
+        ResetLockProfile();
+    return ret;
+}
+
+UniValue getzmqnotifications(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getzmqnotifications\n"
+            "\nReturns information about the active ZeroMQ notifications and the publisher queue.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"queuesize\": n,          (numeric) Notifications waiting to be published\n"
+            "  \"maxqueuesize\": n,       (numeric) Highest queue depth seen so far\n"
+            "  \"queuelimit\": n,         (numeric) Queue depth above which notifications are dropped (-zmqqueuesize)\n"
+            "  \"enqueued\": n,           (numeric) Notifications accepted into the queue\n"
+            "  \"dropped\": n,            (numeric) Notifications dropped because the queue was full\n"
+            "  \"notifiers\": [\n"
+            "    {\n"
+            "      \"type\": \"pubhashtx\",  (string) Type of notification\n"
+            "      \"address\": \"...\",     (string) Address of the publisher\n"
+            "      \"hwm\": n,              (numeric) Outbound message high water mark\n"
+            "      \"sent\": n,             (numeric) Messages published\n"
+            "      \"failed\": n            (numeric) Messages that could not be sent\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getzmqnotifications", "") + HelpExampleRpc("getzmqnotifications", ""));
+
+    UniValue result(UniValue::VOBJ);
+    UniValue notifiers(UniValue::VARR);
+#if ENABLE_ZMQ
+    if (pzmqNotificationInterface) {
+        CZMQQueueStats queueStats;
+        std::vector<CZMQNotifierStats> notifierStats;
+        pzmqNotificationInterface->GetStats(queueStats, notifierStats);
+
+        result.push_back(Pair("queuesize", (uint64_t)queueStats.nDepth));
+        result.push_back(Pair("maxqueuesize", (uint64_t)queueStats.nMaxDepth));
+        result.push_back(Pair("queuelimit", (uint64_t)queueStats.nLimit));
+        result.push_back(Pair("enqueued", queueStats.nEnqueued));
+        result.push_back(Pair("dropped", queueStats.nDropped));
+
+        for (const CZMQNotifierStats& stats : notifierStats) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("type", stats.type));
+            obj.push_back(Pair("address", stats.address));
+            obj.push_back(Pair("hwm", stats.hwm));
+            obj.push_back(Pair("sent", stats.nSent));
+            obj.push_back(Pair("failed", stats.nFailed));
+            notifiers.push_back(obj);
+        }
+    }
+#endif
+    result.push_back(Pair("notifiers", notifiers));
+
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
@@ -570,6 +725,7 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"mintablecoins\": true|false,      (boolean) if the wallet has mintable coins\n"
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
+            "  \"blocksverified\": true|false,     (boolean) if the startup check of the block database has finished\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
             "}\n"
 
@@ -577,14 +733,11 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             HelpExampleCli("getstakingstatus", "") +
             HelpExampleRpc("getstakingstatus", ""));
 
-#ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
-#else
-    LOCK(cs_main);
-#endif
+    // Only the wallet queries take locks, and they take them themselves
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
 
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("validtime", chainActive.Tip()->nTime > 1471482000));
+    obj.push_back(Pair("validtime", status->nTime > 1471482000));
     obj.push_back(Pair("haveconnections", !vNodes.empty()));
     if (pwalletMain) {
         obj.push_back(Pair("walletunlocked", !pwalletMain->IsLocked()));
@@ -592,13 +745,9 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         obj.push_back(Pair("enoughcoins", nReserveBalance <= pwalletMain->GetBalance()));
     }
     obj.push_back(Pair("mnsync", masternodeSync.IsSynced()));
+    obj.push_back(Pair("blocksverified", (bool)fBlockDatabaseVerified));
 
-    bool nStaking = false;
-    if (mapHashedBlocks.count(chainActive.Tip()->nHeight))
-        nStaking = true;
-    else if (mapHashedBlocks.count(chainActive.Tip()->nHeight - 1) && nLastCoinStakeSearchInterval)
-        nStaking = true;
-    obj.push_back(Pair("staking status", nStaking));
+    obj.push_back(Pair("staking status", IsStakingActive(*status)));
 
     return obj;
 }
@@ -13,12 +13,14 @@
 #include "main.h"
 #include "net.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "script/script.h"
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
 #include "swifttx.h"
+#include "txsubmit.h"
 #include "uint256.h"
 #include "utilmoneystr.h"
 #ifdef ENABLE_WALLET
@@ -66,6 +68,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 
     if (!hashBlock.IsNull()) {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
+        LOCK(cs_main);
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
             CBlockIndex* pindex = (*mi).second;
@@ -152,8 +155,6 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
-    LOCK(cs_main);
-
     bool in_active_chain = true;
     uint256 hash = ParseHashV(params[0], "parameter 1");
     CBlockIndex* blockindex = nullptr;
@@ -162,6 +163,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     if (!params[2].isNull()) {
         uint256 blockhash = ParseHashV(params[2], "parameter 3");
+        LOCK(cs_main);
         BlockMap::iterator it = mapBlockIndex.find(blockhash);
         if (it == mapBlockIndex.end()) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block hash not found");
@@ -175,6 +177,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     if (!GetTransaction(hash, tx, hash_block, true, blockindex)) {
         std::string errmsg;
         if (blockindex) {
+            LOCK(cs_main);
             if (!(blockindex->nStatus & BLOCK_HAVE_DATA)) {
                 throw JSONRPCError(RPC_MISC_ERROR, "Block not available");
             }
@@ -198,6 +201,73 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 }
 
 #ifdef ENABLE_WALLET
+static void ParseListUnspentParams(const UniValue& params, int& nMinDepth, int& nMaxDepth, std::set<CBitcoinAddress>& setAddress)
+{
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VARR)(UniValue::VNUM));
+
+    nMinDepth = 1;
+    if (params.size() > 0)
+        nMinDepth = params[0].get_int();
+
+    nMaxDepth = 9999999;
+    if (params.size() > 1)
+        nMaxDepth = params[1].get_int();
+
+    if (params.size() > 2) {
+        UniValue inputs = params[2].get_array();
+        for (unsigned int inx = 0; inx < inputs.size(); inx++) {
+            const UniValue& input = inputs[inx];
+            CBitcoinAddress address(input.get_str());
+            if (!address.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid NBX address: ") + input.get_str());
+            if (setAddress.count(address))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid parameter, duplicated address: ") + input.get_str());
+            setAddress.insert(address);
+        }
+    }
+}
+
+/** Fill entry with the listunspent entry of out, or return false if it does not pass the filters */
+static bool unspentToJSON(const COutput& out, int nMinDepth, int nMaxDepth, const std::set<CBitcoinAddress>& setAddress, UniValue& entry)
+{
+    if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+        return false;
+
+    if (setAddress.size()) {
+        CTxDestination address;
+        if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
+            return false;
+
+        if (!setAddress.count(address))
+            return false;
+    }
+
+    CAmount nValue = out.tx->vout[out.i].nValue;
+    const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+    entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
+    entry.push_back(Pair("vout", out.i));
+    CTxDestination address;
+    if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
+        entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+        if (pwalletMain->mapAddressBook.count(address))
+            entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+    }
+    entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+    if (pk.IsPayToScriptHash()) {
+        CTxDestination address;
+        if (ExtractDestination(pk, address)) {
+            const CScriptID& hash = boost::get<CScriptID>(address);
+            CScript redeemScript;
+            if (pwalletMain->GetCScript(hash, redeemScript))
+                entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+        }
+    }
+    entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+    entry.push_back(Pair("confirmations", out.nDepth));
+    entry.push_back(Pair("spendable", out.fSpendable));
+    return true;
+}
+
 UniValue listunspent(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
@@ -239,29 +309,9 @@ UniValue listunspent(const UniValue& params, bool fHelp)
             HelpExampleCli("listunspent", "6 9999999 \"[\\\"NYkDC3hHouRaCSAMNsSxFj5Xv1h5etPzGT\\\",\\\"NbMDdS7JjQHKACRtJT3aGm31BLW2eNvALs\\\"]\"") +
             HelpExampleRpc("listunspent", "6, 9999999, [\"NYkDC3hHouRaCSAMNsSxFj5Xv1h5etPzGT\",\"NbMDdS7JjQHKACRtJT3aGm31BLW2eNvALs\"]"));
 
-    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VARR)(UniValue::VNUM));
-
-    int nMinDepth = 1;
-    if (params.size() > 0)
-        nMinDepth = params[0].get_int();
-
-    int nMaxDepth = 9999999;
-    if (params.size() > 1)
-        nMaxDepth = params[1].get_int();
-
+    int nMinDepth, nMaxDepth;
     std::set<CBitcoinAddress> setAddress;
-    if (params.size() > 2) {
-        UniValue inputs = params[2].get_array();
-        for (unsigned int inx = 0; inx < inputs.size(); inx++) {
-            const UniValue& input = inputs[inx];
-            CBitcoinAddress address(input.get_str());
-            if (!address.IsValid())
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid NBX address: ") + input.get_str());
-            if (setAddress.count(address))
-                throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid parameter, duplicated address: ") + input.get_str());
-            setAddress.insert(address);
-        }
-    }
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
 
     UniValue results(UniValue::VARR);
     std::vector<COutput> vecOutputs;
@@ -269,46 +319,34 @@ UniValue listunspent(const UniValue& params, bool fHelp)
     LOCK2(cs_main, pwalletMain->cs_wallet);
     pwalletMain->AvailableCoins(vecOutputs, false, NULL, true, ALL_COINS, false);
     for (const COutput& out : vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
+        UniValue entry(UniValue::VOBJ);
+        if (unspentToJSON(out, nMinDepth, nMaxDepth, setAddress, entry))
+            results.push_back(entry);
+    }
+
+    return results;
+}
 
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                continue;
+bool listunspent_stream(const UniValue& params, CJSONStreamWriter& out)
+{
+    if (params.size() > 3 || !pwalletMain)
+        return false;
 
-            if (!setAddress.count(address))
-                continue;
-        }
+    int nMinDepth, nMaxDepth;
+    std::set<CBitcoinAddress> setAddress;
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
 
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+    std::vector<COutput> vecOutputs;
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    pwalletMain->AvailableCoins(vecOutputs, false, NULL, true, ALL_COINS, false);
+    out.BeginArray();
+    for (const COutput& output : vecOutputs) {
         UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        CTxDestination address;
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
-        }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        if (pk.IsPayToScriptHash()) {
-            CTxDestination address;
-            if (ExtractDestination(pk, address)) {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
-            }
-        }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
-        results.push_back(entry);
+        if (unspentToJSON(output, nMinDepth, nMaxDepth, setAddress, entry))
+            out.Value(entry);
     }
-
-    return results;
+    out.EndArray();
+    return true;
 }
 #endif
 
@@ -501,7 +539,6 @@ UniValue decodescript(const UniValue& params, bool fHelp)
             HelpExampleCli("decodescript", "\"hexstring\"") +
             HelpExampleRpc("decodescript", "\"hexstring\""));
 
-    LOCK(cs_main);
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR));
 
     UniValue r(UniValue::VOBJ);
@@ -766,6 +803,7 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     UniValue vErrors(UniValue::VARR);
 
     // Sign what we can:
+    PrecomputedTransactionData txdata(mergedTx);
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn &txin = mergedTx.vin[i];
         const CCoins *coins = view.AccessCoins(txin.prevout.hash);
@@ -788,14 +826,14 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
         txin.scriptSig.clear();
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
-            SignSignature(keystore, *prevPubKey, mergedTx, i, nHashType);
+            SignSignature(keystore, *prevPubKey, mergedTx, i, nHashType, &txdata);
 
         // ... and merge in other signatures:
         for (const CMutableTransaction& txv : txVariants) {
             txin.scriptSig = CombineSignatures(*prevPubKey, mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
         }
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, *prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&mergedTx, i), &serror)) {
+        if (!VerifyScript(txin.scriptSig, *prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&mergedTx, i, &txdata), &serror)) {
             TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
         }
     }
@@ -838,7 +876,6 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
             "\nAs a json rpc call\n" +
             HelpExampleRpc("sendrawtransaction", "\"signedhex\""));
 
-    LOCK(cs_main);
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR)(UniValue::VBOOL));
 
     // parse hex string from parameter
@@ -851,6 +888,10 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 
     bool fSwiftX = ParseBool(params[2]);
 
+    // Verify the signatures before taking cs_main, so AcceptToMemoryPool finds them in the cache
+    PreVerifyTransactions(std::vector<CTransaction>(1, tx));
+
+    LOCK(cs_main);
     CCoinsViewCache& view = *pcoinsTip;
     const CCoins* existingCoins = view.AccessCoins(hashTx);
     bool fHaveMempool = mempool.exists(hashTx);
@@ -881,3 +922,78 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 
     return hashTx.GetHex();
 }
+
+UniValue sendrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions to local node and network.\n"
+            "The signatures of all transactions are verified in parallel, then the transactions are\n"
+            "added to the memory pool in the given order, so they may spend outputs of earlier ones.\n"
+
+            "\nArguments:\n"
+            "1. \"hexstrings\"    (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\": \"hash\",   (string) The transaction hash, absent if the transaction could not be decoded\n"
+            "    \"error\": null     (object) null if the transaction was submitted, otherwise the error as\n"
+            "                      sendrawtransaction would have reported it: { \"code\": n, \"message\": \"text\" }\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex2\\\"]\"") +
+            HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex2\"]"));
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    const UniValue& hexstrings = params[0].get_array();
+    bool fOverrideFees = ParseBool(params[1]);
+
+    std::vector<CTransaction> vtx;
+    std::vector<int> vIndex;
+    std::vector<UniValue> vEntries(hexstrings.size(), UniValue(UniValue::VOBJ));
+    for (unsigned int i = 0; i < hexstrings.size(); i++) {
+        CTransaction tx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(tx, hexstrings[i].get_str())) {
+            vEntries[i].push_back(Pair("error", JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed")));
+        } else {
+            vEntries[i].push_back(Pair("txid", tx.GetHash().GetHex()));
+            vtx.push_back(tx);
+            vIndex.push_back(i);
+        }
+    }
+
+    std::vector<CTxSubmitResult> vResults = SubmitTransactions(vtx, !fOverrideFees);
+    for (unsigned int i = 0; i < vResults.size(); i++) {
+        const CTxSubmitResult& submitted = vResults[i];
+        UniValue error;
+        switch (submitted.status) {
+        case TXSUBMIT_ACCEPTED:
+        case TXSUBMIT_IN_MEMPOOL:
+            break;
+        case TXSUBMIT_IN_CHAIN:
+            error = JSONRPCError(RPC_TRANSACTION_ALREADY_IN_CHAIN, "transaction already in block chain");
+            break;
+        case TXSUBMIT_MISSING_INPUTS:
+            error = JSONRPCError(RPC_TRANSACTION_ERROR, "Missing inputs");
+            break;
+        case TXSUBMIT_REJECTED:
+            if (submitted.state.IsInvalid())
+                error = JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", submitted.state.GetRejectCode(), submitted.state.GetRejectReason()));
+            else
+                error = JSONRPCError(RPC_TRANSACTION_ERROR, submitted.state.GetRejectReason());
+            break;
+        }
+        vEntries[vIndex[i]].push_back(Pair("error", error));
+    }
+
+    UniValue results(UniValue::VARR);
+    for (const UniValue& entry : vEntries)
+        results.push_back(entry);
+    return results;
+}
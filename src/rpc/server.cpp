@@ -12,6 +12,7 @@
 #include "init.h"
 #include "main.h"
 #include "random.h"
+#include "rpc/stats.h"
 #include "sync.h"
 #include "guiinterface.h"
 #include "util.h"
@@ -26,6 +27,11 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 #include <univalue.h>
 
 static bool fRPCRunning = false;
@@ -40,6 +46,15 @@ static RPCTimerInterface* timerInterface = NULL;
 /* Map of name to timer.
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
+/* Executes batch elements on other RPC threads */
+static RPCWorkerInterface* workerInterface = NULL;
+
+/* -rpcconcurrency overrides of CRPCCommand::maxConcurrency */
+static std::map<std::string, int> mapRPCConcurrencyLimits;
+/* Number of batch elements of each command currently executing */
+static std::mutex cs_rpcInFlight;
+static std::condition_variable condRPCInFlight;
+static std::map<const CRPCCommand*, int> mapRPCInFlight;
 
 static struct CRPCSignals
 {
@@ -320,170 +335,195 @@ UniValue show(const UniValue& params, bool fHelp)
  */
 static const CRPCCommand vRPCCommands[] =
     {
-        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet
-        //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
+        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet maxConcurrency
+        //  --------------------- ------------------------  -----------------------  ---------- ---------- --------- --------------
         /* Overall control/query calls */
-        {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
-        {"control", "help", &help, true, true, false},
-        {"control", "stop", &stop, true, true, false},
-        {"control", "show", &show, true, true, false},
+        {"control", "getinfo", &getinfo, true, false, false, 0}, /* uses wallet if enabled */
+        {"control", "help", &help, true, true, false, 0},
+        {"control", "stop", &stop, true, true, false, 0},
+        {"control", "show", &show, true, true, false, 0},
+        {"control", "getrpcstats", &getrpcstats, true, true, false, 0},
+        {"control", "getdbstats", &getdbstats, true, true, false, 0},
+        {"control", "setlockprofiler", &setlockprofiler, true, true, false, 0},
+        {"control", "getlockprofile", &getlockprofile, true, true, false, 0},
 
         /* P2P networking */
-        {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
-        {"network", "addnode", &addnode, true, true, false},
-        {"network", "disconnectnode", &disconnectnode, true, true, false},
-        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
-        {"network", "getconnectioncount", &getconnectioncount, true, false, false},
-        {"network", "getnettotals", &getnettotals, true, true, false},
-        {"network", "getpeerinfo", &getpeerinfo, true, false, false},
-        {"network", "ping", &ping, true, false, false},
-        {"network", "setban", &setban, true, false, false},
-        {"network", "listbanned", &listbanned, true, false, false},
-        {"network", "clearbanned", &clearbanned, true, false, false},
+        {"network", "getnetworkinfo", &getnetworkinfo, true, false, false, 0},
+        {"network", "addnode", &addnode, true, true, false, 0},
+        {"network", "disconnectnode", &disconnectnode, true, true, false, 0},
+        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false, 0},
+        {"network", "getconnectioncount", &getconnectioncount, true, false, false, 0},
+        {"network", "getnettotals", &getnettotals, true, true, false, 0},
+        {"network", "getpeerinfo", &getpeerinfo, true, false, false, 0},
+        {"network", "ping", &ping, true, false, false, 0},
+        {"network", "setban", &setban, true, false, false, 0},
+        {"network", "listbanned", &listbanned, true, false, false, 0},
+        {"network", "clearbanned", &clearbanned, true, false, false, 0},
 
         /* Block chain and UTXO */
-        {"blockchain", "getblockindexstats", &getblockindexstats, true, false, false},
-        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
-        {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
-        {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
-        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "clearmempool", &clearmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
-        {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
-        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"blockchain", "verifychain", &verifychain, true, false, false},
+        {"blockchain", "getblockindexstats", &getblockindexstats, true, false, false, 0},
+        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false, 0},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false, 8},
+        {"blockchain", "getblockcount", &getblockcount, true, false, false, 8},
+        {"blockchain", "getblock", &getblock, true, false, false, 4},
+        {"blockchain", "getblockhash", &getblockhash, true, false, false, 8},
+        {"blockchain", "getblockheader", &getblockheader, false, false, false, 8},
+        {"blockchain", "getchaintips", &getchaintips, true, false, false, 0},
+        {"blockchain", "getdifficulty", &getdifficulty, true, false, false, 8},
+        {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false, 0},
+        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false, 0},
+        {"blockchain", "getrawmempool", &getrawmempool, true, false, false, 0},
+        {"blockchain", "clearmempool", &clearmempool, true, false, false, 0},
+        {"blockchain", "gettxout", &gettxout, true, false, false, 4},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false, 0},
+        {"blockchain", "invalidateblock", &invalidateblock, true, true, false, 0},
+        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false, 0},
+        {"blockchain", "verifychain", &verifychain, true, false, false, 0},
 
         /* Mining */
-        {"mining", "getblocktemplate", &getblocktemplate, true, false, false},
-        {"mining", "getmininginfo", &getmininginfo, true, false, false},
-        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false},
-        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false},
-        {"mining", "submitblock", &submitblock, true, true, false},
-        {"mining", "reservebalance", &reservebalance, true, true, false},
+        {"mining", "getblocktemplate", &getblocktemplate, true, false, false, 0},
+        {"mining", "getmininginfo", &getmininginfo, true, false, false, 0},
+        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false, 0},
+        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false, 0},
+        {"mining", "submitblock", &submitblock, true, true, false, 0},
+        {"mining", "reservebalance", &reservebalance, true, true, false, 0},
 
 #ifdef ENABLE_WALLET
         /* Coin generation */
-        {"generating", "getgenerate", &getgenerate, true, false, false},
-        {"generating", "gethashespersec", &gethashespersec, true, false, false},
-        {"generating", "setgenerate", &setgenerate, true, true, false},
-        {"generating", "generate", &generate, true, true, false},
+        {"generating", "getgenerate", &getgenerate, true, false, false, 0},
+        {"generating", "gethashespersec", &gethashespersec, true, false, false, 0},
+        {"generating", "setgenerate", &setgenerate, true, true, false, 0},
+        {"generating", "generate", &generate, true, true, false, 0},
 #endif
         /* dApp Store */
-        {"dapp", "addnewdapp", &addnewdapp, false, false, true},
-        {"dapp", "dappdelete", &dappdelete, false, false, true},
-        {"dapp", "dappupdate", &dappupdate, false, false, true},
-        {"dapp", "getdapp", &getdapp, false, false, false},
-        {"dapp", "getdappprice", &getdappprice, false, false, false},
-        {"dapp", "listdapps", &listdapps, false, false, false},
-        {"dapp", "listmydapps", &listmydapps, false, false, true},
+        {"dapp", "addnewdapp", &addnewdapp, false, false, true, 0},
+        {"dapp", "dappdelete", &dappdelete, false, false, true, 0},
+        {"dapp", "dappupdate", &dappupdate, false, false, true, 0},
+        {"dapp", "getdapp", &getdapp, false, false, false, 0},
+        {"dapp", "getdappprice", &getdappprice, false, false, false, 0},
+        {"dapp", "listdapps", &listdapps, false, false, false, 0},
+        {"dapp", "listmydapps", &listmydapps, false, false, true, 0},
 
         /* Raw transactions */
-        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
-        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
-        {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
-        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
-        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
+        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false, 8},
+        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false, 8},
+        {"rawtransactions", "decodescript", &decodescript, true, false, false, 8},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false, 4},
+        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false, 0},
+        {"rawtransactions", "sendrawtransactions", &sendrawtransactions, false, false, false, 0},
+        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false, 0}, /* uses wallet if enabled */
 
         /* Utility functions */
-        {"util", "createmultisig", &createmultisig, true, true, false},
-        {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
-        {"util", "verifymessage", &verifymessage, true, false, false},
-        {"util", "estimatefee", &estimatefee, true, true, false},
-        {"util", "estimatepriority", &estimatepriority, true, true, false},
+        {"util", "createmultisig", &createmultisig, true, true, false, 0},
+        {"util", "validateaddress", &validateaddress, true, false, false, 8}, /* uses wallet if enabled */
+        {"util", "verifymessage", &verifymessage, true, false, false, 8},
+        {"util", "estimatefee", &estimatefee, true, true, false, 0},
+        {"util", "estimatepriority", &estimatepriority, true, true, false, 0},
+
+        /* ZMQ */
+        {"zmq", "getzmqnotifications", &getzmqnotifications, true, true, false, 0},
 
         /* Not shown in help */
-        {"hidden", "invalidateblock", &invalidateblock, true, true, false},
-        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"hidden", "setmocktime", &setmocktime, true, false, false},
-        {"hidden", "waitfornewblock", &waitfornewblock, true, true, false},
-        {"hidden", "waitforblock", &waitforblock, true, true, false},
-        {"hidden", "waitforblockheight", &waitforblockheight, true, true, false},
+        {"hidden", "invalidateblock", &invalidateblock, true, true, false, 0},
+        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false, 0},
+        {"hidden", "setmocktime", &setmocktime, true, false, false, 0},
+        {"hidden", "waitfornewblock", &waitfornewblock, true, true, false, 0},
+        {"hidden", "waitforblock", &waitforblock, true, true, false, 0},
+        {"hidden", "waitforblockheight", &waitforblockheight, true, true, false, 0},
 
         /* NBX features */
-        {"nbx", "listmasternodes", &listmasternodes, true, true, false},
-        {"nbx", "getmasternodecount", &getmasternodecount, true, true, false},
-        {"nbx", "masternodeconnect", &masternodeconnect, true, true, false},
-        {"nbx", "createmasternodebroadcast", &createmasternodebroadcast, true, true, false},
-        {"nbx", "decodemasternodebroadcast", &decodemasternodebroadcast, true, true, false},
-        {"nbx", "relaymasternodebroadcast", &relaymasternodebroadcast, true, true, false},
-        {"nbx", "masternodecurrent", &masternodecurrent, true, true, false},
-        {"nbx", "masternodedebug", &masternodedebug, true, true, false},
-        {"nbx", "startmasternode", &startmasternode, true, true, false},
-        {"nbx", "createmasternodekey", &createmasternodekey, true, true, false},
-        {"nbx", "getmasternodeoutputs", &getmasternodeoutputs, true, true, false},
-        {"nbx", "listmasternodeconf", &listmasternodeconf, true, true, false},
-        {"nbx", "getmasternodestatus", &getmasternodestatus, true, true, false},
-        {"nbx", "getmasternodewinners", &getmasternodewinners, true, true, false},
-        {"nbx", "getmasternodescores", &getmasternodescores, true, true, false},
-        {"nbx", "mnsync", &mnsync, true, true, false},
-        {"nbx", "spork", &spork, true, true, false},
-        {"nbx", "getpoolinfo", &getpoolinfo, true, true, false},
+        {"nbx", "listmasternodes", &listmasternodes, true, true, false, 0},
+        {"nbx", "getmasternodecount", &getmasternodecount, true, true, false, 0},
+        {"nbx", "masternodeconnect", &masternodeconnect, true, true, false, 0},
+        {"nbx", "createmasternodebroadcast", &createmasternodebroadcast, true, true, false, 0},
+        {"nbx", "decodemasternodebroadcast", &decodemasternodebroadcast, true, true, false, 0},
+        {"nbx", "relaymasternodebroadcast", &relaymasternodebroadcast, true, true, false, 0},
+        {"nbx", "masternodecurrent", &masternodecurrent, true, true, false, 0},
+        {"nbx", "masternodedebug", &masternodedebug, true, true, false, 0},
+        {"nbx", "startmasternode", &startmasternode, true, true, false, 0},
+        {"nbx", "createmasternodekey", &createmasternodekey, true, true, false, 0},
+        {"nbx", "getmasternodeoutputs", &getmasternodeoutputs, true, true, false, 0},
+        {"nbx", "listmasternodeconf", &listmasternodeconf, true, true, false, 0},
+        {"nbx", "getmasternodestatus", &getmasternodestatus, true, true, false, 0},
+        {"nbx", "getmasternodewinners", &getmasternodewinners, true, true, false, 0},
+        {"nbx", "getmasternodescores", &getmasternodescores, true, true, false, 0},
+        {"nbx", "mnsync", &mnsync, true, true, false, 0},
+        {"nbx", "spork", &spork, true, true, false, 0},
+        {"nbx", "getpoolinfo", &getpoolinfo, true, true, false, 0},
 
 #ifdef ENABLE_WALLET
         /* Wallet */
-        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
-        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
-        {"wallet", "backupwallet", &backupwallet, true, false, true},
-        {"wallet", "createnewwallet", &createnewwallet, false, false, true},
-        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true},
-        {"wallet", "dumpwallet", &dumpwallet, true, false, true},
-        {"wallet", "encryptwallet", &encryptwallet, true, false, true},
-        {"wallet", "getaccountaddress", &getaccountaddress, true, false, true},
-        {"wallet", "getaccount", &getaccount, true, false, true},
-        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, false, true},
-        {"wallet", "getbalance", &getbalance, false, false, true},
-        {"wallet", "gethdseed", &gethdseed, false, false, true},
-        {"wallet", "getnewaddress", &getnewaddress, true, false, true},
-        {"wallet", "getreservedaddress", &getreservedaddress, true, false, true},
-        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true},
-        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true},
-        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true},
-        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
-        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
-        {"wallet", "gettransaction", &gettransaction, false, false, true},
-        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
-        {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "getxpub", &getxpub, false, false, true},
-        {"wallet", "getfirstaddress", &getfirstaddress, false, false, true},
-        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
-        {"wallet", "listaccounts", &listaccounts, false, false, true},
-        {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
-        {"wallet", "listlockunspent", &listlockunspent, false, false, true},
-        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
-        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
-        {"wallet", "listsinceblock", &listsinceblock, false, false, true},
-        {"wallet", "listtransactions", &listtransactions, false, false, true},
-        {"wallet", "listunspent", &listunspent, false, false, true},
-        {"wallet", "lockunspent", &lockunspent, true, false, true},
-        {"wallet", "move", &movecmd, false, false, true},
-        {"wallet", "multisend", &multisend, false, false, true},
-        {"wallet", "sendfrom", &sendfrom, false, false, true},
-        {"wallet", "sendmany", &sendmany, false, false, true},
-        {"wallet", "presendtoaddresses", &presendtoaddresses, false, false, true},
-        {"wallet", "presendtoaddress", &presendtoaddress, false, false, true},
-        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true},
-        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true},
-        {"wallet", "setaccount", &setaccount, true, false, true},
-        {"wallet", "sethdseed", &sethdseed, false, false, true},
-        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, false, true},
-        {"wallet", "settxfee", &settxfee, true, false, true},
-        {"wallet", "signmessage", &signmessage, true, false, true},
-        {"wallet", "walletlock", &walletlock, true, false, true},
-        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true},
-        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true},
+        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true, 0},
+        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true, 0},
+        {"wallet", "backupwallet", &backupwallet, true, false, true, 0},
+        {"wallet", "createnewwallet", &createnewwallet, false, false, true, 0},
+        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true, 0},
+        {"wallet", "dumpwallet", &dumpwallet, true, false, true, 0},
+        {"wallet", "encryptwallet", &encryptwallet, true, false, true, 0},
+        {"wallet", "getaccountaddress", &getaccountaddress, true, false, true, 0},
+        {"wallet", "getaccount", &getaccount, true, false, true, 0},
+        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, false, true, 0},
+        {"wallet", "getbalance", &getbalance, false, false, true, 0},
+        {"wallet", "gethdseed", &gethdseed, false, false, true, 0},
+        {"wallet", "getnewaddress", &getnewaddress, true, false, true, 0},
+        {"wallet", "getreservedaddress", &getreservedaddress, true, false, true, 0},
+        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true, 0},
+        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true, 0},
+        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true, 0},
+        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true, 0},
+        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true, 0},
+        {"wallet", "gettransaction", &gettransaction, false, false, true, 0},
+        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true, 0},
+        {"wallet", "getwalletinfo", &getwalletinfo, false, false, true, 0},
+        {"wallet", "getxpub", &getxpub, false, false, true, 0},
+        {"wallet", "getfirstaddress", &getfirstaddress, false, false, true, 0},
+        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true, 0},
+        {"wallet", "listaccounts", &listaccounts, false, false, true, 0},
+        {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true, 0},
+        {"wallet", "listlockunspent", &listlockunspent, false, false, true, 0},
+        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true, 0},
+        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true, 0},
+        {"wallet", "listsinceblock", &listsinceblock, false, false, true, 0},
+        {"wallet", "listtransactions", &listtransactions, false, false, true, 0},
+        {"wallet", "listunspent", &listunspent, false, false, true, 0},
+        {"wallet", "lockunspent", &lockunspent, true, false, true, 0},
+        {"wallet", "move", &movecmd, false, false, true, 0},
+        {"wallet", "multisend", &multisend, false, false, true, 0},
+        {"wallet", "sendfrom", &sendfrom, false, false, true, 0},
+        {"wallet", "sendmany", &sendmany, false, false, true, 0},
+        {"wallet", "presendtoaddresses", &presendtoaddresses, false, false, true, 0},
+        {"wallet", "presendtoaddress", &presendtoaddress, false, false, true, 0},
+        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true, 0},
+        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true, 0},
+        {"wallet", "setaccount", &setaccount, true, false, true, 0},
+        {"wallet", "sethdseed", &sethdseed, false, false, true, 0},
+        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, false, true, 0},
+        {"wallet", "settxfee", &settxfee, true, false, true, 0},
+        {"wallet", "signmessage", &signmessage, true, false, true, 0},
+        {"wallet", "walletlock", &walletlock, true, false, true, 0},
+        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true, 0},
+        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true, 0},
 
 #endif // ENABLE_WALLET
 };
 
+/**
+ * Commands with large results that can also be written as they are produced.
+ */
+static const struct {
+    const char* name;
+    rpcstreamfn_type actor;
+} vRPCStreamCommands[] =
+    {
+        {"getblock", &getblock_stream},
+        {"getrawmempool", &getrawmempool_stream},
+        {"listdapps", &listdapps_stream},
+        {"listmasternodes", &listmasternodes_stream},
+#ifdef ENABLE_WALLET
+        {"listunspent", &listunspent_stream},
+#endif
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -493,6 +533,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamCommands[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].actor;
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -506,6 +548,18 @@ const CRPCCommand *CRPCTable::operator[](const std::string &name) const
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
+    mapRPCConcurrencyLimits.clear();
+    for (const std::string& strLimit : mapMultiArgs["-rpcconcurrency"]) {
+        size_t nSep = strLimit.find(':');
+        int nLimit = 0;
+        if (nSep == std::string::npos || !ParseInt32(strLimit.substr(nSep + 1), &nLimit) || nLimit < 0) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf("Invalid -rpcconcurrency specification: %s. Use <method>:<n>, where 0 runs the method in order.", strLimit),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+        mapRPCConcurrencyLimits[strLimit.substr(0, nSep)] = nLimit;
+    }
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -602,15 +656,177 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/** Concurrency limit of a batchable command, 0 if it must run in order */
+static int RPCConcurrencyLimit(const CRPCCommand* pcmd)
+{
+    if (!pcmd)
+        return 0;
+    std::map<std::string, int>::const_iterator it = mapRPCConcurrencyLimits.find(pcmd->name);
+    if (it != mapRPCConcurrencyLimits.end())
+        return it->second;
+    return pcmd->maxConcurrency;
+}
+
+/** Holds one of the maxConcurrency slots of a command while it executes */
+class CRPCConcurrencySlot
+{
+private:
+    const CRPCCommand* pcmd;
+
+public:
+    CRPCConcurrencySlot(const CRPCCommand* pcmdIn, int nLimit) : pcmd(pcmdIn)
+    {
+        std::unique_lock<std::mutex> lock(cs_rpcInFlight);
+        while (mapRPCInFlight[pcmd] >= nLimit)
+            condRPCInFlight.wait(lock);
+        mapRPCInFlight[pcmd]++;
+    }
+    ~CRPCConcurrencySlot()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs_rpcInFlight);
+            mapRPCInFlight[pcmd]--;
+        }
+        condRPCInFlight.notify_all();
+    }
+};
+
+/**
+ * A run of consecutive batch elements that may execute concurrently.
+ * The calling thread and any helpers queued on other RPC threads claim
+ * elements one at a time. Helpers keep the run alive through a shared
+ * pointer, so one that is only scheduled after the batch has completed
+ * finds nothing left to claim and returns without touching the request.
+ */
+struct CRPCBatchRun
+{
+    const UniValue* vReq;
+    std::vector<UniValue>* vResult;
+    std::vector<int> vLimit;
+    size_t nBegin;
+    size_t nEnd;
+    std::atomic<size_t> nNext;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nDone;
+};
+
+static void RPCBatchRunWork(std::shared_ptr<CRPCBatchRun> run)
+{
+    size_t nCompleted = 0;
+    while (true) {
+        size_t i = run->nNext++;
+        if (i >= run->nEnd)
+            break;
+        const UniValue& req = (*run->vReq)[i];
+        {
+            CRPCConcurrencySlot slot(tableRPC[find_value(req, "method").get_str()], run->vLimit[i - run->nBegin]);
+            (*run->vResult)[i] = JSONRPCExecOne(req);
+        }
+        nCompleted++;
+    }
+    if (nCompleted) {
+        {
+            std::lock_guard<std::mutex> lock(run->cs);
+            run->nDone += nCompleted;
+        }
+        run->cond.notify_all();
+    }
+}
+
+static void JSONRPCExecRun(const UniValue& vReq, std::vector<UniValue>& vResult, size_t nBegin, size_t nEnd, const std::vector<int>& vLimit)
+{
+    std::shared_ptr<CRPCBatchRun> run(new CRPCBatchRun());
+    run->vReq = &vReq;
+    run->vResult = &vResult;
+    run->vLimit.assign(vLimit.begin() + nBegin, vLimit.begin() + nEnd);
+    run->nBegin = nBegin;
+    run->nEnd = nEnd;
+    run->nNext = nBegin;
+    run->nDone = 0;
+
+    // This thread is one of the workers, so at most Threads() - 1 helpers
+    int nHelpers = std::min<int>(nEnd - nBegin, workerInterface->Threads()) - 1;
+    for (int i = 0; i < nHelpers; i++) {
+        if (!workerInterface->Dispatch(boost::bind(&RPCBatchRunWork, run)))
+            break;
+    }
+
+    RPCBatchRunWork(run);
+
+    // Elements claimed by helpers are being executed; wait for them
+    std::unique_lock<std::mutex> lock(run->cs);
+    while (run->nDone < nEnd - nBegin)
+        run->cond.wait(lock);
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    // Look up which elements are allowed to run concurrently. Elements that
+    // are not (or are malformed) run in order and separate the runs, so
+    // a batch observes its state-changing calls in the order they were sent.
+    std::vector<int> vLimit(vReq.size(), 0);
+    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+        const UniValue& req = vReq[reqIdx];
+        if (!req.isObject())
+            continue;
+        const UniValue& method = find_value(req, "method");
+        if (method.isStr())
+            vLimit[reqIdx] = RPCConcurrencyLimit(tableRPC[method.get_str()]);
+    }
+
+    std::vector<UniValue> vResult(vReq.size());
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int reqEnd = reqIdx;
+        while (reqEnd < vReq.size() && vLimit[reqEnd] > 0)
+            reqEnd++;
+        if (reqEnd - reqIdx > 1 && workerInterface && workerInterface->Threads() > 1) {
+            JSONRPCExecRun(vReq, vResult, reqIdx, reqEnd, vLimit);
+            reqIdx = reqEnd;
+        } else {
+            vResult[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (unsigned int reqIdx = 0; reqIdx < vResult.size(); reqIdx++)
+        ret.push_back(vResult[reqIdx]);
 
     return ret.write() + "\n";
 }
 
+/**
+ * Times one command for getrpcstats and signals PostCommand when the command
+ * returns or throws, so every PreCommand is paired with a PostCommand.
+ */
+class CRPCCommandScope
+{
+private:
+    const CRPCCommand& cmd;
+    int64_t nStart;
+    int64_t nLockWaitStart;
+
+public:
+    bool fSuccess;
+    //! Set when the command is handed on to execute(), which records its stats itself
+    bool fHandedOn;
+
+    CRPCCommandScope(const CRPCCommand& cmdIn) : cmd(cmdIn), nStart(GetTimeMicros()), nLockWaitStart(GetThreadLockWaitMicros()), fSuccess(false), fHandedOn(false)
+    {
+        g_rpcSignals.PreCommand(cmd);
+    }
+
+    ~CRPCCommandScope()
+    {
+        if (!fHandedOn)
+            RecordRequest(STATS_RPC, cmd.name, GetTimeMicros() - nStart, GetThreadLockWaitMicros() - nLockWaitStart, !fSuccess);
+        g_rpcSignals.PostCommand(cmd);
+    }
+};
+
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
 {
     // Find method
@@ -618,16 +834,36 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 
-    g_rpcSignals.PreCommand(*pcmd);
+    CRPCCommandScope scope(*pcmd);
 
     try {
         // Execute
-        return pcmd->actor(params, false);
+        UniValue result = pcmd->actor(params, false);
+        scope.fSuccess = true;
+        return result;
     } catch (std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
+}
+
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStreamWriter& out) const
+{
+    std::map<std::string, rpcstreamfn_type>::const_iterator it = mapStreamCommands.find(strMethod);
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (it == mapStreamCommands.end() || !pcmd)
+        return false;
+
+    CRPCCommandScope scope(*pcmd);
 
-    g_rpcSignals.PostCommand(*pcmd);
+    try {
+        // Execute
+        bool fStreamed = it->second(params, out);
+        scope.fSuccess = true;
+        scope.fHandedOn = !fStreamed;
+        return fStreamed;
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
@@ -670,6 +906,17 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface)
         timerInterface = NULL;
 }
 
+void RPCSetWorkerInterface(RPCWorkerInterface *iface)
+{
+    workerInterface = iface;
+}
+
+void RPCUnsetWorkerInterface(RPCWorkerInterface *iface)
+{
+    if (workerInterface == iface)
+        workerInterface = NULL;
+}
+
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds)
 {
     if (!timerInterface)
@@ -21,6 +21,7 @@
 
 #include <univalue.h>
 
+class CJSONStreamWriter;
 class CRPCCommand;
 
 namespace RPCServer
@@ -115,7 +116,31 @@ void RPCUnsetTimerInterface(RPCTimerInterface *iface);
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
+/**
+ * RPC worker "driver". Lets batch requests hand elements to other RPC
+ * threads without the RPC server depending on the HTTP server.
+ */
+class RPCWorkerInterface
+{
+public:
+    virtual ~RPCWorkerInterface() {}
+    /** Number of threads executing RPC requests */
+    virtual int Threads() = 0;
+    /** Queue func on another worker thread.
+     * Returns false if it could not be queued (e.g. the work queue is full).
+     */
+    virtual bool Dispatch(const boost::function<void(void)>& func) = 0;
+};
+
+/** Set worker interface used to execute batch requests concurrently */
+void RPCSetWorkerInterface(RPCWorkerInterface *iface);
+/** Unset worker interface */
+void RPCUnsetWorkerInterface(RPCWorkerInterface *iface);
+
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/** Writes the result of a command to out instead of returning it. Returns
+ * false, without writing anything, for params that are not streamed. */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStreamWriter& out);
 
 class CRPCCommand
 {
@@ -126,6 +151,9 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    /** Read-only commands that may run alongside other elements of a batch
+     * set this to how many may execute at the same time. 0 runs in order. */
+    int maxConcurrency;
 };
 
 /**
@@ -135,6 +163,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamCommands;
 
 public:
     CRPCTable();
@@ -150,6 +179,16 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing its result to out as it is produced.
+     * @param method   Method to execute
+     * @param params   UniValue Array of arguments (JSON objects)
+     * @param out      Writer positioned where the result value goes
+     * @returns false if the method does not stream these params; use execute() instead.
+     * @throws an exception (UniValue) when an error happens, like execute().
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStreamWriter& out) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -260,10 +299,12 @@ extern UniValue dappupdate(const UniValue& params, bool fHelp);
 extern UniValue getdapp(const UniValue& params, bool fHelp);
 extern UniValue getdappprice(const UniValue& params, bool fHelp);
 extern UniValue listdapps(const UniValue& params, bool fHelp);
+extern bool listdapps_stream(const UniValue& params, CJSONStreamWriter& out);
 extern UniValue listmydapps(const UniValue& params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rpc/rawtransaction.cpp
 extern UniValue listunspent(const UniValue& params, bool fHelp);
+extern bool listunspent_stream(const UniValue& params, CJSONStreamWriter& out);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
 extern UniValue createrawtransaction(const UniValue& params, bool fHelp);
@@ -271,6 +312,7 @@ extern UniValue decoderawtransaction(const UniValue& params, bool fHelp);
 extern UniValue decodescript(const UniValue& params, bool fHelp);
 extern UniValue signrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue sendrawtransaction(const UniValue& params, bool fHelp);
+extern UniValue sendrawtransactions(const UniValue& params, bool fHelp);
 
 extern UniValue getblockcount(const UniValue& params, bool fHelp); // in rpc/blockchain.cpp
 extern UniValue getbestblockhash(const UniValue& params, bool fHelp);
@@ -281,9 +323,11 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern bool getrawmempool_stream(const UniValue& params, CJSONStreamWriter& out);
 extern UniValue clearmempool(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool getblock_stream(const UniValue& params, CJSONStreamWriter& out);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
@@ -297,6 +341,7 @@ extern void validaterange(const UniValue& params, int& heightStart, int& heightE
 
 extern UniValue getpoolinfo(const UniValue& params, bool fHelp); // in rpc/masternode.cpp
 extern UniValue listmasternodes(const UniValue& params, bool fHelp);
+extern bool listmasternodes_stream(const UniValue& params, CJSONStreamWriter& out);
 extern UniValue getmasternodecount(const UniValue& params, bool fHelp);
 extern UniValue createmasternodebroadcast(const UniValue& params, bool fHelp);
 extern UniValue decodemasternodebroadcast(const UniValue& params, bool fHelp);
@@ -313,13 +358,18 @@ extern UniValue getmasternodewinners(const UniValue& params, bool fHelp);
 extern UniValue getmasternodescores(const UniValue& params, bool fHelp);
 
 extern UniValue getinfo(const UniValue& params, bool fHelp); // in rpc/misc.cpp
+extern UniValue getrpcstats(const UniValue& params, bool fHelp); // in rpc/stats.cpp
+extern UniValue getdbstats(const UniValue& params, bool fHelp);
 extern UniValue mnsync(const UniValue& params, bool fHelp);
 extern UniValue spork(const UniValue& params, bool fHelp);
 extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue createmultisig(const UniValue& params, bool fHelp);
 extern UniValue verifymessage(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue setlockprofiler(const UniValue& params, bool fHelp);
+extern UniValue getlockprofile(const UniValue& params, bool fHelp);
 extern UniValue getstakingstatus(const UniValue& params, bool fHelp);
+extern UniValue getzmqnotifications(const UniValue& params, bool fHelp);
 
 bool StartRPC();
 void InterruptRPC();
@@ -0,0 +1,309 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/stats.h"
+
+#include "httpserver.h"
+#include "leveldbwrapper.h"
+#include "rpc/server.h"
+#include "tinyformat.h"
+
+#include <mutex>
+#include <sstream>
+
+#include <univalue.h>
+
+static std::mutex cs_requestStats;
+static std::map<std::string, CRequestStats> mapRPCStats;
+static std::map<std::string, CRequestStats> mapRESTStats;
+
+static std::map<std::string, CRequestStats>& StatsMap(RequestStatsKind kind)
+{
+    return kind == STATS_RPC ? mapRPCStats : mapRESTStats;
+}
+
+CRequestStats::CRequestStats() : nCount(0), nErrors(0), nBytesOut(0), nTotalMicros(0), nLockWaitMicros(0), nMaxMicros(0)
+{
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        vBuckets[i] = 0;
+}
+
+void CRequestStats::Add(int64_t nMicros, int64_t nLockWaitMicrosIn, bool fError)
+{
+    nCount++;
+    if (fError)
+        nErrors++;
+    nTotalMicros += nMicros;
+    nLockWaitMicros += nLockWaitMicrosIn;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+    int i = 0;
+    while (i < LATENCY_BUCKETS - 1 && nMicros > BucketLimit(i))
+        i++;
+    vBuckets[i]++;
+}
+
+int64_t CRequestStats::Percentile(double q) const
+{
+    if (nCount == 0)
+        return 0;
+    uint64_t nRank = std::max((uint64_t)1, (uint64_t)(q * nCount + 0.5));
+    uint64_t nSeen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        nSeen += vBuckets[i];
+        if (nSeen >= nRank)
+            return std::min(BucketLimit(i), nMaxMicros);
+    }
+    return nMaxMicros;
+}
+
+void RecordRequest(RequestStatsKind kind, const std::string& strName, int64_t nMicros, int64_t nLockWaitMicros, bool fError)
+{
+    std::lock_guard<std::mutex> lock(cs_requestStats);
+    StatsMap(kind)[strName].Add(nMicros, nLockWaitMicros, fError);
+}
+
+void RecordReplyBytes(RequestStatsKind kind, const std::string& strName, size_t nBytes)
+{
+    std::lock_guard<std::mutex> lock(cs_requestStats);
+    StatsMap(kind)[strName].nBytesOut += nBytes;
+}
+
+std::map<std::string, CRequestStats> GetRequestStats(RequestStatsKind kind)
+{
+    std::lock_guard<std::mutex> lock(cs_requestStats);
+    return StatsMap(kind);
+}
+
+void ResetRequestStats()
+{
+    std::lock_guard<std::mutex> lock(cs_requestStats);
+    mapRPCStats.clear();
+    mapRESTStats.clear();
+}
+
+static std::string EscapeLabel(const std::string& str)
+{
+    std::string strOut;
+    for (char c : str) {
+        if (c == '\\' || c == '"')
+            strOut += '\\';
+        strOut += c;
+    }
+    return strOut;
+}
+
+static void WriteRequestMetrics(std::ostringstream& out, const std::string& strPrefix, const std::string& strLabel, const std::string& strWhat, const std::map<std::string, CRequestStats>& mapStats)
+{
+    out << "# HELP " << strPrefix << "_request_duration_seconds Time spent handling " << strWhat << ".\n";
+    out << "# TYPE " << strPrefix << "_request_duration_seconds histogram\n";
+    for (const std::pair<const std::string, CRequestStats>& item : mapStats) {
+        std::string strLabels = strLabel + "=\"" + EscapeLabel(item.first) + "\"";
+        const CRequestStats& stats = item.second;
+        uint64_t nCumulative = 0;
+        for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+            nCumulative += stats.vBuckets[i];
+            out << strprintf("%s_request_duration_seconds_bucket{%s,le=\"%g\"} %u\n", strPrefix, strLabels, CRequestStats::BucketLimit(i) * 1e-6, nCumulative);
+        }
+        out << strprintf("%s_request_duration_seconds_bucket{%s,le=\"+Inf\"} %u\n", strPrefix, strLabels, stats.nCount);
+        out << strprintf("%s_request_duration_seconds_sum{%s} %.6f\n", strPrefix, strLabels, stats.nTotalMicros * 1e-6);
+        out << strprintf("%s_request_duration_seconds_count{%s} %u\n", strPrefix, strLabels, stats.nCount);
+    }
+
+    out << "# HELP " << strPrefix << "_lock_wait_seconds_total Part of the handling time spent waiting for contended locks.\n";
+    out << "# TYPE " << strPrefix << "_lock_wait_seconds_total counter\n";
+    for (const std::pair<const std::string, CRequestStats>& item : mapStats)
+        out << strprintf("%s_lock_wait_seconds_total{%s=\"%s\"} %.6f\n", strPrefix, strLabel, EscapeLabel(item.first), item.second.nLockWaitMicros * 1e-6);
+
+    out << "# HELP " << strPrefix << "_errors_total Number of " << strWhat << " that failed.\n";
+    out << "# TYPE " << strPrefix << "_errors_total counter\n";
+    for (const std::pair<const std::string, CRequestStats>& item : mapStats)
+        out << strprintf("%s_errors_total{%s=\"%s\"} %u\n", strPrefix, strLabel, EscapeLabel(item.first), item.second.nErrors);
+
+    out << "# HELP " << strPrefix << "_response_bytes_total Size of the replies to " << strWhat << ".\n";
+    out << "# TYPE " << strPrefix << "_response_bytes_total counter\n";
+    for (const std::pair<const std::string, CRequestStats>& item : mapStats)
+        out << strprintf("%s_response_bytes_total{%s=\"%s\"} %u\n", strPrefix, strLabel, EscapeLabel(item.first), item.second.nBytesOut);
+}
+
+std::string GetPrometheusMetrics()
+{
+    std::ostringstream out;
+    WriteRequestMetrics(out, "nbx_rpc", "method", "JSON-RPC calls", GetRequestStats(STATS_RPC));
+    WriteRequestMetrics(out, "nbx_rest", "endpoint", "REST requests", GetRequestStats(STATS_REST));
+
+    HTTPWorkQueueStats queue;
+    if (GetHTTPWorkQueueStats(queue)) {
+        out << "# HELP nbx_http_workqueue_depth Number of HTTP requests waiting for a worker thread.\n";
+        out << "# TYPE nbx_http_workqueue_depth gauge\n";
+        out << strprintf("nbx_http_workqueue_depth %u\n", queue.nDepth);
+        out << "# HELP nbx_http_workqueue_peak_depth Highest number of waiting HTTP requests.\n";
+        out << "# TYPE nbx_http_workqueue_peak_depth gauge\n";
+        out << strprintf("nbx_http_workqueue_peak_depth %u\n", queue.nPeakDepth);
+        out << "# HELP nbx_http_workqueue_capacity Maximum number of waiting HTTP requests (-rpcworkqueue).\n";
+        out << "# TYPE nbx_http_workqueue_capacity gauge\n";
+        out << strprintf("nbx_http_workqueue_capacity %u\n", queue.nCapacity);
+        out << "# HELP nbx_http_workqueue_threads Number of HTTP worker threads (-rpcthreads).\n";
+        out << "# TYPE nbx_http_workqueue_threads gauge\n";
+        out << strprintf("nbx_http_workqueue_threads %d\n", queue.nThreads);
+        out << "# HELP nbx_http_workqueue_busy_threads Number of HTTP worker threads handling a request.\n";
+        out << "# TYPE nbx_http_workqueue_busy_threads gauge\n";
+        out << strprintf("nbx_http_workqueue_busy_threads %d\n", queue.nBusy);
+        out << "# HELP nbx_http_workqueue_rejected_total Number of HTTP requests rejected because the work queue was full.\n";
+        out << "# TYPE nbx_http_workqueue_rejected_total counter\n";
+        out << strprintf("nbx_http_workqueue_rejected_total %u\n", queue.nRejected);
+    }
+    return out.str();
+}
+
+static UniValue RequestStatsToJSON(const std::map<std::string, CRequestStats>& mapStats)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const std::pair<const std::string, CRequestStats>& item : mapStats) {
+        const CRequestStats& stats = item.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", (uint64_t)stats.nCount));
+        obj.push_back(Pair("errors", (uint64_t)stats.nErrors));
+        obj.push_back(Pair("mean_ms", stats.nCount ? stats.nTotalMicros * 0.001 / stats.nCount : 0.0));
+        obj.push_back(Pair("p50_ms", stats.Percentile(0.5) * 0.001));
+        obj.push_back(Pair("p99_ms", stats.Percentile(0.99) * 0.001));
+        obj.push_back(Pair("max_ms", stats.nMaxMicros * 0.001));
+        obj.push_back(Pair("exec_ms", (stats.nTotalMicros - stats.nLockWaitMicros) * 0.001));
+        obj.push_back(Pair("lock_wait_ms", stats.nLockWaitMicros * 0.001));
+        obj.push_back(Pair("bytes_out", (uint64_t)stats.nBytesOut));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
+
+UniValue getrpcstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns latency and traffic statistics of the RPC methods and REST endpoints\n"
+            "called since startup or the last reset, and the state of the HTTP work queue.\n"
+            "Percentiles are upper bounds of power-of-two buckets. Replies to batch requests are\n"
+            "accounted to \"batch\", their elements to their methods.\n"
+
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Clear the statistics after returning them\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"rpc\": {                 (json object) Statistics by method\n"
+            "    \"method\": {\n"
+            "      \"count\": n,          (numeric) Number of calls\n"
+            "      \"errors\": n,         (numeric) Number of calls that returned an error\n"
+            "      \"mean_ms\": n,        (numeric) Mean time per call\n"
+            "      \"p50_ms\": n,         (numeric) Median time per call\n"
+            "      \"p99_ms\": n,         (numeric) 99th percentile of the time per call\n"
+            "      \"max_ms\": n,         (numeric) Longest call\n"
+            "      \"exec_ms\": n,        (numeric) Total time spent executing\n"
+            "      \"lock_wait_ms\": n,   (numeric) Total time spent waiting for contended locks\n"
+            "      \"bytes_out\": n       (numeric) Total size of the replies\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"rest\": { ... },         (json object) The same by REST endpoint\n"
+            "  \"workqueue\": {           (json object) The HTTP work queue\n"
+            "    \"depth\": n,            (numeric) Requests waiting for a worker thread\n"
+            "    \"peak_depth\": n,       (numeric) Highest number of waiting requests\n"
+            "    \"capacity\": n,         (numeric) Maximum number of waiting requests\n"
+            "    \"threads\": n,          (numeric) Number of worker threads\n"
+            "    \"busy\": n,             (numeric) Worker threads handling a request\n"
+            "    \"rejected\": n          (numeric) Requests rejected because the queue was full\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") +
+            HelpExampleRpc("getrpcstats", "true"));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("rpc", RequestStatsToJSON(GetRequestStats(STATS_RPC))));
+    ret.push_back(Pair("rest", RequestStatsToJSON(GetRequestStats(STATS_REST))));
+
+    HTTPWorkQueueStats queue;
+    if (GetHTTPWorkQueueStats(queue)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("depth", (uint64_t)queue.nDepth));
+        obj.push_back(Pair("peak_depth", (uint64_t)queue.nPeakDepth));
+        obj.push_back(Pair("capacity", (uint64_t)queue.nCapacity));
+        obj.push_back(Pair("threads", queue.nThreads));
+        obj.push_back(Pair("busy", queue.nBusy));
+        obj.push_back(Pair("rejected", (uint64_t)queue.nRejected));
+        ret.push_back(Pair("workqueue", obj));
+    }
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetRequestStats();
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns the tuning and internals of the open databases. Compactions count the memory\n"
+            "table flushes and compactions scheduled since the database was opened.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                     (json object) The database: chainstate, index or sporks\n"
+            "    \"options\": {                 (json object) Options set with -dboption\n"
+            "      \"filterbits\": n,           (numeric) Bloom filter bits per key, 0 for none\n"
+            "      \"blocksize\": n,            (numeric) Approximate size of data blocks\n"
+            "      \"writebuffer\": n,          (numeric) Size of the memory table\n"
+            "      \"compression\": true|false, (boolean) Whether data blocks are compressed\n"
+            "      \"maxopenfiles\": n,         (numeric) Maximum number of open table files\n"
+            "      \"verifychecksums\": true|false (boolean) Whether point lookups verify checksums\n"
+            "    },\n"
+            "    \"cache_size\": n,             (numeric) Size of the block cache\n"
+            "    \"approximate_size\": n,       (numeric) Approximate size on disk\n"
+            "    \"memory_usage\": n,           (numeric) Memory used by memory tables and the block cache\n"
+            "    \"files_per_level\": [n,...],  (array) Number of table files at each level\n"
+            "    \"compactions\": n,            (numeric) Background work scheduled\n"
+            "    \"cache_hits\": n,             (numeric) Block cache lookups that hit\n"
+            "    \"cache_misses\": n,           (numeric) Block cache lookups that missed\n"
+            "    \"cache_hit_rate\": n,         (numeric) Fraction of the lookups that hit\n"
+            "    \"stats\": \"text\"              (string) The leveldb.stats property\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") +
+            HelpExampleRpc("getdbstats", ""));
+
+    UniValue ret(UniValue::VOBJ);
+    std::vector<std::pair<std::string, CLevelDBStats> > vStats = GetLevelDBStats();
+    for (const std::pair<std::string, CLevelDBStats>& item : vStats) {
+        const CLevelDBStats& stats = item.second;
+        UniValue options(UniValue::VOBJ);
+        options.push_back(Pair("filterbits", stats.options.nFilterBits));
+        options.push_back(Pair("blocksize", (uint64_t)stats.options.nBlockSize));
+        options.push_back(Pair("writebuffer", (uint64_t)stats.options.nWriteBufferSize));
+        options.push_back(Pair("compression", stats.options.fCompression));
+        options.push_back(Pair("maxopenfiles", stats.options.nMaxOpenFiles));
+        options.push_back(Pair("verifychecksums", stats.options.fVerifyChecksums));
+
+        UniValue levels(UniValue::VARR);
+        for (int nFiles : stats.vFilesPerLevel)
+            levels.push_back(nFiles);
+
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("options", options));
+        obj.push_back(Pair("cache_size", (uint64_t)stats.nCacheSize));
+        obj.push_back(Pair("approximate_size", stats.nApproximateSize));
+        obj.push_back(Pair("memory_usage", stats.nMemoryUsage));
+        obj.push_back(Pair("files_per_level", levels));
+        obj.push_back(Pair("compactions", stats.nCompactions));
+        obj.push_back(Pair("cache_hits", stats.nCacheHits));
+        obj.push_back(Pair("cache_misses", stats.nCacheMisses));
+        obj.push_back(Pair("cache_hit_rate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+        obj.push_back(Pair("stats", stats.strStats));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_STATS_H
+#define BITCOIN_RPC_STATS_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+/** Number of latency buckets; bucket i counts requests of at most 2^i microseconds, the last one all others */
+static const int LATENCY_BUCKETS = 28;
+
+/** Latency and traffic counters of one RPC method or REST endpoint */
+class CRequestStats
+{
+public:
+    uint64_t nCount;
+    uint64_t nErrors;
+    uint64_t nBytesOut;
+    //! Total time spent in the handler, including lock waits
+    int64_t nTotalMicros;
+    //! Part of nTotalMicros spent waiting for contended locks
+    int64_t nLockWaitMicros;
+    int64_t nMaxMicros;
+    uint64_t vBuckets[LATENCY_BUCKETS];
+
+    CRequestStats();
+
+    void Add(int64_t nMicros, int64_t nLockWaitMicrosIn, bool fError);
+    //! Upper bound of the latency below which a fraction q of the requests finished
+    int64_t Percentile(double q) const;
+    //! Upper bound of bucket i in microseconds
+    static int64_t BucketLimit(int i) { return (int64_t)1 << i; }
+};
+
+enum RequestStatsKind {
+    STATS_RPC,
+    STATS_REST,
+};
+
+/** Account a handled request to strName */
+void RecordRequest(RequestStatsKind kind, const std::string& strName, int64_t nMicros, int64_t nLockWaitMicros, bool fError);
+/** Account the size of a reply to strName */
+void RecordReplyBytes(RequestStatsKind kind, const std::string& strName, size_t nBytes);
+/** Return a copy of the counters of all methods or endpoints seen so far */
+std::map<std::string, CRequestStats> GetRequestStats(RequestStatsKind kind);
+void ResetRequestStats();
+
+/** All counters, and the state of the HTTP work queue, in the Prometheus text format */
+std::string GetPrometheusMetrics();
+
+#endif // BITCOIN_RPC_STATS_H
@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -83,7 +84,40 @@ enum
     SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY = (1U << 9)
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/** Fewest inputs of a transaction for which PrecomputedTransactionData saves work */
+static const unsigned int SIGHASH_PRECOMPUTE_MIN_INPUTS = 3;
+
+/**
+ * The parts of a transaction shared by the SIGHASH_ALL signature hashes of all
+ * its inputs. Each of these hashes the whole transaction with only the signed
+ * input's script filled in, which makes signing or verifying all inputs
+ * quadratic in their number. Here the transaction is serialized once with all
+ * scripts blank, and the SHA-256 state before each input is kept, so a hash
+ * only serializes its own input and hashes the rest from there. None of the
+ * parts depend on the scriptSigs, so the data stays valid while the inputs of
+ * the transaction are signed.
+ */
+class PrecomputedTransactionData
+{
+private:
+    //! The transaction with all input scripts blank
+    std::vector<unsigned char> vchBlank;
+    //! Size of the version and input count before the first input
+    size_t nInputsBegin;
+    //! SHA-256 state after the serialization before each input
+    std::vector<CSHA256> vMidstates;
+
+public:
+    //! Empty, and so not used, for transactions with fewer than SIGHASH_PRECOMPUTE_MIN_INPUTS inputs
+    template <class T>
+    explicit PrecomputedTransactionData(const T& txTo);
+
+    //! Set hashRet to the signature hash of input nIn, if nHashType hashes all inputs and outputs
+    bool SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType, uint256& hashRet) const;
+};
+
+template <class T>
+uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = NULL);
 
 class BaseSignatureChecker
 {
@@ -101,29 +135,26 @@ public:
     virtual ~BaseSignatureChecker() {}
 };
 
-class TransactionSignatureChecker : public BaseSignatureChecker
+template <class T>
+class GenericTransactionSignatureChecker : public BaseSignatureChecker
 {
 private:
-    const CTransaction* txTo;
+    const T* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    GenericTransactionSignatureChecker(const T* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
 };
 
-class MutableTransactionSignatureChecker : public TransactionSignatureChecker
-{
-private:
-    const CTransaction txTo;
-
-public:
-    MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
-};
+typedef GenericTransactionSignatureChecker<CTransaction> TransactionSignatureChecker;
+//! Checks an input of a transaction still being signed, without copying it
+typedef GenericTransactionSignatureChecker<CMutableTransaction> MutableTransactionSignatureChecker;
 
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
@@ -135,8 +135,14 @@ bool IsSporkActive(int nSporkID)
 
 void ReprocessBlocks(int nBlocks)
 {
-    std::map<uint256, int64_t>::iterator it = mapRejectedBlocks.begin();
-    while (it != mapRejectedBlocks.end()) {
+    // Copied, as CheckBlock inserts into it while holding cs_main
+    std::map<uint256, int64_t> mapRejected;
+    {
+        LOCK(cs_mapRejectedBlocks);
+        mapRejected = mapRejectedBlocks;
+    }
+    std::map<uint256, int64_t>::iterator it = mapRejected.begin();
+    while (it != mapRejected.end()) {
         //use a window twice as large as is usual for the nBlocks we want to reset
         if ((*it).second > GetTime() - (nBlocks * 60 * 5)) {
             BlockMap::iterator mi = mapBlockIndex.find((*it).first);
@@ -11,32 +11,48 @@
 bool CNbxStake::SetInput(CTransaction txPrev, unsigned int n)
 {
     this->txFrom = txPrev;
+    this->hashFrom = txPrev.GetHash();
     this->nPosition = n;
+    this->txOutFrom = txPrev.vout[n];
+    return true;
+}
+
+bool CNbxStake::SetInput(const COutPoint& prevout, const CTxOut& txOut, CBlockIndex* pindexFromIn)
+{
+    this->hashFrom = prevout.hash;
+    this->nPosition = prevout.n;
+    this->txOutFrom = txOut;
+    this->pindexFrom = pindexFromIn;
     return true;
 }
 
 bool CNbxStake::GetTxFrom(CTransaction& tx)
 {
+    if (txFrom.IsNull()) {
+        uint256 hashBlock;
+        if (!GetTransaction(hashFrom, txFrom, hashBlock, true))
+            return false;
+    }
     tx = txFrom;
     return true;
 }
 
 bool CNbxStake::CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut)
 {
-    txIn = CTxIn(txFrom.GetHash(), nPosition);
+    txIn = CTxIn(hashFrom, nPosition);
     return true;
 }
 
 CAmount CNbxStake::GetValue()
 {
-    return txFrom.vout[nPosition].nValue;
+    return txOutFrom.nValue;
 }
 
 bool CNbxStake::CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal)
 {
     std::vector<valtype> vSolutions;
     txnouttype whichType;
-    CScript scriptPubKeyKernel = txFrom.vout[nPosition].scriptPubKey;
+    CScript scriptPubKeyKernel = txOutFrom.scriptPubKey;
     if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
         LogPrintf("CreateCoinStake : failed to parse kernel\n");
         return false;
@@ -86,7 +102,7 @@ CDataStream CNbxStake::GetUniqueness()
 {
     //The unique identifier for a NBX stake is the outpoint
     CDataStream ss(SER_NETWORK, 0);
-    ss << nPosition << txFrom.GetHash();
+    ss << nPosition << hashFrom;
     return ss;
 }
 
@@ -95,9 +111,14 @@ CBlockIndex* CNbxStake::GetIndexFrom()
 {
     if (pindexFrom)
         return pindexFrom;
+    // Unspent outputs are found in the coins database, which unlike the
+    // block files is never pruned
+    CTxOut txOut;
+    if (GetUnspentOutput(COutPoint(hashFrom, nPosition), txOut, &pindexFrom) && pindexFrom)
+        return pindexFrom;
     uint256 hashBlock = 0;
     CTransaction tx;
-    if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
+    if (GetTransaction(hashFrom, tx, hashBlock, true)) {
         // If the index is in the chain, then set it as the "index from"
         if (mapBlockIndex.count(hashBlock)) {
             CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
@@ -105,7 +126,7 @@ CBlockIndex* CNbxStake::GetIndexFrom()
                 pindexFrom = pindex;
         }
     } else {
-        LogPrintf("%s : failed to find tx %s\n", __func__, txFrom.GetHash().GetHex());
+        LogPrintf("%s : failed to find tx %s\n", __func__, hashFrom.GetHex());
     }
 
     return pindexFrom;
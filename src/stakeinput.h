@@ -38,8 +38,11 @@ public:
 class CNbxStake : public CStakeInput
 {
 private:
+    //! Only set when the input was given as a whole transaction
     CTransaction txFrom;
+    uint256 hashFrom;
     unsigned int nPosition;
+    CTxOut txOutFrom;
 
     // cached data
     uint64_t nStakeModifier = 0;
@@ -49,6 +52,8 @@ public:
     CNbxStake(){}
 
     bool SetInput(CTransaction txPrev, unsigned int n);
+    //! Set the input from the unspent output and the block that created it, as found in the coins database
+    bool SetInput(const COutPoint& prevout, const CTxOut& txOut, CBlockIndex* pindexFromIn);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
@@ -187,9 +187,12 @@ bool IsIXTXValid(const CTransaction& txCollateral)
         nValueOut += o.nValue;
 
     for (const CTxIn &i : txCollateral.vin) {
+        CTxOut txOut;
         CTransaction tx2;
         uint256 hash;
-        if (GetTransaction(i.prevout.hash, tx2, hash, true)) {
+        if (GetUnspentOutput(i.prevout, txOut)) {
+            nValueIn += txOut.nValue;
+        } else if (GetTransaction(i.prevout.hash, tx2, hash, true)) {
             if (tx2.vout.size() > i.prevout.n) {
                 nValueIn += tx2.vout[i.prevout.n].nValue;
             }
@@ -5,6 +5,7 @@
 
 #include "sync.h"
 
+#include <map>
 #include <memory>
 #include <set>
 
@@ -24,6 +25,68 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static thread_local int64_t nThreadLockWaitMicros = 0;
+
+int64_t WaitForLock(std::unique_lock<CCriticalSection>& lock)
+{
+    int64_t nStart = GetTimeMicros();
+    lock.lock();
+    int64_t nWaitMicros = GetTimeMicros() - nStart;
+    nThreadLockWaitMicros += nWaitMicros;
+    return nWaitMicros;
+}
+
+int64_t GetThreadLockWaitMicros()
+{
+    return nThreadLockWaitMicros;
+}
+
+std::atomic<int> nLockProfilerRate(0);
+
+//! Samples are aggregated under a plain mutex, which the profiler does not see
+static std::mutex csLockProfile;
+static std::map<std::pair<std::string, int>, CLockSiteStats> mapLockProfile;
+static thread_local unsigned int nThreadAcquisitions = 0;
+
+bool LockProfilerSampleNext()
+{
+    int nRate = nLockProfilerRate.load(std::memory_order_relaxed);
+    return nRate > 0 && ++nThreadAcquisitions % nRate == 0;
+}
+
+void RecordLockSample(const char* pszName, const char* pszFile, int nLine, int64_t nWaitMicros, int64_t nHoldMicros)
+{
+    std::lock_guard<std::mutex> lock(csLockProfile);
+    CLockSiteStats& site = mapLockProfile[std::make_pair(std::string(pszFile), nLine)];
+    if (site.nSamples == 0) {
+        site.strName = pszName;
+        site.strFile = pszFile;
+        site.nLine = nLine;
+    }
+    site.nSamples++;
+    if (nWaitMicros > 0)
+        site.nContended++;
+    site.nWaitMicros += nWaitMicros;
+    site.nMaxWaitMicros = std::max(site.nMaxWaitMicros, nWaitMicros);
+    site.nHoldMicros += nHoldMicros;
+    site.nMaxHoldMicros = std::max(site.nMaxHoldMicros, nHoldMicros);
+}
+
+std::vector<CLockSiteStats> GetLockProfile()
+{
+    std::vector<CLockSiteStats> vSites;
+    std::lock_guard<std::mutex> lock(csLockProfile);
+    for (const std::pair<const std::pair<std::string, int>, CLockSiteStats>& item : mapLockProfile)
+        vSites.push_back(item.second);
+    return vSites;
+}
+
+void ResetLockProfile()
+{
+    std::lock_guard<std::mutex> lock(csLockProfile);
+    mapLockProfile.clear();
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,10 +8,14 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
 
+#include <atomic>
 #include <condition_variable>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 /////////////////////////////////////////////////
@@ -110,23 +114,65 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Block on a contended lock, accounting the time waited to the calling thread. Returns the time waited. */
+int64_t WaitForLock(std::unique_lock<CCriticalSection>& lock);
+/** Total time the calling thread has spent waiting for contended CCriticalSections */
+int64_t GetThreadLockWaitMicros();
+
+/**
+ * Lock contention profiler. While enabled, one in every nLockProfilerRate
+ * acquisitions of a CCriticalSection is timed, and its wait and hold times are
+ * accounted to the site (file and line) that took the lock. 0 disables it.
+ */
+extern std::atomic<int> nLockProfilerRate;
+
+/** Wait and hold times of the sampled acquisitions at one lock site */
+struct CLockSiteStats {
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    uint64_t nSamples;
+    //! Samples that found the lock taken
+    uint64_t nContended;
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+
+    CLockSiteStats() : nLine(0), nSamples(0), nContended(0), nWaitMicros(0), nMaxWaitMicros(0), nHoldMicros(0), nMaxHoldMicros(0) {}
+};
+
+/** Whether the calling thread should sample its next acquisition */
+bool LockProfilerSampleNext();
+void RecordLockSample(const char* pszName, const char* pszFile, int nLine, int64_t nWaitMicros, int64_t nHoldMicros);
+std::vector<CLockSiteStats> GetLockProfile();
+void ResetLockProfile();
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
 private:
     std::unique_lock<CCriticalSection> lock;
+    //! Site of a sampled acquisition, and when it got the lock; 0 if not sampled
+    const char* pszSampleName;
+    const char* pszSampleFile;
+    int nSampleLine;
+    int64_t nSampleWaitMicros;
+    int64_t nSampleAcquired;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        bool fSample = nLockProfilerRate.load(std::memory_order_relaxed) > 0 && LockProfilerSampleNext();
+        int64_t nWaitMicros = 0;
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            nWaitMicros = WaitForLock(lock);
         }
-#endif
+        if (fSample)
+            BeginSample(pszName, pszFile, nLine, nWaitMicros);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -135,11 +181,22 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (nLockProfilerRate.load(std::memory_order_relaxed) > 0 && LockProfilerSampleNext())
+            BeginSample(pszName, pszFile, nLine, 0);
         return lock.owns_lock();
     }
 
+    void BeginSample(const char* pszName, const char* pszFile, int nLine, int64_t nWaitMicros)
+    {
+        pszSampleName = pszName;
+        pszSampleFile = pszFile;
+        nSampleLine = nLine;
+        nSampleWaitMicros = nWaitMicros;
+        nSampleAcquired = GetTimeMicros();
+    }
+
 public:
-    CCriticalBlock(CCriticalSection& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, std::defer_lock)
+    CCriticalBlock(CCriticalSection& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, std::defer_lock), nSampleAcquired(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -147,7 +204,7 @@ public:
             Enter(pszName, pszFile, nLine);
     }
 
-    CCriticalBlock(CCriticalSection* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    CCriticalBlock(CCriticalSection* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : nSampleAcquired(0)
     {
         if (!pmutexIn) return;
 
@@ -160,8 +217,11 @@ public:
 
     ~CCriticalBlock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (nSampleAcquired)
+                RecordLockSample(pszSampleName, pszSampleFile, nSampleLine, nSampleWaitMicros, GetTimeMicros() - nSampleAcquired);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -9,6 +9,7 @@
 
 #include "checkpoints.h"
 
+#include "chainparams.h"
 #include "uint256.h"
 #include "test_nbx.h"
 
@@ -35,4 +36,18 @@ BOOST_AUTO_TEST_CASE(sanity)
     BOOST_CHECK(Checkpoints::GetTotalBlocksEstimate() >= 623933);
 }
 
+BOOST_AUTO_TEST_CASE(assumevalid_defaults)
+{
+    // Covering the initial download, before the block itself is known, needs it to be a checkpoint
+    for (CBaseChainParams::Network network : {CBaseChainParams::MAIN, CBaseChainParams::TESTNET}) {
+        const CChainParams& params = Params(network);
+        const Checkpoints::MapCheckpoints& checkpoints = *params.Checkpoints().mapCheckpoints;
+        bool fCheckpoint = false;
+        for (const std::pair<const int, uint256>& checkpoint : checkpoints)
+            fCheckpoint |= checkpoint.second == params.DefaultAssumeValid();
+        BOOST_CHECK_MESSAGE(fCheckpoint, params.NetworkIDString());
+    }
+    BOOST_CHECK(Params(CBaseChainParams::REGTEST).DefaultAssumeValid() == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
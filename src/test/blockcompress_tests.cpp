@@ -0,0 +1,244 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "main.h"
+#include "random.h"
+#include "test/test_nbx.h"
+#include "txdb.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompress_tests, TestingSetup)
+
+static std::vector<unsigned char> RandomBytes(int nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    GetRandBytes(&vch[0], nSize);
+    return vch;
+}
+
+static CScript PayToKeyHash(const std::vector<unsigned char>& vchKeyHash)
+{
+    return CScript() << OP_DUP << OP_HASH160 << vchKeyHash << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+/**
+ * A proof-of-stake block laid out like those of the main network: a coinstake
+ * paying the staker, a masternode and the activity and team addresses, then
+ * nTransactions payments between the addresses of vKeyHashes, every tenth
+ * carrying compressed dApp data in an OP_RETURN output.
+ */
+static CBlock MakeBlock(int nTransactions, const std::vector<std::vector<unsigned char> >& vKeyHashes)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+    block.nBits = 0x1e0ffff0;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 100000 << OP_0;
+    coinbase.vout.push_back(CTxOut());
+    coinbase.vout[0].SetEmpty();
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 1), CScript() << RandomBytes(72)));
+    coinstake.vout.push_back(CTxOut());
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout.push_back(CTxOut(1000 * COIN, CScript() << RandomBytes(33) << OP_CHECKSIG));
+    coinstake.vout.push_back(CTxOut(3 * COIN, PayToKeyHash(vKeyHashes[GetRand(20)])));
+    coinstake.vout.push_back(CTxOut(COIN, PayToKeyHash(vKeyHashes[0])));
+    coinstake.vout.push_back(CTxOut(COIN, PayToKeyHash(vKeyHashes[1])));
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        for (int j = 0; j < 1 + i % 2; j++)
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), GetRand(4)), CScript() << RandomBytes(72) << RandomBytes(33)));
+        tx.vout.push_back(CTxOut(GetRand(1000) * COIN, PayToKeyHash(vKeyHashes[GetRand(vKeyHashes.size())])));
+        tx.vout.push_back(CTxOut(GetRand(1000) * COIN, PayToKeyHash(vKeyHashes[GetRand(vKeyHashes.size())])));
+        if (i % 10 == 0)
+            tx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << RandomBytes(200)));
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static std::vector<std::vector<unsigned char> > MakeKeyHashes(int n)
+{
+    std::vector<std::vector<unsigned char> > vKeyHashes;
+    for (int i = 0; i < n; i++)
+        vKeyHashes.push_back(RandomBytes(20));
+    return vKeyHashes;
+}
+
+/** Append blocks to block file nFile as -compressblocks says, index their transactions and return the bytes written */
+static uint64_t WriteBlocks(int nFile, const std::vector<CBlock>& vBlocks, std::vector<CDiskBlockPos>& vPos)
+{
+    CDiskBlockPos pos(nFile, 0);
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    if (boost::filesystem::exists(path))
+        pos.nPos = boost::filesystem::file_size(path);
+    uint64_t nWritten = 0;
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxIndex;
+    for (unsigned int i = vPos.size(); i < vBlocks.size(); i++) {
+        CStoredBlock stored;
+        stored.Set(vBlocks[i]);
+        BOOST_CHECK(WriteBlockToDisk(stored, pos));
+        vPos.push_back(pos);
+        CDiskTxPos postx(pos, GetSizeOfCompactSize(vBlocks[i].vtx.size()));
+        for (const CTransaction& tx : vBlocks[i].vtx) {
+            vTxIndex.push_back(std::make_pair(tx.GetHash(), postx));
+            postx.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+        pos.nPos += stored.vchData.size();
+        nWritten += stored.GetDiskSize();
+    }
+    BOOST_CHECK(pblocktree->WriteTxIndex(vTxIndex));
+    return nWritten;
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_frame)
+{
+    CBlock block = MakeBlock(50, MakeKeyHashes(100));
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+
+    std::vector<char> vchFrame;
+    BOOST_CHECK(CompressBlockData(&ssBlock[0], &ssBlock[0] + ssBlock.size(), vchFrame));
+    BOOST_CHECK(vchFrame.size() < ssBlock.size());
+    CDataStream ssInflated(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(DecompressBlockData(vchFrame.data(), vchFrame.data() + vchFrame.size(), ssInflated));
+    BOOST_CHECK(ssInflated.str() == ssBlock.str());
+
+    // The zlib checksum catches corruption
+    vchFrame[vchFrame.size() / 2] ^= 1;
+    BOOST_CHECK(!DecompressBlockData(vchFrame.data(), vchFrame.data() + vchFrame.size(), ssInflated));
+    BOOST_CHECK(!DecompressBlockData(vchFrame.data(), vchFrame.data() + 2, ssInflated));
+
+    // Not stored compressed if that does not save anything
+    std::vector<unsigned char> vchRandom = RandomBytes(1000);
+    BOOST_CHECK(!CompressBlockData((const char*)&vchRandom[0], (const char*)&vchRandom[0] + vchRandom.size(), vchFrame));
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_read)
+{
+    const int nFile = 90100;
+    bool fCompressBlocksOld = fCompressBlocks;
+    bool fMapBlockFilesOld = fMapBlockFiles;
+    std::vector<std::vector<unsigned char> > vKeyHashes = MakeKeyHashes(100);
+    std::vector<CBlock> vBlocks;
+    std::vector<CDiskBlockPos> vPos;
+
+    // Both formats in one file
+    for (int i = 0; i < 4; i++) {
+        fCompressBlocks = i % 2 == 0;
+        vBlocks.push_back(MakeBlock(30, vKeyHashes));
+        WriteBlocks(nFile, vBlocks, vPos);
+        CStoredBlock stored;
+        stored.Set(vBlocks.back());
+        BOOST_CHECK_EQUAL(stored.fCompressed, fCompressBlocks);
+    }
+
+    for (int nMapped = 0; nMapped < 2; nMapped++) {
+        fMapBlockFiles = nMapped;
+        for (unsigned int i = 0; i < vBlocks.size(); i++) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, vPos[i]));
+            BOOST_CHECK(block.GetHash() == vBlocks[i].GetHash());
+            BOOST_CHECK(block.vtx == vBlocks[i].vtx);
+
+            const CTransaction& txExpected = vBlocks[i].vtx[20];
+            CTransaction tx;
+            uint256 hashBlock;
+            BOOST_CHECK(GetTransaction(txExpected.GetHash(), tx, hashBlock));
+            BOOST_CHECK(tx == txExpected);
+            BOOST_CHECK(hashBlock == vBlocks[i].GetHash());
+        }
+    }
+    fCompressBlocks = fCompressBlocksOld;
+    fMapBlockFiles = fMapBlockFilesOld;
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_fileinfo)
+{
+    CBlockFileInfo info;
+    info.nBlocks = 10;
+    info.nSize = 12345;
+    info.nFormat = BLOCKFILE_FORMAT_COMPRESSED;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << info;
+    CBlockFileInfo infoRead;
+    ss >> infoRead;
+    BOOST_CHECK_EQUAL(infoRead.nSize, info.nSize);
+    BOOST_CHECK_EQUAL(infoRead.nFormat, BLOCKFILE_FORMAT_COMPRESSED);
+
+    // As written before the format was recorded
+    ss << VARINT(info.nBlocks) << VARINT(info.nSize) << VARINT(info.nUndoSize) << VARINT(info.nHeightFirst)
+       << VARINT(info.nHeightLast) << VARINT(info.nTimeFirst) << VARINT(info.nTimeLast);
+    infoRead.nFormat = BLOCKFILE_FORMAT_COMPRESSED;
+    ss >> infoRead;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(infoRead.nBlocks, info.nBlocks);
+    BOOST_CHECK_EQUAL(infoRead.nFormat, BLOCKFILE_FORMAT_RAW);
+}
+
+/** Disk footprint and read latency of blocks stored raw and compressed */
+BOOST_AUTO_TEST_CASE(blockcompress_footprint)
+{
+    const int nBlocks = 100;
+    bool fCompressBlocksOld = fCompressBlocks;
+    std::vector<std::vector<unsigned char> > vKeyHashes = MakeKeyHashes(2000);
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < nBlocks; i++)
+        vBlocks.push_back(MakeBlock(i % 2 ? 5 : 150, vKeyHashes));
+
+    // Compression time and size at a higher level, for comparison
+    uint64_t nBestSize = 0;
+    int64_t nStart = GetTimeMicros();
+    for (const CBlock& block : vBlocks) {
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ssBlock << block;
+        std::vector<char> vchFrame;
+        CompressBlockData(&ssBlock[0], &ssBlock[0] + ssBlock.size(), vchFrame, 9);
+        nBestSize += std::min(vchFrame.size(), ssBlock.size()) + 8;
+    }
+    int64_t nBestMicros = GetTimeMicros() - nStart;
+
+    std::vector<CDiskBlockPos> vPos[2];
+    uint64_t nStoredSize[2];
+    int64_t nWriteMicros[2], nReadMicros[2];
+    for (int nCompressed = 0; nCompressed < 2; nCompressed++) {
+        fCompressBlocks = nCompressed;
+        nStart = GetTimeMicros();
+        nStoredSize[nCompressed] = WriteBlocks(90101 + nCompressed, vBlocks, vPos[nCompressed]);
+        nWriteMicros[nCompressed] = GetTimeMicros() - nStart;
+
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nBlocks; i++) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, vPos[nCompressed][i]));
+        }
+        nReadMicros[nCompressed] = GetTimeMicros() - nStart;
+    }
+    fCompressBlocks = fCompressBlocksOld;
+    BOOST_CHECK(nStoredSize[1] < nStoredSize[0]);
+
+    BOOST_TEST_MESSAGE(strprintf("Block storage: raw %u bytes, %.0fus/block to write, %.0fus/block to read; "
+                                 "compressed %u bytes (%.1f%%), %.0fus/block to write, %.0fus/block to read; level 9 %u bytes (%.1f%%), %.0fus/block to compress",
+        nStoredSize[0], (double)nWriteMicros[0] / nBlocks, (double)nReadMicros[0] / nBlocks,
+        nStoredSize[1], 100.0 * nStoredSize[1] / nStoredSize[0], (double)nWriteMicros[1] / nBlocks, (double)nReadMicros[1] / nBlocks,
+        nBestSize, 100.0 * nBestSize / nStoredSize[0], (double)nBestMicros / nBlocks));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "main.h"
+#include "random.h"
+#include "test/test_nbx.h"
+#include "txdb.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+/** A proof-of-stake block with nTransactions ordinary transactions, which ReadBlockFromDisk accepts without a valid header */
+static CBlock MakeBlock(int nTransactions)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = GetTime();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    coinstake.vout.push_back(CTxOut());
+    coinstake.vout[0].SetEmpty();
+    // Stake, masternode and budget payments
+    for (int i = 0; i < 3; i++)
+        coinstake.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), i), CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2)));
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG));
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Append blocks to block file nFile and index their transactions */
+static void WriteBlocks(int nFile, std::vector<CBlock>& vBlocks, std::vector<CDiskBlockPos>& vPos)
+{
+    CDiskBlockPos pos(nFile, 0);
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    if (boost::filesystem::exists(path))
+        pos.nPos = boost::filesystem::file_size(path);
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxIndex;
+    for (unsigned int i = vPos.size(); i < vBlocks.size(); i++) {
+        CStoredBlock stored;
+        stored.Set(vBlocks[i]);
+        BOOST_CHECK(WriteBlockToDisk(stored, pos));
+        vPos.push_back(pos);
+        CDiskTxPos postx(pos, GetSizeOfCompactSize(vBlocks[i].vtx.size()));
+        for (const CTransaction& tx : vBlocks[i].vtx) {
+            vTxIndex.push_back(std::make_pair(tx.GetHash(), postx));
+            postx.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+        pos.nPos += stored.vchData.size();
+    }
+    BOOST_CHECK(pblocktree->WriteTxIndex(vTxIndex));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+    // Far beyond the block files of the test chain
+    const int nFile = 90000;
+    bool fMapBlockFilesOld = fMapBlockFiles;
+    std::vector<CBlock> vBlocks;
+    std::vector<CDiskBlockPos> vPos;
+    vBlocks.push_back(MakeBlock(10));
+    WriteBlocks(nFile, vBlocks, vPos);
+
+    for (int nMapped = 0; nMapped < 2; nMapped++) {
+        fMapBlockFiles = nMapped;
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, vPos[0]));
+        BOOST_CHECK(block.GetHash() == vBlocks[0].GetHash());
+        BOOST_CHECK(block.vtx == vBlocks[0].vtx);
+    }
+
+    // Appended after the file was mapped
+    vBlocks.push_back(MakeBlock(20));
+    WriteBlocks(nFile, vBlocks, vPos);
+    for (int nMapped = 0; nMapped < 2; nMapped++) {
+        fMapBlockFiles = nMapped;
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, vPos[1]));
+        BOOST_CHECK(block.GetHash() == vBlocks[1].GetHash());
+
+        const CTransaction& txExpected = vBlocks[1].vtx[15];
+        CTransaction tx;
+        uint256 hashBlock;
+        BOOST_CHECK(GetTransaction(txExpected.GetHash(), tx, hashBlock));
+        BOOST_CHECK(tx == txExpected);
+        BOOST_CHECK(hashBlock == vBlocks[1].GetHash());
+    }
+    fMapBlockFiles = fMapBlockFilesOld;
+}
+
+/** Sequential block reads and random transaction lookups, through the mapping and with stdio */
+BOOST_AUTO_TEST_CASE(blockfilemap_throughput)
+{
+    const int nFile = 90001;
+    const int nBlocks = 200;
+    const int nLookups = 5000;
+    bool fMapBlockFilesOld = fMapBlockFiles;
+    std::vector<CBlock> vBlocks;
+    std::vector<CDiskBlockPos> vPos;
+    for (int i = 0; i < nBlocks; i++)
+        vBlocks.push_back(MakeBlock(100));
+    WriteBlocks(nFile, vBlocks, vPos);
+
+    std::vector<uint256> vLookups;
+    for (int i = 0; i < nLookups; i++) {
+        const CBlock& block = vBlocks[GetRand(nBlocks)];
+        vLookups.push_back(block.vtx[GetRand(block.vtx.size())].GetHash());
+    }
+
+    int64_t nReadMicros[2], nLookupMicros[2];
+    for (int nMapped = 0; nMapped < 2; nMapped++) {
+        fMapBlockFiles = nMapped;
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nBlocks; i++) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, vPos[i]));
+        }
+        nReadMicros[nMapped] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+        nStart = GetTimeMicros();
+        for (const uint256& hash : vLookups) {
+            CTransaction tx;
+            uint256 hashBlock;
+            BOOST_CHECK(GetTransaction(hash, tx, hashBlock));
+        }
+        nLookupMicros[nMapped] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    }
+    fMapBlockFiles = fMapBlockFilesOld;
+
+    BOOST_TEST_MESSAGE(strprintf("Sequential block reads: %.0f blocks/sec from file, %.0f blocks/sec mapped; random transaction lookups: %.0f txs/sec from file, %.0f txs/sec mapped",
+        nBlocks * 1e6 / nReadMicros[0], nBlocks * 1e6 / nReadMicros[1],
+        nLookups * 1e6 / nLookupMicros[0], nLookups * 1e6 / nLookupMicros[1]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "main.h"
+#include "random.h"
+#include "test/test_nbx.h"
+#include "txdb.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_tests, TestingSetup)
+
+/** A chain of n proof-of-stake entries on top of the genesis block */
+static void BuildChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHashes, int n)
+{
+    vIndex.resize(n);
+    vHashes.resize(n);
+    CBlockIndex* pprev = chainActive.Genesis();
+    for (int i = 0; i < n; i++) {
+        CBlockIndex& index = vIndex[i];
+        index.pprev = pprev;
+        index.nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        index.nVersion = 4;
+        index.nTime = pprev->nTime + 60;
+        index.nBits = pprev->nBits;
+        index.nNonce = i;
+        index.hashMerkleRoot = GetRandHash();
+        index.nStatus = BLOCK_VALID_TREE;
+        index.nMoneySupply = i * COIN;
+        vHashes[i] = index.GetBlockHeader().GetHash();
+        index.phashBlock = &vHashes[i];
+        pprev = &index;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_load)
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildChain(vIndex, vHashes, 300);
+
+    CBlockTreeDB db(1 << 20, true);
+    for (const CBlockIndex& index : vIndex)
+        BOOST_CHECK(db.WriteBlockIndex(CDiskBlockIndex(&index)));
+
+    size_t nSize = mapBlockIndex.size();
+    BOOST_CHECK(db.LoadBlockIndexGuts());
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), nSize + vIndex.size());
+    for (unsigned int i = 0; i < vIndex.size(); i++) {
+        BlockMap::iterator it = mapBlockIndex.find(vHashes[i]);
+        BOOST_CHECK(it != mapBlockIndex.end());
+        const CBlockIndex* pindex = it->second;
+        BOOST_CHECK(pindex->GetBlockHash() == vHashes[i]);
+        BOOST_CHECK(pindex->GetBlockHeader().GetHash() == vHashes[i]);
+        BOOST_CHECK(pindex->pprev == (i ? mapBlockIndex[vHashes[i - 1]] : chainActive.Genesis()));
+        BOOST_CHECK_EQUAL(pindex->nHeight, vIndex[i].nHeight);
+        BOOST_CHECK_EQUAL(pindex->nMoneySupply, vIndex[i].nMoneySupply);
+        BOOST_CHECK_EQUAL(pindex->nStatus, vIndex[i].nStatus);
+    }
+
+    // The entries themselves stay allocated until the block index is unloaded
+    for (const uint256& hash : vHashes)
+        mapBlockIndex.erase(hash);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_stake_prevout)
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildChain(vIndex, vHashes, 1);
+    vIndex[0].SetProofOfStake();
+
+    CDiskBlockIndex diskindex(&vIndex[0]);
+    BOOST_CHECK_EQUAL(diskindex.nStakeTime, vIndex[0].nTime);
+    diskindex.prevoutStake = COutPoint(GetRandHash(), 1);
+    BOOST_CHECK(pblocktree->WriteBlockIndex(diskindex));
+
+    // Read back from the block tree database on demand
+    COutPoint prevout;
+    LOCK(cs_main);
+    BOOST_CHECK(GetBlockStakePrevout(&vIndex[0], prevout));
+    BOOST_CHECK(prevout == diskindex.prevoutStake);
+
+    CDiskBlockIndex diskindexRead;
+    BOOST_CHECK(pblocktree->ReadBlockIndex(vHashes[0], diskindexRead));
+    BOOST_CHECK_EQUAL(diskindexRead.nStakeTime, diskindex.nStakeTime);
+    BOOST_CHECK(diskindexRead.IsProofOfStake());
+
+    // Rewriting the entry, as a flush does without reading the stake input, keeps it
+    vIndex[0].nStatus |= BLOCK_FAILED_VALID;
+    BOOST_CHECK(pblocktree->WriteBlockIndex(CDiskBlockIndex(&vIndex[0])));
+    BOOST_CHECK(GetBlockStakePrevout(&vIndex[0], prevout));
+    BOOST_CHECK(prevout == diskindex.prevoutStake);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_stake_prevout_upgrade)
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildChain(vIndex, vHashes, 1);
+    vIndex[0].SetProofOfStake();
+
+    // An entry written by a version that kept the stake input in the entry only
+    CBlockTreeDB db(1 << 20, true);
+    CDiskBlockIndex diskindex(&vIndex[0]);
+    diskindex.prevoutStake = COutPoint(GetRandHash(), 2);
+    BOOST_CHECK(db.Write(std::make_pair('b', vHashes[0]), diskindex));
+    COutPoint prevout;
+    BOOST_CHECK(db.ReadStakePrevout(vHashes[0], prevout));
+    BOOST_CHECK(prevout == diskindex.prevoutStake);
+
+    // Loading the index copies it to its own key, so later rewrites keep it
+    BOOST_CHECK(db.LoadBlockIndexGuts());
+    bool fStakePrevouts = false;
+    BOOST_CHECK(db.ReadFlag("stakeprevouts", fStakePrevouts) && fStakePrevouts);
+    BOOST_CHECK(db.WriteBlockIndex(CDiskBlockIndex(&vIndex[0])));
+    prevout.SetNull();
+    BOOST_CHECK(db.ReadStakePrevout(vHashes[0], prevout));
+    BOOST_CHECK(prevout == diskindex.prevoutStake);
+
+    mapBlockIndex.erase(vHashes[0]);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_load_checks_hash)
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildChain(vIndex, vHashes, 1);
+
+    // An entry stored under a key that is not the hash of its header
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_CHECK(db.Write(std::make_pair('b', GetRandHash()), CDiskBlockIndex(&vIndex[0])));
+
+    bool fCheckBlockIndexOld = fCheckBlockIndex;
+    fCheckBlockIndex = true;
+    size_t nSize = mapBlockIndex.size();
+    BOOST_CHECK(!db.LoadBlockIndexGuts());
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), nSize);
+    fCheckBlockIndex = fCheckBlockIndexOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
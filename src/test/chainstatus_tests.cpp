@@ -0,0 +1,66 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstatus.h"
+
+#include "chain.h"
+#include "main.h"
+#include "test/test_nbx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(chainstatus_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(chainstatus_follows_tip)
+{
+    std::shared_ptr<const CChainStatus> status = GetChainStatus();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(status->nHeight, chainActive.Height());
+        BOOST_CHECK(status->hashBlock == chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK_EQUAL(status->nTime, chainActive.Tip()->GetBlockTime());
+        BOOST_CHECK(status->nChainWork == chainActive.Tip()->nChainWork);
+        BOOST_CHECK_EQUAL(status->nHeadersHeight, pindexBestHeader->nHeight);
+    }
+
+    // Publishing masternode counts keeps the tip and leaves old snapshots untouched
+    CMasternodeCounts counts;
+    counts.nTotal = 7;
+    counts.nEnabled = 5;
+    PublishMasternodeCounts(counts);
+    std::shared_ptr<const CChainStatus> updated = GetChainStatus();
+    BOOST_CHECK(updated != status);
+    BOOST_CHECK(updated->hashBlock == status->hashBlock);
+    BOOST_CHECK(updated->mnCounts.fValid);
+    BOOST_CHECK_EQUAL(updated->mnCounts.nTotal, 7);
+    BOOST_CHECK_EQUAL(updated->mnCounts.nEnabled, 5);
+    BOOST_CHECK(!status->mnCounts.fValid);
+
+    // A new tip carries the masternode counts over
+    {
+        LOCK(cs_main);
+        PublishChainTip(NULL, NULL);
+    }
+    BOOST_CHECK_EQUAL(GetChainStatus()->nHeight, -1);
+    BOOST_CHECK_EQUAL(GetChainStatus()->mnCounts.nTotal, 7);
+    {
+        LOCK(cs_main);
+        PublishChainTip(chainActive.Tip(), pindexBestHeader);
+    }
+    BOOST_CHECK(GetChainStatus()->hashBlock == status->hashBlock);
+}
+
+BOOST_AUTO_TEST_CASE(chainstatus_staking)
+{
+    CChainStatus status;
+    status.nHeight = 10;
+    BOOST_CHECK(!IsStakingActive(status));
+    SetStakeHashedHeight(10);
+    BOOST_CHECK(IsStakingActive(status));
+    SetStakeHashedHeight(8);
+    BOOST_CHECK(!IsStakingActive(status));
+    SetStakeHashedHeight(-1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "coins.h"
 #include "random.h"
+#include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 #include "test/test_nbx.h"
 
@@ -176,4 +179,28 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_serialize_size)
+{
+    // Enough spentness bytes for the header code to need a second VARINT byte
+    for (unsigned int nMaskBytes = 0; nMaskBytes < 20; nMaskBytes++) {
+        for (int nFlags = 0; nFlags < 8; nFlags++) {
+            CCoins coins;
+            coins.fCoinBase = nFlags & 1;
+            coins.fCoinStake = (nFlags & 2) != 0;
+            coins.nHeight = 1000;
+            coins.vout.resize(2 + 8 * nMaskBytes);
+            if (nFlags & 4)
+                coins.vout[0] = CTxOut(5000, CScript() << OP_TRUE);
+            for (unsigned int b = 0; b < nMaskBytes; b++)
+                coins.vout[2 + 8 * b] = CTxOut(1000 + b, CScript() << OP_TRUE);
+            if (coins.IsPruned())
+                continue;
+
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << coins;
+            BOOST_CHECK_EQUAL(coins.GetSerializeSize(SER_DISK, CLIENT_VERSION), ss.size());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
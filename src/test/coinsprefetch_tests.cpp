@@ -0,0 +1,157 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "random.h"
+#include "test/test_nbx.h"
+#include "txdb.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, TestingSetup)
+
+/** Write nCoins single output coins to view and return their txids */
+static std::vector<uint256> WriteCoins(CCoinsView& view, int nCoins)
+{
+    std::vector<uint256> vTxids;
+    CCoinsViewCache cache(&view);
+    for (int i = 0; i < nCoins; i++) {
+        uint256 txid = GetRandHash();
+        CCoinsModifier coins = cache.ModifyCoins(txid);
+        coins->nVersion = 1;
+        coins->nHeight = i;
+        coins->vout.push_back(CTxOut(i + 1, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG));
+        vTxids.push_back(txid);
+    }
+    cache.SetBestBlock(GetRandHash());
+    BOOST_CHECK(cache.Flush());
+    return vTxids;
+}
+
+/** Wait until the reads queued on view have finished */
+static void WaitForPrefetch(const CCoinsViewPrefetch& view, uint64_t nQueued)
+{
+    for (int i = 0; i < 1000; i++) {
+        CCoinsPrefetchStats stats = view.GetPrefetchStats();
+        if (stats.nStaged + stats.nDiscarded >= nQueued)
+            return;
+        MilliSleep(10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_lookup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewPrefetch prefetch(&db, 2);
+    std::vector<uint256> vTxids = WriteCoins(db, 100);
+    uint256 txidMissing = GetRandHash();
+
+    std::vector<uint256> vPrefetch(vTxids.begin(), vTxids.begin() + 50);
+    vPrefetch.push_back(txidMissing);
+    prefetch.Prefetch(vPrefetch);
+    // Queued twice, read once
+    prefetch.Prefetch(vPrefetch);
+    WaitForPrefetch(prefetch, vPrefetch.size());
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchStats().nQueued, vPrefetch.size());
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchStats().nStaged, vPrefetch.size());
+
+    for (int i = 0; i < 100; i++) {
+        CCoins coins;
+        BOOST_CHECK(prefetch.GetCoins(vTxids[i], coins));
+        BOOST_CHECK_EQUAL(coins.nHeight, i);
+        BOOST_CHECK_EQUAL(coins.vout[0].nValue, i + 1);
+    }
+    CCoins coins;
+    BOOST_CHECK(!prefetch.HaveCoins(txidMissing));
+    BOOST_CHECK(!prefetch.GetCoins(txidMissing, coins));
+
+    CCoinsPrefetchStats stats = prefetch.GetPrefetchStats();
+    BOOST_CHECK_EQUAL(stats.nHits + stats.nWaits, 51U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 50U);
+    BOOST_CHECK_EQUAL(stats.nStaged, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_write)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewPrefetch prefetch(&db, 2);
+    std::vector<uint256> vTxids = WriteCoins(db, 2);
+    prefetch.Prefetch(vTxids);
+    WaitForPrefetch(prefetch, vTxids.size());
+
+    // Spending one of the staged coins drops it
+    CCoinsMap mapCoins;
+    mapCoins[vTxids[0]].flags = CCoinsCacheEntry::DIRTY;
+    BOOST_CHECK(prefetch.BatchWrite(mapCoins, GetRandHash()));
+    CCoinsPrefetchStats stats = prefetch.GetPrefetchStats();
+    BOOST_CHECK_EQUAL(stats.nDiscarded, 1U);
+    BOOST_CHECK_EQUAL(stats.nStaged, 1U);
+
+    CCoins coins;
+    BOOST_CHECK(!prefetch.GetCoins(vTxids[0], coins));
+    BOOST_CHECK(prefetch.GetCoins(vTxids[1], coins));
+    BOOST_CHECK_EQUAL(prefetch.GetPrefetchStats().nHits, 1U);
+}
+
+/** View whose reads take as long as a random read from disk */
+class CCoinsViewSlow : public CCoinsViewBacked
+{
+public:
+    int64_t nReadMicros;
+
+    CCoinsViewSlow(CCoinsView* viewIn, int64_t nReadMicrosIn) : CCoinsViewBacked(viewIn), nReadMicros(nReadMicrosIn) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        if (nReadMicros)
+            boost::this_thread::sleep_for(boost::chrono::microseconds(nReadMicros));
+        return CCoinsViewBacked::GetCoins(txid, coins);
+    }
+};
+
+/** Resolve the inputs of blocks with and without reading them ahead */
+BOOST_AUTO_TEST_CASE(coinsprefetch_throughput)
+{
+    const int nCoins = 50000;
+    const int nBlocks = 10;
+    const int nInputs = 1000;
+    // On disk, with a small cache, as the chainstate of a node whose UTXO set does not fit in memory
+    CCoinsViewDB db(1 << 20, false, true);
+    std::vector<uint256> vTxids = WriteCoins(db, nCoins);
+
+    // Reads served from the page cache, and reads taking as long as on a disk with 100us random reads
+    for (int64_t nReadMicros : {0, 100}) {
+        CCoinsViewSlow dbSlow(&db, nReadMicros);
+        int64_t nMicros[2];
+        CCoinsPrefetchStats stats;
+        for (int nMode = 0; nMode < 2; nMode++) {
+            CCoinsViewPrefetch prefetch(&dbSlow, DEFAULT_PREFETCH_THREADS);
+            CCoinsViewCache tip(nMode ? (CCoinsView*)&prefetch : (CCoinsView*)&dbSlow);
+            int64_t nStart = GetTimeMicros();
+            for (int i = 0; i < nBlocks; i++) {
+                std::vector<uint256> vInputs;
+                for (int j = 0; j < nInputs; j++)
+                    vInputs.push_back(vTxids[GetRand(nCoins)]);
+                if (nMode)
+                    prefetch.Prefetch(vInputs);
+                for (const uint256& txid : vInputs)
+                    BOOST_CHECK(tip.AccessCoins(txid) != NULL);
+            }
+            nMicros[nMode] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+            if (nMode)
+                stats = prefetch.GetPrefetchStats();
+        }
+
+        BOOST_TEST_MESSAGE(strprintf("Block input lookups with %dus added per read: %.0f inputs/sec from the database, %.0f inputs/sec read ahead by %d threads; prefetch hits %u, waits %u, misses %u, hit rate %.2f",
+            nReadMicros, nBlocks * nInputs * 1e6 / nMicros[0], nBlocks * nInputs * 1e6 / nMicros[1], DEFAULT_PREFETCH_THREADS,
+            stats.nHits, stats.nWaits, stats.nMisses, stats.HitRate()));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+#include "test/test_nbx.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(jsonstream_tests, BasicTestingSetup)
+
+static void AppendChunk(std::vector<std::string>* chunks, const std::string& chunk)
+{
+    chunks->push_back(chunk);
+}
+
+/** Stream the members of obj (an object or array) one by one */
+static std::string StreamValue(const UniValue& val, size_t nChunkSize, std::vector<std::string>& chunks)
+{
+    CJSONStreamWriter out(boost::bind(&AppendChunk, &chunks, _1), nChunkSize);
+    if (val.isObject()) {
+        out.BeginObject();
+        const std::vector<std::string>& keys = val.getKeys();
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            if (val[i].isArray()) {
+                out.Key(keys[i]);
+                out.BeginArray();
+                for (unsigned int j = 0; j < val[i].size(); j++)
+                    out.Value(val[i][j]);
+                out.EndArray();
+            } else
+                out.Write(keys[i], val[i]);
+        }
+        out.EndObject();
+    } else {
+        out.BeginArray();
+        for (unsigned int i = 0; i < val.size(); i++)
+            out.Value(val[i]);
+        out.EndArray();
+    }
+    BOOST_CHECK_EQUAL(out.Started(), !chunks.empty());
+    std::string strOut;
+    for (const std::string& chunk : chunks)
+        strOut += chunk;
+    return strOut + out.Finish();
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_write)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("hash", "0000000000000000000000000000000000000000000000000000000000000000"));
+    obj.push_back(Pair("escaped \"key\"\n", "value\twith \\ escapes"));
+    obj.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    UniValue txs(UniValue::VARR);
+    for (int i = 0; i < 100; i++) {
+        UniValue tx(UniValue::VOBJ);
+        tx.push_back(Pair("n", i));
+        tx.push_back(Pair("value", 1.5 * i));
+        tx.push_back(Pair("nested", UniValue(UniValue::VOBJ)));
+        txs.push_back(tx);
+    }
+    obj.push_back(Pair("tx", txs));
+    obj.push_back(Pair("null", NullUniValue));
+    obj.push_back(Pair("bool", true));
+
+    // Everything fits into one chunk: nothing is passed to the sink
+    std::vector<std::string> chunks;
+    BOOST_CHECK_EQUAL(StreamValue(obj, DEFAULT_JSON_STREAM_CHUNK, chunks), obj.write());
+    BOOST_CHECK(chunks.empty());
+
+    // Tiny chunks: output is split but identical
+    chunks.clear();
+    BOOST_CHECK_EQUAL(StreamValue(obj, 16, chunks), obj.write());
+    BOOST_CHECK(chunks.size() > 10);
+    for (const std::string& chunk : chunks)
+        BOOST_CHECK(chunk.size() >= 16);
+
+    chunks.clear();
+    BOOST_CHECK_EQUAL(StreamValue(txs, 100, chunks), txs.write());
+    BOOST_CHECK(!chunks.empty());
+
+    chunks.clear();
+    UniValue empty(UniValue::VOBJ);
+    BOOST_CHECK_EQUAL(StreamValue(empty, 1, chunks), "{}");
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_members)
+{
+    UniValue head(UniValue::VOBJ);
+    head.push_back(Pair("a", 1));
+    head.push_back(Pair("b", "two"));
+    UniValue tail(UniValue::VOBJ);
+    tail.push_back(Pair("c", UniValue(UniValue::VARR)));
+
+    UniValue all(UniValue::VOBJ);
+    all.pushKVs(head);
+    all.push_back(Pair("list", UniValue(UniValue::VARR)));
+    all.pushKVs(tail);
+
+    std::vector<std::string> chunks;
+    CJSONStreamWriter out(boost::bind(&AppendChunk, &chunks, _1));
+    out.BeginObject();
+    out.WriteMembers(head);
+    out.Key("list");
+    out.BeginArray();
+    out.EndArray();
+    out.WriteMembers(tail);
+    out.EndObject();
+    BOOST_CHECK_EQUAL(out.Finish(), all.write());
+
+    // A value written after a key, as done for the result of a JSON-RPC reply
+    CJSONStreamWriter reply(boost::bind(&AppendChunk, &chunks, _1));
+    reply.BeginObject();
+    reply.Key("result");
+    reply.BeginArray();
+    reply.Value("x");
+    reply.EndArray();
+    reply.Write("error", NullUniValue);
+    reply.Write("id", 1);
+    reply.EndObject();
+    BOOST_CHECK_EQUAL(reply.Finish(), "{\"result\":[\"x\"],\"error\":null,\"id\":1}");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
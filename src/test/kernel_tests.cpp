@@ -0,0 +1,360 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "stakeinput.h"
+#include "test/test_nbx.h"
+#include "utiltime.h"
+
+#include <limits>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, TestingSetup)
+
+/**
+ * A proof-of-stake block on top of the tip with nTransactions ordinary
+ * transactions, whose coinstake spends a signed output created at the
+ * genesis height in the coins view
+ */
+static CBlock MakeStakeBlock(int nTransactions, COutPoint& prevout)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    prevout = COutPoint(GetRandHash(), 0);
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(prevout.hash);
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.push_back(CTxOut(1000 * COIN, scriptPubKey));
+    }
+
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = GetTime();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.push_back(CTxIn(prevout));
+    coinstake.vout.push_back(CTxOut());
+    coinstake.vout[0].SetEmpty();
+    // Stake, masternode and budget payments
+    for (int i = 0; i < 3; i++)
+        coinstake.vout.push_back(CTxOut(i ? COIN : 1001 * COIN, scriptPubKey));
+    BOOST_CHECK(SignSignature(keystore, scriptPubKey, coinstake, 0));
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), i), CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2)));
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG));
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_stake_origin)
+{
+    COutPoint prevout;
+    CBlock block = MakeStakeBlock(10, prevout);
+    std::unique_ptr<CStakeInput> stake;
+    BOOST_REQUIRE(initStakeInput(block, stake, chainActive.Height()));
+    BOOST_CHECK(stake->GetIndexFrom() == chainActive.Genesis());
+
+    // A bad signature is still rejected
+    CBlock blockBad = block;
+    CMutableTransaction coinstake(blockBad.vtx[1]);
+    coinstake.vout[1].nValue++;
+    blockBad.vtx[1] = coinstake;
+    BOOST_CHECK(!initStakeInput(blockBad, stake, chainActive.Height()));
+
+    // Once spent, the output is found among the resolved stake inputs only
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(prevout.hash)->Spend(0);
+    }
+    BOOST_REQUIRE(initStakeInput(block, stake, chainActive.Height()));
+    BOOST_CHECK(stake->GetIndexFrom() == chainActive.Genesis());
+    ClearStakeOrigins();
+    BOOST_CHECK(!initStakeInput(block, stake, chainActive.Height()));
+}
+
+/** Resolve the stake input of a large block, against the copy of it each check used to make */
+BOOST_AUTO_TEST_CASE(kernel_stake_origin_throughput)
+{
+    const int nChecks = 200;
+    COutPoint prevout;
+    CBlock block = MakeStakeBlock(2000, prevout);
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nChecks; i++) {
+        CBlock blockCopy(block);
+        BOOST_CHECK(blockCopy.vtx.size() == block.vtx.size());
+    }
+    int64_t nCopyMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    int64_t nMicros[2];
+    for (int nCached = 0; nCached < 2; nCached++) {
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nChecks; i++) {
+            if (!nCached)
+                ClearStakeOrigins();
+            std::unique_ptr<CStakeInput> stake;
+            BOOST_CHECK(initStakeInput(block, stake, chainActive.Height()));
+        }
+        nMicros[nCached] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    }
+
+    BOOST_TEST_MESSAGE(strprintf("Stake input of a block of %u transactions: %.1fus from the coins view, %.1fus from resolved stake inputs; the block copy each check used to make: %.1fus",
+        block.vtx.size(), (double)nMicros[0] / nChecks, (double)nMicros[1] / nChecks, (double)nCopyMicros / nChecks));
+}
+
+/**
+ * A chain of n entries on top of pprev, indexed in mapBlockIndex, whose block
+ * times are about a minute apart but out of order at times, and half of which
+ * generate a stake modifier
+ */
+static void BuildModifierChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHashes, CBlockIndex* pprev, int n)
+{
+    vIndex.resize(n);
+    vHashes.resize(n);
+    for (int i = 0; i < n; i++) {
+        CBlockIndex& index = vIndex[i];
+        index.pprev = pprev;
+        index.nHeight = pprev->nHeight + 1;
+        index.nTime = pprev->nTime + GetRand(120) - 20;
+        index.SetStakeModifier(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(2));
+        vHashes[i] = GetRandHash();
+        index.phashBlock = &vHashes[i];
+        index.BuildSkip();
+        mapBlockIndex.insert(std::make_pair(vHashes[i], &index));
+        pprev = &index;
+    }
+}
+
+/** Check the index only holds blocks of the active chain */
+static void CheckKernelModifierIndexActive(const std::vector<CBlockIndex>& vIndex)
+{
+    for (const CBlockIndex& index : vIndex) {
+        const CBlockIndex* pindexModifier = GetIndexedKernelModifierBlock(index.nHeight);
+        BOOST_CHECK(!pindexModifier || chainActive.Contains(pindexModifier));
+    }
+}
+
+/** Check the stake modifiers of kernels from the blocks of vIndex against a walk of the active chain */
+static void CheckKernelModifiers(const std::vector<CBlockIndex>& vIndex)
+{
+    for (const CBlockIndex& index : vIndex) {
+        const CBlockIndex* pindexExpected = &index;
+        int64_t nModifierTime = index.GetBlockTime();
+        while (pindexExpected && nModifierTime < index.GetBlockTime() + OLD_MODIFIER_INTERVAL) {
+            pindexExpected = chainActive[pindexExpected->nHeight + 1];
+            if (pindexExpected && pindexExpected->GeneratedStakeModifier())
+                nModifierTime = pindexExpected->GetBlockTime();
+        }
+
+        uint64_t nStakeModifier;
+        int nStakeModifierHeight;
+        int64_t nStakeModifierTime;
+        BOOST_CHECK_EQUAL(GetKernelStakeModifier(index.GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false), pindexExpected != NULL);
+        if (pindexExpected) {
+            BOOST_CHECK_EQUAL(nStakeModifier, pindexExpected->nStakeModifier);
+            BOOST_CHECK_EQUAL(nStakeModifierHeight, pindexExpected->nHeight);
+            BOOST_CHECK_EQUAL(nStakeModifierTime, pindexExpected->GetBlockTime());
+        }
+    }
+}
+
+static void UnloadModifierChain(const std::vector<uint256>& vHashes)
+{
+    chainActive.SetTip(chainActive.Genesis());
+    UpdateKernelModifierIndex();
+    for (const uint256& hash : vHashes)
+        mapBlockIndex.erase(hash);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_modifier_index)
+{
+    std::vector<CBlockIndex> vIndex, vFork;
+    std::vector<uint256> vHashes, vForkHashes;
+    BuildModifierChain(vIndex, vHashes, chainActive.Tip(), 2000);
+    BuildModifierChain(vFork, vForkHashes, &vIndex[1500], 700);
+
+    chainActive.SetTip(&vIndex.back());
+    UpdateKernelModifierIndex();
+    CheckKernelModifiers(vIndex);
+
+    // Reorganized onto the fork, including kernels from the blocks left behind
+    chainActive.SetTip(&vFork.back());
+    UpdateKernelModifierIndex();
+    CheckKernelModifiers(vIndex);
+    CheckKernelModifiers(vFork);
+
+    CheckKernelModifierIndexActive(vIndex);
+
+    // Back, one block at a time, and onto the fork again one block at a time
+    for (unsigned int i = 1500; i < vIndex.size(); i++) {
+        chainActive.SetTip(&vIndex[i]);
+        UpdateKernelModifierIndex();
+    }
+    CheckKernelModifiers(vIndex);
+    for (int i = vIndex.size() - 1; i >= 1500; i--) {
+        chainActive.SetTip(&vIndex[i]);
+        UpdateKernelModifierIndex();
+        CheckKernelModifierIndexActive(vIndex);
+    }
+    for (unsigned int i = 0; i < vFork.size(); i++) {
+        chainActive.SetTip(&vFork[i]);
+        UpdateKernelModifierIndex();
+    }
+    CheckKernelModifierIndexActive(vFork);
+    CheckKernelModifiers(vIndex);
+    CheckKernelModifiers(vFork);
+
+    UnloadModifierChain(vHashes);
+    UnloadModifierChain(vForkHashes);
+}
+
+/** Stake modifier lookups of kernels from a long chain with and without the index */
+BOOST_AUTO_TEST_CASE(kernel_modifier_index_throughput)
+{
+    const int nBlocks = 50000;
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildModifierChain(vIndex, vHashes, chainActive.Tip(), nBlocks);
+    chainActive.SetTip(&vIndex.back());
+
+    int64_t nStart = GetTimeMicros();
+    UpdateKernelModifierIndex();
+    int64_t nBuildMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    int64_t nMicros[2];
+    int nFound[2] = {0, 0};
+    for (int nIndexed = 1; nIndexed >= 0; nIndexed--) {
+        if (!nIndexed)
+            ClearKernelModifierIndex();
+        nStart = GetTimeMicros();
+        for (const uint256& hash : vHashes) {
+            uint64_t nStakeModifier;
+            int nStakeModifierHeight;
+            int64_t nStakeModifierTime;
+            if (GetKernelStakeModifier(hash, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+                nFound[nIndexed]++;
+        }
+        nMicros[nIndexed] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    }
+    BOOST_CHECK_EQUAL(nFound[0], nFound[1]);
+
+    BOOST_TEST_MESSAGE(strprintf("Stake modifier lookups over %d blocks: %.0f lookups/sec walking the chain, %.0f lookups/sec indexed; index built in %.1fms",
+        nBlocks, nBlocks * 1e6 / nMicros[0], nBlocks * 1e6 / nMicros[1], nBuildMicros / 1e3));
+
+    UnloadModifierChain(vHashes);
+}
+
+/** Prune mode for the scope of a test, which removes the block and undo file it wrote on leaving */
+struct PrunedScope {
+    const bool fPruneModeOld;
+    const bool fHavePrunedOld;
+    const CDiskBlockPos pos;
+
+    PrunedScope(int nFile) : fPruneModeOld(fPruneMode), fHavePrunedOld(fHavePruned), pos(nFile, 0)
+    {
+        fPruneMode = fHavePruned = true;
+    }
+
+    ~PrunedScope()
+    {
+        fPruneMode = fPruneModeOld;
+        fHavePruned = fHavePrunedOld;
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+    }
+};
+
+/**
+ * On a pruned node, a block on a fork stakes an output that the active chain
+ * has spent since, and whose transaction is in no block file any more. It
+ * is found in the undo data of the spending block, which the reorg needs.
+ */
+BOOST_AUTO_TEST_CASE(kernel_stake_origin_fork_pruned)
+{
+    PrunedScope pruned(99);
+
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHashes;
+    BuildModifierChain(vIndex, vHashes, chainActive.Tip(), 2);
+    chainActive.SetTip(&vIndex[0]);
+
+    // The fork block on top of the first block, staking an output of it
+    COutPoint prevout;
+    CBlock block = MakeStakeBlock(0, prevout);
+    CTxOut txOut;
+    {
+        LOCK(cs_main);
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(prevout.hash);
+        coins->nHeight = 1;
+        txOut = coins->vout[0];
+    }
+
+    // The second block of the active chain staked the same output
+    CBlock blockSpend = block;
+    blockSpend.nTime++;
+    mapBlockIndex.erase(vHashes[1]);
+    vHashes[1] = blockSpend.GetHash();
+    mapBlockIndex.insert(std::make_pair(vHashes[1], &vIndex[1]));
+    CStoredBlock stored;
+    stored.Set(blockSpend);
+    CDiskBlockPos pos = pruned.pos;
+    BOOST_REQUIRE(WriteBlockToDisk(stored, pos));
+    vIndex[1].nFile = pos.nFile;
+    vIndex[1].nDataPos = pos.nPos;
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.resize(1);
+    blockUndo.vtxundo[0].vprevout.push_back(CTxInUndo(txOut, false, false, 1, 1));
+    CDiskBlockPos posUndo = pruned.pos;
+    BOOST_REQUIRE(blockUndo.WriteToDisk(posUndo, vHashes[0]));
+    vIndex[1].nUndoPos = posUndo.nPos;
+    vIndex[1].nStatus |= BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(prevout.hash)->Spend(0);
+    }
+    chainActive.SetTip(&vIndex[1]);
+    ClearStakeOrigins();
+
+    std::unique_ptr<CStakeInput> stake;
+    BOOST_REQUIRE(initStakeInput(block, stake, 1));
+    BOOST_CHECK(stake->GetIndexFrom() == &vIndex[0]);
+    BOOST_CHECK(stake->GetValue() == txOut.nValue);
+
+    // An output created after the fork cannot be staked on it
+    blockUndo.vtxundo[0].vprevout[0].nHeight = 2;
+    posUndo = pruned.pos;
+    BOOST_REQUIRE(blockUndo.WriteToDisk(posUndo, vHashes[0]));
+    ClearStakeOrigins();
+    BOOST_CHECK(!initStakeInput(block, stake, 1));
+
+    UnloadModifierChain(vHashes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "leveldbwrapper.h"
+
+#include "test/test_nbx.h"
+#include "uint256.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(leveldbwrapper_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_options)
+{
+    std::vector<std::string> vOld = mapMultiArgs["-dboption"];
+    std::vector<std::string>& vArgs = mapMultiArgs["-dboption"];
+    vArgs.clear();
+    vArgs.push_back("all.blocksize=8192");
+    vArgs.push_back("chainstate.blocksize=16384");
+    vArgs.push_back("index.filterbits=0");
+    vArgs.push_back("sporks.verifychecksums=0");
+
+    std::string strInvalid;
+    BOOST_CHECK(CheckLevelDBOptions(strInvalid));
+    CLevelDBOptions chainstate = GetLevelDBOptions("chainstate");
+    CLevelDBOptions index = GetLevelDBOptions("index");
+    CLevelDBOptions sporks = GetLevelDBOptions("sporks");
+    BOOST_CHECK_EQUAL(chainstate.nBlockSize, 16384U);
+    BOOST_CHECK_EQUAL(chainstate.nFilterBits, 10);
+    BOOST_CHECK_EQUAL(index.nBlockSize, 8192U);
+    BOOST_CHECK_EQUAL(index.nFilterBits, 0);
+    BOOST_CHECK_EQUAL(sporks.nBlockSize, 8192U);
+    BOOST_CHECK(!sporks.fVerifyChecksums);
+    // Unnamed databases keep the defaults
+    BOOST_CHECK_EQUAL(GetLevelDBOptions("").nBlockSize, 4096U);
+
+    const char* vInvalid[] = {"chainstate.blocksize=12", "wallet.filterbits=10", "chainstate.nosuchoption=1", "chainstate.compression", "all.maxopenfiles=-1", "filterbits=10"};
+    for (const char* pszInvalid : vInvalid) {
+        vArgs.push_back(pszInvalid);
+        BOOST_CHECK_MESSAGE(!CheckLevelDBOptions(strInvalid), pszInvalid);
+        BOOST_CHECK_EQUAL(strInvalid, pszInvalid);
+        vArgs.pop_back();
+    }
+    mapMultiArgs["-dboption"] = vOld;
+}
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_stats)
+{
+    std::vector<std::string> vOld = mapMultiArgs["-dboption"];
+    // Small memory tables so the writes below are flushed to tables read through the block cache
+    mapMultiArgs["-dboption"].push_back("leveldbwrapper_test.writebuffer=65536");
+    {
+        CLevelDBWrapper db(GetDataDirForDb() + "leveldbwrapper_test", 1 << 20, true, false, "leveldbwrapper_test");
+        const int nKeys = 4000;
+        for (int i = 0; i < nKeys; i++)
+            BOOST_CHECK(db.Write(i, uint256(i)));
+        for (int nPass = 0; nPass < 2; nPass++) {
+            for (int i = 0; i < nKeys; i++) {
+                uint256 value;
+                BOOST_CHECK(db.Read(i, value) && value == uint256(i));
+            }
+        }
+
+        std::vector<std::pair<std::string, CLevelDBStats> > vStats = GetLevelDBStats();
+        bool fFound = false;
+        for (const std::pair<std::string, CLevelDBStats>& item : vStats) {
+            if (item.first != "leveldbwrapper_test")
+                continue;
+            fFound = true;
+            const CLevelDBStats& stats = item.second;
+            BOOST_CHECK_EQUAL(stats.options.nWriteBufferSize, 65536U);
+            BOOST_CHECK_EQUAL(stats.nCacheSize, 1U << 20);
+            BOOST_CHECK(stats.nCompactions > 0);
+            BOOST_CHECK(stats.nCacheHits > 0);
+            BOOST_CHECK(stats.nCacheMisses > 0);
+            BOOST_CHECK_EQUAL(stats.vFilesPerLevel.size(), 7U);
+            BOOST_CHECK(!stats.strStats.empty());
+        }
+        BOOST_CHECK(fFound);
+    }
+    // Closed databases are no longer reported
+    std::vector<std::pair<std::string, CLevelDBStats> > vStats = GetLevelDBStats();
+    for (const std::pair<std::string, CLevelDBStats>& item : vStats)
+        BOOST_CHECK(item.first != "leveldbwrapper_test");
+    mapMultiArgs["-dboption"] = vOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
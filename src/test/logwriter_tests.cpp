@@ -0,0 +1,191 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logwriter.h"
+
+#include "test/test_nbx.h"
+#include "tinyformat.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logwriter_tests, BasicTestingSetup)
+
+/** A sink keeping the batches it is handed, which can hold the writer in the middle of one */
+struct CTestSink {
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<std::vector<std::string> > vBatches;
+    bool fBlocked;
+    bool fWriting;
+
+    CTestSink() : fBlocked(false), fWriting(false) {}
+
+    void Write(const CLogEntry* pfirst)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        fWriting = true;
+        cond.notify_all();
+        while (fBlocked)
+            cond.wait(lock);
+        vBatches.push_back(std::vector<std::string>());
+        for (const CLogEntry* pentry = pfirst; pentry != NULL; pentry = pentry->pnext)
+            vBatches.back().push_back(pentry->str);
+        fWriting = false;
+    }
+
+    std::vector<std::string> GetMessages()
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::vector<std::string> vMessages;
+        for (const std::vector<std::string>& vBatch : vBatches)
+            vMessages.insert(vMessages.end(), vBatch.begin(), vBatch.end());
+        return vMessages;
+    }
+};
+
+static void QueueMessages(CLogWriter* pwriter, int nThread, int nMessages)
+{
+    for (int i = 0; i < nMessages; i++)
+        pwriter->Queue(strprintf("thread %d message %d\n", nThread, i), i);
+}
+
+/** Messages from several threads all reach the sink, in the order each thread queued them */
+BOOST_AUTO_TEST_CASE(logwriter_queue)
+{
+    const int nThreads = 4;
+    const int nMessages = 5000;
+    CTestSink sink;
+    CLogWriter writer(boost::bind(&CTestSink::Write, &sink, _1), 1 << 26);
+
+    // Not queued until the writer runs, the caller writes them
+    BOOST_CHECK(!writer.Queue("before\n", 0));
+
+    writer.Start();
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&QueueMessages, &writer, i, nMessages));
+    threads.join_all();
+    writer.Stop();
+    BOOST_CHECK(!writer.Queue("after\n", 0));
+
+    std::vector<int> vNext(nThreads, 0);
+    for (const std::string& str : sink.GetMessages()) {
+        int nThread, nMessage;
+        BOOST_REQUIRE(sscanf(str.c_str(), "thread %d message %d", &nThread, &nMessage) == 2);
+        BOOST_REQUIRE(nThread >= 0 && nThread < nThreads);
+        BOOST_CHECK_EQUAL(nMessage, vNext[nThread]);
+        vNext[nThread] = nMessage + 1;
+    }
+    for (int i = 0; i < nThreads; i++)
+        BOOST_CHECK_EQUAL(vNext[i], nMessages);
+}
+
+/** Flush hands the queued messages to the sink before it returns */
+BOOST_AUTO_TEST_CASE(logwriter_flush)
+{
+    CTestSink sink;
+    CLogWriter writer(boost::bind(&CTestSink::Write, &sink, _1), 1 << 26);
+    writer.Start();
+    for (int i = 0; i < 10; i++) {
+        std::string str = strprintf("message %d\n", i);
+        BOOST_CHECK(writer.Queue(str, i));
+        writer.Flush();
+        std::vector<std::string> vMessages = sink.GetMessages();
+        BOOST_REQUIRE_EQUAL(vMessages.size(), (size_t)i + 1);
+        BOOST_CHECK_EQUAL(vMessages.back(), str);
+    }
+    writer.Stop();
+}
+
+/** Messages beyond the queue limit are dropped while the sink is behind, and their number written after it */
+BOOST_AUTO_TEST_CASE(logwriter_dropped)
+{
+    const size_t nMaxQueuedBytes = 100;
+    CTestSink sink;
+    CLogWriter writer(boost::bind(&CTestSink::Write, &sink, _1), nMaxQueuedBytes);
+    writer.Start();
+
+    // Hold the writer in the middle of writing the first message
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        sink.fBlocked = true;
+    }
+    BOOST_CHECK(writer.Queue("first\n", 0));
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        while (!sink.fWriting)
+            sink.cond.wait(lock);
+    }
+    BOOST_CHECK(writer.GetBatch() != NULL);
+
+    // The first message still counts against the limit until it is written
+    const int nMessages = 20;
+    for (int i = 0; i < nMessages; i++)
+        BOOST_CHECK(writer.Queue(strprintf("message %02d\n", i), 0));
+    const int nQueued = (nMaxQueuedBytes - 6) / 11;
+
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        sink.fBlocked = false;
+        sink.cond.notify_all();
+    }
+    writer.Stop();
+
+    std::vector<std::string> vMessages = sink.GetMessages();
+    BOOST_REQUIRE_EQUAL(vMessages.size(), (size_t)nQueued + 2);
+    BOOST_CHECK_EQUAL(vMessages[0], "first\n");
+    for (int i = 0; i < nQueued; i++)
+        BOOST_CHECK_EQUAL(vMessages[i + 1], strprintf("message %02d\n", i));
+    BOOST_CHECK_EQUAL(vMessages.back(), strprintf("%d log messages dropped, the log writer fell behind\n", nMessages - nQueued));
+}
+
+/** A crash handler takes the messages queued behind the batch being written, oldest first */
+BOOST_AUTO_TEST_CASE(logwriter_take_queue)
+{
+    CTestSink sink;
+    CLogWriter writer(boost::bind(&CTestSink::Write, &sink, _1), 1 << 26);
+    writer.Start();
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        sink.fBlocked = true;
+    }
+    BOOST_CHECK(writer.Queue("first\n", 0));
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        while (!sink.fWriting)
+            sink.cond.wait(lock);
+    }
+    const CLogEntry* pbatch = writer.GetBatch();
+    std::string strBatch = pbatch ? pbatch->str : "";
+    BOOST_CHECK(writer.Queue("second\n", 1));
+    BOOST_CHECK(writer.Queue("third\n", 2));
+    std::vector<std::string> vQueued;
+    for (CLogEntry* pentry = writer.TakeQueue(); pentry != NULL;) {
+        vQueued.push_back(pentry->str);
+        CLogEntry* pnext = pentry->pnext;
+        delete pentry;
+        pentry = pnext;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(sink.mutex);
+        sink.fBlocked = false;
+        sink.cond.notify_all();
+    }
+    BOOST_CHECK_EQUAL(strBatch, "first\n");
+    BOOST_REQUIRE_EQUAL(vQueued.size(), 2U);
+    BOOST_CHECK_EQUAL(vQueued[0], "second\n");
+    BOOST_CHECK_EQUAL(vQueued[1], "third\n");
+    writer.Stop();
+    BOOST_CHECK(writer.GetBatch() == NULL);
+    BOOST_CHECK_EQUAL(sink.GetMessages().size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,8 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "random.h"
+#include "script/script.h"
 #include "test_nbx.h"
 
 #include <boost/test/unit_test.hpp>
@@ -49,4 +51,42 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(apply_tx_in_undo_coinstake)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    // A coinstake: first output empty, the stake and the rewards after it
+    CMutableTransaction stake;
+    stake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    stake.vout.resize(4);
+    stake.vout[0].SetEmpty();
+    for (unsigned int i = 1; i < stake.vout.size(); i++)
+        stake.vout[i] = CTxOut(i * COIN, CScript() << OP_TRUE);
+    CTransaction txStake(stake);
+    BOOST_CHECK(txStake.IsCoinStake());
+    view.ModifyCoins(txStake.GetHash())->FromTx(txStake, 100);
+    CCoins coinsBefore = *view.AccessCoins(txStake.GetHash());
+
+    // Spend all its outputs, the empty marker included, so the undo data
+    // carries the metadata of the coins
+    CMutableTransaction spend;
+    for (unsigned int i = 0; i < stake.vout.size(); i++)
+        spend.vin.push_back(CTxIn(COutPoint(txStake.GetHash(), i)));
+    spend.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    CTransaction txSpend(spend);
+    CValidationState state;
+    CTxUndo undo;
+    UpdateCoins(txSpend, state, view, undo, 200);
+    const CCoins* coinsSpent = view.AccessCoins(txStake.GetHash());
+    BOOST_CHECK(!coinsSpent || coinsSpent->IsPruned());
+
+    for (unsigned int j = txSpend.vin.size(); j-- > 0;)
+        BOOST_CHECK(ApplyTxInUndo(undo.vprevout[j], view, txSpend.vin[j].prevout));
+    const CCoins* coins = view.AccessCoins(txStake.GetHash());
+    BOOST_REQUIRE(coins);
+    BOOST_CHECK(coins->IsCoinStake());
+    BOOST_CHECK(*coins == coinsBefore);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
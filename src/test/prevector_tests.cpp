@@ -0,0 +1,232 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prevector.h"
+
+#include "coins.h"
+#include "compressor.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_nbx.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prevector_tests, BasicTestingSetup)
+
+/** Bytes allocated on the heap, or 0 where the allocator does not report them */
+static size_t HeapUsage()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+typedef prevector<8, int> TestVector;
+
+/** Check that a prevector holds the same elements as the std::vector it mirrors */
+static void CheckEqual(const TestVector& pre, const std::vector<int>& real)
+{
+    BOOST_REQUIRE_EQUAL(pre.size(), real.size());
+    BOOST_CHECK_EQUAL(pre.empty(), real.empty());
+    BOOST_CHECK(pre.capacity() >= pre.size());
+    for (size_t i = 0; i < real.size(); i++)
+        BOOST_CHECK_EQUAL(pre[i], real[i]);
+    BOOST_CHECK(std::equal(pre.begin(), pre.end(), real.begin()));
+    BOOST_CHECK(std::equal(pre.rbegin(), pre.rend(), real.rbegin()));
+    TestVector copy(pre);
+    BOOST_CHECK(copy == pre);
+    TestVector assigned;
+    assigned = pre;
+    BOOST_CHECK(assigned == pre);
+}
+
+/** Random edits applied to a prevector and a std::vector alike, across the inline and heap storage */
+BOOST_AUTO_TEST_CASE(prevector_random_ops)
+{
+    for (int nRun = 0; nRun < 64; nRun++) {
+        TestVector pre;
+        std::vector<int> real;
+        for (int i = 0; i < 2000; i++) {
+            int nValue = insecure_rand();
+            switch (insecure_rand() % 10) {
+            case 0:
+                if (real.size() < 40) {
+                    size_t pos = insecure_rand() % (real.size() + 1);
+                    pre.insert(pre.begin() + pos, nValue);
+                    real.insert(real.begin() + pos, nValue);
+                }
+                break;
+            case 1:
+                if (real.size() < 40) {
+                    size_t pos = insecure_rand() % (real.size() + 1);
+                    size_t count = 1 + insecure_rand() % 12;
+                    pre.insert(pre.begin() + pos, count, nValue);
+                    real.insert(real.begin() + pos, count, nValue);
+                }
+                break;
+            case 2:
+                if (real.size() < 40) {
+                    size_t pos = insecure_rand() % (real.size() + 1);
+                    std::vector<int> values(insecure_rand() % 12, nValue);
+                    pre.insert(pre.begin() + pos, values.begin(), values.end());
+                    real.insert(real.begin() + pos, values.begin(), values.end());
+                }
+                break;
+            case 3:
+                if (!real.empty()) {
+                    size_t first = insecure_rand() % real.size();
+                    size_t last = first + insecure_rand() % (real.size() - first + 1);
+                    pre.erase(pre.begin() + first, pre.begin() + last);
+                    real.erase(real.begin() + first, real.begin() + last);
+                }
+                break;
+            case 4:
+                if (!real.empty()) {
+                    size_t pos = insecure_rand() % real.size();
+                    pre.erase(pre.begin() + pos);
+                    real.erase(real.begin() + pos);
+                }
+                break;
+            case 5:
+                if (real.size() < 40) {
+                    pre.push_back(nValue);
+                    real.push_back(nValue);
+                } else {
+                    pre.pop_back();
+                    real.pop_back();
+                }
+                break;
+            case 6: {
+                size_t nSize = insecure_rand() % 40;
+                pre.resize(nSize);
+                real.resize(nSize);
+                break;
+            }
+            case 7:
+                if (!real.empty()) {
+                    pre[nValue % real.size()] = nValue;
+                    real[nValue % real.size()] = nValue;
+                    pre.push_back(pre.front());
+                    real.push_back(real.front());
+                }
+                break;
+            case 8:
+                if (insecure_rand() % 2)
+                    pre.shrink_to_fit();
+                else
+                    pre.reserve(insecure_rand() % 40);
+                break;
+            case 9: {
+                TestVector other(real.begin(), real.end());
+                pre.swap(other);
+                CheckEqual(other, real);
+                break;
+            }
+            }
+            CheckEqual(pre, real);
+        }
+        pre.clear();
+        real.clear();
+        CheckEqual(pre, real);
+    }
+}
+
+/** Scripts serialize and compare as the std::vectors they were before */
+BOOST_AUTO_TEST_CASE(prevector_script_serialization)
+{
+    for (size_t nSize : {0, 1, 27, 28, 29, 107, 300, 10000}) {
+        std::vector<unsigned char> vch(nSize);
+        for (size_t i = 0; i < nSize; i++)
+            vch[i] = insecure_rand();
+        CScript script(vch.begin(), vch.end());
+        BOOST_CHECK_EQUAL(script.allocated_memory() == 0, nSize <= 28);
+
+        CDataStream ssVector(SER_DISK, CLIENT_VERSION);
+        ssVector << vch;
+        CDataStream ssScript(SER_DISK, CLIENT_VERSION);
+        ssScript << script;
+        BOOST_CHECK(ssScript.str() == ssVector.str());
+        BOOST_CHECK_EQUAL(::GetSerializeSize(script, SER_DISK, CLIENT_VERSION), ssVector.size());
+
+        CScript scriptRead;
+        ssVector >> scriptRead;
+        BOOST_CHECK(scriptRead == script);
+        BOOST_CHECK(std::vector<unsigned char>(scriptRead.begin(), scriptRead.end()) == vch);
+
+        // Compressed as coins are stored in the database
+        CTxOut txout(COIN, script);
+        CDataStream ssCompressed(SER_DISK, CLIENT_VERSION);
+        ssCompressed << CTxOutCompressor(txout);
+        CTxOut txoutRead;
+        ssCompressed >> REF(CTxOutCompressor(txoutRead));
+        BOOST_CHECK(txoutRead == txout);
+    }
+
+    // Ordered as std::vector, not by size first
+    std::vector<unsigned char> vchShort(1, 0xff);
+    std::vector<unsigned char> vchLong(40, 0x00);
+    BOOST_CHECK(CScript(vchLong.begin(), vchLong.end()) < CScript(vchShort.begin(), vchShort.end()));
+    BOOST_CHECK(!(CScript(vchShort.begin(), vchShort.end()) < CScript(vchLong.begin(), vchLong.end())));
+}
+
+/** A block of nTransactions P2PKH spends with two outputs each */
+static CBlock MakeBlock(int nTransactions)
+{
+    CBlock block;
+    for (int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2)));
+        for (int j = 0; j < 2; j++)
+            tx.vout.push_back(CTxOut(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG));
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+/** Block deserialization speed and the memory the coins cache takes per P2PKH coin */
+BOOST_AUTO_TEST_CASE(prevector_throughput)
+{
+    const int nTransactions = 2000;
+    const int nReads = 20;
+    const int nCoins = 50000;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << MakeBlock(nTransactions);
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nReads; i++) {
+        CDataStream ssRead(ss.begin(), ss.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ssRead >> block;
+        BOOST_CHECK_EQUAL(block.vtx.size(), (size_t)nTransactions);
+    }
+    int64_t nReadMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    CCoinsView viewDummy;
+    size_t nHeapBefore = HeapUsage();
+    {
+        CCoinsViewCache cache(&viewDummy);
+        CTransaction tx(MakeBlock(1).vtx[0]);
+        for (int i = 0; i < nCoins; i++) {
+            CCoinsModifier coins = cache.ModifyCoins(GetRandHash());
+            coins->FromTx(tx, i);
+        }
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), (unsigned int)nCoins);
+        size_t nHeapCache = HeapUsage() - nHeapBefore;
+
+        BOOST_TEST_MESSAGE(strprintf("Block of %d transactions (%u bytes): %.0f deserializations/sec; coins cache: %.0f bytes per coin with two P2PKH outputs",
+            nTransactions, ss.size(), nReads * 1e6 / nReadMicros, (double)nHeapCache / nCoins));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
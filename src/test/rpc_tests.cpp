@@ -5,6 +5,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/stats.h"
 
 #include "base58.h"
 #include "netbase.h"
@@ -264,4 +265,28 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_request_stats)
+{
+    CRequestStats stats;
+    BOOST_CHECK_EQUAL(stats.Percentile(0.5), 0);
+
+    // 98 fast calls of 100us and two slow ones
+    for (int i = 0; i < 98; i++)
+        stats.Add(100, 0, false);
+    stats.Add(5000, 4000, true);
+    stats.Add(300000, 0, false);
+    BOOST_CHECK_EQUAL(stats.nCount, 100U);
+    BOOST_CHECK_EQUAL(stats.nErrors, 1U);
+    BOOST_CHECK_EQUAL(stats.nLockWaitMicros, 4000);
+    BOOST_CHECK_EQUAL(stats.nMaxMicros, 300000);
+    BOOST_CHECK_EQUAL(stats.Percentile(0.5), 128);
+    BOOST_CHECK_EQUAL(stats.Percentile(0.99), 8192);
+    BOOST_CHECK_EQUAL(stats.Percentile(1.0), 300000);
+
+    // Calls longer than the last bucket report the maximum
+    stats.Add((int64_t)1 << 40, 0, false);
+    BOOST_CHECK_EQUAL(stats.vBuckets[LATENCY_BUCKETS - 1], 1U);
+    BOOST_CHECK_EQUAL(stats.Percentile(1.0), (int64_t)1 << 40);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "data/sighash.json.h"
+#include "key.h"
+#include "keystore.h"
 #include "main.h"
+#include "pubkey.h"
 #include "random.h"
 #include "serialize.h"
 #include "script/script.h"
 #include "script/interpreter.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "util.h"
+#include "utiltime.h"
 #include "version.h"
 #include "test_nbx.h"
 
@@ -210,4 +216,82 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+
+// Signature hashes taken from the precomputed data match the reference for
+// every input and hash type, while the inputs get signed
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 500; i++) {
+        int nHashType = insecure_rand();
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        // Enough inputs to be precomputed, and outputs for SIGHASH_SINGLE
+        int nExtra = insecure_rand() % 20 + SIGHASH_PRECOMPUTE_MIN_INPUTS;
+        for (int j = 0; j < nExtra; j++) {
+            txTo.vin.push_back(CTxIn(COutPoint(GetRandHash(), insecure_rand() % 4)));
+            txTo.vout.push_back(CTxOut(insecure_rand() % 100000000, CScript() << OP_TRUE));
+        }
+        PrecomputedTransactionData txdata(txTo);
+
+        for (unsigned int nIn = 0; nIn < txTo.vin.size(); nIn++) {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            uint256 sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
+            BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, &txdata) == sho);
+            BOOST_CHECK(SignatureHash(scriptCode, CTransaction(txTo), nIn, nHashType, &txdata) == sho);
+            BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, SIGHASH_ALL, &txdata) == SignatureHashOld(scriptCode, txTo, nIn, SIGHASH_ALL));
+            RandomScript(txTo.vin[nIn].scriptSig);
+        }
+    }
+}
+
+/** Sign and verify the inputs of a transaction with 500 inputs, with and without the precomputed data */
+BOOST_AUTO_TEST_CASE(sighash_precomputed_throughput)
+{
+    const int nInputs = 500;
+    ECCVerifyHandle verifyHandle;
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txUnsigned;
+    for (int i = 0; i < nInputs; i++)
+        txUnsigned.vin.push_back(CTxIn(COutPoint(GetRandHash(), i % 4)));
+    txUnsigned.vout.push_back(CTxOut(nInputs * COIN, scriptPubKey));
+    txUnsigned.vout.push_back(CTxOut(COIN, scriptPubKey));
+
+    int64_t nHashMicros[2], nSignMicros[2], nVerifyMicros[2];
+    uint256 hashTx[2];
+    for (int nPrecomputed = 0; nPrecomputed < 2; nPrecomputed++) {
+        CMutableTransaction txTo(txUnsigned);
+        int64_t nStart = GetTimeMicros();
+        std::unique_ptr<PrecomputedTransactionData> txdata(nPrecomputed ? new PrecomputedTransactionData(txTo) : NULL);
+        for (int i = 0; i < nInputs; i++)
+            SignatureHash(scriptPubKey, txTo, i, SIGHASH_ALL, txdata.get());
+        nHashMicros[nPrecomputed] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nInputs; i++)
+            BOOST_CHECK(SignSignature(keystore, scriptPubKey, txTo, i, SIGHASH_ALL, txdata.get()));
+        nSignMicros[nPrecomputed] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+        CTransaction tx(txTo);
+        hashTx[nPrecomputed] = tx.GetHash();
+        nStart = GetTimeMicros();
+        PrecomputedTransactionData txdataVerify(tx);
+        for (int i = 0; i < nInputs; i++)
+            BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i, nPrecomputed ? &txdataVerify : NULL)));
+        nVerifyMicros[nPrecomputed] = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    }
+    // Signatures are deterministic
+    BOOST_CHECK(hashTx[0] == hashTx[1]);
+
+    BOOST_TEST_MESSAGE(strprintf("Transaction with %d inputs: signature hashes %.1fms, %.1fms precomputed; signing %.1fms, %.1fms precomputed; verifying %.1fms, %.1fms precomputed",
+        nInputs, nHashMicros[0] / 1e3, nHashMicros[1] / 1e3, nSignMicros[0] / 1e3, nSignMicros[1] / 1e3, nVerifyMicros[0] / 1e3, nVerifyMicros[1] / 1e3));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
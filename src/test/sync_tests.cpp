@@ -0,0 +1,78 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_nbx.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static const CLockSiteStats* FindSite(const std::vector<CLockSiteStats>& vSites, int nLine)
+{
+    for (const CLockSiteStats& site : vSites) {
+        if (site.nLine == nLine)
+            return &site;
+    }
+    return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(lock_profiler)
+{
+    CCriticalSection cs;
+    ResetLockProfile();
+
+    // Nothing is sampled while the profiler is disabled
+    nLockProfilerRate = 0;
+    {
+        LOCK(cs);
+    }
+    BOOST_CHECK(GetLockProfile().empty());
+
+    // Every acquisition is sampled at rate 1, and a lock taken by another
+    // thread is seen as contended
+    nLockProfilerRate = 1;
+    int nLine;
+    std::atomic<bool> fHeld(false);
+    std::thread t([&cs, &fHeld]() {
+        std::lock_guard<CCriticalSection> other(cs);
+        fHeld = true;
+        MilliSleep(20);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    {
+        LOCK(cs); nLine = __LINE__;
+        MilliSleep(5);
+    }
+    t.join();
+
+    std::vector<CLockSiteStats> vSites = GetLockProfile();
+    const CLockSiteStats* site = FindSite(vSites, nLine);
+    BOOST_REQUIRE(site);
+    BOOST_CHECK_EQUAL(site->strName, "cs");
+    BOOST_CHECK_EQUAL(site->nSamples, 1U);
+    BOOST_CHECK_EQUAL(site->nContended, 1U);
+    BOOST_CHECK(site->nWaitMicros > 0);
+    BOOST_CHECK(site->nHoldMicros >= 5000);
+    BOOST_CHECK_EQUAL(vSites.size(), 1U);
+
+    // TRY_LOCK is sampled when it succeeds
+    {
+        TRY_LOCK(cs, lockTry); nLine = __LINE__;
+        bool fLocked = lockTry;
+        BOOST_CHECK(fLocked);
+    }
+    BOOST_CHECK(FindSite(GetLockProfile(), nLine));
+
+    nLockProfilerRate = 0;
+    ResetLockProfile();
+    BOOST_CHECK(GetLockProfile().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
+#include "txsubmit.h"
 #include "guiinterface.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
@@ -61,8 +62,10 @@ TestingSetup::TestingSetup()
         RegisterValidationInterface(pwalletMain);
 #endif
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadTxPreVerify);
+        }
         RegisterNodeSignals(GetNodeSignals());
 }
 
@@ -0,0 +1,122 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txsubmit.h"
+
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_nbx.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txsubmit_tests, TestingSetup)
+
+static const CAmount SUBMIT_TEST_FEE = 100000;
+
+/** Add a confirmed transaction with nOutputs outputs to key to the coins view */
+static uint256 AddFunding(const CKey& key, int nOutputs)
+{
+    uint256 hash = GetRandHash();
+    LOCK(cs_main);
+    CCoinsModifier coins = pcoinsTip->ModifyCoins(hash);
+    coins->fCoinBase = false;
+    coins->nVersion = 1;
+    coins->nHeight = 1;
+    coins->vout.assign(nOutputs, CTxOut(COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    return hash;
+}
+
+static CTransaction Spend(const CBasicKeyStore& keystore, const CKey& key, const COutPoint& prevout, CAmount nValueIn)
+{
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(nValueIn - SUBMIT_TEST_FEE, scriptPubKey));
+    SignSignature(keystore, scriptPubKey, tx, 0);
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(txsubmit_batch)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    uint256 funding = AddFunding(key, 3);
+
+    std::vector<CTransaction> vtx;
+    vtx.push_back(Spend(keystore, key, COutPoint(funding, 0), COIN));
+    // Spends an output created earlier in the batch
+    vtx.push_back(Spend(keystore, key, COutPoint(vtx[0].GetHash(), 0), COIN - SUBMIT_TEST_FEE));
+    // With an invalid signature
+    CMutableTransaction mtx(Spend(keystore, key, COutPoint(funding, 1), COIN));
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << ToByteVector(key.GetPubKey());
+    vtx.push_back(mtx);
+    vtx.push_back(Spend(keystore, key, COutPoint(GetRandHash(), 0), COIN));
+    vtx.push_back(vtx[0]);
+
+    std::vector<CTxSubmitResult> vResults = SubmitTransactions(vtx, true);
+    BOOST_CHECK_EQUAL(vResults.size(), vtx.size());
+    BOOST_CHECK_EQUAL(vResults[0].status, TXSUBMIT_ACCEPTED);
+    BOOST_CHECK_EQUAL(vResults[1].status, TXSUBMIT_ACCEPTED);
+    BOOST_CHECK_EQUAL(vResults[2].status, TXSUBMIT_REJECTED);
+    BOOST_CHECK(vResults[2].state.IsInvalid());
+    // Reported the same way as by sendrawtransaction
+    BOOST_CHECK_EQUAL(vResults[3].status, TXSUBMIT_REJECTED);
+    BOOST_CHECK_EQUAL(vResults[3].state.GetRejectReason(), "bad-txns-inputs-not-found");
+    BOOST_CHECK_EQUAL(vResults[4].status, TXSUBMIT_IN_MEMPOOL);
+    BOOST_CHECK(vResults[4].IsAccepted());
+    BOOST_CHECK(mempool.exists(vtx[0].GetHash()));
+    BOOST_CHECK(mempool.exists(vtx[1].GetHash()));
+    BOOST_CHECK(!mempool.exists(vtx[2].GetHash()));
+}
+
+/** Throughput of the submission pipeline against accepting one transaction at a time */
+BOOST_AUTO_TEST_CASE(txsubmit_throughput)
+{
+    const int nTransactions = 400;
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    uint256 funding = AddFunding(key, 2 * nTransactions);
+
+    std::vector<CTransaction> vSerial, vBatch;
+    for (int i = 0; i < nTransactions; i++) {
+        vSerial.push_back(Spend(keystore, key, COutPoint(funding, i), COIN));
+        vBatch.push_back(Spend(keystore, key, COutPoint(funding, nTransactions + i), COIN));
+    }
+
+    int64_t nStart = GetTimeMicros();
+    for (const CTransaction& tx : vSerial) {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, false, NULL, true));
+    }
+    int64_t nSerialMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    // The two steps of SubmitTransactions, timed separately: the acceptance
+    // finds every signature in the cache, which is what it spends under cs_main
+    nStart = GetTimeMicros();
+    PreVerifyTransactions(vBatch);
+    int64_t nPreVerifyMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    nStart = GetTimeMicros();
+    std::vector<CTxSubmitResult> vResults = AcceptSubmittedTransactions(vBatch, true);
+    int64_t nAcceptMicros = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    for (const CTxSubmitResult& result : vResults)
+        BOOST_CHECK_EQUAL(result.status, TXSUBMIT_ACCEPTED);
+
+    BOOST_TEST_MESSAGE(strprintf("AcceptToMemoryPool: %.0f txs/sec; SubmitTransactions: %.0f txs/sec, of which pre-verification %.0f txs/sec and acceptance %.0f txs/sec",
+        nTransactions * 1e6 / nSerialMicros, nTransactions * 1e6 / (nPreVerifyMicros + nAcceptMicros),
+        nTransactions * 1e6 / nPreVerifyMicros, nTransactions * 1e6 / nAcceptMicros));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -16,7 +16,9 @@
 #include <stdint.h>
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(util_tests, BasicTestingSetup)
 
@@ -424,4 +426,38 @@ BOOST_AUTO_TEST_CASE(test_FormatSubVersion)
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments),std::string("/Test:0.9.99(comment1)/"));
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments2),std::string("/Test:0.9.99(comment1; comment2)/"));
 }
+
+static void AcceptCategory(const char* category, int nCalls, int* pnAccepted)
+{
+    for (int i = 0; i < nCalls; i++) {
+        if (LogAcceptCategory(category))
+            (*pnAccepted)++;
+    }
+}
+
+/** Messages of a -debug category beyond -lograte in a second are not logged */
+BOOST_AUTO_TEST_CASE(util_lograte)
+{
+    bool fDebugOld = fDebug;
+    fDebug = true;
+    mapMultiArgs["-debug"].push_back("lograte");
+
+    // In new threads, which read the -debug categories afresh
+    int nAccepted = 0;
+    nLogRate = 10;
+    boost::thread threadLimited(boost::bind(&AcceptCategory, "lograte", 1000, &nAccepted));
+    threadLimited.join();
+    // The calls may span the start of a second
+    BOOST_CHECK(nAccepted >= 10 && nAccepted <= 20);
+
+    nAccepted = 0;
+    nLogRate = 0;
+    boost::thread threadUnlimited(boost::bind(&AcceptCategory, "lograte", 1000, &nAccepted));
+    threadUnlimited.join();
+    BOOST_CHECK_EQUAL(nAccepted, 1000);
+
+    mapMultiArgs["-debug"].pop_back();
+    fDebug = fDebugOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,190 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "crypto/muhash.h"
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "test/test_nbx.h"
+#include "txdb.h"
+#include "undo.h"
+
+#include <string.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxostats_tests, TestingSetup)
+
+static uint256 FinalizeCopy(const MuHash3072& muhash)
+{
+    MuHash3072 copy = muhash;
+    uint256 hash;
+    copy.Finalize(hash.begin());
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_inverse)
+{
+    for (int i = 0; i < 10; i++) {
+        unsigned char data[Num3072::BYTE_SIZE];
+        for (unsigned int j = 0; j < sizeof(data); j++)
+            data[j] = insecure_rand();
+        if (i == 0)
+            memset(data, 0xff, sizeof(data)); // above the modulus
+        Num3072 x(data);
+        Num3072 y = x.GetInverse();
+        y.Multiply(x);
+        BOOST_CHECK(y.IsOne());
+        y.Divide(x);
+        y.Multiply(x);
+        BOOST_CHECK(y.IsOne());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set)
+{
+    const unsigned char a[] = {1}, b[] = {2}, c[] = {3, 4};
+
+    MuHash3072 acc;
+    acc.Insert(a, sizeof(a)).Insert(b, sizeof(b)).Insert(c, sizeof(c)).Remove(b, sizeof(b));
+    MuHash3072 other(c, sizeof(c));
+    other.Insert(a, sizeof(a));
+    BOOST_CHECK(FinalizeCopy(acc) == FinalizeCopy(other));
+    BOOST_CHECK(FinalizeCopy(acc) != FinalizeCopy(MuHash3072(a, sizeof(a))));
+
+    // Removing everything gives the hash of the empty set
+    MuHash3072 empty = acc;
+    empty.Remove(a, sizeof(a)).Remove(c, sizeof(c));
+    BOOST_CHECK(FinalizeCopy(empty) == FinalizeCopy(MuHash3072()));
+
+    // Union and difference of sets
+    MuHash3072 sum(a, sizeof(a));
+    sum *= MuHash3072(c, sizeof(c));
+    BOOST_CHECK(FinalizeCopy(sum) == FinalizeCopy(acc));
+    sum /= MuHash3072(a, sizeof(a));
+    BOOST_CHECK(FinalizeCopy(sum) == FinalizeCopy(MuHash3072(c, sizeof(c))));
+
+    // The state survives a round trip, including the denominator
+    unsigned char state[MuHash3072::STATE_SIZE];
+    acc.ToBytes(state);
+    MuHash3072 restored;
+    restored.FromBytes(state);
+    BOOST_CHECK(FinalizeCopy(restored) == FinalizeCopy(acc));
+}
+
+static CMutableTransaction MakeTx(const std::vector<COutPoint>& vPrevouts, int nOutputs, bool fOpReturn)
+{
+    CMutableTransaction tx;
+    if (vPrevouts.empty()) {
+        tx.vin.resize(1);
+        tx.vin[0].prevout.SetNull();
+        tx.vin[0].scriptSig = CScript() << insecure_rand();
+    }
+    for (const COutPoint& prevout : vPrevouts)
+        tx.vin.push_back(CTxIn(prevout));
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(1000 * (i + 1), CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG));
+    if (fOpReturn)
+        tx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << std::vector<unsigned char>(8, 1)));
+    return tx;
+}
+
+static void Connect(CUtxoStats& stats, CCoinsViewCache& view, const CTransaction& tx, int nHeight, CTxUndo& undo)
+{
+    CValidationState state;
+    stats.BeginTx(tx, view, nHeight, true);
+    UpdateCoins(tx, state, view, undo, nHeight);
+    stats.EndTx(tx, view, true);
+}
+
+/** The same as DisconnectBlock does for one transaction */
+static void Disconnect(CUtxoStats& stats, CCoinsViewCache& view, const CTransaction& tx, int nHeight, const CTxUndo& undo)
+{
+    stats.BeginTx(tx, view, nHeight, false);
+    view.ModifyCoins(tx.GetHash())->Clear();
+    for (unsigned int j = tx.vin.size(); j-- > 0;)
+        BOOST_CHECK(ApplyTxInUndo(undo.vprevout[j], view, tx.vin[j].prevout));
+    stats.EndTx(tx, view, false);
+}
+
+static void CheckEqual(const CUtxoStats& a, const CUtxoStats& b)
+{
+    BOOST_CHECK_EQUAL(a.nTransactions, b.nTransactions);
+    BOOST_CHECK_EQUAL(a.nTransactionOutputs, b.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(a.nSerializedSize, b.nSerializedSize);
+    BOOST_CHECK_EQUAL(a.nTotalAmount, b.nTotalAmount);
+    BOOST_CHECK(FinalizeCopy(a.muhash) == FinalizeCopy(b.muhash));
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_incremental_matches_scan)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    CCoinsViewCache view(&db);
+    CUtxoStats stats;
+
+    // A coinbase with an unspendable output, and transactions spending
+    // some or all outputs of earlier ones
+    CTransaction coinbase(MakeTx(std::vector<COutPoint>(), 12, true));
+    CTxUndo undoCoinbase;
+    Connect(stats, view, coinbase, 1, undoCoinbase);
+
+    std::vector<COutPoint> vSpend;
+    vSpend.push_back(COutPoint(coinbase.GetHash(), 0));
+    vSpend.push_back(COutPoint(coinbase.GetHash(), 11));
+    CTransaction tx1(MakeTx(vSpend, 3, false));
+    CTxUndo undo1;
+    Connect(stats, view, tx1, 2, undo1);
+    CUtxoStats statsBefore = stats;
+
+    vSpend.clear();
+    for (int i = 0; i < 3; i++)
+        vSpend.push_back(COutPoint(tx1.GetHash(), i));
+    vSpend.push_back(COutPoint(coinbase.GetHash(), 5));
+    CTransaction tx2(MakeTx(vSpend, 1, true));
+    CTxUndo undo2;
+    Connect(stats, view, tx2, 3, undo2);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 2U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 10U);
+
+    view.SetBestBlock(GetRandHash());
+    BOOST_CHECK(view.Flush());
+    CUtxoStats scanned;
+    BOOST_CHECK(db.GetUtxoStats(scanned));
+    CheckEqual(stats, scanned);
+    BOOST_CHECK(scanned.hashBlock == db.GetBestBlock());
+
+    // The legacy scan reports the same counters
+    CCoinsStats legacy;
+    BOOST_CHECK(db.GetStats(legacy));
+    BOOST_CHECK_EQUAL(legacy.nTransactions, scanned.nTransactions);
+    BOOST_CHECK_EQUAL(legacy.nSerializedSize, scanned.nSerializedSize);
+    BOOST_CHECK_EQUAL(legacy.nTotalAmount, scanned.nTotalAmount);
+    uint256 hashSerialized = legacy.hashSerialized;
+
+    // Disconnecting restores the earlier statistics
+    Disconnect(stats, view, tx2, 3, undo2);
+    CheckEqual(stats, statsBefore);
+    view.SetBestBlock(GetRandHash());
+    BOOST_CHECK(view.Flush());
+    scanned = CUtxoStats();
+    BOOST_CHECK(db.GetUtxoStats(scanned));
+    CheckEqual(stats, scanned);
+    // Its result is not reused once the best block moved
+    BOOST_CHECK(db.GetStats(legacy));
+    BOOST_CHECK(legacy.hashBlock == db.GetBestBlock());
+    BOOST_CHECK_EQUAL(legacy.nTransactionOutputs, scanned.nTransactionOutputs);
+    BOOST_CHECK(legacy.hashSerialized != hashSerialized);
+
+    // The running state survives serialization
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << stats;
+    CUtxoStats restored;
+    ss >> restored;
+    CheckEqual(stats, restored);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
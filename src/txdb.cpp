@@ -10,6 +10,7 @@
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 
@@ -28,7 +29,7 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDirForDb() + "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDirForDb() + "chainstate", nCacheSize, fMemory, fWipe, "chainstate")
 {
 }
 
@@ -71,13 +72,23 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDirForDb() + "blocks" + (char)boost::filesystem::path::preferred_separator + "index", nCacheSize, fMemory, fWipe)
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDirForDb() + "blocks" + (char)boost::filesystem::path::preferred_separator + "index", nCacheSize, fMemory, fWipe, "index")
 {
 }
 
+/** Also store the stake input under its own key when it is known, see WriteBatchSync */
+static void WriteBlockIndexBatch(CLevelDBBatch& batch, const CDiskBlockIndex& blockindex)
+{
+    batch.Write(std::make_pair('b', blockindex.GetBlockHash()), blockindex);
+    if (blockindex.IsProofOfStake() && !blockindex.prevoutStake.IsNull())
+        batch.Write(std::make_pair('p', blockindex.GetBlockHash()), blockindex.prevoutStake);
+}
+
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
-    return Write(std::make_pair('b', blockindex.GetBlockHash()), blockindex);
+    CLevelDBBatch batch;
+    WriteBlockIndexBatch(batch, blockindex);
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo& info)
@@ -99,12 +110,50 @@ bool CBlockTreeDB::ReadReindexing(bool& fReindexing)
     return true;
 }
 
+bool CBlockTreeDB::ReadBlockIndex(const uint256& hash, CDiskBlockIndex& diskindex)
+{
+    return Read(std::make_pair('b', hash), diskindex);
+}
+
+bool CBlockTreeDB::ReadStakePrevout(const uint256& hash, COutPoint& prevout)
+{
+    if (Read(std::make_pair('p', hash), prevout))
+        return true;
+    // Written by a version that kept the stake input in the entry only
+    CDiskBlockIndex diskindex;
+    if (!ReadBlockIndex(hash, diskindex) || diskindex.prevoutStake.IsNull())
+        return false;
+    prevout = diskindex.prevoutStake;
+    return true;
+}
+
 bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 {
     return Read('l', nFile);
 }
 
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+{
+    // Every write moves the best block, so the set has not changed since
+    if (statsCache.hashBlock != 0 && statsCache.hashBlock == GetBestBlock()) {
+        stats = statsCache;
+        return true;
+    }
+
+    // The MuHash of the set is kept by CUtxoStats, there is no need to compute it again here
+    if (!ScanStats(stats, NULL))
+        return false;
+    statsCache = stats;
+    return true;
+}
+
+bool CCoinsViewDB::GetUtxoStats(CUtxoStats& utxostats) const
+{
+    CCoinsStats stats;
+    return ScanStats(stats, &utxostats);
+}
+
+bool CCoinsViewDB::ScanStats(CCoinsStats& stats, CUtxoStats* putxostats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -113,7 +162,10 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     pcursor->SeekToFirst();
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats = CCoinsStats();
     stats.hashBlock = GetBestBlock();
+    if (putxostats)
+        putxostats->hashBlock = stats.hashBlock;
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
@@ -135,6 +187,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 ss << (coins.fCoinBase ? 'c' : 'n');
                 ss << VARINT(coins.nHeight);
                 stats.nTransactions++;
+                if (putxostats)
+                    putxostats->AddEntry(&coins);
                 for (unsigned int i = 0; i < coins.vout.size(); i++) {
                     const CTxOut& out = coins.vout[i];
                     if (!out.IsNull()) {
@@ -142,6 +196,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                         ss << VARINT(i + 1);
                         ss << out;
                         nTotalAmount += out.nValue;
+                        if (putxostats)
+                            putxostats->AddOutput(COutPoint(txhash, i), out, coins.nHeight, coins.fCoinBase, coins.fCoinStake);
                     }
                 }
                 stats.nSerializedSize += 32 + slValue.size();
@@ -152,20 +208,21 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
+    BlockMap::const_iterator it = mapBlockIndex.find(stats.hashBlock);
+    stats.nHeight = it == mapBlockIndex.end() ? 0 : it->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair('f', it->first), *it->second);
     }
     batch.Write('l', nLastFile);
-    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(std::make_pair('b', (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    for (std::vector<CDiskBlockIndex>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        WriteBlockIndexBatch(batch, *it);
     }
     return WriteBatch(batch, true);
 }
@@ -207,6 +264,69 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteUtxoStats(const uint256& hashBlock, const CCoinsStats& stats)
+{
+    return Write(std::make_pair('S', hashBlock), stats);
+}
+
+bool CBlockTreeDB::ReadUtxoStats(const uint256& hashBlock, CCoinsStats& stats)
+{
+    return Read(std::make_pair('S', hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteUtxoStatsState(const CUtxoStats& utxostats)
+{
+    return Write('U', utxostats);
+}
+
+bool CBlockTreeDB::ReadUtxoStatsState(CUtxoStats& utxostats)
+{
+    return Read('U', utxostats);
+}
+
+namespace
+{
+/** Number of block index entries read from the database before they are decoded in parallel */
+const size_t BLOCK_INDEX_LOAD_CHUNK = 32768;
+/** Lower bound of the size of one block index entry on disk, to estimate the number of entries */
+const size_t BLOCK_INDEX_ENTRY_DISK_SIZE = 160;
+
+struct CBlockIndexLoadChunk {
+    //! Hashes from the database keys, and the serialized entries
+    std::vector<std::pair<uint256, std::string> > vRaw;
+    std::vector<CDiskBlockIndex> vDecoded;
+    boost::mutex cs;
+    std::string strError;
+};
+
+/** Decode every nStride'th entry of the chunk, starting at nFirst */
+void DecodeBlockIndexEntries(CBlockIndexLoadChunk& chunk, size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < chunk.vRaw.size(); i += nStride) {
+        const uint256& hash = chunk.vRaw[i].first;
+        const std::string& strValue = chunk.vRaw[i].second;
+        CDiskBlockIndex& diskindex = chunk.vDecoded[i];
+        std::string strError;
+        try {
+            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> diskindex;
+            // The key is the hash of the header, so only recompute it for consistency checks
+            if (fCheckBlockIndex && diskindex.GetBlockHash() != hash)
+                strError = strprintf("block index entry %s has header hash %s", hash.ToString(), diskindex.GetBlockHash().ToString());
+            else if (diskindex.nHeight <= Params().LAST_POW_BLOCK() && !CheckProofOfWork(hash, diskindex.nBits))
+                strError = strprintf("CheckProofOfWork failed: %s", hash.ToString());
+        } catch (const std::exception& e) {
+            strError = strprintf("Deserialize or I/O error - %s", e.what());
+        }
+        if (!strError.empty()) {
+            boost::lock_guard<boost::mutex> lock(chunk.cs);
+            chunk.strError = strError;
+            return;
+        }
+    }
+}
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -215,65 +335,111 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << std::make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
+    // Size mapBlockIndex up front instead of rehashing it while it grows
+    size_t nEstimatedEntries = EstimateSize(std::make_pair('b', uint256(0)), std::make_pair('c', uint256(0))) / BLOCK_INDEX_ENTRY_DISK_SIZE;
+    mapBlockIndex.reserve(mapBlockIndex.size() + nEstimatedEntries);
+
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS));
+    int64_t nReadMicros = 0, nDecodeMicros = 0, nLinkMicros = 0;
+    size_t nEntries = 0;
+
+    // Stake inputs of entries written by earlier versions are copied to their own keys once
+    bool fStakePrevouts = false;
+    ReadFlag("stakeprevouts", fStakePrevouts);
+
+    // Load mapBlockIndex in chunks: the database is read by this thread, the
+    // entries are then decoded in parallel and linked in here again
+    CBlockIndexLoadChunk chunk;
+    bool fDone = false;
+    while (!fDone) {
         boost::this_thread::interruption_point();
+        int64_t nStart = GetTimeMicros();
+        chunk.vRaw.clear();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
-                    pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                } else {
-                    pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+            while (chunk.vRaw.size() < BLOCK_INDEX_LOAD_CHUNK) {
+                if (!pcursor->Valid()) {
+                    fDone = true;
+                    break;
                 }
-                if (Params().IsDynamicRewardSave(pindexNew->nHeight))
-                    pindexNew->nDynamicMultiplier = diskindex.nDynamicMultiplier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true;
+                    break;
                 }
-
+                uint256 hash;
+                ssKey >> hash;
+                leveldb::Slice slValue = pcursor->value();
+                chunk.vRaw.push_back(std::make_pair(hash, std::string(slValue.data(), slValue.size())));
                 pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
+        int64_t nRead = GetTimeMicros();
+        nReadMicros += nRead - nStart;
+
+        chunk.vDecoded.assign(chunk.vRaw.size(), CDiskBlockIndex());
+        int nChunkThreads = std::min((size_t)nThreads, (chunk.vRaw.size() + 1023) / 1024);
+        if (nChunkThreads > 1) {
+            boost::thread_group threads;
+            for (int t = 0; t < nChunkThreads; t++)
+                threads.create_thread(boost::bind(&DecodeBlockIndexEntries, boost::ref(chunk), t, nChunkThreads));
+            threads.join_all();
+        } else {
+            DecodeBlockIndexEntries(chunk, 0, 1);
+        }
+        if (!chunk.strError.empty())
+            return error("LoadBlockIndex() : %s", chunk.strError);
+        int64_t nDecoded = GetTimeMicros();
+        nDecodeMicros += nDecoded - nRead;
+
+        CLevelDBBatch batchStake;
+        for (size_t i = 0; i < chunk.vDecoded.size(); i++) {
+            const CDiskBlockIndex& diskindex = chunk.vDecoded[i];
+            if (!fStakePrevouts && diskindex.IsProofOfStake() && !diskindex.prevoutStake.IsNull())
+                batchStake.Write(std::make_pair('p', chunk.vRaw[i].first), diskindex.prevoutStake);
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(chunk.vRaw[i].first);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
+                pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            } else {
+                pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+            }
+            if (Params().IsDynamicRewardSave(pindexNew->nHeight))
+                pindexNew->nDynamicMultiplier = diskindex.nDynamicMultiplier;
+        }
+        if (!fStakePrevouts && !WriteBatch(batchStake))
+            return error("%s : failed to write stake inputs", __func__);
+        nEntries += chunk.vDecoded.size();
+        nLinkMicros += GetTimeMicros() - nDecoded;
     }
+    if (!fStakePrevouts && !WriteFlag("stakeprevouts", true))
+        return error("%s : failed to write stake inputs", __func__);
+
+    LogPrintf("%s: %u entries (%u estimated), read %.0fms, decode %.0fms (%d threads), link %.0fms\n", __func__,
+        nEntries, nEstimatedEntries, nReadMicros * 0.001, nDecodeMicros * 0.001, nThreads, nLinkMicros * 0.001);
 
     return true;
 }
@@ -17,6 +17,7 @@
 #include <vector>
 
 class CCoins;
+class CUtxoStats;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -39,7 +40,16 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    //! Scan the whole database for the counters and hashSerialized; hashMuHash is kept by CUtxoStats instead
     bool GetStats(CCoinsStats& stats) const;
+    //! Compute the running UTXO set statistics by scanning the whole database
+    bool GetUtxoStats(CUtxoStats& utxostats) const;
+
+private:
+    //! Result of the last GetStats, reused while the best block stays the same
+    mutable CCoinsStats statsCache;
+
+    bool ScanStats(CCoinsStats& stats, CUtxoStats* putxostats) const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -54,7 +64,10 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo);
+    bool ReadBlockIndex(const uint256& hash, CDiskBlockIndex& diskindex);
+    //! The stake input of a proof-of-stake entry, which is stored when the entry is first written
+    bool ReadStakePrevout(const uint256& hash, COutPoint& prevout);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
@@ -65,6 +78,10 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    bool WriteUtxoStats(const uint256& hashBlock, const CCoinsStats& stats);
+    bool ReadUtxoStats(const uint256& hashBlock, CCoinsStats& stats);
+    bool WriteUtxoStatsState(const CUtxoStats& utxostats);
+    bool ReadUtxoStatsState(CUtxoStats& utxostats);
     bool LoadBlockIndexGuts();
 };
 
@@ -0,0 +1,147 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txsubmit.h"
+
+#include "checkqueue.h"
+#include "coins.h"
+#include "net.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <algorithm>
+#include <map>
+
+#include <boost/thread/mutex.hpp>
+
+namespace
+{
+/** Verifies one input for its effect on the signature cache; never fails, so one bad transaction does not stop the batch */
+class CTxPreVerifyCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction* ptxTo;
+    unsigned int nIn;
+    unsigned int nFlags;
+
+public:
+    CTxPreVerifyCheck() : ptxTo(0), nIn(0), nFlags(0) {}
+    CTxPreVerifyCheck(const CScript& scriptPubKeyIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn) : scriptPubKey(scriptPubKeyIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn) {}
+
+    bool operator()()
+    {
+        VerifyScript(ptxTo->vin[nIn].scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, true));
+        return true;
+    }
+
+    void swap(CTxPreVerifyCheck& check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nFlags, check.nFlags);
+    }
+};
+
+CCheckQueue<CTxPreVerifyCheck> txpreverifyqueue(128);
+//! Held by the thread controlling txpreverifyqueue; others verify on their own thread
+boost::mutex csPreVerifyQueue;
+}
+
+void ThreadTxPreVerify()
+{
+    RenameThread("txpreverify");
+    txpreverifyqueue.Thread();
+}
+
+void PreVerifyTransactions(const std::vector<CTransaction>& vtx)
+{
+    // Outputs created within the batch, then those of the memory pool and the chain
+    std::map<uint256, CCoins> mapInputs;
+    for (const CTransaction& tx : vtx)
+        mapInputs[tx.GetHash()] = CCoins(tx, MEMPOOL_HEIGHT);
+    for (unsigned int nBegin = 0; nBegin < vtx.size(); nBegin += MAX_TX_SUBMIT_BATCH) {
+        unsigned int nEnd = std::min(nBegin + MAX_TX_SUBMIT_BATCH, (unsigned int)vtx.size());
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        for (unsigned int i = nBegin; i < nEnd; i++) {
+            for (const CTxIn& txin : vtx[i].vin) {
+                if (mapInputs.count(txin.prevout.hash))
+                    continue;
+                CCoins coins;
+                if (viewMemPool.GetCoins(txin.prevout.hash, coins))
+                    mapInputs[txin.prevout.hash].swap(coins);
+            }
+        }
+    }
+
+    // The same flags AcceptToMemoryPool verifies with first
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    std::vector<CTxPreVerifyCheck> vChecks;
+    for (const CTransaction& tx : vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            std::map<uint256, CCoins>::const_iterator it = mapInputs.find(tx.vin[i].prevout.hash);
+            if (it == mapInputs.end() || !it->second.IsAvailable(tx.vin[i].prevout.n))
+                continue;
+            vChecks.push_back(CTxPreVerifyCheck(it->second.vout[tx.vin[i].prevout.n].scriptPubKey, tx, i, flags));
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock(csPreVerifyQueue, boost::try_to_lock);
+    if (nScriptCheckThreads && lock.owns_lock() && vChecks.size() > 1) {
+        CCheckQueueControl<CTxPreVerifyCheck> control(&txpreverifyqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (CTxPreVerifyCheck& check : vChecks)
+            check();
+    }
+}
+
+std::vector<CTxSubmitResult> AcceptSubmittedTransactions(const std::vector<CTransaction>& vtx, bool fRejectInsaneFee)
+{
+    std::vector<CTxSubmitResult> vResults(vtx.size());
+    for (unsigned int nBegin = 0; nBegin < vtx.size(); nBegin += MAX_TX_SUBMIT_BATCH) {
+        unsigned int nEnd = std::min(nBegin + MAX_TX_SUBMIT_BATCH, (unsigned int)vtx.size());
+        LOCK(cs_main);
+        CCoinsViewCache& view = *pcoinsTip;
+        for (unsigned int i = nBegin; i < nEnd; i++) {
+            const CTransaction& tx = vtx[i];
+            CTxSubmitResult& result = vResults[i];
+            const CCoins* existingCoins = view.AccessCoins(tx.GetHash());
+            if (existingCoins && existingCoins->nHeight < 1000000000) {
+                result.status = TXSUBMIT_IN_CHAIN;
+                continue;
+            }
+            if (mempool.exists(tx.GetHash())) {
+                result.status = TXSUBMIT_IN_MEMPOOL;
+                continue;
+            }
+            bool fMissingInputs;
+            if (AcceptToMemoryPool(mempool, result.state, tx, false, &fMissingInputs, fRejectInsaneFee))
+                result.status = TXSUBMIT_ACCEPTED;
+            else if (!result.state.IsInvalid() && fMissingInputs)
+                result.status = TXSUBMIT_MISSING_INPUTS;
+            else
+                result.status = TXSUBMIT_REJECTED;
+        }
+    }
+
+    for (unsigned int i = 0; i < vtx.size(); i++) {
+        if (vResults[i].IsAccepted())
+            RelayTransaction(vtx[i]);
+    }
+    return vResults;
+}
+
+std::vector<CTxSubmitResult> SubmitTransactions(const std::vector<CTransaction>& vtx, bool fRejectInsaneFee)
+{
+    PreVerifyTransactions(vtx);
+    return AcceptSubmittedTransactions(vtx, fRejectInsaneFee);
+}
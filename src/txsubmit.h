@@ -0,0 +1,56 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXSUBMIT_H
+#define BITCOIN_TXSUBMIT_H
+
+#include "main.h"
+#include "primitives/transaction.h"
+
+#include <vector>
+
+/**
+ * Submission of locally created transactions, as done by sendrawtransaction.
+ *
+ * Checking the signatures dominates the time AcceptToMemoryPool spends under
+ * cs_main. Submitted transactions are therefore verified against their inputs
+ * first, without holding cs_main, on the script verification threads. This
+ * fills the signature cache, so the acceptance that follows only has to look
+ * the signatures up.
+ */
+
+enum TxSubmitStatus {
+    TXSUBMIT_ACCEPTED,
+    //! Already in the memory pool; relayed again
+    TXSUBMIT_IN_MEMPOOL,
+    TXSUBMIT_IN_CHAIN,
+    TXSUBMIT_MISSING_INPUTS,
+    //! Rejected by AcceptToMemoryPool, see state
+    TXSUBMIT_REJECTED,
+};
+
+/** Transactions handled per cs_main hold, so a large submission does not stall block processing */
+static const unsigned int MAX_TX_SUBMIT_BATCH = 100;
+
+struct CTxSubmitResult {
+    TxSubmitStatus status;
+    CValidationState state;
+
+    CTxSubmitResult() : status(TXSUBMIT_REJECTED) {}
+    bool IsAccepted() const { return status == TXSUBMIT_ACCEPTED || status == TXSUBMIT_IN_MEMPOOL; }
+};
+
+/** Verify the scripts of vtx, storing the valid signatures in the signature cache. The results are not used otherwise. */
+void PreVerifyTransactions(const std::vector<CTransaction>& vtx);
+
+/** Add vtx to the memory pool in order, taking cs_main once per MAX_TX_SUBMIT_BATCH transactions, and relay the accepted ones */
+std::vector<CTxSubmitResult> AcceptSubmittedTransactions(const std::vector<CTransaction>& vtx, bool fRejectInsaneFee);
+
+/** Pre-verify vtx, then accept and relay them as AcceptSubmittedTransactions does */
+std::vector<CTxSubmitResult> SubmitTransactions(const std::vector<CTransaction>& vtx, bool fRejectInsaneFee);
+
+/** Run a pre-verification worker thread */
+void ThreadTxPreVerify();
+
+#endif // BITCOIN_TXSUBMIT_H
@@ -16,6 +16,7 @@
 #include "backtrace.h"
 #include "chainparamsbase.h"
 #include "clientversion.h"
+#include "logwriter.h"
 #include "random.h"
 #include "sync.h"
 #include "utilstrencodings.h"
@@ -42,10 +43,12 @@
 #endif // __linux__
 
 #include <algorithm>
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #else
 
@@ -87,6 +90,7 @@
 #include <boost/program_options/detail/config_file.hpp>
 #include <boost/program_options/parsers.hpp>
 #include <boost/thread.hpp>
+#include <atomic>
 #include <openssl/conf.h>
 #include <openssl/crypto.h>
 #include <openssl/rand.h>
@@ -113,6 +117,7 @@ bool fServer = false;
 std::string strMiscWarning;
 bool fLogTimestamps = false;
 bool fLogIPs = false;
+int nLogRate = DEFAULT_LOG_RATE;
 volatile bool fReopenDebugLog = false;
 
 /** Init OpenSSL library multithreading support */
@@ -176,6 +181,9 @@ public:
  * the mutex).
  */
 
+/** Most bytes of messages queued for the writer thread; more are dropped */
+static const size_t MAX_LOG_QUEUE_BYTES = 1 << 26;
+
 static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
 /**
  * We use boost::call_once() to make sure these are initialized
@@ -183,6 +191,16 @@ static boost::once_flag debugPrintInitFlag = BOOST_ONCE_INIT;
  */
 static FILE* fileout = NULL;
 static boost::mutex* mutexDebugLog = NULL;
+static CLogWriter* plogWriter = NULL;
+//! Guarded by mutexDebugLog
+static bool fStartedNewLine = true;
+//! The batch of queued messages being written to debug.log, and how much of it is written, for the crash handler
+static std::atomic<const std::string*> pstrLogBatch(NULL);
+static std::atomic<size_t> nLogBatchWritten(0);
+//! The last batch of queued messages written in full
+static std::atomic<const CLogEntry*> plogBatchWritten(NULL);
+
+static void WriteDebugLogBatch(const CLogEntry* pfirst);
 
 static void DebugPrintInit()
 {
@@ -194,6 +212,59 @@ static void DebugPrintInit()
     if (fileout) setbuf(fileout, NULL); // unbuffered
 
     mutexDebugLog = new boost::mutex();
+    plogWriter = new CLogWriter(&WriteDebugLogBatch, MAX_LOG_QUEUE_BYTES);
+}
+
+/** Messages of a -debug category in the current second, shared by all threads */
+struct CLogCategoryRate {
+    std::atomic<int64_t> nSecond;
+    std::atomic<int> nCount;
+    std::atomic<int> nSuppressed;
+
+    CLogCategoryRate() : nSecond(0), nCount(0), nSuppressed(0) {}
+};
+
+static boost::once_flag logRateInitFlag = BOOST_ONCE_INIT;
+static boost::mutex* mutexLogRates = NULL;
+static std::map<std::string, CLogCategoryRate*>* pmapLogRates = NULL;
+
+static void LogRateInit()
+{
+    mutexLogRates = new boost::mutex();
+    pmapLogRates = new std::map<std::string, CLogCategoryRate*>();
+}
+
+/** Count a message of category against -lograte, and return whether it is within it */
+static bool LogAcceptRate(const char* category)
+{
+    // Each thread looks the shared counters of a category up once
+    static boost::thread_specific_ptr<std::map<std::string, CLogCategoryRate*> > ptrRates;
+    if (ptrRates.get() == NULL)
+        ptrRates.reset(new std::map<std::string, CLogCategoryRate*>());
+    CLogCategoryRate*& pRate = (*ptrRates)[category];
+    if (pRate == NULL) {
+        boost::call_once(&LogRateInit, logRateInitFlag);
+        boost::mutex::scoped_lock scoped_lock(*mutexLogRates);
+        CLogCategoryRate*& pShared = (*pmapLogRates)[category];
+        if (pShared == NULL)
+            pShared = new CLogCategoryRate();
+        pRate = pShared;
+    }
+
+    int64_t nNow = GetTimeMillis() / 1000;
+    int64_t nSecond = pRate->nSecond;
+    if (nSecond != nNow && pRate->nSecond.compare_exchange_strong(nSecond, nNow)) {
+        pRate->nCount = 0;
+        // Reported once the category logs again, as nothing else runs at the end of a second
+        int nSuppressed = pRate->nSuppressed.exchange(0);
+        if (nSuppressed)
+            LogPrintStr(strprintf("%d %s messages suppressed by -lograte\n", nSuppressed, category));
+    }
+    if (++pRate->nCount > nLogRate) {
+        pRate->nSuppressed++;
+        return false;
+    }
+    return true;
 }
 
 bool LogAcceptCategory(const char* category)
@@ -226,10 +297,203 @@ bool LogAcceptCategory(const char* category)
         if (setCategories.count(std::string("")) == 0 &&
             setCategories.count(std::string(category)) == 0)
             return false;
+
+        if (nLogRate > 0 && !LogAcceptRate(category))
+            return false;
     }
     return true;
 }
 
+/** Reopen debug.log if requested, after it was rotated; mutexDebugLog must be held */
+static void ReopenDebugLog()
+{
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
+            setbuf(fileout, NULL); // unbuffered
+    }
+}
+
+/** Append a message logged at nTime to strOut as debug.log shows it; mutexDebugLog must be held */
+static void FormatDebugLog(std::string& strOut, const std::string& str, int64_t nTime)
+{
+    // Debug print useful for profiling
+    if (fLogTimestamps && fStartedNewLine) {
+        // Formatted once per second, as a busy log writes many lines in each
+        static int64_t nTimeFormatted = -1;
+        static std::string strTimeFormatted;
+        if (nTime != nTimeFormatted) {
+            strTimeFormatted = DateTimeStrFormat("%Y-%m-%d %H:%M:%S ", nTime);
+            nTimeFormatted = nTime;
+        }
+        strOut += strTimeFormatted;
+    }
+    if (!str.empty() && str[str.size() - 1] == '\n')
+        fStartedNewLine = true;
+    else
+        fStartedNewLine = false;
+
+    strOut += str;
+}
+
+/**
+ * Write a batch of queued messages to debug.log in one go. It is written
+ * straight to the file descriptor, so none of it waits in the file buffer,
+ * and the crash handler can finish a batch it interrupts.
+ */
+static void WriteDebugLogBatch(const CLogEntry* pfirst)
+{
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+    plogBatchWritten = NULL;
+    ReopenDebugLog();
+    std::string strBatch;
+    for (const CLogEntry* pentry = pfirst; pentry != NULL; pentry = pentry->pnext)
+        FormatDebugLog(strBatch, pentry->str, pentry->nTime);
+
+#ifdef WIN32
+    fwrite(strBatch.data(), 1, strBatch.size(), fileout);
+    fflush(fileout);
+#else
+    nLogBatchWritten = 0;
+    pstrLogBatch = &strBatch;
+    int fd = fileno(fileout);
+    while (nLogBatchWritten < strBatch.size()) {
+        ssize_t nWritten = write(fd, strBatch.data() + nLogBatchWritten, strBatch.size() - nLogBatchWritten);
+        if (nWritten < 0 && errno == EINTR)
+            continue;
+        if (nWritten <= 0)
+            break;
+        nLogBatchWritten += nWritten;
+    }
+    plogBatchWritten = pfirst;
+    pstrLogBatch = NULL;
+#endif
+}
+
+#ifndef WIN32
+static const int vCrashSignals[] = {SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV};
+static const int nCrashSignals = sizeof(vCrashSignals) / sizeof(vCrashSignals[0]);
+static struct sigaction vCrashActionsPrev[nCrashSignals];
+
+//! "%Y-%m-%d %H:%M:%S " without the terminating null
+static const size_t LOG_TIME_LENGTH = 20;
+
+/** Format nTime as the log timestamp, by arithmetic only: gmtime_r and strftime are not async-signal-safe */
+static void FormatCrashLogTime(int64_t nTime, char* pszTime)
+{
+    int64_t nDays = nTime / 86400;
+    int64_t nSeconds = nTime % 86400;
+    if (nSeconds < 0) {
+        nSeconds += 86400;
+        nDays--;
+    }
+    // Civil date from days since 1970-01-01, counting years from March
+    nDays += 719468;
+    int64_t nEra = (nDays >= 0 ? nDays : nDays - 146096) / 146097;
+    int64_t nDayOfEra = nDays - nEra * 146097;
+    int64_t nYearOfEra = (nDayOfEra - nDayOfEra / 1460 + nDayOfEra / 36524 - nDayOfEra / 146096) / 365;
+    int64_t nDayOfYear = nDayOfEra - (365 * nYearOfEra + nYearOfEra / 4 - nYearOfEra / 100);
+    int64_t nMonthIndex = (5 * nDayOfYear + 2) / 153;
+    int nDay = nDayOfYear - (153 * nMonthIndex + 2) / 5 + 1;
+    int nMonth = nMonthIndex < 10 ? nMonthIndex + 3 : nMonthIndex - 9;
+    int nYear = (nYearOfEra + nEra * 400 + (nMonth <= 2 ? 1 : 0)) % 10000;
+    if (nYear < 0)
+        nYear = 0;
+
+    const int vFields[] = {nYear / 100, nYear % 100, nMonth, nDay, (int)(nSeconds / 3600), (int)(nSeconds / 60 % 60), (int)(nSeconds % 60)};
+    const char vSeparators[] = {0, '-', '-', ' ', ':', ':', ' '};
+    char* p = pszTime;
+    for (int i = 0; i < 7; i++) {
+        p[0] = '0' + vFields[i] / 10;
+        p[1] = '0' + vFields[i] % 10;
+        p += 2;
+        if (vSeparators[i])
+            *p++ = vSeparators[i];
+    }
+}
+
+/** Write messages to fd from the crash handler, formatting their timestamps without allocating */
+static void WriteCrashLog(int fd, const CLogEntry* pfirst, bool& fNewLine)
+{
+    for (const CLogEntry* pentry = pfirst; pentry != NULL; pentry = pentry->pnext) {
+        if (fLogTimestamps && fNewLine) {
+            char pszTime[LOG_TIME_LENGTH];
+            FormatCrashLogTime(pentry->nTime, pszTime);
+            if (write(fd, pszTime, sizeof(pszTime)) < 0)
+                break;
+        }
+        if (write(fd, pentry->str.data(), pentry->str.size()) < 0)
+            break;
+        fNewLine = !pentry->str.empty() && pentry->str[pentry->str.size() - 1] == '\n';
+    }
+}
+
+/**
+ * Write out the messages not yet in debug.log when the process crashes: the
+ * rest of the batch the writer thread is writing, and those queued after it.
+ * The lock may be held by the crashing thread, so this writes straight to
+ * the file descriptor and avoids allocating. Messages written directly are
+ * already flushed.
+ */
+static void HandleCrashSignal(int nSignal)
+{
+    int fd = fileno(fileout);
+    bool fNewLine = fStartedNewLine;
+    bool fWritten = true;
+    const std::string* pstrBatch = pstrLogBatch;
+    const CLogEntry* pbatch = plogWriter->GetBatch();
+    if (pstrBatch != NULL) {
+        size_t nWritten = nLogBatchWritten;
+        if (nWritten < pstrBatch->size())
+            fWritten = write(fd, pstrBatch->data() + nWritten, pstrBatch->size() - nWritten) >= 0;
+    } else if (pbatch != NULL && pbatch != plogBatchWritten) {
+        // Taken by the writer thread but not formatted yet
+        WriteCrashLog(fd, pbatch, fNewLine);
+    }
+    if (fWritten)
+        WriteCrashLog(fd, plogWriter->TakeQueue(), fNewLine);
+
+    // Continue with the previous action, which dumps core or reports the crash
+    for (int i = 0; i < nCrashSignals; i++) {
+        if (vCrashSignals[i] == nSignal)
+            sigaction(nSignal, &vCrashActionsPrev[i], NULL);
+    }
+    raise(nSignal);
+}
+#endif
+
+void StartDebugLogWriter()
+{
+    if (fPrintToConsole || !fPrintToDebugLog || !AreBaseParamsConfigured())
+        return;
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    if (fileout == NULL || plogWriter->IsRunning())
+        return;
+
+    plogWriter->Start();
+#ifndef WIN32
+    static bool fCrashHandlers = false;
+    if (!fCrashHandlers) {
+        struct sigaction sa;
+        sa.sa_handler = HandleCrashSignal;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = 0;
+        for (int i = 0; i < nCrashSignals; i++)
+            sigaction(vCrashSignals[i], &sa, &vCrashActionsPrev[i]);
+        // Also written out when the process exits without a shutdown
+        atexit(StopDebugLogWriter);
+        fCrashHandlers = true;
+    }
+#endif
+}
+
+void StopDebugLogWriter()
+{
+    if (plogWriter != NULL)
+        plogWriter->Stop();
+}
+
 int LogPrintStr(const std::string& str)
 {
     int ret = 0; // Returns total number of characters written
@@ -238,31 +502,20 @@ int LogPrintStr(const std::string& str)
         ret = fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
     } else if (fPrintToDebugLog && AreBaseParamsConfigured()) {
-        static bool fStartedNewLine = true;
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
 
         if (fileout == NULL)
             return ret;
 
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        if (plogWriter->Queue(str, GetTime()))
+            return str.size();
 
-        // reopen the log file, if requested
-        if (fReopenDebugLog) {
-            fReopenDebugLog = false;
-            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-            if (freopen(pathDebug.string().c_str(), "a", fileout) != NULL)
-                setbuf(fileout, NULL); // unbuffered
-        }
-
-        // Debug print useful for profiling
-        if (fLogTimestamps && fStartedNewLine)
-            ret += fprintf(fileout, "%s ", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()).c_str());
-        if (!str.empty() && str[str.size() - 1] == '\n')
-            fStartedNewLine = true;
-        else
-            fStartedNewLine = false;
-
-        ret = fwrite(str.data(), 1, str.size(), fileout);
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        ReopenDebugLog();
+        std::string strLine;
+        FormatDebugLog(strLine, str, GetTime());
+        ret = fwrite(strLine.data(), 1, strLine.size(), fileout);
+        fflush(fileout);
     }
 
     return ret;
@@ -50,8 +50,12 @@ extern bool fServer;
 extern std::string strMiscWarning;
 extern bool fLogTimestamps;
 extern bool fLogIPs;
+extern int nLogRate;
 extern volatile bool fReopenDebugLog;
 
+/** Default for -lograte, the most messages per second of each -debug category; 0 for no limit */
+static const int DEFAULT_LOG_RATE = 0;
+
 void SetupEnvironment();
 bool SetupNetworking();
 
@@ -59,6 +63,13 @@ bool SetupNetworking();
 bool LogAcceptCategory(const char* category);
 /** Send a string to the log output */
 int LogPrintStr(const std::string& str);
+/**
+ * Start the thread writing debug.log. Until it is stopped, logging only
+ * queues the message, and the file is written in batches with buffered I/O.
+ */
+void StartDebugLogWriter();
+/** Write out the queued messages and stop the writer thread; later messages are written directly */
+void StopDebugLogWriter();
 
 #define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
 
@@ -0,0 +1,120 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "clientversion.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+
+#include <algorithm>
+#include <vector>
+
+/** The MuHash element of an unspent output: its outpoint, origin and value */
+static CDataStream OutputElement(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase, bool fCoinStake)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nCode = nHeight * 4 + (fCoinBase ? 2 : 0) + (fCoinStake ? 1 : 0);
+    ss << outpoint << VARINT(nCode) << out;
+    return ss;
+}
+
+/** The transaction ids whose coin database entries are changed by tx */
+static std::vector<uint256> ChangedEntries(const CTransaction& tx)
+{
+    std::vector<uint256> vHashes;
+    vHashes.push_back(tx.GetHash());
+    if (!tx.IsCoinBase()) {
+        for (const CTxIn& txin : tx.vin)
+            vHashes.push_back(txin.prevout.hash);
+    }
+    std::sort(vHashes.begin(), vHashes.end());
+    vHashes.erase(std::unique(vHashes.begin(), vHashes.end()), vHashes.end());
+    return vHashes;
+}
+
+void CUtxoStats::AddEntry(const CCoins* coins)
+{
+    if (!coins || coins->IsPruned())
+        return;
+    nTransactions++;
+    nSerializedSize += 32 + ::GetSerializeSize(*coins, SER_DISK, CLIENT_VERSION);
+}
+
+void CUtxoStats::RemoveEntry(const CCoins* coins)
+{
+    if (!coins || coins->IsPruned())
+        return;
+    nTransactions--;
+    nSerializedSize -= 32 + ::GetSerializeSize(*coins, SER_DISK, CLIENT_VERSION);
+}
+
+void CUtxoStats::AddOutput(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase, bool fCoinStake)
+{
+    CDataStream ss = OutputElement(outpoint, out, nHeight, fCoinBase, fCoinStake);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nTotalAmount += out.nValue;
+}
+
+void CUtxoStats::RemoveOutput(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase, bool fCoinStake)
+{
+    CDataStream ss = OutputElement(outpoint, out, nHeight, fCoinBase, fCoinStake);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nTotalAmount -= out.nValue;
+}
+
+void CUtxoStats::BeginTx(const CTransaction& tx, const CCoinsViewCache& view, int nHeight, bool fConnect)
+{
+    for (const uint256& hash : ChangedEntries(tx))
+        RemoveEntry(view.AccessCoins(hash));
+
+    if (fConnect && !tx.IsCoinBase()) {
+        for (const CTxIn& txin : tx.vin) {
+            const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+            if (coins && coins->IsAvailable(txin.prevout.n))
+                RemoveOutput(txin.prevout, coins->vout[txin.prevout.n], coins->nHeight, coins->fCoinBase, coins->fCoinStake);
+        }
+    }
+
+    // Provably unspendable outputs never enter the set (see CCoins::ClearUnspendable)
+    const uint256& hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        if (tx.vout[i].scriptPubKey.IsUnspendable())
+            continue;
+        if (fConnect)
+            AddOutput(COutPoint(hash, i), tx.vout[i], nHeight, tx.IsCoinBase(), tx.IsCoinStake());
+        else
+            RemoveOutput(COutPoint(hash, i), tx.vout[i], nHeight, tx.IsCoinBase(), tx.IsCoinStake());
+    }
+}
+
+void CUtxoStats::EndTx(const CTransaction& tx, const CCoinsViewCache& view, bool fConnect)
+{
+    for (const uint256& hash : ChangedEntries(tx))
+        AddEntry(view.AccessCoins(hash));
+
+    if (!fConnect && !tx.IsCoinBase()) {
+        for (const CTxIn& txin : tx.vin) {
+            const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+            if (coins && coins->IsAvailable(txin.prevout.n))
+                AddOutput(txin.prevout, coins->vout[txin.prevout.n], coins->nHeight, coins->fCoinBase, coins->fCoinStake);
+        }
+    }
+}
+
+CCoinsStats CUtxoStats::GetStats(int nHeight) const
+{
+    CCoinsStats stats;
+    stats.nHeight = nHeight;
+    stats.hashBlock = hashBlock;
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nSerializedSize = nSerializedSize;
+    stats.nTotalAmount = nTotalAmount;
+    MuHash3072 hash = muhash;
+    hash.Finalize(stats.hashMuHash.begin());
+    return stats;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 Netbox.Global
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSTATS_H
+#define BITCOIN_UTXOSTATS_H
+
+#include "amount.h"
+#include "coins.h"
+#include "crypto/muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+class CCoinsViewCache;
+class COutPoint;
+class CTransaction;
+class CTxOut;
+
+/**
+ * Statistics of the UTXO set that are kept up to date as blocks are connected
+ * and disconnected, so they do not have to be recomputed by scanning the coin
+ * database.
+ *
+ * The counters match those of a full scan: transactions and serialized size
+ * refer to the coin database entries (one per transaction with unspent
+ * outputs), the other counters to the individual outputs. The set itself is
+ * committed to by a MuHash3072 over all unspent outputs, which, unlike the
+ * serialized hash of a scan, does not depend on the order of the outputs.
+ */
+class CUtxoStats
+{
+public:
+    //! The block whose UTXO set these statistics describe
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CUtxoStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    //! Add or remove a coin database entry
+    void AddEntry(const CCoins* coins);
+    void RemoveEntry(const CCoins* coins);
+    //! Add or remove a single unspent output
+    void AddOutput(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase, bool fCoinStake);
+    void RemoveOutput(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase, bool fCoinStake);
+
+    /**
+     * Call before tx is applied to view (fConnect) or undone from it: removes
+     * the database entries tx changes and the outputs it spends or created.
+     */
+    void BeginTx(const CTransaction& tx, const CCoinsViewCache& view, int nHeight, bool fConnect);
+    /** Call afterwards: adds the changed entries back, and the restored outputs */
+    void EndTx(const CTransaction& tx, const CCoinsViewCache& view, bool fConnect);
+
+    //! Statistics of the set at the given height; finalizing the hash is not free
+    CCoinsStats GetStats(int nHeight) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nSerializedSize));
+        READWRITE(nTotalAmount);
+        unsigned char state[MuHash3072::STATE_SIZE];
+        if (!ser_action.ForRead())
+            muhash.ToBytes(state);
+        READWRITE(FLATDATA(state));
+        if (ser_action.ForRead())
+            muhash.FromBytes(state);
+    }
+};
+
+#endif // BITCOIN_UTXOSTATS_H
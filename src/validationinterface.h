@@ -13,6 +13,7 @@
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class COutPoint;
 class CReserveScript;
 class CTransaction;
 class CValidationInterface;
@@ -33,7 +34,7 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
 class CValidationInterface {
 protected:
 // XX42    virtual void EraseFromWallet(const uint256& hash){};
-    virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
@@ -44,6 +45,9 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
 // XX42    virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
+    virtual void NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent) {}
+    virtual void NotifyMasternodeState(const COutPoint &outpoint, int nState) {}
+    virtual void NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -51,8 +55,8 @@ protected:
 
 struct CMainSignals {
 // XX42    boost::signals2::signal<void(const uint256&)> EraseTransaction;
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of updated block chain tip (and the tip block, if it is already in memory) */
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
@@ -72,6 +76,13 @@ struct CMainSignals {
 // XX42    boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /** Notifies listeners of a dApp Store change (dApp id, message txid, DAppEvent) */
+    boost::signals2::signal<void (const uint256 &, const uint256 &, int)> NotifyDAppUpdate;
+    /** Notifies listeners of a masternode entering a new CMasternode::state */
+    boost::signals2::signal<void (const COutPoint &, int)> NotifyMasternodeState;
+    /** Notifies listeners of a block changing the dynamic reward multiplier when it becomes the tip
+     * (the new multiplier), or when it is disconnected (the multiplier restored from its parent) */
+    boost::signals2::signal<void (const CBlockIndex *, int, bool)> NotifyDynamicReward;
 };
 
 CMainSignals& GetMainSignals();
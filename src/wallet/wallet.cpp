@@ -2127,8 +2127,9 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, CAmount> >&
 
                 // Sign
                 int nIn = 0;
+                PrecomputedTransactionData txdata(txNew);
                 for (const PAIRTYPE(const CWalletTx*, unsigned int) & coin : setCoins)
-                    if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+                    if (!SignSignature(*this, *coin.first, txNew, nIn++, SIGHASH_ALL, &txdata)) {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
@@ -2305,9 +2306,10 @@ bool CWallet::CreateCoinStake(
 
     // Sign
     int nIn = 0;
+    PrecomputedTransactionData txdata(txNew);
     for (CTxIn txIn : txNew.vin) {
         const CWalletTx *wtx = GetWalletTx(txIn.prevout.hash);
-        if (!SignSignature(*this, *wtx, txNew, nIn++))
+        if (!SignSignature(*this, *wtx, txNew, nIn++, SIGHASH_ALL, &txdata))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
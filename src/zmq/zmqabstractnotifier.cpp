@@ -11,17 +11,32 @@ CZMQAbstractNotifier::~CZMQAbstractNotifier()
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/, const CBlock * /*CBlock*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransaction(const uint256 &/*hash*/, const CTransaction * /*ptx*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransactionLock(const uint256 &/*hash*/, const CTransaction * /*ptx*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyDAppUpdate(const uint256 &/*dAppId*/, const uint256 &/*txid*/, int /*nEvent*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeState(const COutPoint &/*outpoint*/, int /*nState*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyDynamicReward(const CBlockIndex * /*pindex*/, int /*nMultiplier*/, bool /*fConnected*/)
 {
     return true;
 }
@@ -15,7 +15,9 @@ typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
+    CZMQAbstractNotifier() : psocket(0), outbound_message_high_water_mark(DEFAULT_ZMQ_SNDHWM), nMessagesSent(0), nMessagesFailed(0) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,18 +30,34 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(const int sndhwm) {
+        if (sndhwm >= 0) {
+            outbound_message_high_water_mark = sndhwm;
+        }
+    }
+    uint64_t GetMessagesSent() const { return nMessagesSent; }
+    uint64_t GetMessagesFailed() const { return nMessagesFailed; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
-    virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    /** pblock is the block for pindex, or NULL if no raw notifier needs it or it could not be read */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
+    /** ptx is the transaction for hash, or NULL if no raw notifier needs it or it is no longer available */
+    virtual bool NotifyTransaction(const uint256 &hash, const CTransaction *ptx);
+    virtual bool NotifyTransactionLock(const uint256 &hash, const CTransaction *ptx);
+    virtual bool NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent);
+    virtual bool NotifyMasternodeState(const COutPoint &outpoint, int nState);
+    virtual bool NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int outbound_message_high_water_mark; // aka SNDHWM
+    uint64_t nMessagesSent;
+    uint64_t nMessagesFailed;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -10,12 +10,34 @@
 #include "streams.h"
 #include "util.h"
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface* pzmqNotificationInterface = NULL;
+
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL),
+                                                         fNotifyBlock(false),
+                                                         fNotifyRawBlock(false),
+                                                         fNotifyTransaction(false),
+                                                         fNotifyRawTransaction(false),
+                                                         fNotifyTransactionLock(false),
+                                                         fNotifyRawTransactionLock(false),
+                                                         fNotifyDAppUpdate(false),
+                                                         fNotifyMasternodeState(false),
+                                                         fNotifyDynamicReward(false),
+                                                         nQueueLimit(DEFAULT_ZMQ_QUEUE_SIZE),
+                                                         nQueueMaxDepth(0),
+                                                         nEnqueued(0),
+                                                         nDropped(0),
+                                                         fRunning(false),
+                                                         nBlockCacheTx(0)
 {
 }
 
@@ -41,6 +63,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubdappupdate"] = CZMQAbstractNotifier::Create<CZMQPublishDAppUpdateNotifier>;
+    factories["pubmnstate"] = CZMQAbstractNotifier::Create<CZMQPublishMasternodeStateNotifier>;
+    factories["pubdynreward"] = CZMQAbstractNotifier::Create<CZMQPublishDynamicRewardNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -52,6 +77,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            std::map<std::string, std::string>::const_iterator k = args.find("-zmq" + i->first + "hwm");
+            if (k!=args.end())
+                notifier->SetOutboundMessageHighWaterMark(atoi(k->second));
             notifiers.push_back(notifier);
         }
     }
@@ -61,6 +89,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
 
+        std::map<std::string, std::string>::const_iterator j = args.find("-zmqqueuesize");
+        if (j!=args.end() && atoi(j->second) > 0)
+            notificationInterface->nQueueLimit = atoi(j->second);
+
         if (!notificationInterface->Initialize())
         {
             delete notificationInterface;
@@ -98,6 +130,27 @@ bool CZMQNotificationInterface::Initialize()
             LogPrint("zmq", "  Notifier %s failed (address = %s)\n", notifier->GetType(), notifier->GetAddress());
             break;
         }
+
+        // Only queue the events somebody actually publishes
+        const std::string& type = notifier->GetType();
+        if (type == "pubhashblock" || type == "pubrawblock")
+            fNotifyBlock = true;
+        if (type == "pubrawblock")
+            fNotifyRawBlock = true;
+        if (type == "pubhashtx" || type == "pubrawtx")
+            fNotifyTransaction = true;
+        if (type == "pubrawtx")
+            fNotifyRawTransaction = true;
+        if (type == "pubhashtxlock" || type == "pubrawtxlock")
+            fNotifyTransactionLock = true;
+        if (type == "pubrawtxlock")
+            fNotifyRawTransactionLock = true;
+        if (type == "pubdappupdate")
+            fNotifyDAppUpdate = true;
+        if (type == "pubmnstate")
+            fNotifyMasternodeState = true;
+        if (type == "pubdynreward")
+            fNotifyDynamicReward = true;
     }
 
     if (i!=notifiers.end())
@@ -105,6 +158,10 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    fRunning = true;
+    publisherThread = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "zmqpub",
+                                                boost::function<void()>(boost::bind(&CZMQNotificationInterface::ThreadPublish, this))));
+
     return true;
 }
 
@@ -112,8 +169,17 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    {
+        std::unique_lock<std::mutex> lock(cs_queue);
+        fRunning = false;
+        condQueue.notify_all();
+    }
+    if (publisherThread.joinable())
+        publisherThread.join();
+
     if (pcontext)
     {
+        std::unique_lock<std::mutex> lock(cs_notifiers);
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -126,46 +192,169 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::GetStats(CZMQQueueStats& queueStats, std::vector<CZMQNotifierStats>& notifierStats)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
-        {
-            i++;
-        }
-        else
+        std::unique_lock<std::mutex> lock(cs_queue);
+        queueStats.nDepth = queue.size();
+        queueStats.nMaxDepth = nQueueMaxDepth;
+        queueStats.nLimit = nQueueLimit;
+        queueStats.nEnqueued = nEnqueued;
+        queueStats.nDropped = nDropped;
+    }
+
+    std::unique_lock<std::mutex> lock(cs_notifiers);
+    notifierStats.clear();
+    for (const CZMQAbstractNotifier* notifier : notifiers) {
+        CZMQNotifierStats stats;
+        stats.type = notifier->GetType();
+        stats.address = notifier->GetAddress();
+        stats.hwm = notifier->GetOutboundMessageHighWaterMark();
+        stats.nSent = notifier->GetMessagesSent();
+        stats.nFailed = notifier->GetMessagesFailed();
+        notifierStats.push_back(stats);
+    }
+}
+
+bool CZMQNotificationInterface::Enqueue(CZMQNotification&& notification)
+{
+    std::unique_lock<std::mutex> lock(cs_queue);
+    if (!fRunning)
+        return false;
+    if (queue.size() >= nQueueLimit)
+    {
+        nDropped++;
+        LogPrint("zmq", "zmq: Notification queue full (%u), dropping notification\n", queue.size());
+        return false;
+    }
+    queue.push_back(std::move(notification));
+    nEnqueued++;
+    nQueueMaxDepth = std::max(nQueueMaxDepth, queue.size());
+    condQueue.notify_one();
+    return true;
+}
+
+void CZMQNotificationInterface::ThreadPublish()
+{
+    while (true)
+    {
+        CZMQNotification notification;
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            std::unique_lock<std::mutex> lock(cs_queue);
+            while (fRunning && queue.empty())
+                condQueue.wait(lock);
+            if (!fRunning)
+                break;
+            notification = std::move(queue.front());
+            queue.pop_front();
         }
+        Publish(notification);
     }
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+std::shared_ptr<const CBlock> CZMQNotificationInterface::LoadBlock(const CBlockIndex* pindex)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    if (blockCache && hashBlockCache == pindex->GetBlockHash())
+        return blockCache;
+
+    CDiskBlockPos pos;
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        LOCK(cs_main);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            return std::shared_ptr<const CBlock>();
+        pos = pindex->GetBlockPos();
+    }
+
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pos) || block->GetHash() != pindex->GetBlockHash())
+        return std::shared_ptr<const CBlock>();
+
+    blockCache = block;
+    hashBlockCache = pindex->GetBlockHash();
+    nBlockCacheTx = 0;
+    return blockCache;
+}
+
+// Returns the queued transaction, or NULL if it is no longer available
+const CTransaction* CZMQNotificationInterface::LoadTransaction(const CZMQNotification& notification, CTransaction& txLoaded)
+{
+    if (notification.tx)
+        return notification.tx.get();
+
+    if (!notification.hashBlock.IsNull())
+    {
+        const CBlockIndex* pindex = NULL;
         {
-            i++;
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(notification.hashBlock);
+            if (mi != mapBlockIndex.end())
+                pindex = mi->second;
         }
-        else
+        std::shared_ptr<const CBlock> block;
+        if (pindex)
+            block = LoadBlock(pindex);
+        if (block)
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            // Transactions are queued in block order, carry on from the previous one
+            for (size_t n = 0; n < block->vtx.size(); n++)
+            {
+                size_t nTx = (nBlockCacheTx + n) % block->vtx.size();
+                if (block->vtx[nTx].GetHash() == notification.txid)
+                {
+                    nBlockCacheTx = nTx + 1;
+                    return &block->vtx[nTx];
+                }
+            }
         }
     }
+
+    // Queued from the mempool; it may have been mined since
+    uint256 hashBlock;
+    if (GetTransaction(notification.txid, txLoaded, hashBlock, true))
+        return &txLoaded;
+    return NULL;
 }
 
-void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+void CZMQNotificationInterface::Publish(const CZMQNotification& notification)
 {
+    // Load what the raw notifiers publish once, for all of them
+    std::shared_ptr<const CBlock> block;
+    CTransaction txLoaded;
+    const CTransaction* ptx = NULL;
+    if (notification.type == CZMQNotification::BLOCK && fNotifyRawBlock)
+        block = LoadBlock(notification.pindex);
+    if ((notification.type == CZMQNotification::TRANSACTION && fNotifyRawTransaction) ||
+        (notification.type == CZMQNotification::TRANSACTION_LOCK && fNotifyRawTransactionLock))
+        ptx = LoadTransaction(notification, txLoaded);
+
+    std::unique_lock<std::mutex> lock(cs_notifiers);
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
+        bool fResult = true;
+        switch (notification.type)
+        {
+        case CZMQNotification::BLOCK:
+            fResult = notifier->NotifyBlock(notification.pindex, block.get());
+            break;
+        case CZMQNotification::TRANSACTION:
+            fResult = notifier->NotifyTransaction(notification.txid, ptx);
+            break;
+        case CZMQNotification::TRANSACTION_LOCK:
+            fResult = notifier->NotifyTransactionLock(notification.txid, ptx);
+            break;
+        case CZMQNotification::DAPP_UPDATE:
+            fResult = notifier->NotifyDAppUpdate(notification.hash, notification.txid, notification.nValue);
+            break;
+        case CZMQNotification::MASTERNODE_STATE:
+            fResult = notifier->NotifyMasternodeState(notification.outpoint, notification.nValue);
+            break;
+        case CZMQNotification::DYNAMIC_REWARD:
+            fResult = notifier->NotifyDynamicReward(notification.pindex, notification.nValue, notification.fConnected);
+            break;
+        }
+
+        if (fResult)
         {
             i++;
         }
@@ -176,3 +365,76 @@ void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
         }
     }
 }
+
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock)
+{
+    if (!fNotifyBlock)
+        return;
+
+    // The publisher thread reads the block back from disk
+    CZMQNotification notification(CZMQNotification::BLOCK);
+    notification.pindex = pindex;
+    Enqueue(std::move(notification));
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    if (!fNotifyTransaction)
+        return;
+
+    CZMQNotification notification(CZMQNotification::TRANSACTION);
+    notification.txid = tx.GetHash();
+    if (pblock)
+        notification.hashBlock = pblock->GetHash();
+    else if (fNotifyRawTransaction && !mempool.exists(notification.txid))
+        // Conflicted or disconnected, there will be nowhere to look it up
+        notification.tx = std::make_shared<const CTransaction>(tx);
+    Enqueue(std::move(notification));
+}
+
+void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+{
+    if (!fNotifyTransactionLock)
+        return;
+
+    CZMQNotification notification(CZMQNotification::TRANSACTION_LOCK);
+    notification.txid = tx.GetHash();
+    if (fNotifyRawTransactionLock && !mempool.exists(notification.txid))
+        notification.tx = std::make_shared<const CTransaction>(tx);
+    Enqueue(std::move(notification));
+}
+
+void CZMQNotificationInterface::NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent)
+{
+    if (!fNotifyDAppUpdate)
+        return;
+
+    CZMQNotification notification(CZMQNotification::DAPP_UPDATE);
+    notification.hash = dAppId;
+    notification.txid = txid;
+    notification.nValue = nEvent;
+    Enqueue(std::move(notification));
+}
+
+void CZMQNotificationInterface::NotifyMasternodeState(const COutPoint &outpoint, int nState)
+{
+    if (!fNotifyMasternodeState)
+        return;
+
+    CZMQNotification notification(CZMQNotification::MASTERNODE_STATE);
+    notification.outpoint = outpoint;
+    notification.nValue = nState;
+    Enqueue(std::move(notification));
+}
+
+void CZMQNotificationInterface::NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected)
+{
+    if (!fNotifyDynamicReward)
+        return;
+
+    CZMQNotification notification(CZMQNotification::DYNAMIC_REWARD);
+    notification.pindex = pindex;
+    notification.nValue = nMultiplier;
+    notification.fConnected = fConnected;
+    Enqueue(std::move(notification));
+}
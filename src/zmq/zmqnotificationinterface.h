@@ -5,13 +5,79 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "primitives/transaction.h"
+#include "uint256.h"
 #include "validationinterface.h"
-#include <string>
+#include <condition_variable>
+#include <deque>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
 
+class CBlock;
 class CBlockIndex;
+class CTransaction;
 class CZMQAbstractNotifier;
 
+static const size_t DEFAULT_ZMQ_QUEUE_SIZE = 1000;
+
+/** A validation event waiting to be published. Blocks and transactions are
+ * queued by hash and only loaded on the publisher thread, once for all
+ * notifiers, so validation never copies them while it holds cs_main. */
+struct CZMQNotification
+{
+    enum Type {
+        BLOCK,
+        TRANSACTION,
+        TRANSACTION_LOCK,
+        DAPP_UPDATE,
+        MASTERNODE_STATE,
+        DYNAMIC_REWARD
+    };
+
+    Type type;
+    const CBlockIndex* pindex;
+    uint256 hashBlock;   //! block holding the transaction, null if it is not mined
+    std::shared_ptr<const CTransaction> tx; //! copy of a transaction that can't be looked up later
+    uint256 hash;        //! dApp id
+    uint256 txid;        //! transaction, or dApp Store message transaction
+    COutPoint outpoint;  //! masternode collateral
+    int nValue;          //! DAppEvent, masternode state or dynamic multiplier
+    bool fConnected;     //! dynamic multiplier set by a connected block, or restored by a disconnect
+
+    CZMQNotification() : type(BLOCK), pindex(NULL), nValue(0), fConnected(true) {}
+    explicit CZMQNotification(Type typeIn) : type(typeIn), pindex(NULL), nValue(0), fConnected(true) {}
+};
+
+struct CZMQNotifierStats
+{
+    std::string type;
+    std::string address;
+    int hwm;
+    uint64_t nSent;
+    uint64_t nFailed;
+};
+
+struct CZMQQueueStats
+{
+    size_t nDepth;
+    size_t nMaxDepth;
+    size_t nLimit;
+    uint64_t nEnqueued;
+    uint64_t nDropped;
+};
+
+/**
+ * Publishes validation events on ZMQ sockets. Events are only queued on the
+ * signalling (validation) thread; serialization and sending happen on a
+ * dedicated publisher thread. When the queue is full, new events are dropped
+ * and counted rather than stalling block connection.
+ */
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -19,20 +85,63 @@ public:
 
     static CZMQNotificationInterface* CreateWithArguments(const std::map<std::string, std::string> &args);
 
+    void GetStats(CZMQQueueStats& queueStats, std::vector<CZMQNotifierStats>& notifierStats);
+
 protected:
     bool Initialize();
     void Shutdown();
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock);
     void NotifyTransactionLock(const CTransaction &tx);
+    void NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent);
+    void NotifyMasternodeState(const COutPoint &outpoint, int nState);
+    void NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected);
 
 private:
     CZMQNotificationInterface();
 
+    bool Enqueue(CZMQNotification&& notification);
+    void Publish(const CZMQNotification& notification);
+    void ThreadPublish();
+
+    std::shared_ptr<const CBlock> LoadBlock(const CBlockIndex* pindex);
+    const CTransaction* LoadTransaction(const CZMQNotification& notification, CTransaction& txLoaded);
+
     void *pcontext;
+
+    //! Protects notifiers; they are only used by the publisher thread once it runs
+    std::mutex cs_notifiers;
     std::list<CZMQAbstractNotifier*> notifiers;
+    bool fNotifyBlock;
+    bool fNotifyRawBlock;
+    bool fNotifyTransaction;
+    bool fNotifyRawTransaction;
+    bool fNotifyTransactionLock;
+    bool fNotifyRawTransactionLock;
+    bool fNotifyDAppUpdate;
+    bool fNotifyMasternodeState;
+    bool fNotifyDynamicReward;
+
+    //! Protects the queue and its counters
+    std::mutex cs_queue;
+    std::condition_variable condQueue;
+    std::deque<CZMQNotification> queue;
+    size_t nQueueLimit;
+    size_t nQueueMaxDepth;
+    uint64_t nEnqueued;
+    uint64_t nDropped;
+    bool fRunning;
+
+    //! Last block read by the publisher thread, its transactions usually come one after the other
+    std::shared_ptr<const CBlock> blockCache;
+    uint256 hashBlockCache;
+    size_t nBlockCacheTx;
+
+    boost::thread publisherThread;
 };
 
+extern CZMQNotificationInterface* pzmqNotificationInterface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -16,6 +16,16 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_DAPPUPDATE = "dappupdate";
+static const char *MSG_MNSTATE    = "mnstate";
+static const char *MSG_DYNREWARD  = "dynreward";
+
+// Copy a hash in the byte order used by the hash* topics (as displayed by RPC)
+static void WriteHashReversed(unsigned char *data, const uint256 &hash)
+{
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+}
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -73,7 +83,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint("zmq", "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -135,15 +155,19 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     WriteLE32(&msgseq[0], nSequence);
     int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
     if (rc == -1)
+    {
+        nMessagesFailed++;
         return false;
+    }
 
     /* increment memory only sequence number after sending */
     nSequence++;
+    nMessagesSent++;
 
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock * /*pblock*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -153,9 +177,8 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const uint256 &hash, const CTransaction * /*ptx*/)
 {
-    uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -163,9 +186,8 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const uint256 &hash, const CTransaction * /*ptx*/)
 {
-    uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -173,42 +195,77 @@ bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransa
     return SendMessage(MSG_HASHTXLOCK, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    if (!pblock)
     {
-        LOCK(cs_main);
-        CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+        zmqError("Can't read block from disk");
+        return false;
     }
 
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *pblock;
+
     return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const uint256 &hash, const CTransaction *ptx)
 {
-    uint256 hash = transaction.GetHash();
+    if (!ptx)
+    {
+        // Left the mempool before it could be published; not a socket error
+        LogPrint("zmq", "zmq: Transaction %s no longer available, not published on rawtx\n", hash.GetHex());
+        return true;
+    }
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
+    ss << *ptx;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
 
-bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const uint256 &hash, const CTransaction *ptx)
 {
-    uint256 hash = transaction.GetHash();
+    if (!ptx)
+    {
+        // Left the mempool before it could be published; not a socket error
+        LogPrint("zmq", "zmq: Transaction %s no longer available, not published on rawtxlock\n", hash.GetHex());
+        return true;
+    }
     LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
+    ss << *ptx;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishDAppUpdateNotifier::NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent)
+{
+    LogPrint("zmq", "zmq: Publish dappupdate %s (event %d)\n", dAppId.GetHex(), nEvent);
+    unsigned char data[65];
+    data[0] = (unsigned char)nEvent;
+    WriteHashReversed(&data[1], dAppId);
+    WriteHashReversed(&data[33], txid);
+    return SendMessage(MSG_DAPPUPDATE, data, sizeof(data));
+}
+
+bool CZMQPublishMasternodeStateNotifier::NotifyMasternodeState(const COutPoint &outpoint, int nState)
+{
+    LogPrint("zmq", "zmq: Publish mnstate %s (state %d)\n", outpoint.ToString(), nState);
+    unsigned char data[37];
+    WriteHashReversed(&data[0], outpoint.hash);
+    WriteLE32(&data[32], outpoint.n);
+    data[36] = (unsigned char)nState;
+    return SendMessage(MSG_MNSTATE, data, sizeof(data));
+}
+
+bool CZMQPublishDynamicRewardNotifier::NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected)
+{
+    LogPrint("zmq", "zmq: Publish dynreward %d at height %d (%s)\n", nMultiplier, pindex->nHeight, fConnected ? "connected" : "disconnected");
+    unsigned char data[41];
+    WriteHashReversed(&data[0], pindex->GetBlockHash());
+    WriteLE32(&data[32], pindex->nHeight);
+    WriteLE32(&data[36], nMultiplier);
+    data[40] = fConnected ? 1 : 0;
+    return SendMessage(MSG_DYNREWARD, data, sizeof(data));
+}
@@ -31,37 +31,59 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const uint256 &hash, const CTransaction *ptx);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(const uint256 &hash, const CTransaction *ptx);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const uint256 &hash, const CTransaction *ptx);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(const uint256 &hash, const CTransaction *ptx);
+};
+
+/* dappupdate: event (1 byte) | dApp id (32) | message txid (32) */
+class CZMQPublishDAppUpdateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyDAppUpdate(const uint256 &dAppId, const uint256 &txid, int nEvent);
+};
+
+/* mnstate: collateral txid (32) | collateral vout (LE 4 bytes) | state (1 byte) */
+class CZMQPublishMasternodeStateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeState(const COutPoint &outpoint, int nState);
+};
+
+/* dynreward: block hash (32) | height (LE 4 bytes) | multiplier (LE 4 bytes) | connected (1 byte)
+   A disconnected block carries the multiplier restored from its parent. */
+class CZMQPublishDynamicRewardNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyDynamicReward(const CBlockIndex *pindex, int nMultiplier, bool fConnected);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
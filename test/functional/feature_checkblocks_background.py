@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Netbox.Global
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -checkblocksinbackground.
+
+- Restart the node checking every block before it starts, and read the
+  result of the check from debug.log.
+- Restart it with -checkblocksinbackground. The node answers RPCs right
+  away, and the check it finishes later reports the same result.
+"""
+
+import os
+import re
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+CHECKED_RE = re.compile(r"Checked (\d+) blocks on \d+ threads")
+COINS_RE = re.compile(r"No coin database inconsistencies in last (\d+) blocks \((\d+) transactions\)")
+BACKGROUND_DONE = "Background verification of the block database finished"
+
+class CheckBlocksBackgroundTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+
+    def read_log(self):
+        with open(os.path.join(self.nodes[0].datadir, "regtest", "debug.log"), encoding="utf-8") as f:
+            return f.read()
+
+    def verify_result(self, log):
+        """The number of blocks checked, and the blocks and transactions the coin database check covered"""
+        checked = CHECKED_RE.findall(log)
+        coins = COINS_RE.findall(log)
+        assert checked and coins
+        return int(checked[-1]), int(coins[-1][0]), int(coins[-1][1])
+
+    def run_test(self):
+        node = self.nodes[0]
+        height = node.getblockcount()
+
+        self.log.info("Check the blocks before starting")
+        self.stop_node(0)
+        log_start = len(self.read_log())
+        self.start_node(0, ["-checkblocks=0"])
+        # debug.log is written from a background thread
+        wait_until(lambda: COINS_RE.search(self.read_log()[log_start:]), timeout=10)
+        foreground = self.verify_result(self.read_log()[log_start:])
+        assert_equal(foreground[0], height)
+
+        self.log.info("Check the blocks in the background")
+        self.stop_node(0)
+        log_start = len(self.read_log())
+        self.start_node(0, ["-checkblocks=0", "-checkblocksinbackground"])
+        assert_equal(node.getblockcount(), height)
+        wait_until(lambda: BACKGROUND_DONE in self.read_log()[log_start:], timeout=60)
+        background = self.verify_result(self.read_log()[log_start:])
+        assert_equal(background, foreground)
+
+        # The verification status is reported with the staking status
+        assert node.getstakingstatus()["blocksverified"]
+
+if __name__ == '__main__':
+    CheckBlocksBackgroundTest().main()
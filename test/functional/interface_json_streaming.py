@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Netbox.Global
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test streamed JSON replies of large RPC and REST results.
+
+getblock, getrawmempool and the REST block and mempool endpoints write their
+JSON as it is produced, using chunked transfer encoding once the reply grows
+beyond one chunk. The streamed documents must be identical to the ones built
+in memory, which are still returned inside JSON-RPC batches.
+
+Run with --blocksize=2000000 to benchmark time to first byte and peak RSS
+for a full block with transaction details.
+"""
+
+import http.client
+import json
+import time
+import urllib.parse
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class JSONStreamingTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-rest", "-blockmaxsize=2000000"]]
+
+    def add_options(self, parser):
+        parser.add_option("--blocksize", dest="blocksize", default=150000, type="int",
+                          help="Approximate size of the block used for the measurements")
+
+    def http_get(self, method, path, body=None):
+        """Return (status, headers, seconds to first byte, seconds in total, body)"""
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        headers = {"Authorization": "Basic " + str_to_b64str(url.username + ":" + url.password)}
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        start = time.time()
+        conn.request(method, path, body, headers)
+        response = conn.getresponse()
+        first = response.read(1)
+        ttfb = time.time() - start
+        data = first + response.read()
+        total = time.time() - start
+        conn.close()
+        return response.status, response.getheaders(), ttfb, total, data.decode("utf-8")
+
+    def rpc_single(self, method, *params):
+        request = json.dumps({"version": "1.1", "id": 1, "method": method, "params": list(params)})
+        return self.http_get("POST", "/", request)
+
+    def rpc_batched(self, method, *params):
+        """Batch replies are built in memory, so they serve as the reference"""
+        request = json.dumps([{"version": "1.1", "id": 1, "method": method, "params": list(params)}])
+        status, _, _, _, data = self.http_get("POST", "/", request)
+        assert_equal(status, 200)
+        return json.loads(data, parse_float=Decimal)[0]
+
+    def peak_rss_kb(self):
+        with open("/proc/%d/status" % self.nodes[0].process.pid) as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+        return 0
+
+    def reset_peak_rss(self):
+        # Writing 5 to clear_refs resets VmHWM (Linux 4.0+)
+        try:
+            with open("/proc/%d/clear_refs" % self.nodes[0].process.pid, "w") as f:
+                f.write("5")
+            return True
+        except OSError:
+            return False
+
+    def is_chunked(self, headers):
+        return ("Transfer-Encoding", "chunked") in headers
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(110)
+
+        self.log.info("Filling the mempool with about %d bytes of transactions" % self.options.blocksize)
+        addresses = [node.getnewaddress() for _ in range(250)]
+        while node.getmempoolinfo()["bytes"] < self.options.blocksize:
+            node.sendmany("", {address: Decimal("0.01") for address in addresses})
+
+        self.log.info("getrawmempool and /rest/mempool/contents are streamed")
+        status, headers, _, _, data = self.rpc_single("getrawmempool", True)
+        assert_equal(status, 200)
+        reply = json.loads(data, parse_float=Decimal)
+        assert_equal(reply, self.rpc_batched("getrawmempool", True))
+        assert_equal(sorted(reply["result"].keys()), sorted(node.getrawmempool()))
+
+        status, headers, _, _, data = self.http_get("GET", "/rest/mempool/contents.json")
+        assert_equal(status, 200)
+        assert_equal(json.loads(data, parse_float=Decimal), reply["result"])
+
+        blockhash = node.generate(1)[0]
+        block = node.getblock(blockhash)
+        assert_equal(node.getrawmempool(), [])
+        self.log.info("Block of %d bytes with %d transactions" % (block["size"], len(block["tx"])))
+
+        self.log.info("Small replies are not chunked")
+        status, headers, _, _, data = self.rpc_single("getblock", node.getblockhash(1))
+        assert_equal(status, 200)
+        assert not self.is_chunked(headers)
+        assert_equal(json.loads(data)["result"]["height"], 1)
+
+        self.log.info("Errors are reported before anything is streamed")
+        status, _, _, _, data = self.rpc_single("getblock", "00" * 32)
+        assert_equal(status, 500)
+        assert_equal(json.loads(data)["error"]["code"], -5)
+
+        self.log.info("getblock non-verbose is not streamed")
+        status, headers, _, _, data = self.rpc_single("getblock", blockhash, False)
+        assert_equal(status, 200)
+        assert_equal(json.loads(data)["result"], node.getblock(blockhash, False))
+
+        self.log.info("Streamed getblock matches the in-memory result")
+        status, headers, _, _, data = self.rpc_single("getblock", blockhash)
+        assert_equal(status, 200)
+        assert_equal(json.loads(data, parse_float=Decimal), self.rpc_batched("getblock", blockhash))
+
+        self.log.info("Streamed /rest/block/ matches the block")
+        for path in ["/rest/block/notxdetails/", "/rest/block/"]:
+            status, headers, ttfb, total, data = self.http_get("GET", path + blockhash + ".json")
+            assert_equal(status, 200)
+            rest_block = json.loads(data)
+            assert_equal(rest_block["hash"], blockhash)
+            if path == "/rest/block/":
+                assert self.is_chunked(headers)
+                assert_equal([tx["txid"] for tx in rest_block["tx"]], block["tx"])
+            else:
+                assert_equal(rest_block["tx"], block["tx"])
+
+        self.log.info("Measuring /rest/block/ with transaction details")
+        can_reset = self.reset_peak_rss()
+        rss_before = self.peak_rss_kb()
+        status, headers, ttfb, total, data = self.http_get("GET", "/rest/block/" + blockhash + ".json")
+        rss_after = self.peak_rss_kb()
+        self.log.info("%d bytes of JSON: first byte after %.1f ms, complete after %.1f ms" % (len(data), ttfb * 1000, total * 1000))
+        if can_reset:
+            self.log.info("Peak RSS grew by %d kB while serving the block" % (rss_after - rss_before))
+        assert ttfb <= total
+
+if __name__ == '__main__':
+    JSONStreamingTest().main()
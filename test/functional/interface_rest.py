@@ -6,6 +6,7 @@
 
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import *
+from test_framework.messages import ser_compact_size, deser_compact_size
 from struct import *
 from io import BytesIO
 from codecs import encode
@@ -322,5 +323,58 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         assert_equal(json_obj['bestblockhash'], bb_hash)
 
+        ##########################
+        # Bulk and range queries #
+        ##########################
+
+        # outpoints posted in the body are not limited to 15
+        unspent = self.nodes[0].listunspent()
+        outpoints = [(u['txid'], u['vout']) for u in unspent] * 50
+        outpoints.append(('00' * 32, 0))
+        binaryRequest = b'\x00' + ser_compact_size(len(outpoints))
+        for (utxo_txid, utxo_n) in outpoints:
+            binaryRequest += hex_str_to_bytes(utxo_txid)[::-1] + pack("<I", utxo_n)
+        response = http_post_call(url.hostname, url.port, '/rest/getutxos'+self.FORMAT_SEPARATOR+'hex', bytes_to_hex_str(binaryRequest), True)
+        assert_equal(response.status, 200)
+        output = BytesIO(hex_str_to_bytes(response.read().decode('utf-8').strip()))
+        output.read(4 + 32)
+        bitmap_size = deser_compact_size(output)
+        assert_equal(bitmap_size, (len(outpoints) + 7) // 8)
+        bitmap = output.read(bitmap_size)
+        hits = [(bitmap[i // 8] >> (i % 8)) & 1 for i in range(len(outpoints))]
+        assert_equal(hits, [1] * (len(outpoints) - 1) + [0])
+        assert_equal(deser_compact_size(output), len(outpoints) - 1)
+
+        binaryRequest = b'\x00' + ser_compact_size(10001) + (b'\x00' * 36) * 10001
+        response = http_post_call(url.hostname, url.port, '/rest/getutxos'+self.FORMAT_SEPARATOR+'bin', binaryRequest, True)
+        assert_equal(response.status, 500)
+
+        # header ranges by height end at the tip
+        tip_height = self.nodes[0].getblockcount()
+        headers = hex_str_to_bytes(http_get_call(url.hostname, url.port, '/rest/headersbyheight/1/2000'+self.FORMAT_SEPARATOR+'hex').strip())
+        first = self.nodes[0].getblockheader(self.nodes[0].getblockhash(1), False)
+        header_size = len(first) // 2
+        assert_equal(len(headers), tip_height * header_size)
+        assert_equal(bytes_to_hex_str(headers[:header_size]), first)
+        last = self.nodes[0].getblockheader(self.nodes[0].getbestblockhash(), False)
+        assert_equal(bytes_to_hex_str(headers[-header_size:]), last)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/headersbyheight/100/5'+self.FORMAT_SEPARATOR+'json'))
+        assert_equal([h['height'] for h in json_obj], list(range(100, tip_height + 1)))
+        response = http_get_call(url.hostname, url.port, '/rest/headersbyheight/'+str(tip_height + 1)+'/1'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 404)
+        response = http_get_call(url.hostname, url.port, '/rest/headersbyheight/0/0'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 400)
+
+        # block ranges are the serialized blocks one after the other
+        blocks = http_get_call(url.hostname, url.port, '/rest/blocksbyheight/'+str(tip_height - 2)+'/3'+self.FORMAT_SEPARATOR+'hex').strip()
+        expected = ''.join(self.nodes[0].getblock(self.nodes[0].getblockhash(h), False) for h in range(tip_height - 2, tip_height + 1))
+        assert_equal(blocks, expected)
+        json_obj = json.loads(http_get_call(url.hostname, url.port, '/rest/blocksbyheight/'+str(tip_height - 1)+'/10'+self.FORMAT_SEPARATOR+'json'))
+        assert_equal([b['hash'] for b in json_obj], [self.nodes[0].getblockhash(h) for h in (tip_height - 1, tip_height)])
+
+        # the dApp Store is not enabled on this node
+        response = http_get_call(url.hostname, url.port, '/rest/dapps'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 404)
+
 if __name__ == '__main__':
     RESTTest ().main ()
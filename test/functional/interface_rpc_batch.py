@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Netbox.Global
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test concurrent execution of JSON-RPC batch requests.
+
+node0 runs read-only batch elements on all of its RPC threads. node1 has
+the same chain but -rpcconcurrency forces every element to run in order,
+so its replies are the reference and its timings the serial baseline.
+
+Run with --iterations=<n> --batchsize=<n> to use it as a load test for
+batch latency.
+"""
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+BATCH_METHODS = ["getbestblockhash", "getblockcount", "getblock", "getblockhash",
+                 "getblockheader", "getdifficulty", "gettxout", "createrawtransaction",
+                 "decoderawtransaction", "decodescript", "getrawtransaction",
+                 "validateaddress", "verifymessage"]
+
+class RPCBatchTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-rpcthreads=8", "-rpcworkqueue=64"],
+                           ["-rpcthreads=8", "-rpcworkqueue=64"] + ["-rpcconcurrency=%s:0" % m for m in BATCH_METHODS]]
+
+    def add_options(self, parser):
+        parser.add_option("--iterations", dest="iterations", default=3, type="int",
+                          help="Number of timed batches per node")
+        parser.add_option("--batchsize", dest="batchsize", default=400, type="int",
+                          help="Number of elements in each timed batch")
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def call(self, id, method, *params):
+        return {"version": "1.1", "id": id, "method": method, "params": list(params)}
+
+    def run_test(self):
+        height = self.nodes[0].getblockcount()
+        assert_equal(height, self.nodes[1].getblockcount())
+
+        self.log.info("Replies keep the order and ids of the request")
+        batch = []
+        for h in range(height + 1):
+            batch.append(self.call("hash%d" % h, "getblockhash", h))
+            batch.append(self.call("count%d" % h, "getblockcount"))
+        replies = self.nodes[0].batch(batch)
+        assert_equal([r["id"] for r in replies], [c["id"] for c in batch])
+        for h in range(height + 1):
+            assert_equal(replies[2 * h]["result"], self.nodes[0].getblockhash(h))
+            assert_equal(replies[2 * h + 1]["result"], height)
+        assert_equal(replies, self.nodes[1].batch(batch))
+
+        self.log.info("Errors are returned for the failing element only")
+        batch = [self.call(1, "getblockhash", 0),
+                 self.call(2, "getblockhash", height + 1),
+                 self.call(3, "nosuchmethod"),
+                 self.call(4, "getblock", "00" * 32),
+                 self.call(5, "getblockhash", height)]
+        replies = self.nodes[0].batch(batch)
+        assert_equal(replies[0]["result"], self.nodes[0].getblockhash(0))
+        assert_equal(replies[1]["error"]["code"], -8)
+        assert_equal(replies[2]["error"]["code"], -32601)
+        assert_equal(replies[3]["error"]["code"], -5)
+        assert_equal(replies[4]["result"], self.nodes[0].getbestblockhash())
+        assert_equal(replies, self.nodes[1].batch(batch))
+
+        self.log.info("State-changing elements are executed in order")
+        tip = self.nodes[0].getbestblockhash()
+        batch = [self.call(1, "getblockcount"),
+                 self.call(2, "getbestblockhash"),
+                 self.call(3, "invalidateblock", tip),
+                 self.call(4, "getblockcount"),
+                 self.call(5, "getbestblockhash"),
+                 self.call(6, "reconsiderblock", tip),
+                 self.call(7, "getblockcount"),
+                 self.call(8, "getbestblockhash")]
+        replies = self.nodes[0].batch(batch)
+        assert_equal([r["result"] for r in replies],
+                     [height, tip, None, height - 1, self.nodes[0].getblockhash(height - 1), None, height, tip])
+
+        self.log.info("Timing batches of %d elements" % self.options.batchsize)
+        hashes = [self.nodes[0].getblockhash(h) for h in range(height + 1)]
+        batch = []
+        for i in range(self.options.batchsize):
+            if i % 2:
+                batch.append(self.call(i, "getblock", hashes[i % len(hashes)]))
+            else:
+                batch.append(self.call(i, "getblockheader", hashes[i % len(hashes)]))
+        timings = []
+        for node in self.nodes:
+            start = time.time()
+            for _ in range(self.options.iterations):
+                replies = node.batch(batch)
+                assert_equal(len(replies), len(batch))
+                assert all(r["error"] is None for r in replies)
+            timings.append((time.time() - start) / self.options.iterations)
+        self.log.info("Concurrent: %.1f ms per batch, in order: %.1f ms per batch" % (timings[0] * 1000, timings[1] * 1000))
+        assert_equal(self.nodes[0].batch(batch), self.nodes[1].batch(batch))
+
+if __name__ == '__main__':
+    RPCBatchTest().main()
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Netbox.Global
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test getrpcstats and the REST metrics endpoint.
+
+Every RPC method and REST endpoint is timed, including calls that fail, and
+the size of the replies is counted. The same counters, and the state of the
+HTTP work queue, are exported in the Prometheus text format on /rest/metrics.
+"""
+
+import http.client
+import json
+import urllib.parse
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class RPCStatsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-rest"]]
+
+    def http_request(self, method, path, body=None):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        headers = {"Authorization": "Basic " + str_to_b64str(url.username + ":" + url.password)}
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request(method, path, body, headers)
+        response = conn.getresponse()
+        data = response.read().decode("utf-8")
+        conn.close()
+        return response.status, response.getheader("Content-Type"), data
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(5)
+
+        self.log.info("Reset clears the statistics after returning them")
+        node.getrpcstats(True)
+        stats = node.getrpcstats()
+        assert_equal(list(stats["rpc"].keys()), ["getrpcstats"])
+        assert_equal(stats["rest"], {})
+
+        self.log.info("Calls and errors are counted per method")
+        for _ in range(10):
+            node.getblockcount()
+        assert_raises_rpc_error(-8, None, node.getblockhash, 100)
+        node.getblockhash(1)
+        stats = node.getrpcstats()
+        count = stats["rpc"]["getblockcount"]
+        assert_equal(count["count"], 10)
+        assert_equal(count["errors"], 0)
+        assert_greater_than(count["bytes_out"], 0)
+        assert count["p50_ms"] <= count["p99_ms"]
+        assert_equal(stats["rpc"]["getblockhash"]["count"], 2)
+        assert_equal(stats["rpc"]["getblockhash"]["errors"], 1)
+
+        self.log.info("Batches are accounted as a whole and per element")
+        batch = json.dumps([{"id": i, "method": "getbestblockhash", "params": []} for i in range(4)])
+        status, _, _ = self.http_request("POST", "/", batch)
+        assert_equal(status, 200)
+        stats = node.getrpcstats()
+        assert_equal(stats["rpc"]["batch"]["count"], 1)
+        assert_equal(stats["rpc"]["getbestblockhash"]["count"], 4)
+
+        self.log.info("The work queue is reported")
+        queue = stats["workqueue"]
+        assert_greater_than(queue["threads"], 0)
+        assert_greater_than(queue["capacity"], 0)
+        assert_greater_than_or_equal(queue["busy"], 1)
+        assert_equal(queue["rejected"], 0)
+
+        self.log.info("REST requests are accounted to their endpoint")
+        status, _, _ = self.http_request("GET", "/rest/chaininfo.json")
+        assert_equal(status, 200)
+        status, _, _ = self.http_request("GET", "/rest/tx/" + "00" * 32 + ".json")
+        assert_equal(status, 404)
+        rest = node.getrpcstats()["rest"]
+        assert_equal(rest["/rest/chaininfo"]["count"], 1)
+        assert_equal(rest["/rest/chaininfo"]["errors"], 0)
+        assert_equal(rest["/rest/tx/"]["errors"], 1)
+
+        self.log.info("The metrics endpoint serves the Prometheus text format")
+        status, content_type, metrics = self.http_request("GET", "/rest/metrics")
+        assert_equal(status, 200)
+        assert content_type.startswith("text/plain")
+        assert '# TYPE nbx_rpc_request_duration_seconds histogram' in metrics
+        assert 'nbx_rpc_request_duration_seconds_count{method="getblockcount"} 10' in metrics
+        assert 'nbx_rpc_request_duration_seconds_bucket{method="getblockcount",le="+Inf"} 10' in metrics
+        assert 'nbx_rpc_errors_total{method="getblockhash"} 1' in metrics
+        assert 'nbx_rest_errors_total{endpoint="/rest/tx/"} 1' in metrics
+        assert 'nbx_http_workqueue_rejected_total 0' in metrics
+
+if __name__ == '__main__':
+    RPCStatsTest().main()
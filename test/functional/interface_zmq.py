@@ -16,6 +16,12 @@ from test_framework.util import (assert_equal,
                                 )
 from io import BytesIO
 
+# DAppEvent
+DAPP_EVENT_ADD = 0
+DAPP_EVENT_UPDATE = 1
+DAPP_EVENT_DELETE = 2
+DAPP_EVENT_UNDO = 3
+
 class ZMQSubscriber:
     def __init__(self, socket, topic):
         self.sequence = 0
@@ -72,7 +78,19 @@ class ZMQTest (BitcoinTestFramework):
         self.rawblock = ZMQSubscriber(socket, b"rawblock")
         self.rawtx = ZMQSubscriber(socket, b"rawtx")
 
-        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]], []]
+        # The dApp Store, masternode and dynamic reward events go to a socket of their own,
+        # so they don't interleave with the block and transaction topics above
+        events_address = "tcp://127.0.0.1:28333"
+        events_socket = self.zmq_context.socket(zmq.SUB)
+        events_socket.set(zmq.RCVTIMEO, 60000)
+        events_socket.connect(events_address)
+        self.dappupdate = ZMQSubscriber(events_socket, b"dappupdate")
+        self.mnstate = ZMQSubscriber(events_socket, b"mnstate")
+        self.dynreward = ZMQSubscriber(events_socket, b"dynreward")
+
+        self.extra_args = [["-zmqpub%s=%s" % (sub.topic.decode(), address) for sub in [self.hashblock, self.hashtx, self.rawblock, self.rawtx]] +
+                           ["-zmqpub%s=%s" % (sub.topic.decode(), events_address) for sub in [self.dappupdate, self.mnstate, self.dynreward]] +
+                           ["-dappstore"], []]
         self.add_nodes(self.num_nodes, self.extra_args)
         self.start_nodes()
         time.sleep(10)
@@ -124,5 +142,56 @@ class ZMQTest (BitcoinTestFramework):
         hex = self.rawtx.receive()
         assert_equal(payment_txid, bytes_to_hex_str(hash256(hex)))
 
+        self.log.info("Check publisher statistics")
+        stats = self.nodes[0].getzmqnotifications()
+        assert_equal(stats["dropped"], 0)
+        assert_equal(stats["queuesize"], 0)
+        assert_equal(sorted(n["type"] for n in stats["notifiers"]),
+                     ["pubdappupdate", "pubdynreward", "pubhashblock", "pubhashtx", "pubmnstate", "pubrawblock", "pubrawtx"])
+        for notifier in stats["notifiers"]:
+            assert_equal(notifier["failed"], 0)
+            if notifier["type"] in ["pubhashblock", "pubhashtx", "pubrawblock", "pubrawtx"]:
+                assert notifier["sent"] > 0
+        assert_equal(self.nodes[1].getzmqnotifications()["notifiers"], [])
+
+        self.log.info("Check dApp Store notifications")
+        image = "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNkYPhfDwAChwGA60e6kgAAAABJRU5ErkJggg=="
+        dapp_id = self.nodes[0].addnewdapp("dApp", "https://example.com/", "Ethereum", "Description", image)
+        self.nodes[0].generate(1)
+        self._check_dappupdate(DAPP_EVENT_ADD, dapp_id, dapp_id)
+
+        update_txid = self.nodes[0].dappupdate(dapp_id, "dApp", "https://example.org/", "Ethereum", "Description", image)
+        update_block = self.nodes[0].generate(1)[0]
+        self._check_dappupdate(DAPP_EVENT_UPDATE, dapp_id, update_txid)
+
+        # Disconnecting the update undoes it, connecting the block again replays it
+        self.nodes[0].invalidateblock(update_block)
+        self._check_dappupdate(DAPP_EVENT_UNDO, dapp_id, update_txid)
+        self.nodes[0].reconsiderblock(update_block)
+        self._check_dappupdate(DAPP_EVENT_UPDATE, dapp_id, update_txid)
+
+        delete_txid = self.nodes[0].dappdelete(dapp_id)
+        self.nodes[0].generate(1)
+        self._check_dappupdate(DAPP_EVENT_DELETE, dapp_id, delete_txid)
+
+        self.log.info("Check that reorgs and block verification publish no masternode or reward events")
+        # Regtest has no masternodes and its blocks never change the dynamic reward multiplier,
+        # so neither the reorg above nor the blocks VerifyDB reconnects at startup may publish one
+        self._check_no_events()
+        self.restart_node(0, self.extra_args[0] + ["-checkblocks=0"])
+        self._check_no_events()
+
+    def _check_dappupdate(self, event, dapp_id, txid):
+        body = self.dappupdate.receive()
+        assert_equal(len(body), 65)
+        assert_equal(body[0], event)
+        assert_equal(bytes_to_hex_str(body[1:33]), dapp_id)
+        assert_equal(bytes_to_hex_str(body[33:65]), txid)
+
+    def _check_no_events(self):
+        stats = {n["type"]: n for n in self.nodes[0].getzmqnotifications()["notifiers"]}
+        assert_equal(stats["pubmnstate"]["sent"], 0)
+        assert_equal(stats["pubdynreward"]["sent"], 0)
+
 if __name__ == '__main__':
     ZMQTest().main()
@@ -72,6 +72,35 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['bytes_serialized'], 14073),
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized']), 64)
+        assert_equal(len(res['muhash']), 64)
+
+        # Without hash_serialized the result comes from the stored statistics alone
+        res_stored = node.gettxoutsetinfo(None, False)
+        assert 'hash_serialized' not in res_stored
+        assert_equal(res_stored['muhash'], res['muhash'])
+
+        # Statistics of earlier blocks are kept, by height or hash
+        res199 = node.gettxoutsetinfo(199)
+        assert_equal(res199['height'], 199)
+        assert_equal(res199['bestblock'], node.getblockhash(199))
+        assert_equal(res199['txouts'], 199)
+        assert_equal(node.gettxoutsetinfo(node.getblockhash(199)), res199)
+        assert res199['muhash'] != res['muhash']
+        assert_raises_rpc_error(-8, "Block height out of range", node.gettxoutsetinfo, 201)
+        assert_raises_rpc_error(-5, "Block not found", node.gettxoutsetinfo, "00" * 32)
+
+        # Disconnecting the tip restores the previous statistics, and
+        # reconnecting it the current ones
+        besthash = node.getbestblockhash()
+        node.invalidateblock(besthash)
+        assert_equal(node.gettxoutsetinfo(None, False), res199)
+        node.reconsiderblock(besthash)
+        assert_equal(node.gettxoutsetinfo(), res)
+
+        # The statistics survive a restart
+        self.stop_node(0)
+        self.start_node(0)
+        assert_equal(node.gettxoutsetinfo(), res)
 
     def _test_getblockheader(self):
         node = self.nodes[0]
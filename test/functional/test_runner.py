@@ -85,6 +85,7 @@ BASE_SCRIPTS= [
     #'mempool_limit.py', # We currently don't limit our mempool
     #'wallet_abandonconflict.py',
     'feature_reindex.py',
+    'feature_checkblocks_background.py',
 
     # vv Tests less than 30s vv
     'rpc_spork.py',
@@ -96,6 +97,9 @@ BASE_SCRIPTS= [
     'mempool_reorg.py',
     #'mempool_persist.py', # Not yet implemented
     'interface_http.py',
+    'interface_rpc_batch.py',
+    'interface_json_streaming.py',
+    'interface_rpc_stats.py',
     #'rpc_users.py',
     'rpc_signrawtransaction.py',
     'p2p_disconnect_ban.py',